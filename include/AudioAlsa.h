@@ -78,16 +78,26 @@ public:
 
 	static DeviceInfoCollection getAvailableDevices();
 
+	// how many periods the buffer of the device holds if not configured
+	static const int DEFAULT_PERIODS = 8;
+
 private:
 	virtual void startProcessing();
 	virtual void stopProcessing();
 	virtual void applyQualitySettings();
 	virtual void run();
 
+	int openDevice();
 	int setHWParams( const ch_cnt_t _channels, snd_pcm_access_t _access );
 	int setSWParams();
 	int handleError( int _err );
 
+	void writePeriodsMmap();
+	void writePeriods();
+	// fills _dst with _frames frames in the format of the device - returns
+	// false if the mixer has no more data
+	bool fillBuffer( void * _dst, snd_pcm_uframes_t _frames );
+
 
 	snd_pcm_t * m_handle;
 
@@ -97,8 +107,16 @@ private:
 	snd_pcm_hw_params_t * m_hwParams;
 	snd_pcm_sw_params_t * m_swParams;
 
+	// whether we write right into the buffer of the device
+	bool m_mmap;
+	snd_pcm_format_t m_format;
 	bool m_convertEndian;
 
+	// data of the mixer not written to the device yet
+	surroundSampleFrame * m_outBuf;
+	fpp_t m_outBufFrames;
+	fpp_t m_outBufPos;
+
 } ;
 
 #endif
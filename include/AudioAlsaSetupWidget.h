@@ -54,6 +54,7 @@ public slots:
 private:
 	QComboBox * m_deviceComboBox;
 	LcdSpinBox * m_channels;
+	LcdSpinBox * m_periods;
 
 	int m_selectedDevice;
 	AudioAlsa::DeviceInfoCollection m_deviceInfos;
@@ -30,6 +30,8 @@
 #include <QtCore/QThread>
 #include <samplerate.h>
 
+#include "AtomicInt.h"
+#include "HalfBandDecimator.h"
 #include "lmms_basics.h"
 #include "TabWidget.h"
 
@@ -63,6 +65,21 @@ public:
 	virtual void unregisterPort( AudioPort * _port );
 	virtual void renamePort( AudioPort * _port );
 
+	// called by registered ports from the mixer threads with their
+	// final output of the period currently being rendered
+	virtual void writePortBuffer( AudioPort * /*_port*/,
+					const sampleFrame * /*_buf*/,
+					const fpp_t /*_frames*/ )
+	{
+	}
+
+	// whether the driver renders the periods of the mixer itself from
+	// within its callback - the mixer doesn't need a FIFO then
+	virtual bool rendersInCallback() const
+	{
+		return false;
+	}
+
 
 	inline bool supportsCapture() const
 	{
@@ -79,6 +96,12 @@ public:
 		return m_channels;
 	}
 
+	// how often the device ran out of data and had to recover
+	int xruns() const
+	{
+		return m_xruns;
+	}
+
 	void processNextBuffer();
 
 	virtual void startProcessing()
@@ -135,6 +158,12 @@ protected:
 
 	bool hqAudio() const;
 
+	// to be called by drivers whenever they recover from an underrun
+	void countXRun()
+	{
+		m_xruns.ref();
+	}
+
 
 protected:
 	bool m_supportsCapture;
@@ -150,9 +179,14 @@ private:
 
 	SRC_DATA m_srcData;
 	SRC_STATE * m_srcState;
+	// used instead of libsamplerate for getting the output of an
+	// oversampling mixer back to the rate of the device
+	HalfBandDecimator m_decimator;
 
 	surroundSampleFrame * m_buffer;
 
+	AtomicInt m_xruns;
+
 } ;
 
 
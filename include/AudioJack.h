@@ -33,6 +33,7 @@
 #include <QtCore/QVector>
 #include <QtCore/QList>
 #include <QtCore/QMap>
+#include <QtCore/QMutex>
 
 #include "AudioDevice.h"
 #include "AudioDeviceSetupWidget.h"
@@ -40,6 +41,7 @@
 
 class QLineEdit;
 class LcdSpinBox;
+class LedCheckBox;
 
 
 class AudioJack : public QObject, public AudioDevice
@@ -67,6 +69,8 @@ public:
 	private:
 		QLineEdit * m_clientName;
 		LcdSpinBox * m_channels;
+		LedCheckBox * m_renderInCallback;
+		LedCheckBox * m_trackOutputs;
 
 	} ;
 
@@ -86,7 +90,18 @@ private:
 	virtual void unregisterPort( AudioPort * _port );
 	virtual void renamePort( AudioPort * _port );
 
+	virtual void writePortBuffer( AudioPort * _port,
+					const sampleFrame * _buf,
+					const fpp_t _frames );
+
+	virtual bool rendersInCallback() const
+	{
+		return m_renderInCallback;
+	}
+
 	int processCallback( jack_nframes_t _nframes, void * _udata );
+	jack_nframes_t renderPeriods( jack_nframes_t _nframes );
+	jack_nframes_t copyBuffers( jack_nframes_t _nframes );
 
 	static int staticProcessCallback( jack_nframes_t _nframes,
 							void * _udata );
@@ -98,6 +113,13 @@ private:
 	bool m_active;
 	bool m_stopped;
 
+	// render the periods of the mixer right in the process callback
+	// rather than taking them from its FIFO
+	const bool m_renderInCallback;
+	// held by the process callback while it works with the mixer, so
+	// stopProcessing() can wait for it
+	QMutex m_processingMutex;
+
 	QVector<jack_port_t *> m_outputPorts;
 	jack_default_audio_sample_t * * m_tempOutBufs;
 	surroundSampleFrame * m_outBuf;
@@ -106,15 +128,25 @@ private:
 	f_cnt_t m_framesToDoInCurBuf;
 
 
-#ifdef AUDIO_PORT_SUPPORT
+	// separate outputs of the tracks, only available when rendering in
+	// the process callback
+	const bool m_trackOutputs;
+
 	struct StereoPort
 	{
-		jack_port_t * ports[2];
+		jack_port_t * ports[DEFAULT_CHANNELS];
+		// buffers of the ports in the current process cycle
+		jack_default_audio_sample_t * buffers[DEFAULT_CHANNELS];
 	} ;
 
 	typedef QMap<AudioPort *, StereoPort> JackPortMap;
 	JackPortMap m_portMap;
-#endif
+	// guards m_portMap - never held while the mixer renders
+	QMutex m_portMapMutex;
+	// set by the process callback while the mixer renders the period
+	// starting at m_portFrame into the port buffers
+	bool m_writePorts;
+	jack_nframes_t m_portFrame;
 
 signals:
 	void zombified();
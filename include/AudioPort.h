@@ -62,6 +62,7 @@ public:
 
 
 	// indicate whether JACK & Co should provide output-buffer at ext. port
+	// - off unless enabled by the owner, e.g. a track
 	inline bool extOutputEnabled() const
 	{
 		return m_extOutputEnabled;
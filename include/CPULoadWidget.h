@@ -52,6 +52,8 @@ protected slots:
 
 private:
 	int m_currentLoad;
+	int m_xruns;
+	int m_starvations;
 
 	QPixmap m_temp;
 	QPixmap m_background;
@@ -189,6 +189,9 @@ public:
 	{
 		return m_workingDir + "recover.mmp";
 	}
+
+	// where caches are kept - next to the configuration file
+	QString cacheDir() const;
 	
 	const QString & version() const
 	{
@@ -32,7 +32,9 @@
 #include "export.h"
 #include "MemoryManager.h"
 
+class QIODevice;
 class QTextStream;
+class QXmlStreamReader;
 
 class EXPORT DataFile : public QDomDocument
 {
@@ -55,9 +57,12 @@ public:
 	DataFile( const QString& fileName );
 	DataFile( const QByteArray& data );
 	DataFile( Type type );
+	DataFile( const DataFile & _other );
 
 	virtual ~DataFile();
 
+	DataFile & operator=( const DataFile & _other );
+
 	///
 	/// \brief validate
 	/// performs basic validation, compared to file extension.
@@ -67,7 +72,8 @@ public:
 	QString nameWithExtension( const QString& fn ) const;
 
 	void write( QTextStream& strm );
-	bool writeFile( const QString& fn );
+	// pass false for _showErrors when not called from the GUI thread
+	bool writeFile( const QString& fn, bool _showErrors = true );
 
 	QDomElement& content()
 	{
@@ -127,6 +133,33 @@ private:
 	void upgrade();
 
 	void loadData( const QByteArray & _data, const QString & _sourceFile );
+	void loadContainer( const QString & _fileName );
+	// builds the document while reading, without an intermediate copy of
+	// the whole file
+	bool parse( QXmlStreamReader & _reader, QString * _errorMsg,
+						int * _line, int * _col );
+	// parses data written by qCompress(), inflating it while reading
+	bool parseCompressed( QIODevice & _in, QString * _errorMsg,
+						int * _line, int * _col );
+	// checks and upgrades the parsed document
+	void processDocument( const QString & _sourceFile );
+	static bool isCompressed( const QByteArray & _data );
+
+	// moves the embedded samples into chunks of a ProjectContainer
+	bool writeContainer( QIODevice & _out, const quint32 _generation );
+	// replaces references to samples of a ProjectContainer by base64
+	// data, as expected in .mmp and .mmpz files - returns the attributes
+	// changed and puts their references into _references, so they can
+	// be restored
+	QList<QDomAttr> inlineSamples( QStringList * _references );
+	// the attributes holding samples embedded into the document
+	QList<QDomAttr> embeddedSamples();
+	// decodes the embedded sample _b64 into SampleCache, so the document
+	// doesn't hold its base64 data - returns the reference to put into
+	// the document in its place or an empty string if it's no sample
+	QString storeEmbeddedSample( const QString & _b64 );
+	void referenceStoredSamples( const DataFile & _other );
+	void releaseStoredSamples();
 
 
 	struct EXPORT typeDescStruct
@@ -140,6 +173,11 @@ private:
 	QDomElement m_head;
 	Type m_type;
 
+	// samples decoded by storeEmbeddedSample(), which are kept until
+	// the document has been loaded
+	QString m_sampleLocation;
+	QList<const void *> m_storedSamples;
+
 } ;
 
 
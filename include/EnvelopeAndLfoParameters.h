@@ -27,6 +27,7 @@
 
 #include <QtCore/QVector>
 
+#include "AtomicInt.h"
 #include "JournallingObject.h"
 #include "AutomatableModel.h"
 #include "SampleBuffer.h"
@@ -38,35 +39,6 @@ class EXPORT EnvelopeAndLfoParameters : public Model, public JournallingObject
 {
 	Q_OBJECT
 public:
-	class LfoInstances
-	{
-	public:
-		LfoInstances()
-		{
-		}
-
-		~LfoInstances()
-		{
-		}
-
-		inline bool isEmpty() const
-		{
-			return m_lfos.isEmpty();
-		}
-
-		void trigger();
-		void reset();
-
-		void add( EnvelopeAndLfoParameters * lfo );
-		void remove( EnvelopeAndLfoParameters * lfo );
-
-	private:
-		QMutex m_lfoListMutex;
-		typedef QList<EnvelopeAndLfoParameters *> LfoList;
-		LfoList m_lfos;
-
-	} ;
-
 	EnvelopeAndLfoParameters( float _value_for_zero_amount,
 							Model * _parent );
 	virtual ~EnvelopeAndLfoParameters();
@@ -76,9 +48,17 @@ public:
 		return ( ( _val < 0 ) ? -_val : _val ) * _val;
 	}
 
-	static LfoInstances * instances()
+	// advance the global LFO clock - called once per period by the mixer;
+	// shape data of the single instances is regenerated lazily in
+	// fillLevel() so that idle instances do not cost anything
+	static inline void advanceLfoFrame( const fpp_t _frames )
+	{
+		s_lfoFrame += _frames;
+	}
+
+	static inline void resetLfoFrame()
 	{
-		return s_lfoInstances;
+		s_lfoFrame = 0;
 	}
 
 	void fillLevel( float * _buf, f_cnt_t _frame,
@@ -118,7 +98,7 @@ protected:
 
 
 private:
-	static LfoInstances * s_lfoInstances;
+	static f_cnt_t s_lfoFrame;
 	bool m_used;
 
 
@@ -155,12 +135,14 @@ private:
 	f_cnt_t m_lfoPredelayFrames;
 	f_cnt_t m_lfoAttackFrames;
 	f_cnt_t m_lfoOscillationFrames;
-	f_cnt_t m_lfoFrame;
+	// the LFO frame m_lfoShapeData is valid for, -1 if it isn't valid -
+	// published once the data is complete
+	AtomicInt m_lfoShapeFrame;
+	AtomicInt m_lfoShapeUpdating;
 	float m_lfoAmount;
 	bool m_lfoAmountIsZero;
 	sample_t * m_lfoShapeData;
 	sample_t m_random;
-	bool m_bad_lfoShapeData;
 	SampleBuffer m_userWave;
 
 	enum LfoShapes
@@ -174,8 +156,8 @@ private:
 		NumLfoShapes
 	} ;
 
-	sample_t lfoShapeSample( fpp_t _frame_offset );
-	void updateLfoShapeData();
+	sample_t lfoShapeSample( f_cnt_t _lfo_frame, fpp_t _frame_offset );
+	void updateLfoShapeData( f_cnt_t _lfo_frame );
 
 
 	friend class EnvelopeAndLfoView;
@@ -0,0 +1,81 @@
+/*
+ * FixedRatioResampler.h - fast resampler for constant pitch playback
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef FIXED_RATIO_RESAMPLER_H
+#define FIXED_RATIO_RESAMPLER_H
+
+#include "lmms_basics.h"
+
+
+// Resamples a stream of frames whose ratio only changes between periods,
+// i.e. notes without pitch automation. Handles libsamplerate's zero order
+// hold and linear modes as well as its fastest sinc mode, for which a
+// polyphase windowed sinc filter is used. Modes and ratios not supported
+// have to be handled by libsamplerate.
+class FixedRatioResampler
+{
+public:
+	// taps on each side of the sinc filter when not decimating
+	static const int SincZeroCrossings = 16;
+	// highest ratio the sinc filter can decimate by
+	static const int MaxDecimation = 4;
+
+	FixedRatioResampler();
+
+	// whether _ratio (input frames per output frame) can be done in the
+	// given libsamplerate converter mode
+	static bool supports( const double _ratio, const int _mode );
+
+	// how many frames process() reads behind the last output position
+	static f_cnt_t lookahead( const double _ratio, const int _mode );
+
+	// writes _frames frames to _out and returns how many frames of _in
+	// were consumed - _in has to hold at least
+	// _frames * _ratio + lookahead() + 1 frames
+	f_cnt_t process( const sampleFrame * _in, sampleFrame * _out,
+				const fpp_t _frames, const double _ratio,
+				const int _mode );
+
+	void reset();
+
+
+private:
+	static const int HistoryFrames = SincZeroCrossings * MaxDecimation;
+
+	void processSinc( const sampleFrame * _in, sampleFrame * _out,
+				const fpp_t _frames, const double _ratio );
+	void processSincDecimating( const sampleFrame * _in,
+					sampleFrame * _out, const fpp_t _frames,
+					const double _ratio );
+	void updateHistory( const sampleFrame * _in, const f_cnt_t _used );
+
+	// fractional position of the next output frame, relative to _in
+	double m_position;
+	// the frames preceding _in, needed by the sinc filter
+	sampleFrame m_history[HistoryFrames];
+
+} ;
+
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * HalfBandDecimator.h - decimation of oversampled output by powers of two
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef HALF_BAND_DECIMATOR_H
+#define HALF_BAND_DECIMATOR_H
+
+#include "lmms_basics.h"
+
+
+// Brings the output of an oversampling mixer down to the rate of the audio
+// device, if that's a power of two below. Each stage halves the rate with
+// a half-band FIR filter. Only the band below the final nyquist has to be
+// kept clean, so all but the last stage get along with short filters.
+//
+// Unlike libsamplerate this needs no locking, as long as only one thread
+// calls process() at a time.
+class HalfBandDecimator
+{
+public:
+	static const int MaxStages = 3;
+
+	// _maxFrames is the most frames process() is given at once
+	HalfBandDecimator( const fpp_t _maxFrames );
+	~HalfBandDecimator();
+
+	// whether the rate can be reduced by _ratio
+	static bool supports( const int _ratio );
+
+	inline int ratio() const
+	{
+		return 1 << m_stages;
+	}
+
+	// changes the ratio, which clears the filters
+	void setRatio( const int _ratio );
+
+	// decimates _frames frames of _in into _out and returns how many
+	// frames were written, which is _frames / ratio() if _frames is a
+	// multiple of ratio()
+	fpp_t process( const surroundSampleFrame * _in,
+				surroundSampleFrame * _out, const fpp_t _frames );
+
+	void reset();
+
+
+private:
+	struct Stage
+	{
+		// half the length of the filter
+		int pairs;
+		// filter for the odd input frames, as the even ones are
+		// weighted 0 except for the centre
+		const float * coeffs;
+
+		// input frames at even and odd positions, odd starting
+		// pairs frames before even
+		surroundSampleFrame * even;
+		surroundSampleFrame * odd;
+		int evenFrames;
+		int oddFrames;
+		// whether the next input frame is an odd one
+		bool oddNext;
+	} ;
+
+	fpp_t processStage( Stage & _stage, const surroundSampleFrame * _in,
+				surroundSampleFrame * _out, const fpp_t _frames );
+
+	const fpp_t m_maxFrames;
+	int m_stages;
+	Stage m_stage[MaxStages];
+	// output of every stage but the last one
+	surroundSampleFrame * m_temp[MaxStages - 1];
+
+} ;
+
+
+#endif
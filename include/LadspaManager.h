@@ -30,6 +30,8 @@
 
 #include <ladspa.h>
 
+#include <QtCore/QByteArray>
+#include <QtCore/QFileInfo>
 #include <QtCore/QMap>
 #include <QtCore/QPair>
 #include <QtCore/QString>
@@ -48,10 +50,15 @@ typedef QList<sortable_plugin_t> l_sortable_plugin_t;
 typedef QList<ladspa_key_t> l_ladspa_key_t;
 
 /* ladspaManager provides a database of LADSPA plug-ins.  Upon instantiation,
-it loads all of the plug-ins found in the LADSPA_PATH environmental variable
+it finds all of the plug-ins in the LADSPA_PATH environmental variable
 and stores their access descriptors according in a dictionary keyed on
 the filename the plug-in was loaded from and the label of the plug-in.
 
+What is needed to list the plug-ins and describe their ports is kept in a
+PluginIndex, so only libraries which changed since the last start are loaded
+right away.  The others are loaded when one of their plug-ins is
+instantiated the first time.
+
 The can be retrieved by using ladspa_key_t.  For example, to get the
 "Phase Modulated Voice" plug-in from the cmt library, you would perform the
 calls using:
@@ -70,13 +77,34 @@ enum ladspaPluginType
 	OTHER
 };
 
+// what is known about a port without loading the library
+typedef struct ladspaManagerPortStorage
+{
+	LADSPA_PortDescriptor descriptor;
+	LADSPA_PortRangeHintDescriptor hints;
+	float lowerBound;
+	float upperBound;
+	QString name;
+} ladspaManagerPortDescription;
+
+
 typedef struct ladspaManagerStorage
 {
+	// NULL until the library is loaded, which happens when the plug-in
+	// is used the first time
 	LADSPA_Descriptor_Function descriptorFunction;
+	QString library;
 	uint32_t index;
 	ladspaPluginType type;
 	uint16_t inputChannels;
 	uint16_t outputChannels;
+	// known without loading the library
+	QString label;
+	QString name;
+	QString maker;
+	QString copyright;
+	LADSPA_Properties properties;
+	QList<ladspaManagerPortDescription> ports;
 } ladspaManagerDescription;
 
 
@@ -323,8 +351,15 @@ public:
 						LADSPA_Handle _instance );
 
 private:
-	void  addPlugins( LADSPA_Descriptor_Function _descriptor_func,
-						const QString & _file );
+	// the plug-ins of a library as stored in the index
+	QByteArray  describePlugins(
+				LADSPA_Descriptor_Function _descriptor_func );
+	void  addPlugins( const QByteArray & _description,
+						const QFileInfo & _file );
+	LADSPA_Descriptor_Function  loadLibrary(
+				ladspaManagerDescription * _plugin );
+	const ladspaManagerPortDescription *  getPort(
+			const ladspa_key_t & _plugin, uint32_t _port );
 	uint16_t  getPluginInputs( const LADSPA_Descriptor * _descriptor );
 	uint16_t  getPluginOutputs( const LADSPA_Descriptor * _descriptor );
 
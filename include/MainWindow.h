@@ -154,8 +154,9 @@ public slots:
 	void createNewProject();
 	void createNewProjectFromTemplate( QAction * _idx );
 	void openProject();
-	bool saveProject();
-	bool saveProjectAs();
+	// waitUntilWritten is needed if the project is closed afterwards
+	bool saveProject( bool waitUntilWritten = false );
+	bool saveProjectAs( bool waitUntilWritten = false );
 	bool saveProjectAsNewVersion();
 	void saveProjectAsDefaultTemplate();
 	void showSettingsDialog();
@@ -29,14 +29,17 @@
 #include <QtCore/QString>
 #include <QtCore/QList>
 #include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
 
+#include "AtomicInt.h"
 #include "Midi.h"
+#include "MidiEvent.h"
 #include "MidiTime.h"
 #include "AutomatableModel.h"
 
 
 class MidiClient;
-class MidiEvent;
 class MidiEventProcessor;
 class MidiPortMenu;
 
@@ -99,9 +102,19 @@ public:
 		return outputChannel() - 1;
 	}
 
+	// called by the MIDI-client - the event is timed on arrival and handed
+	// on to the event-processor with the period it arrived in, channel mode
+	// messages are passed on in order but from the thread of the GUI, as
+	// they stop all notes
 	void processInEvent( const MidiEvent& event, const MidiTime& time = MidiTime() );
 	void processOutEvent( const MidiEvent& event, const MidiTime& time = MidiTime() );
 
+	// called by the mixer at the beginning of a period with frames
+	// frames covering the MIDI clock times begin to end - events which
+	// arrived in between are placed into it accordingly, later ones are
+	// kept for the next period
+	void dispatchInEvents( qint64 begin, qint64 end, fpp_t frames );
+
 
 	virtual void saveSettings( QDomDocument& doc, QDomElement& thisElement );
 	virtual void loadSettings( const QDomElement& thisElement );
@@ -127,6 +140,41 @@ public:
 	MidiPortMenu* m_readablePortsMenu;
 	MidiPortMenu* m_writablePortsMenu;
 
+	struct InEvent
+	{
+		MidiEvent event;
+		MidiTime time;
+		// on the MIDI clock of the mixer
+		qint64 arrival;
+	} ;
+
+	// takes events from the threads of the MIDI-client to the mixer
+	// without locking - see m_inEventOverflow for when it's full
+	class InEventQueue
+	{
+	public:
+		enum { Size = 256 };
+
+		InEventQueue();
+
+		// false if the queue is full
+		bool push( const InEvent& event );
+		// only to be called by the mixer
+		bool pop( InEvent* event );
+
+	private:
+		struct Cell
+		{
+			AtomicInt sequence;
+			InEvent event;
+		} ;
+
+		Cell m_cells[Size];
+		AtomicInt m_writeIndex;
+		int m_readIndex;
+
+	} ;
+
 
 public slots:
 	void updateMidiPortMode();
@@ -136,9 +184,14 @@ private slots:
 	void updateReadablePorts();
 	void updateWritablePorts();
 	void updateOutputProgram();
+	void processDeferredInEvent();
 
 
 private:
+	// false if the event has to wait for a later period
+	bool dispatchInEvent( const InEvent& queued, qint64 begin, qint64 end,
+								fpp_t frames );
+
 	MidiClient* m_midiClient;
 	MidiEventProcessor* m_midiEventProcessor;
 
@@ -159,6 +212,21 @@ private:
 	Map m_readablePorts;
 	Map m_writablePorts;
 
+	InEventQueue m_inEvents;
+	// events which didn't fit into m_inEvents and all following ones
+	// until the mixer has caught up, so none get lost or reordered
+	QVector<InEvent> m_inEventOverflow;
+	QMutex m_inEventOverflowMutex;
+	AtomicInt m_inEventsOverflowing;
+
+	// taken from the queue by the mixer but not dispatched yet
+	InEvent m_heldInEvent;
+	bool m_hasHeldInEvent;
+	// channel mode message passed to the GUI thread - the mixer doesn't
+	// dispatch anything until it has been processed
+	InEvent m_deferredInEvent;
+	AtomicInt m_inEventDeferred;
+
 
 	friend class ControllerConnectionDialog;
 	friend class InstrumentMidiIOView;
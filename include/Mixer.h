@@ -29,6 +29,8 @@
 
 #include "lmmsconfig.h"
 
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMap>
 #include <QtCore/QMutex>
 #include <QtCore/QThread>
 #include <QtCore/QVector>
@@ -44,6 +46,7 @@
 
 class AudioDevice;
 class MidiClient;
+class MidiPort;
 class AudioPort;
 
 
@@ -203,6 +206,23 @@ public:
 		return m_midiClient;
 	}
 
+	// ports receiving events from the MIDI-client, which are handed on
+	// at the beginning of every period
+	inline void addMidiPort( MidiPort * _port )
+	{
+		requestChangeInModel();
+		m_midiPorts.push_back( _port );
+		doneChangeInModel();
+	}
+
+	void removeMidiPort( MidiPort * _port );
+
+	// microseconds on the clock incoming MIDI-events are timed with
+	inline qint64 midiClock() const
+	{
+		return m_midiClock.nsecsElapsed() / 1000;
+	}
+
 
 	// play-handle stuff
 	bool addPlayHandle( PlayHandle* handle );
@@ -329,10 +349,19 @@ public:
 	void requestChangeInModel();
 	void doneChangeInModel();
 
+	// lets processors delaying their output (e.g. pipelined remote
+	// plugins) tell by how many frames, so it can be compensated - a
+	// latency of 0 removes _source
+	void reportLatency( const void * _source, const f_cnt_t _frames );
+
+	// the largest latency reported
+	f_cnt_t latency() const;
+
 
 signals:
 	void qualitySettingsChanged();
 	void sampleRateChanged();
+	void latencyChanged();
 	void nextAudioBuffer( const surroundSampleFrame * buffer );
 
 
@@ -370,6 +399,8 @@ private:
 
 	const surroundSampleFrame * renderNextBuffer();
 
+	void dispatchMidiInput();
+
 
 	void runChangesInModel();
 
@@ -417,6 +448,11 @@ private:
 	// MIDI device stuff
 	MidiClient * m_midiClient;
 	QString m_midiClientName;
+	QVector<MidiPort *> m_midiPorts;
+	QElapsedTimer m_midiClock;
+	// start of the MIDI clock time covered by the next period - advanced
+	// by exactly one period length per period
+	qint64 m_midiPeriodStart;
 
 	// mutexes
 	QMutex m_inputFramesMutex;
@@ -440,6 +476,9 @@ private:
 	QWaitCondition m_changesMixerCondition;
 	QWaitCondition m_changesRequestCondition;
 
+	QMap<const void *, f_cnt_t> m_latencies;
+	mutable QMutex m_latencyMutex;
+
 	friend class LmmsCore;
 	friend class MixerWorkerThread;
 
@@ -27,11 +27,13 @@
 
 #include <QtCore/QFileInfo>
 #include <QtCore/QList>
+#include <QtCore/QStringList>
 
 #include "export.h"
 #include "Plugin.h"
 
 class QLibrary;
+class PluginIndex;
 
 class EXPORT PluginFactory
 {
@@ -41,6 +43,8 @@ public:
 		PluginInfo() : library(nullptr), descriptor(nullptr) {}
 		const QString name() const;
 		QFileInfo file;
+		/// Libraries of plugins known from the plugin index aren't loaded
+		/// before the plugin is needed, see PluginFactory::load().
 		QLibrary* library;
 		Plugin::Descriptor* descriptor;
 
@@ -70,6 +74,10 @@ public:
 	/// PluginInfo::isNull() to check this).
 	const PluginInfo pluginInfo(const char* name) const;
 
+	/// Loads the library of the given plugin, if it isn't yet. Returns false
+	/// if it can't be loaded.
+	bool load(const PluginInfo& info);
+
 	/// When loading a library fails during discovery, the error string is saved.
 	/// It can be retrieved by calling this function.
 	QString errorString(QString pluginName) const;
@@ -78,12 +86,24 @@ public slots:
 	void discoverPlugins();
 
 private:
+	struct IndexedPlugin;
+
+	void scanLibrary(const QFileInfo& file, PluginInfoList& infos);
+	bool restoreLibrary(const QFileInfo& file, const QByteArray& entry,
+						PluginInfoList& infos);
+	void loadHelperLibraries();
+
 	DescriptorMap m_descriptors;
 	PluginInfoList m_pluginInfos;
 	QMap<QString, PluginInfo*> m_pluginByExt;
 
 	QHash<QString, QString> m_errors;
 
+	PluginIndex* m_index;
+	/// Libraries without plugins, which plugins might depend on
+	QStringList m_helperLibraries;
+	QList<IndexedPlugin*> m_indexedPlugins;
+
 	static PluginFactory* s_instance;
 };
 
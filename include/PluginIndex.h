@@ -0,0 +1,82 @@
+/*
+ * PluginIndex.h - on-disk cache of plugin library metadata
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef PLUGIN_INDEX_H
+#define PLUGIN_INDEX_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+#include "export.h"
+
+
+class QFileInfo;
+
+
+// Remembers what was found out about plugin libraries, so they needn't be
+// loaded just to list the plugins they contain. Every library has an entry
+// of its own, which is only valid as long as the modification time and
+// size of the library stay the same - changing, adding or removing a
+// library doesn't invalidate the entries of the others.
+//
+// What an entry holds is up to the user of the index.
+class EXPORT PluginIndex
+{
+public:
+	// _name is the name of the index file in the cache directory
+	PluginIndex( const QString & _name );
+	~PluginIndex();
+
+	// the data stored for _library - empty if there is none or the
+	// library changed since
+	QByteArray lookup( const QFileInfo & _library );
+
+	void store( const QFileInfo & _library, const QByteArray & _data );
+
+	// writes the index if anything changed - entries of libraries which
+	// were neither looked up nor stored are dropped, as the libraries
+	// are gone
+	void save();
+
+
+private:
+	struct Entry
+	{
+		qint64 modified;
+		qint64 size;
+		QByteArray data;
+		bool used;
+	} ;
+
+	void load();
+
+	QString m_file;
+	QHash<QString, Entry> m_entries;
+	bool m_modified;
+
+} ;
+
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * ProjectContainer.h - binary project files with memory-mapped samples
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef PROJECT_CONTAINER_H
+#define PROJECT_CONTAINER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include "export.h"
+#include "lmmsconfig.h"
+#include "SampleCache.h"
+#include "shared_object.h"
+
+
+class QIODevice;
+
+
+// A project file (.mmpb) made of a header, an index of chunks and the
+// chunks themselves. One chunk holds the XML document, every sample
+// embedded into the project gets a chunk of raw sample frames, aligned so
+// it can be used right from the mapped file.
+//
+// The document refers to the samples with references in place of the
+// base64 data .mmp files contain. When loading, they are resolved to
+// references including the location of the container, which
+// SampleBuffer::loadFromBase64() understands. The location identifies the
+// file as it was loaded, so the references stay valid after the project
+// has been saved over it.
+class EXPORT ProjectContainer : public sharedObject
+{
+public:
+	static const char * const Extension;
+
+	// true if _head, the first bytes of a file, belong to a container
+	static bool isContainer( const QByteArray & _head );
+
+	// maps _file - returns NULL if it isn't a valid container
+	static ProjectContainer * open( const QString & _file );
+	// maps the container at _location, see location() - returns NULL if
+	// the file has been changed since
+	static ProjectContainer * openLocation( const QString & _location );
+	virtual ~ProjectContainer();
+
+	// writes a container holding _document and _samples, which are raw
+	// sample frames - _generation should differ from the one of the file
+	// replaced, see generation()
+	static bool write( QIODevice & _out, const QByteArray & _document,
+					const QList<QByteArray> & _samples,
+					const quint32 _generation );
+	// the generation of the container in _file, 0 if there is none
+	static quint32 generation( const QString & _file );
+
+	// reference to sample _index as stored in the document
+	static QString reference( const int _index );
+	// reference to sample _index of the container at _location
+	static QString reference( const QString & _location, const int _index );
+	// a new location for samples which only exist in SampleCache, like
+	// the ones DataFile decodes while parsing - references to them are
+	// valid only as long as someone holds the samples
+	static QString memoryLocation();
+	static bool isMemoryLocation( const QString & _location );
+	// parses both kinds of references, _location is left empty for the
+	// first one - returns false if _ref isn't a reference at all
+	static bool parseReference( const QString & _ref, int * _index,
+							QString * _location );
+
+	// gets the frames of sample _index of the container at _location
+	// like acquireSample() - samples still used by a SampleBuffer are
+	// found even if the file has been replaced since
+	static bool acquireSample( const QString & _location, const int _index,
+						SampleCache::Data * _data );
+
+	// puts _data, allocated with MM_ALLOC, into SampleCache as the
+	// frames of sample _index at _location, a memoryLocation()
+	static void insertSample( const QString & _location, const int _index,
+						SampleCache::Data * _data );
+
+	const QString & file() const
+	{
+		return m_file;
+	}
+
+	// the file along with its state when it was mapped
+	const QString & location() const
+	{
+		return m_key;
+	}
+
+	// the uncompressed XML document, which might point into the mapped
+	// file and thus is valid as long as the container is
+	QByteArray document() const;
+
+	int sampleCount() const
+	{
+		return m_samples.size();
+	}
+
+	// the frames of sample _index, without copying them out of the map
+	QByteArray sampleData( const int _index ) const;
+
+	// makes the frames of sample _index available through SampleCache,
+	// which keeps the container mapped as long as they are used
+	bool acquireSample( const int _index, SampleCache::Data * _data );
+
+
+private:
+	struct Chunk
+	{
+		quint32 type;
+		quint32 flags;
+		quint64 offset;
+		quint64 size;
+	} ;
+
+	ProjectContainer( const QString & _file );
+
+	static QString sampleKey( const QString & _location, const int _index );
+
+	bool map();
+
+	QString m_file;
+#ifdef LMMS_BUILD_WIN32
+	// HANDLEs of the file and its mapping
+	void * m_fileHandle;
+	void * m_mapping;
+#else
+	QFile m_mappedFile;
+#endif
+	// identifies the file in SampleCache
+	QString m_key;
+	const uchar * m_data;
+	qint64 m_size;
+	quint32 m_generation;
+	Chunk m_document;
+	QList<Chunk> m_samples;
+
+} ;
+
+
+#endif
@@ -25,6 +25,7 @@
 #ifndef PROJECT_JOURNAL_H
 #define PROJECT_JOURNAL_H
 
+#include <QtCore/QByteArray>
 #include <QtCore/QHash>
 #include <QtCore/QStack>
 
@@ -34,10 +35,16 @@
 class JournallingObject;
 
 
+// Keeps the states of JournallingObjects for undo and redo. States are
+// stored as serialized XML instead of DOM trees, and only the newest state
+// of each object on a stack is kept completely - older ones are stored as
+// the difference to the next newer one. The size of the history is limited
+// to MAX_UNDO_STATES checkpoints and to app/undomemory megabytes.
 class ProjectJournal
 {
 public:
 	static const int MAX_UNDO_STATES;
+	static const int DEFAULT_UNDO_MEMORY;
 
 	ProjectJournal();
 	virtual ~ProjectJournal();
@@ -93,22 +100,47 @@ private:
 
 	struct CheckPoint
 	{
-		CheckPoint( jo_id_t initID = 0, const DataFile& initData = DataFile( DataFile::JournalData ) ) :
+		CheckPoint( jo_id_t initID = 0,
+				const QByteArray & initData = QByteArray() ) :
 			joID( initID ),
+			delta( false ),
+			prefix( 0 ),
+			suffix( 0 ),
 			data( initData )
 		{
 		}
 		jo_id_t joID;
-		DataFile data;
+		// if set, data replaces everything but the first prefix and
+		// the last suffix bytes of the next newer state of the object
+		bool delta;
+		int prefix;
+		int suffix;
+		QByteArray data;
 	} ;
 	typedef QStack<CheckPoint> CheckPointStack;
 
+	static QByteArray saveState( JournallingObject * _jo );
+	static void restoreState( JournallingObject * _jo,
+						const QByteArray & _state );
+
+	// pushes the complete _state, turning the one before into a delta
+	static void push( CheckPointStack & _stack, const jo_id_t _id,
+						const QByteArray & _state );
+	// pops the newest checkpoint, which holds a complete state
+	static CheckPoint pop( CheckPointStack & _stack );
+
+	// drops the oldest checkpoints until the memory budget is met
+	void limitMemory();
+
 	JoIdMap m_joIDs;
 
 	CheckPointStack m_undoCheckPoints;
 	CheckPointStack m_redoCheckPoints;
 
 	bool m_journalling;
+	qint64 m_memoryLimit;
+
+	friend class ProjectJournalTest;
 
 } ;
 
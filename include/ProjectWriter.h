@@ -0,0 +1,91 @@
+/*
+ * ProjectWriter.h - writes project files in the background
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef PROJECT_WRITER_H
+#define PROJECT_WRITER_H
+
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include "export.h"
+
+
+class QThreadPool;
+class DataFile;
+
+
+// Serializes, compresses and writes DataFiles on a thread of its own, so
+// saving a big project doesn't block the GUI. The DataFile is the
+// snapshot of the project taken by the caller - it isn't touched by
+// anyone else once handed over.
+class EXPORT ProjectWriter : public QObject
+{
+	Q_OBJECT
+public:
+	static void init();
+	// waits until all files are written
+	static void cleanup();
+
+	// NULL before init() and after cleanup()
+	static ProjectWriter * inst()
+	{
+		return s_instance;
+	}
+
+	// takes over _dataFile and writes it to _file - files are written in
+	// the order they are queued
+	void write( DataFile * _dataFile, const QString & _file );
+	// like write(), but returns once _file is written - false if writing
+	// it failed
+	bool writeAndWait( DataFile * _dataFile, const QString & _file );
+
+	void waitForAll();
+
+	int pendingWrites() const;
+
+
+signals:
+	// emitted from the writer thread once _file is written
+	void written( const QString & _file, bool _success );
+
+
+private:
+	class Job;
+
+	ProjectWriter();
+	virtual ~ProjectWriter();
+
+	void finished( const QString & _file, bool _success );
+
+	static ProjectWriter * s_instance;
+
+	QThreadPool * m_pool;
+	mutable QMutex m_mutex;
+	int m_pending;
+
+} ;
+
+
+#endif
@@ -29,6 +29,7 @@
 #include "MidiEvent.h"
 #include "VstSyncData.h"
 
+#include <deque>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
@@ -37,7 +38,19 @@
 #include <cassert>
 
 
-#if !(defined(LMMS_HAVE_SYS_IPC_H) && defined(LMMS_HAVE_SEMAPHORE_H))
+#if defined(LMMS_BUILD_LINUX) && defined(LMMS_HAVE_SYS_SHM_H)
+// sleeping readers are woken up through futexes
+#define SYNC_WITH_SHM_FIFO
+#define USE_FUTEX
+// a single thread can wait for the messages to several plugin instances,
+// so they can share a process
+#define REMOTE_PLUGIN_SHARED_HOST
+
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#elif !(defined(LMMS_HAVE_SYS_IPC_H) && defined(LMMS_HAVE_SEMAPHORE_H))
 #define SYNC_WITH_SHM_FIFO
 #define USE_QT_SEMAPHORES
 
@@ -88,9 +101,13 @@ typedef int32_t key_t;
 #endif
 
 #else
+#include <QtCore/QMap>
 #include <QtCore/QMutex>
 #include <QtCore/QProcess>
 #include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include "MicroTimer.h"
 
 #ifndef SYNC_WITH_SHM_FIFO
 #include <poll.h>
@@ -100,13 +117,22 @@ typedef int32_t key_t;
 
 #ifdef SYNC_WITH_SHM_FIFO
 // sometimes we need to exchange bigger messages (e.g. for VST parameter dumps)
-// so set a usable value here
+// so set a usable value here - has to be a power of 2
 const int SHM_FIFO_SIZE = 512*1024;
 
+// how often a reader checks for a new message before it goes to sleep -
+// most replies arrive within a few microseconds, which isn't worth two
+// context switches
+const int SHM_FIFO_SPIN_COUNT = 4000;
+
 
-// implements a FIFO inside a shared memory segment
+// implements a FIFO inside a shared memory segment - one process writes to
+// it and the other one reads from it, which doesn't need any locks across
+// the processes. Only a reader waiting for a message longer than a moment
+// sleeps in the kernel, and only then the writer wakes it up.
 class shmFifo
 {
+#ifdef USE_QT_SEMAPHORES
 	// need this union to handle different sizes of sem_t on 32 bit
 	// and 64 bit platforms
 	union sem32_t
@@ -114,13 +140,23 @@ class shmFifo
 		int semKey;
 		char fill[32];
 	} ;
+#endif
 	struct shmData
 	{
-		sem32_t dataSem;	// semaphore for locking this
-					// FIFO management data
-		sem32_t messageSem;	// semaphore for incoming messages
-		volatile int32_t startPtr; // current start of FIFO in memory
-		volatile int32_t endPtr;   // current end of FIFO in memory
+#ifdef USE_QT_SEMAPHORES
+		sem32_t messageSem;	// semaphore sleeping readers wait on
+#endif
+		volatile int32_t messages;	// messages written so far
+		volatile int32_t sleepers;	// readers waiting for a message
+		volatile int32_t rings;		// see setDoorbell()
+		volatile int32_t ringSleepers;
+		// the positions only ever grow, the writer and the reader
+		// own one each - keep them in cache lines of their own
+		char pad0[56];
+		volatile uint32_t writePos;
+		char pad1[60];
+		volatile uint32_t readPos;
+		char pad2[60];
 		char data[SHM_FIFO_SIZE];  // actual data
 	} ;
 
@@ -136,9 +172,11 @@ public:
 		m_shmID( -1 ),
 #endif
 		m_data( NULL ),
-		m_dataSem( QString::null ),
+#ifdef USE_QT_SEMAPHORES
 		m_messageSem( QString::null ),
-		m_lockDepth( 0 )
+#endif
+		m_received( 0 ),
+		m_doorbell( NULL )
 	{
 #ifdef USE_QT_SHMEM
 		do
@@ -156,15 +194,19 @@ public:
 		m_data = (shmData *) shmat( m_shmID, 0, 0 );
 #endif
 		assert( m_data != NULL );
-		m_data->startPtr = m_data->endPtr = 0;
+		m_data->messages = 0;
+		m_data->sleepers = 0;
+		m_data->rings = 0;
+		m_data->ringSleepers = 0;
+		m_data->writePos = m_data->readPos = 0;
+#ifdef USE_QT_SEMAPHORES
 		static int k = 0;
-		m_data->dataSem.semKey = ( getpid()<<10 ) + ++k;
 		m_data->messageSem.semKey = ( getpid()<<10 ) + ++k;
-		m_dataSem.setKey( QString::number( m_data->dataSem.semKey ),
-						1, QSystemSemaphore::Create );
 		m_messageSem.setKey( QString::number(
 						m_data->messageSem.semKey ),
 						0, QSystemSemaphore::Create );
+#endif
+		pthread_mutex_init( &m_mutex, NULL );
 	}
 
 	// constructor for remote-/client-side - use _shm_key for making up
@@ -179,9 +221,11 @@ public:
 		m_shmID( shmget( _shm_key, 0, 0 ) ),
 #endif
 		m_data( NULL ),
-		m_dataSem( QString::null ),
+#ifdef USE_QT_SEMAPHORES
 		m_messageSem( QString::null ),
-		m_lockDepth( 0 )
+#endif
+		m_received( 0 ),
+		m_doorbell( NULL )
 	{
 #ifdef USE_QT_SHMEM
 		if( m_shmObj.attach() )
@@ -195,9 +239,11 @@ public:
 		}
 #endif
 		assert( m_data != NULL );
-		m_dataSem.setKey( QString::number( m_data->dataSem.semKey ) );
+#ifdef USE_QT_SEMAPHORES
 		m_messageSem.setKey( QString::number(
 						m_data->messageSem.semKey ) );
+#endif
+		pthread_mutex_init( &m_mutex, NULL );
 	}
 
 	~shmFifo()
@@ -212,6 +258,7 @@ public:
 #ifndef USE_QT_SHMEM
 		shmdt( m_data );
 #endif
+		pthread_mutex_destroy( &m_mutex );
 	}
 
 	inline bool isInvalid() const
@@ -230,37 +277,78 @@ public:
 		return m_master;
 	}
 
-	// recursive lock
+	// keeps other threads of this process from reading or writing - the
+	// other process is never waited for
 	inline void lock()
 	{
-		if( !isInvalid() && __sync_add_and_fetch( &m_lockDepth, 1 ) == 1 )
-		{
-			m_dataSem.acquire();
-		}
+		pthread_mutex_lock( &m_mutex );
 	}
 
-	// recursive unlock
 	inline void unlock()
 	{
-		if( __sync_sub_and_fetch( &m_lockDepth, 1) <= 0 )
+		pthread_mutex_unlock( &m_mutex );
+	}
+
+	// wait until a message is available - spins for a while before
+	// going to sleep. Needs no lock(), so other threads can use the FIFO
+	// meanwhile - the message is taken with claimMessage() then
+	inline void waitForMessage()
+	{
+		int spins = 0;
+		while( isInvalid() == false && m_data->messages == m_received )
 		{
-			m_dataSem.release();
+			if( spins < spinCount() )
+			{
+				++spins;
+				relax();
+				continue;
+			}
+
+			__sync_add_and_fetch( &m_data->sleepers, 1 );
+			// the writer might have missed us - check again
+			// after announcing ourselves
+			if( isInvalid() == false &&
+					m_data->messages == m_received )
+			{
+				sleep( m_received );
+			}
+			__sync_sub_and_fetch( &m_data->sleepers, 1 );
 		}
 	}
 
-	// wait until message-semaphore is available
-	inline void waitForMessage()
+	// take the next message for reading - false if there is none, e.g.
+	// because another thread took it first. Call with lock() held
+	inline bool claimMessage()
 	{
-		if( !isInvalid() )
+		if( messagesLeft() == false )
 		{
-			m_messageSem.acquire();
+			return false;
 		}
+		__sync_synchronize();
+		++m_received;
+		return true;
 	}
 
-	// increase message-semaphore
+	// signal a complete message to the reader
 	inline void messageSent()
 	{
-		m_messageSem.release();
+		__sync_add_and_fetch( &m_data->messages, 1 );
+		if( m_data->sleepers > 0 )
+		{
+			wake();
+		}
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+		if( m_doorbell != NULL )
+		{
+			m_doorbell->ring();
+		}
+#endif
+	}
+
+	// let a reader waiting for a message notice the FIFO is invalid
+	inline void wakeUp()
+	{
+		wake();
 	}
 
 
@@ -306,10 +394,7 @@ public:
 		{
 			return false;
 		}
-		lock();
-		const bool empty = ( m_data->startPtr == m_data->endPtr );
-		unlock();
-		return !empty;
+		return m_data->messages != m_received;
 	}
 
 
@@ -318,78 +403,194 @@ public:
 		return m_shmKey;
 	}
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+	// every message sent through this FIFO also rings _doorbell, so a
+	// reader of several FIFOs can wait for all of them at once
+	inline void setDoorbell( shmFifo * _doorbell )
+	{
+		m_doorbell = _doorbell;
+	}
 
-private:
-	static inline void fastMemCpy( void * _dest, const void * _src,
-							const int _len )
+	inline void ring()
 	{
-		// calling memcpy() for just an integer is obsolete overhead
-		if( _len == 4 )
+		__sync_add_and_fetch( &m_data->rings, 1 );
+		if( m_data->ringSleepers > 0 )
 		{
-			*( (int32_t *) _dest ) = *( (int32_t *) _src );
+			syscall( SYS_futex, (int32_t *) &m_data->rings,
+				FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
 		}
-		else
+	}
+
+	inline int32_t rings() const
+	{
+		return m_data->rings;
+	}
+
+	// wait until the doorbell rang after rings() returned _rings - or
+	// for a while, so the caller can look after other things
+	inline void waitForRing( int32_t _rings ) const
+	{
+		for( int spins = 0; spins < spinCount() &&
+					m_data->rings == _rings; ++spins )
+		{
+			relax();
+		}
+
+		__sync_add_and_fetch( &m_data->ringSleepers, 1 );
+		if( isInvalid() == false && m_data->rings == _rings )
 		{
-			memcpy( _dest, _src, _len );
+			struct timespec timeout = { 0, 100 * 1000 * 1000 };
+			syscall( SYS_futex, (int32_t *) &m_data->rings,
+				FUTEX_WAIT, _rings, &timeout, NULL, 0 );
 		}
+		__sync_sub_and_fetch( &m_data->ringSleepers, 1 );
 	}
+#endif
 
-	void read( void * _buf, int _len )
+
+private:
+	static inline void relax()
 	{
-		if( isInvalid() )
+#if defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	static inline int spinCount()
+	{
+#ifdef _SC_NPROCESSORS_ONLN
+		// with a single CPU, spinning just keeps the other process
+		// from running
+		static const int count = sysconf( _SC_NPROCESSORS_ONLN ) > 1 ?
+						SHM_FIFO_SPIN_COUNT : 0;
+		return count;
+#else
+		return SHM_FIFO_SPIN_COUNT;
+#endif
+	}
+
+	// waits for data the other process is about to write or space it
+	// is about to free
+	static inline void backOff( int & _spins )
+	{
+		if( ++_spins < spinCount() )
 		{
-			memset( _buf, 0, _len );
-			return;
+			relax();
 		}
-		lock();
-		while( isInvalid() == false &&
-				_len > m_data->endPtr - m_data->startPtr )
-		{
-			unlock();
 #ifndef LMMS_BUILD_WIN32
+		else
+		{
 			usleep( 5 );
+		}
 #endif
-			lock();
+	}
+
+	// how much of _len bytes can be copied at once, which doesn't go
+	// beyond the end of the buffer
+	static inline int chunkSize( const int _len, const uint32_t _max,
+						const uint32_t _offset )
+	{
+		uint32_t len = _len;
+		if( len > _max )
+		{
+			len = _max;
 		}
-		fastMemCpy( _buf, m_data->data + m_data->startPtr, _len );
-		m_data->startPtr += _len;
-		// nothing left?
-		if( m_data->startPtr == m_data->endPtr )
+		if( len > SHM_FIFO_SIZE - _offset )
 		{
-			// then reset to 0
-			m_data->startPtr = m_data->endPtr = 0;
+			len = SHM_FIFO_SIZE - _offset;
 		}
-		unlock();
+		return len;
 	}
 
-	void write( const void * _buf, int _len )
+#ifdef USE_FUTEX
+	inline void sleep( int32_t _messages )
+	{
+		// wake up now and then to notice a peer which died
+		struct timespec timeout = { 0, 100 * 1000 * 1000 };
+		syscall( SYS_futex, (int32_t *) &m_data->messages, FUTEX_WAIT,
+						_messages, &timeout, NULL, 0 );
+	}
+
+	inline void wake()
+	{
+		syscall( SYS_futex, (int32_t *) &m_data->messages, FUTEX_WAKE,
+						INT_MAX, NULL, NULL, 0 );
+	}
+#else
+	inline void sleep( int32_t )
+	{
+		// a left-over release just makes waitForMessage() check again
+		m_messageSem.acquire();
+	}
+
+	inline void wake()
+	{
+		m_messageSem.release();
+	}
+#endif
+
+	void read( void * _buf, int _len )
 	{
-		if( isInvalid() || _len > SHM_FIFO_SIZE )
+		char * buf = (char *) _buf;
+		int spins = 0;
+		while( _len > 0 )
 		{
-			return;
+			if( isInvalid() )
+			{
+				memset( buf, 0, _len );
+				return;
+			}
+
+			const uint32_t readPos = m_data->readPos;
+			const uint32_t available = m_data->writePos - readPos;
+			if( available == 0 )
+			{
+				backOff( spins );
+				continue;
+			}
+			// see the data the writer published
+			__sync_synchronize();
+
+			const uint32_t offset = readPos % SHM_FIFO_SIZE;
+			const int len = chunkSize( _len, available, offset );
+			memcpy( buf, m_data->data + offset, len );
+
+			// done reading before the writer may reuse the space
+			__sync_synchronize();
+			m_data->readPos = readPos + len;
+
+			buf += len;
+			_len -= len;
 		}
-		lock();
-		while( _len > SHM_FIFO_SIZE - m_data->endPtr )
+	}
+
+	void write( const void * _buf, int _len )
+	{
+		const char * buf = (const char *) _buf;
+		int spins = 0;
+		while( _len > 0 && isInvalid() == false )
 		{
-			// if no space is left, try to move data to front
-			if( m_data->startPtr > 0 )
+			const uint32_t writePos = m_data->writePos;
+			const uint32_t space = SHM_FIFO_SIZE -
+						( writePos - m_data->readPos );
+			if( space == 0 )
 			{
-				memmove( m_data->data,
-					m_data->data + m_data->startPtr,
-					m_data->endPtr - m_data->startPtr );
-				m_data->endPtr = m_data->endPtr -
-							m_data->startPtr;
-				m_data->startPtr = 0;
+				backOff( spins );
+				continue;
 			}
-			unlock();
-#ifndef LMMS_BUILD_WIN32
-			usleep( 5 );
-#endif
-			lock();
+			__sync_synchronize();
+
+			const uint32_t offset = writePos % SHM_FIFO_SIZE;
+			const int len = chunkSize( _len, space, offset );
+			memcpy( m_data->data + offset, buf, len );
+
+			// publish the data after it's there
+			__sync_synchronize();
+			m_data->writePos = writePos + len;
+
+			buf += len;
+			_len -= len;
 		}
-		fastMemCpy( m_data->data + m_data->endPtr, _buf, _len );
-		m_data->endPtr += _len;
-		unlock();
 	}
 
 	volatile bool m_invalid;
@@ -401,9 +602,13 @@ private:
 	int m_shmID;
 #endif
 	shmData * m_data;
-	QSystemSemaphore m_dataSem;
+#ifdef USE_QT_SEMAPHORES
 	QSystemSemaphore m_messageSem;
-	volatile int m_lockDepth;
+#endif
+	// messages taken out so far - read by waiting threads without lock()
+	volatile int32_t m_received;
+	pthread_mutex_t m_mutex;
+	shmFifo * m_doorbell;
 
 } ;
 #endif
@@ -432,11 +637,39 @@ enum RemoteMessageIDs
 	IdSavePresetFile,
 	IdLoadPresetFile,
 	IdDebugMessage,
+	IdHostAddInstance,
+	IdParameterChange,
 	IdUserBase = 64
 } ;
 
 
 
+// parameter changes are handed over along with the audio of the period they
+// belong to instead of a message each
+struct RemoteParameterChange
+{
+	int32_t index;
+	float value;
+	int32_t offset;		// frames into the period
+} ;
+
+// how many changes a period can carry - the rest waits for the next one
+const int REMOTE_PARAMETER_CHANGES = 256;
+
+// the start of each period in the processing memory, followed by the
+// inputs and outputs
+struct RemoteParameterBlock
+{
+	int32_t count;
+	int32_t reserved[3];	// keeps the audio aligned
+	RemoteParameterChange changes[REMOTE_PARAMETER_CHANGES];
+} ;
+
+const int REMOTE_PARAMETER_BLOCK_SIZE =
+			sizeof( RemoteParameterBlock ) / sizeof( float );
+
+
+
 class EXPORT RemotePluginBase
 {
 public:
@@ -594,7 +827,7 @@ public:
 	}
 #endif
 
-#ifndef BUILD_REMOTE_PLUGIN_CLIENT
+#if !defined(BUILD_REMOTE_PLUGIN_CLIENT) || defined(SYNC_WITH_SHM_FIFO)
 	inline bool messagesLeft()
 	{
 #ifdef SYNC_WITH_SHM_FIFO
@@ -637,12 +870,20 @@ protected:
 	}
 #endif
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+	// let the messages sent ring _doorbell as well
+	inline void setDoorbell( shmFifo * _doorbell )
+	{
+		m_out->setDoorbell( _doorbell );
+	}
+#endif
+
 	inline void invalidate()
 	{
 #ifdef SYNC_WITH_SHM_FIFO
 		m_in->invalidate();
 		m_out->invalidate();
-		m_in->messageSent();
+		m_in->wakeUp();
 #else
 		m_invalid = true;
 #endif
@@ -750,6 +991,51 @@ private:
 } ;
 
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+// a process running all instances of a plugin which share one - it learns
+// about new instances through a FIFO of its own, whose doorbell is rung by
+// every message to any of the instances
+class RemotePluginHost : public RemotePluginBase
+{
+public:
+	// the process for _executable, which is started if there's none
+	static RemotePluginHost * acquire( const QString & _executable );
+	// quits the process after the last instance is gone
+	void release();
+
+	inline bool isRunning() const
+	{
+		return m_process.state() != QProcess::NotRunning;
+	}
+
+	inline shmFifo * doorbell()
+	{
+		return m_control;
+	}
+
+	// lets the process make up an instance talking through the FIFOs
+	// with the keys given
+	void addInstance( int _shmIn, int _shmOut );
+
+	virtual bool processMessage( const message & _m );
+
+
+private:
+	RemotePluginHost( const QString & _executable, shmFifo * _control );
+	virtual ~RemotePluginHost();
+
+	static QMap<QString, RemotePluginHost *> s_hosts;
+	static QMutex s_hostsMutex;
+
+	QString m_executable;
+	QProcess m_process;
+	shmFifo * m_control;
+	int m_references;
+
+} ;
+#endif
+
+
 class EXPORT RemotePlugin : public QObject, public RemotePluginBase
 {
 	Q_OBJECT
@@ -762,11 +1048,20 @@ public:
 #ifdef DEBUG_REMOTE_PLUGIN
 		return true;
 #else
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+		if( m_host != NULL )
+		{
+			return m_host->isRunning();
+		}
+#endif
 		return m_process.state() != QProcess::NotRunning;
 #endif
 	}
 
-	bool init( const QString &pluginExecutable, bool waitForInitDoneMsg );
+	// plugins able to run several instances in a process pass _shareable,
+	// these share one unless the user prefers a process per instance
+	bool init( const QString &pluginExecutable, bool waitForInitDoneMsg,
+						bool _shareable = false );
 
 	inline void waitForInitDone( bool _busyWaiting = true )
 	{
@@ -779,6 +1074,19 @@ public:
 
 	void processMidiEvent( const MidiEvent&, const f_cnt_t _offset );
 
+	// queues a change of a parameter for the next period - later changes
+	// of the same parameter replace earlier ones
+	void setParameter( int _index, float _value, f_cnt_t _offset = 0 );
+
+	// sends the queued parameter changes if nothing was processed for a
+	// while, which would leave them waiting
+	void flushParameterChanges();
+
+	// sends the queued parameter changes right away - to be called while
+	// locked, before messages which set or read the parameters of the
+	// plugin, as queued changes would otherwise be applied after them
+	void sendParameterChanges();
+
 	void updateSampleRate( sample_rate_t _sr )
 	{
 		lock();
@@ -805,6 +1113,17 @@ public:
 		return m_failed;
 	}
 
+	// in pipelined mode process() hands over the input of a period and
+	// returns the output of the period before, so the remote process
+	// works in parallel to the rest of the mixer - this delays the output
+	// by one period, which is reported to the mixer
+	void setPipelined( bool _on );
+
+	inline bool isPipelined() const
+	{
+		return m_pipelined;
+	}
+
 	inline void lock()
 	{
 		m_commMutex.lock();
@@ -825,12 +1144,17 @@ protected:
 
 private:
 	void resizeSharedProcessingMemory();
+	void reportLatency();
+	void writeParameterChanges( RemoteParameterBlock * _block );
 
 
 	bool m_failed;
 
 	QProcess m_process;
 	ProcessWatcher m_watcher;
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+	RemotePluginHost * m_host;
+#endif
 
 	QMutex m_commMutex;
 	bool m_splitChannels;
@@ -845,6 +1169,31 @@ private:
 	int m_inputCount;
 	int m_outputCount;
 
+	// the shared memory holds a slot (inputs followed by outputs) for
+	// each period that can be in flight
+	bool m_pipelined;
+	int m_currentSlot;
+	int m_pendingPeriods;
+
+	// time in microseconds from asking the remote process to process a
+	// period until its output is there, transport included - in pipelined
+	// mode only the time process() had to wait for it. Only measured
+	// with DEBUG_REMOTE_PLUGIN
+	struct RoundTripStatistics
+	{
+		int last;
+		int average;
+		int max;
+		int periods;
+	} ;
+
+	RoundTripStatistics m_roundTrips;
+
+	QVector<RemoteParameterChange> m_parameterChanges;
+	QMutex m_parameterMutex;
+	// when nothing is processed, changes are sent right away
+	MicroTimer m_lastPeriod;
+
 #ifndef SYNC_WITH_SHM_FIFO
 	int m_server;
 	QString m_socketFile;
@@ -876,6 +1225,19 @@ public:
 #endif
 	virtual bool processMessage( const message & _m );
 
+	// takes the next message and processes it - returns false once the
+	// host asks to quit
+	virtual bool processNextMessage()
+	{
+		const message m = receiveMessage();
+		if( m.id == IdQuit || m.id == IdUndefined )
+		{
+			return false;
+		}
+		processMessage( m );
+		return true;
+	}
+
 	virtual void process( const sampleFrame * _in_buf,
 					sampleFrame * _out_buf ) = 0;
 
@@ -883,6 +1245,12 @@ public:
 	{
 	}
 
+	// called for the parameter changes of a period right before process()
+	virtual void setParameter( int /* _index */, float /* _value */,
+						f_cnt_t /* _offset */ )
+	{
+	}
+
 	inline float * sharedMemory()
 	{
 		return m_shm;
@@ -936,7 +1304,7 @@ public:
 
 private:
 	void setShmKey( key_t _key, int _size );
-	void doProcessing();
+	void doProcessing( int _offset );
 
 #ifdef USE_QT_SHMEM
 	QSharedMemory m_shmObj;
@@ -953,6 +1321,57 @@ private:
 
 } ;
 
+
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+// runs the instances sharing a process - a single thread waits for the
+// messages to all of them and hands each instance with messages to a free
+// thread of a pool, so there's no thread per instance to be woken up
+class RemotePluginClientHost : public RemotePluginBase
+{
+public:
+	typedef RemotePluginClient * ( * InstanceFactory )( key_t _shm_in,
+							key_t _shm_out );
+
+	RemotePluginClientHost( key_t _shm_in, key_t _shm_out,
+						InstanceFactory _factory );
+	virtual ~RemotePluginClientHost();
+
+	// returns once the host asks to quit
+	void run();
+
+	virtual bool processMessage( const message & _m );
+
+
+private:
+	struct Instance
+	{
+		key_t shmIn;
+		key_t shmOut;
+		RemotePluginClient * client;
+		// queued or taken care of by a worker
+		bool scheduled;
+	} ;
+
+	static void * workerThread( void * _arg );
+	void work();
+	// returns false once the instance is gone
+	bool runInstance( Instance * _instance );
+	// needs m_mutex to be locked
+	void schedule( Instance * _instance );
+
+	InstanceFactory m_factory;
+	std::vector<Instance *> m_instances;
+	std::deque<Instance *> m_queue;
+	std::vector<pthread_t> m_workers;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_queueCondition;
+	// plugins are rarely made to be set up by several threads at once
+	pthread_mutex_t m_setupMutex;
+	bool m_quit;
+
+} ;
+#endif
+
 #endif
 
 
@@ -1007,17 +1426,31 @@ RemotePluginBase::~RemotePluginBase()
 int RemotePluginBase::sendMessage( const message & _m )
 {
 #ifdef SYNC_WITH_SHM_FIFO
+	int j = 8;
+	for( unsigned int i = 0; i < _m.data.size(); ++i )
+	{
+		j += 4 + _m.data[i].size();
+	}
+	// the reader has to start on messages not fitting into the FIFO
+	// before they are written completely
+	const bool streamed = j > SHM_FIFO_SIZE;
+
 	m_out->lock();
+	if( streamed )
+	{
+		m_out->messageSent();
+	}
 	m_out->writeInt( _m.id );
 	m_out->writeInt( _m.data.size() );
-	int j = 8;
 	for( unsigned int i = 0; i < _m.data.size(); ++i )
 	{
 		m_out->writeString( _m.data[i] );
-		j += 4 + _m.data[i].size();
 	}
 	m_out->unlock();
-	m_out->messageSent();
+	if( streamed == false )
+	{
+		m_out->messageSent();
+	}
 #else
 	pthread_mutex_lock( &m_sendMutex );
 	writeInt( _m.id );
@@ -1040,8 +1473,14 @@ int RemotePluginBase::sendMessage( const message & _m )
 RemotePluginBase::message RemotePluginBase::receiveMessage()
 {
 #ifdef SYNC_WITH_SHM_FIFO
-	m_in->waitForMessage();
+	// don't keep other threads from the FIFO while waiting
 	m_in->lock();
+	while( m_in->claimMessage() == false && m_in->isInvalid() == false )
+	{
+		m_in->unlock();
+		m_in->waitForMessage();
+		m_in->lock();
+	}
 	message m;
 	m.id = m_in->readInt();
 	const int s = m_in->readInt();
@@ -1264,11 +1703,15 @@ bool RemotePluginClient::processMessage( const message & _m )
 			break;
 
 		case IdStartProcessing:
-			doProcessing();
+			doProcessing( _m.getInt( 0 ) );
 			reply_message.id = IdProcessingDone;
 			reply = true;
 			break;
 
+		case IdParameterChange:
+			setParameter( _m.getInt( 0 ), _m.getFloat( 1 ), 0 );
+			break;
+
 		case IdChangeSharedMemoryKey:
 			setShmKey( _m.getInt( 0 ), _m.getInt( 1 ) );
 			break;
@@ -1337,12 +1780,25 @@ void RemotePluginClient::setShmKey( key_t _key, int _size )
 
 
 
-void RemotePluginClient::doProcessing()
+void RemotePluginClient::doProcessing( int _offset )
 {
 	if( m_shm != NULL )
 	{
-		process( (sampleFrame *)( m_inputCount > 0 ? m_shm : NULL ),
-				(sampleFrame *)( m_shm +
+		// the host might use several buffers one after the other
+		const RemoteParameterBlock * parameters =
+				(const RemoteParameterBlock *)( m_shm + _offset );
+		const int changes = parameters->count < REMOTE_PARAMETER_CHANGES ?
+				parameters->count : REMOTE_PARAMETER_CHANGES;
+		for( int i = 0; i < changes; ++i )
+		{
+			setParameter( parameters->changes[i].index,
+					parameters->changes[i].value,
+					parameters->changes[i].offset );
+		}
+
+		float * shm = m_shm + _offset + REMOTE_PARAMETER_BLOCK_SIZE;
+		process( (sampleFrame *)( m_inputCount > 0 ? shm : NULL ),
+				(sampleFrame *)( shm +
 					( m_inputCount*m_bufferSize ) ) );
 	}
 	else
@@ -1353,6 +1809,242 @@ void RemotePluginClient::doProcessing()
 
 
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+RemotePluginClientHost::RemotePluginClientHost( key_t _shm_in, key_t _shm_out,
+						InstanceFactory _factory ) :
+	RemotePluginBase( new shmFifo( _shm_in ), new shmFifo( _shm_out ) ),
+	m_factory( _factory ),
+	m_instances(),
+	m_queue(),
+	m_workers(),
+	m_quit( false )
+{
+	pthread_mutex_init( &m_mutex, NULL );
+	pthread_cond_init( &m_queueCondition, NULL );
+	pthread_mutex_init( &m_setupMutex, NULL );
+}
+
+
+
+
+RemotePluginClientHost::~RemotePluginClientHost()
+{
+	pthread_mutex_destroy( &m_setupMutex );
+	pthread_cond_destroy( &m_queueCondition );
+	pthread_mutex_destroy( &m_mutex );
+}
+
+
+
+
+void RemotePluginClientHost::run()
+{
+	long threads = sysconf( _SC_NPROCESSORS_ONLN );
+	if( threads < 1 )
+	{
+		threads = 1;
+	}
+	for( long i = 0; i < threads; ++i )
+	{
+		pthread_t thread;
+		if( pthread_create( &thread, NULL, workerThread, this ) == 0 )
+		{
+			m_workers.push_back( thread );
+		}
+	}
+
+	bool quit = false;
+	while( quit == false && isInvalid() == false )
+	{
+		// taken before looking for messages, so none sent meanwhile
+		// is missed
+		const int32_t rings = in()->rings();
+
+		while( messagesLeft() )
+		{
+			const message m = receiveMessage();
+			if( m.id == IdQuit || m.id == IdUndefined )
+			{
+				quit = true;
+				break;
+			}
+			processMessage( m );
+		}
+
+		pthread_mutex_lock( &m_mutex );
+		for( size_t i = 0; i < m_instances.size(); ++i )
+		{
+			Instance * instance = m_instances[i];
+			if( instance->scheduled == false &&
+					instance->client != NULL &&
+					instance->client->messagesLeft() )
+			{
+				schedule( instance );
+			}
+		}
+		pthread_mutex_unlock( &m_mutex );
+
+		if( quit == false )
+		{
+			in()->waitForRing( rings );
+		}
+	}
+
+	pthread_mutex_lock( &m_mutex );
+	m_quit = true;
+	pthread_cond_broadcast( &m_queueCondition );
+	pthread_mutex_unlock( &m_mutex );
+
+	for( size_t i = 0; i < m_workers.size(); ++i )
+	{
+		pthread_join( m_workers[i], NULL );
+	}
+
+	// instances the host didn't say goodbye to
+	for( size_t i = 0; i < m_instances.size(); ++i )
+	{
+		delete m_instances[i]->client;
+		delete m_instances[i];
+	}
+	m_instances.clear();
+}
+
+
+
+
+bool RemotePluginClientHost::processMessage( const message & _m )
+{
+	switch( _m.id )
+	{
+		case IdHostAddInstance:
+		{
+			Instance * instance = new Instance;
+			instance->shmIn = _m.getInt( 0 );
+			instance->shmOut = _m.getInt( 1 );
+			instance->client = NULL;
+			instance->scheduled = false;
+
+			pthread_mutex_lock( &m_mutex );
+			m_instances.push_back( instance );
+			// set up by a worker, as setting up might wait for
+			// the host
+			schedule( instance );
+			pthread_mutex_unlock( &m_mutex );
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return true;
+}
+
+
+
+
+void * RemotePluginClientHost::workerThread( void * _arg )
+{
+	static_cast<RemotePluginClientHost *>( _arg )->work();
+	return NULL;
+}
+
+
+
+
+void RemotePluginClientHost::work()
+{
+	pthread_mutex_lock( &m_mutex );
+	while( true )
+	{
+		while( m_queue.empty() && m_quit == false )
+		{
+			pthread_cond_wait( &m_queueCondition, &m_mutex );
+		}
+		if( m_quit )
+		{
+			break;
+		}
+
+		Instance * instance = m_queue.front();
+		m_queue.pop_front();
+		pthread_mutex_unlock( &m_mutex );
+
+		const bool running = runInstance( instance );
+
+		pthread_mutex_lock( &m_mutex );
+		if( running == false )
+		{
+			for( size_t i = 0; i < m_instances.size(); ++i )
+			{
+				if( m_instances[i] == instance )
+				{
+					m_instances.erase( m_instances.begin() + i );
+					break;
+				}
+			}
+			delete instance;
+			continue;
+		}
+
+		instance->scheduled = false;
+		// a message might have come in after the last look, while
+		// the instance didn't count as available yet
+		if( instance->client->messagesLeft() )
+		{
+			schedule( instance );
+		}
+	}
+	pthread_mutex_unlock( &m_mutex );
+}
+
+
+
+
+bool RemotePluginClientHost::runInstance( Instance * _instance )
+{
+	if( _instance->client == NULL )
+	{
+		pthread_mutex_lock( &m_setupMutex );
+		_instance->client = m_factory( _instance->shmIn,
+							_instance->shmOut );
+		pthread_mutex_unlock( &m_setupMutex );
+		if( _instance->client == NULL )
+		{
+			return false;
+		}
+	}
+
+	while( _instance->client->messagesLeft() )
+	{
+		if( _instance->client->processNextMessage() == false )
+		{
+			pthread_mutex_lock( &m_setupMutex );
+			delete _instance->client;
+			pthread_mutex_unlock( &m_setupMutex );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+
+void RemotePluginClientHost::schedule( Instance * _instance )
+{
+	if( _instance->scheduled == false )
+	{
+		_instance->scheduled = true;
+		m_queue.push_back( _instance );
+		pthread_cond_signal( &m_queueCondition );
+	}
+}
+#endif
+
+
+
 #endif
 
 #define QSTR_TO_STDSTR(s)	std::string( s.toUtf8().constData() )
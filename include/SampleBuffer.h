@@ -26,6 +26,7 @@
 #ifndef SAMPLE_BUFFER_H
 #define SAMPLE_BUFFER_H
 
+#include <QtCore/QMutex>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QObject>
 #include <QtCore/QRect>
@@ -34,14 +35,18 @@
 #include <samplerate.h>
 
 #include "export.h"
+#include "FixedRatioResampler.h"
 #include "interpolation.h"
 #include "lmms_basics.h"
 #include "lmms_math.h"
 #include "shared_object.h"
 #include "MemoryManager.h"
+#include "SampleCache.h"
 
 
 class QPainter;
+class SamplePeaks;
+class SampleStream;
 
 // values for buffer margins, used for various libsamplerate interpolation modes
 // the array positions correspond to the converter_type parameter values in libsamplerate
@@ -49,6 +54,12 @@ class QPainter;
 // may need to be higher - conversely, to optimize, some may work with lower values
 const f_cnt_t MARGIN[] = { 64, 64, 64, 4, 4 };
 
+// default for files being streamed instead of loaded, in seconds - can be
+// overridden with mixer/samplestreamingthreshold (0 disables streaming)
+const int DEFAULT_STREAMING_THRESHOLD = 120;
+// how many seconds of a streamed file are kept in memory
+const int DEFAULT_STREAMING_PRELOAD = 5;
+
 class EXPORT SampleBuffer : public QObject, public sharedObject
 {
 	Q_OBJECT
@@ -59,6 +70,12 @@ public:
 		LoopOn,
 		LoopPingPong
 	};
+	// how the decoded data is held in memory
+	enum StorageFormat {
+		FloatStorage = 0,
+		Int16Storage,
+		Int24Storage
+	};
 	class EXPORT handleState
 	{
 		MM_OPERATORS
@@ -91,13 +108,28 @@ public:
 			return m_interpolationMode;
 		}
 
+		// returns a buffer of at least _frames frames, which is kept
+		// for the next periods - taken from a pool the mixer fills up
+		// front, see reserveScratchBuffers()
+		sampleFrame * scratchBuffer( const f_cnt_t _frames );
+
 
 	private:
 		f_cnt_t m_frameIndex;
 		const bool m_varyingPitch;
 		bool m_isBackwards;
+		// taken from a pool when libsamplerate is needed the first time
 		SRC_STATE * m_resamplingData;
 		int m_interpolationMode;
+		// used instead of libsamplerate if the pitch is constant
+		FixedRatioResampler m_fixedResampler;
+
+		// only used when playing a streamed SampleBuffer
+		SampleStream * m_stream;
+		int m_streamRevision;
+
+		sampleFrame * m_scratch;
+		f_cnt_t m_scratchFrames;
 
 		friend class SampleBuffer;
 
@@ -172,6 +204,25 @@ public:
 		return m_frames;
 	}
 
+	// long files are not loaded completely but streamed from disk while
+	// playing - only the first frames are kept in memory then
+	inline bool isStreamed() const
+	{
+		return m_streamed;
+	}
+
+	inline f_cnt_t framesInMemory() const
+	{
+		return m_streamed ? m_headFrames : m_frames;
+	}
+
+	// whether the file is still being decoded by the SampleLoader - the
+	// buffer holds a single silent frame until then
+	inline bool isLoading() const
+	{
+		return m_loading;
+	}
+
 	inline float amplification() const
 	{
 		return m_amplification;
@@ -207,17 +258,87 @@ public:
 		m_sampleRate = _rate;
 	}
 
-	inline const sampleFrame * data() const
+	// all frames() frames as float - compact and streamed buffers are
+	// expanded into a copy on the first call, which is kept until the
+	// data changes
+	const sampleFrame * data() const;
+
+	// the frames as held in memory if the buffer uses compact storage,
+	// NULL otherwise - see storageFormat() and storageChannels()
+	inline const void * compactData() const
+	{
+		return m_compactData;
+	}
+
+	inline StorageFormat storageFormat() const
+	{
+		return m_storageFormat;
+	}
+
+	inline ch_cnt_t storageChannels() const
 	{
-		return m_data;
+		return m_storageChannels;
 	}
 
+	// converts _frames frames of data held in _format, starting at
+	// _index, to float
+	static void convertStoredFrames( sampleFrame * _dst, const void * _data,
+					StorageFormat _format, ch_cnt_t _channels,
+					f_cnt_t _index, f_cnt_t _frames );
+
+	// lets this buffer keep 16 and 24 bit files as integers if
+	// mixer/compactsamples is enabled - only for buffers which are mostly
+	// played and visualized, as data() has to expand a copy then. Takes
+	// effect with the next file being loaded
+	void allowCompactStorage( bool _allow )
+	{
+		m_compactAllowed = _allow;
+	}
+
+	// lets setAudioFile() return before the file is decoded, see
+	// isLoading() - only for buffers living in the GUI thread whose
+	// users update themselves on sampleUpdated()
+	void allowAsyncLoading( bool _allow )
+	{
+		m_asyncAllowed = _allow;
+	}
+
+	// lets this buffer stream long files from disk, see isStreamed() -
+	// only for buffers which are played without loops, as a stream only
+	// reads ahead. Takes effect with the next file being loaded
+	void allowStreaming( bool _allow )
+	{
+		m_streamingAllowed = _allow;
+	}
+
+	// creates libsamplerate states for converter type _mode up front -
+	// notes take them from a pool then instead of creating them while
+	// rendering
+	static void reserveResamplers( const int _mode );
+
+	// creates the buffers notes read looped or streamed fragments into
+	// up front, sized for periods of _framesPerPeriod frames
+	static void reserveScratchBuffers( const fpp_t _framesPerPeriod );
+
+	// decodes _file into the SampleCache the way setAudioFile() would and
+	// returns a reference to the cached data in _data, which has to be
+	// released by the caller - returns false if the file wasn't cached
+	static bool decodeToCache( const QString & _file, bool _compact,
+						SampleCache::Data * _data );
+
 	QString openAudioFile() const;
 	QString openAndSetAudioFile();
 	QString openAndSetWaveformFile();
 
+	// samples played from a binary project file are returned as a
+	// reference to it, which DataFile resolves when writing the project -
+	// _dst is left empty if there's nothing to encode
 	QString & toBase64( QString & _dst ) const;
 
+	// turns the decoded base64 data of a sample embedded into a project,
+	// which is FLAC encoded if available, into raw sample frames
+	static QByteArray decodeEmbedded( const QByteArray & _data );
+
 
 	// protect calls from the GUI to this function with dataReadLock() and
 	// dataUnlock()
@@ -231,7 +352,7 @@ public:
 	// dataUnlock(), out of loops for efficiency
 	inline sample_t userWaveSample( const float _sample ) const
 	{
-		f_cnt_t frames = m_frames;
+		f_cnt_t frames = framesInMemory();
 		sampleFrame * data = m_data;
 		const float frame = _sample * frames;
 		f_cnt_t f1 = static_cast<f_cnt_t>( frame ) % frames;
@@ -266,7 +387,41 @@ public slots:
 	void sampleRateChanged();
 
 private:
-	void update( bool _keep_settings = false );
+	// _async lets the file be decoded by the SampleLoader unless it is
+	// cached already
+	void update( bool _keep_settings = false, bool _async = false );
+	// called by the SampleLoader once the file is in the cache
+	void finishLoading( bool _keep_settings );
+	QString cacheKey( const QString & _file ) const;
+
+	bool openStreamed( const QString & _file, bool _keep_settings );
+	void readFrames( sampleFrame * _dst, f_cnt_t _index, f_cnt_t _frames,
+						handleState * _state ) const;
+	void readFramesBackwards( sampleFrame * _dst, f_cnt_t _index,
+				f_cnt_t _frames, handleState * _state ) const;
+
+	// frees the data or drops our reference to it if it is shared
+	void releaseData();
+	// the complete data as held in memory, streamed files are decoded
+	// into the cache - *_decoded tells whether _data is a reference to
+	// the cache, which has to be released
+	bool completeData( SampleCache::Data * _data, bool * _decoded ) const;
+	// replaces the data by a reversed private copy
+	void reverseData();
+	// converts frames held in memory to float
+	void readStoredFrames( sampleFrame * _dst, f_cnt_t _index,
+						f_cnt_t _frames ) const;
+	// draws _first to _last using m_peaks, one line per pixel
+	void visualizePeaks( QPainter & _p, const QRect & _dr, f_cnt_t _first,
+						f_cnt_t _last ) const;
+
+	bool useCompactStorage( sample_rate_t _sample_rate,
+					ch_cnt_t _channels ) const;
+	void storeCompact16( int_sample_t * & _buf, f_cnt_t _frames,
+							ch_cnt_t _channels );
+	void storeCompact24( int * & _buf, f_cnt_t _frames,
+							ch_cnt_t _channels );
+	void setSharedData( const SampleCache::Data & _data );
 
 	void convertIntToFloat ( int_sample_t * & _ibuf, f_cnt_t _frames, int _channels);
 	void directFloatWrite ( sample_t * & _fbuf, f_cnt_t _frames, int _channels);
@@ -287,6 +442,13 @@ private:
 	sampleFrame * m_origData;
 	f_cnt_t m_origFrames;
 	sampleFrame * m_data;
+	char * m_compactData;
+	StorageFormat m_storageFormat;
+	ch_cnt_t m_storageChannels;
+	bool m_compactAllowed;
+	bool m_asyncAllowed;
+	bool m_streamingAllowed;
+	bool m_loading;
 	QReadWriteLock m_varLock;
 	f_cnt_t m_frames;
 	f_cnt_t m_startFrame;
@@ -298,15 +460,36 @@ private:
 	float m_frequency;
 	sample_rate_t m_sampleRate;
 
+	// the data belongs to the SampleCache and must not be modified
+	bool m_dataShared;
+
+	// compact or streamed data expanded by data()
+	mutable sampleFrame * m_expandedData;
+	mutable QMutex m_expandMutex;
+
+	bool m_streamed;
+	QString m_streamFile;
+	f_cnt_t m_headFrames;
+	int m_revision;
+
+	// summary of the data used by visualize(), built in the background
+	SamplePeaks * m_peaks;
+
+	// where an embedded sample is played from, see loadFromBase64()
+	QString m_containerLocation;
+	int m_containerSample;
+
 	sampleFrame * getSampleFragment( f_cnt_t _index, f_cnt_t _frames,
 						LoopMode _loopmode,
-						sampleFrame * * _tmp,
 						bool * _backwards, f_cnt_t _loopstart, f_cnt_t _loopend,
-						f_cnt_t _end ) const;
+						f_cnt_t _end, handleState * _state ) const;
 	f_cnt_t getLoopedIndex( f_cnt_t _index, f_cnt_t _startf, f_cnt_t _endf  ) const;
 	f_cnt_t getPingPongIndex( f_cnt_t _index, f_cnt_t _startf, f_cnt_t _endf  ) const;
 
 
+	friend class SampleLoader;
+
+
 signals:
 	void sampleUpdated();
 
@@ -0,0 +1,103 @@
+/*
+ * SampleCache.h - process-wide cache of decoded sample files
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+#include "lmms_basics.h"
+
+
+class QFileInfo;
+class SamplePeaks;
+class sharedObject;
+
+
+// Decoded sample data shared between all SampleBuffers which load the same
+// file. Entries are reference counted and freed as soon as the last
+// SampleBuffer using them releases its reference. The data handed out must
+// never be modified - SampleBuffers needing to alter it have to make a
+// private copy.
+class SampleCache
+{
+public:
+	// decoded data of one file as it is stored by SampleBuffer
+	struct Data
+	{
+		void * data;
+		f_cnt_t frames;
+		int format;
+		ch_cnt_t channels;
+	} ;
+
+	// builds the key for _file decoded at _sampleRate - a file which
+	// changed on disk gets a different key, files which do not exist
+	// get an empty key and are not cached
+	static QString key( const QFileInfo & _file,
+				const sample_rate_t _sampleRate, bool _compact );
+
+	// fills _data with the cached data for _key and increases its
+	// reference count - returns false if nothing is cached for _key
+	static bool acquire( const QString & _key, Data * _data );
+
+	// takes over _data->data, which has to be allocated with MM_ALLOC,
+	// and references it - if someone else inserted the same key in the
+	// meantime, _data->data is freed and _data is replaced by the
+	// existing data instead
+	//
+	// data owned by _owner isn't freed but _owner is referenced as long
+	// as the data is cached
+	static void insert( const QString & _key, Data * _data,
+					sharedObject * _owner = NULL );
+
+	// drops a reference obtained by acquire() or insert()
+	static void release( const void * _data );
+
+	// returns a new reference to the peaks of cached _data, which are
+	// built in the background by the first caller and then shared
+	static SamplePeaks * peaks( const void * _data, const QString & _file,
+					const sample_rate_t _sampleRate );
+
+
+private:
+	struct Entry
+	{
+		QString key;
+		Data data;
+		int refCount;
+		SamplePeaks * peaks;
+		sharedObject * owner;
+	} ;
+
+	static QMutex s_mutex;
+	static QHash<QString, Entry *> s_entries;
+	static QHash<const void *, Entry *> s_entriesByData;
+
+} ;
+
+
+#endif
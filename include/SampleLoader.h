@@ -0,0 +1,112 @@
+/*
+ * SampleLoader.h - decodes sample files in the background
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef SAMPLE_LOADER_H
+#define SAMPLE_LOADER_H
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include "export.h"
+#include "SampleCache.h"
+
+
+class QThreadPool;
+class SampleBuffer;
+
+
+// Decodes sample files into the SampleCache on a pool of threads, so
+// independent files decode in parallel and the GUI doesn't block. Once a
+// file is decoded, the SampleBuffer which requested it is updated from
+// the GUI thread and picks the data up from the cache.
+class EXPORT SampleLoader : public QObject
+{
+	Q_OBJECT
+public:
+	static void init();
+	static void cleanup();
+
+	// NULL before init() and after cleanup()
+	static SampleLoader * inst()
+	{
+		return s_instance;
+	}
+
+	// queues decoding _file for _buffer, replacing a request of _buffer
+	// which is still pending - _keepSettings is passed on to the update
+	// of _buffer when done
+	void load( SampleBuffer * _buffer, const QString & _file,
+					bool _compact, bool _keepSettings );
+
+	// forgets the pending request of _buffer, if any
+	void cancel( SampleBuffer * _buffer );
+
+	// blocks until all pending files are decoded and the buffers are
+	// updated, e.g. before rendering a project
+	void waitForAll();
+
+
+signals:
+	// emitted from the pool threads
+	void requestFinished();
+
+
+private slots:
+	void publishFinished();
+
+
+private:
+	struct Request
+	{
+		SampleBuffer * buffer;
+		QString file;
+		bool compact;
+		bool keepSettings;
+		bool finished;
+		// reference to the decoded data keeping it in the cache until
+		// the buffer picked it up
+		bool decoded;
+		SampleCache::Data data;
+	} ;
+
+	class Job;
+
+	SampleLoader();
+	virtual ~SampleLoader();
+
+	void decode( Request * _request );
+	void dropRequest( Request * _request );
+
+	static SampleLoader * s_instance;
+
+	QThreadPool * m_pool;
+	QMutex m_mutex;
+	QList<Request *> m_requests;
+
+} ;
+
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * SamplePeaks.h - multi-resolution peak data for drawing sample waveforms
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef SAMPLE_PEAKS_H
+#define SAMPLE_PEAKS_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "AtomicInt.h"
+#include "lmms_basics.h"
+#include "SampleCache.h"
+#include "shared_object.h"
+
+
+// Minimum, maximum and RMS of a sample for blocks of BlockFrames frames,
+// plus coarser levels each combining LevelFactor blocks of the level
+// below. This allows drawing a waveform at any zoom level by looking at a
+// few blocks per pixel instead of every frame.
+//
+// The peaks are built by a background thread. Until isReady() returns
+// true, none of the accessors may be used.
+class SamplePeaks : public sharedObject
+{
+public:
+	struct Peak
+	{
+		float min[DEFAULT_CHANNELS];
+		float max[DEFAULT_CHANNELS];
+		// kept squared so blocks can be combined by averaging
+		float meanSquare[DEFAULT_CHANNELS];
+	} ;
+
+	static const f_cnt_t BlockFrames = 64;
+	static const int LevelFactor = 4;
+
+	// _file is only used for reading and writing the peak file next to
+	// it, if enabled in the settings
+	SamplePeaks( const QString & _file, const f_cnt_t _frames,
+					const sample_rate_t _sampleRate );
+	virtual ~SamplePeaks();
+
+	// builds the peaks from decoded data - takes over a reference to
+	// _data obtained from SampleCache, which is released when done
+	void buildFromData( const SampleCache::Data & _data );
+	// builds the peaks by reading the file, used for streamed samples
+	void buildFromFile();
+
+	// waits for all builds and cancels the ones not yet started
+	static void cleanup();
+
+	bool isReady() const
+	{
+		return (int) m_ready != 0;
+	}
+
+	f_cnt_t frames() const
+	{
+		return m_frames;
+	}
+
+	// combines all blocks overlapping _from to _to, using the coarsest
+	// level which still resolves the range
+	Peak range( f_cnt_t _from, f_cnt_t _to ) const;
+
+
+private:
+	class Builder;
+
+	void build( const SampleCache::Data * _data );
+	void addBlock( const sampleFrame * _frames, const f_cnt_t _count );
+	void buildLevels();
+
+	QString peakFile() const;
+	bool load();
+	void save() const;
+
+	QString m_file;
+	bool m_persistent;
+	f_cnt_t m_frames;
+	sample_rate_t m_sampleRate;
+	QVector<QVector<Peak> > m_levels;
+	AtomicInt m_ready;
+
+} ;
+
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * SampleStream.h - streaming of long samples from disk
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+
+#include "AtomicInt.h"
+#include "lmms_basics.h"
+#include "MemoryManager.h"
+
+struct SNDFILE_tag;
+
+
+// ring buffer which is filled with the frames of an audio file by the
+// SampleStreamer thread and read by exactly one SampleBuffer::handleState -
+// the streamer allocates the streams up front and hands them out
+class SampleStream
+{
+	MM_OPERATORS
+public:
+	// called from the audio threads - copies _frames frames, beginning
+	// at frame _index of the file, to _dst; frames which have not been
+	// read from disk yet are replaced by silence and false is returned.
+	// Reading a position outside of what is buffered makes the stream
+	// seek there
+	bool read( sampleFrame * _dst, const f_cnt_t _index,
+						const f_cnt_t _frames );
+
+
+private:
+	enum States
+	{
+		Idle,
+		Claimed,
+		Active,
+		Released
+	} ;
+
+	SampleStream();
+	~SampleStream();
+
+	// called from the audio thread which has claimed the stream
+	void start( const QString & _file, const f_cnt_t _startFrame );
+	// called from the SampleStreamer thread once the stream is released
+	void reset();
+
+	// called from the SampleStreamer thread - returns true if there might
+	// be more to do
+	bool fill();
+
+	QString m_file;
+	SNDFILE_tag * m_sndFile;
+	int m_channels;
+	f_cnt_t m_filePos;
+	float * m_readBuf;
+
+	sampleFrame * m_ring;
+	QMutex m_mutex;
+	f_cnt_t m_ringFrame;	// file position of frame at m_readPos
+	f_cnt_t m_readPos;
+	f_cnt_t m_fill;
+	int m_generation;	// incremented whenever the reader seeks
+
+	AtomicInt m_state;
+
+	friend class SampleStreamer;
+
+} ;
+
+
+
+
+// background thread reading ahead all SampleStreams in use
+class SampleStreamer : public QThread
+{
+public:
+	static void init();
+	static void cleanup();
+
+	// called from the audio threads - takes an idle stream and starts
+	// filling it, without allocating or locking anything. Returns NULL if
+	// all streams are in use.
+	static SampleStream * createStream( const QString & _file,
+						const f_cnt_t _startFrame );
+	// the stream is reused by the streamer thread later on
+	static void releaseStream( SampleStream * _stream );
+
+	// lets the streamer start its next round right away instead of
+	// after polling
+	static void wakeUp();
+
+	// how often playback had to output silence because a stream didn't
+	// deliver in time
+	static int starvations()
+	{
+		return s_starvations;
+	}
+
+	static void countStarvation()
+	{
+		s_starvations.ref();
+	}
+
+
+private:
+	enum
+	{
+		MaxStreams = 256
+	} ;
+
+	SampleStreamer();
+	virtual ~SampleStreamer();
+
+	virtual void run();
+
+	// allocates streams until enough of them are idle
+	void reserveStreams();
+
+	static SampleStreamer * s_instance;
+	static AtomicInt s_starvations;
+
+	// only ever appended to by the streamer thread
+	SampleStream * m_streams[MaxStreams];
+	AtomicInt m_streamCount;
+	AtomicInt m_dataNeeded;
+	volatile bool m_quit;
+
+} ;
+
+
+#endif
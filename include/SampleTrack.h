@@ -70,8 +70,14 @@ public slots:
 	void toggleRecord();
 
 
+private slots:
+	void sampleLoaded();
+
+
 private:
 	SampleBuffer* m_sampleBuffer;
+	// the length follows the sample once it is loaded
+	bool m_lengthPending;
 	BoolModel m_recordModel;
 
 
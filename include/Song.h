@@ -38,6 +38,7 @@
 
 
 class AutomationTrack;
+class DataFile;
 class Pattern;
 class TimeLineWidget;
 
@@ -209,9 +210,15 @@ public:
 	void createNewProject();
 	void createNewProjectFromTemplate( const QString & templ );
 	void loadProject( const QString & filename );
-	bool guiSaveProject();
-	bool guiSaveProjectAs( const QString & filename );
+	// unless waitUntilWritten is set, the file is written in the
+	// background and false is only returned if it couldn't be queued
+	bool guiSaveProject( bool waitUntilWritten = false );
+	bool guiSaveProjectAs( const QString & filename,
+					bool waitUntilWritten = false );
 	bool saveProjectFile( const QString & filename );
+	// returns as soon as the project is serialized into a DataFile,
+	// which is written to filename in the background
+	void saveProjectFileInBackground( const QString & filename );
 
 	const QString & projectFileName() const
 	{
@@ -294,6 +301,8 @@ private slots:
 
 	void updateFramesPerTick();
 
+	void projectWritten( const QString & _file, bool _success );
+
 
 
 private:
@@ -301,6 +310,11 @@ private:
 	Song( const Song & );
 	virtual ~Song();
 
+	// takes a snapshot of the whole project
+	DataFile * createProjectDataFile();
+	// the file of the project has been written
+	void projectSaved();
+
 
 	inline tact_t currentTact() const
 	{
@@ -340,6 +354,8 @@ private:
 	QString m_fileName;
 	QString m_oldFileName;
 	bool m_modified;
+	// whether there were changes since the last snapshot for saving
+	bool m_modifiedSinceSaving;
 
 	volatile bool m_recording;
 	volatile bool m_exporting;
@@ -30,6 +30,8 @@
 #include <QtCore/QString>
 #include <QtCore/QVariant>
 
+#include "export.h"
+
 
 namespace base64
 {
@@ -39,13 +41,19 @@ namespace base64
 		_dst = QByteArray( _data, _size ).toBase64();
 	}
 
+	// number of bytes decodeInto() writes for _b64
+	EXPORT int decodedSize( const QString & _b64 );
+	// decodes _b64 straight into _dst without intermediate copies, which
+	// matters for the samples embedded into projects - returns the
+	// number of bytes written
+	EXPORT int decodeInto( const QString & _b64, char * _dst );
+
 	template<class T>
 	inline void decode( const QString & _b64, T * * _data, int * _size )
 	{
-		QByteArray data = QByteArray::fromBase64( _b64.toUtf8() );
-		*_size = data.size();
-		*_data = new T[*_size / sizeof(T)];
-		memcpy( *_data, data.constData(), *_size );
+		*_size = decodedSize( _b64 );
+		*_data = new T[( *_size + sizeof( T ) - 1 ) / sizeof( T )];
+		decodeInto( _b64, (char *) *_data );
 	}
 	// for compatibility-code only
 	QVariant decode( const QString & _b64,
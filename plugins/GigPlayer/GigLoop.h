@@ -0,0 +1,99 @@
+/*
+ * GigLoop.h - the loop of a GIG sample as it is played
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef GIG_LOOP_H
+#define GIG_LOOP_H
+
+#include <QtCore/QtGlobal>
+
+#include "lmms_basics.h"
+
+
+namespace gig
+{
+	class DimensionRegion;
+	class Sample;
+}
+
+
+// The loop of a sample as it is played. Positions in a sample are counted
+// along the endless sequence of frames the loop produces. Kept apart from
+// GigPlayer.h, so it can be used without libgig.
+struct GigLoop
+{
+	GigLoop() :
+		enabled( false ),
+		bidirectional( false ),
+		start( 0 ),
+		end( 0 )
+	{
+	}
+
+	GigLoop( gig::DimensionRegion * region, gig::Sample * sample );
+
+	// Maps the position frame to the frame of the sample played there and
+	// returns for how many frames (at most max) the sample can be read
+	// from there on in one direction, 0 past the end of an unlooped sample
+	// with total frames
+	f_cnt_t run( f_cnt_t frame, f_cnt_t total, f_cnt_t max,
+				f_cnt_t * source, bool * backward ) const
+	{
+		*backward = false;
+
+		if( enabled == false || frame < end )
+		{
+			*source = frame;
+			return qMax<f_cnt_t>( 0, qMin( max,
+					( enabled ? end : total ) - frame ) );
+		}
+
+		const f_cnt_t length = end - start;
+
+		if( bidirectional == false )
+		{
+			*source = start + ( frame - start ) % length;
+			return qMin( max, end - *source );
+		}
+
+		// Back and forth, starting backwards from the end
+		const f_cnt_t looppos = ( frame - end ) % ( length * 2 );
+		if( looppos < length )
+		{
+			*source = end - 1 - looppos;
+			*backward = true;
+			return qMin( max, length - looppos );
+		}
+
+		*source = start + ( looppos - length );
+		return qMin( max, length * 2 - looppos );
+	}
+
+	bool enabled;
+	bool bidirectional;
+	f_cnt_t start;
+	f_cnt_t end;
+} ;
+
+
+#endif
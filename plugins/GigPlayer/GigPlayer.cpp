@@ -34,6 +34,7 @@
 #include <QLayout>
 #include <QLabel>
 #include <QDomDocument>
+#include <QSet>
 
 #include "FileDialog.h"
 #include "GigPlayer.h"
@@ -74,6 +75,26 @@ Plugin::Descriptor PLUGIN_EXPORT gigplayer_plugin_descriptor =
 }
 
 
+// How many frames of every sample are preloaded, unless configured otherwise
+const f_cnt_t DEFAULT_PRELOAD_FRAMES = 32768;
+// How many frames each stream buffers ahead
+const f_cnt_t GIG_STREAM_RING_FRAMES = 65536;
+// How many frames are read from disk at once
+const f_cnt_t GIG_STREAM_CHUNK_FRAMES = 4096;
+// GIG files hold mono or stereo samples of 16 or 24 bit
+const int GIG_STREAM_MAX_FRAME_SIZE = 2 * 3;
+// How many streams are kept ready for new voices
+const int GIG_STREAM_RESERVE = 16;
+// How long the streamer sleeps when there's nothing to read, in ms
+const int GIG_STREAM_POLL_INTERVAL = 5;
+
+
+GigStreamer * GigStreamer::s_instance = NULL;
+QMutex GigStreamer::s_instanceMutex;
+int GigStreamer::s_references = 0;
+QMutex GigStreamer::s_fileMutex;
+
+
 
 
 GigInstrument::GigInstrument( InstrumentTrack * _instrument_track ) :
@@ -88,6 +109,8 @@ GigInstrument::GigInstrument( InstrumentTrack * _instrument_track ) :
 	m_RandomSeed( 0 ),
 	m_currentKeyDimension( 0 )
 {
+	GigStreamer::acquire();
+
 	InstrumentPlayHandle * iph = new InstrumentPlayHandle( this, _instrument_track );
 	Engine::mixer()->addPlayHandle( iph );
 
@@ -107,6 +130,8 @@ GigInstrument::~GigInstrument()
 				PlayHandle::TypeNotePlayHandle
 				| PlayHandle::TypeInstrumentPlayHandle );
 	freeInstance();
+
+	GigStreamer::release();
 }
 
 
@@ -185,14 +210,17 @@ void GigInstrument::freeInstance()
 
 	if( m_instance != NULL )
 	{
-		delete m_instance;
-		m_instance = NULL;
-
 		// If we're changing instruments, we got to make sure that we
 		// remove all pointers to the old samples and don't try accessing
 		// that instrument again
 		m_instrument = NULL;
 		m_notes.clear();
+
+		// The streamer mustn't read from the file anymore
+		GigStreamer::purge();
+
+		delete m_instance;
+		m_instance = NULL;
 	}
 }
 
@@ -516,76 +544,95 @@ void GigInstrument::loadSample( GigSample& sample, sampleFrame* sampleData, f_cn
 		return;
 	}
 
-	// Determine if we need to loop part of this sample
-	bool loop = false;
-	gig::loop_type_t loopType = gig::loop_type_normal;
-	f_cnt_t loopStart = 0;
-	f_cnt_t loopLength = 0;
+	const int frameSize = sample.sample->FrameSize;
+	unsigned long allocationsize = samples * frameSize;
+	int8_t buffer[allocationsize];
 
-	if( sample.region->pSampleLoops != NULL )
-	{
-		for( uint32_t i = 0; i < sample.region->SampleLoops; ++i )
-		{
-			loop = true;
-			loopType = static_cast<gig::loop_type_t>( sample.region->pSampleLoops[i].LoopType );
-			loopStart = sample.region->pSampleLoops[i].LoopStart;
-			loopLength = sample.region->pSampleLoops[i].LoopLength;
+	const gig::buffer_t cache = sample.sample->GetCache();
+	const int8_t * cached = static_cast<int8_t *>( cache.pStart );
+	const f_cnt_t total = sample.sample->SamplesTotal;
 
-			// Currently only support at max one loop
-			break;
-		}
-	}
+	// Everything is played from memory if the whole sample, or at least
+	// the whole part of it that is looped, is preloaded
+	const bool streamed = sample.cachedFrames < total &&
+		!( sample.loop.enabled && sample.loop.end <= sample.cachedFrames );
 
-	unsigned long allocationsize = samples * sample.sample->FrameSize;
-	int8_t buffer[allocationsize];
+	f_cnt_t done = 0;
 
-	// Load the sample in different ways depending on if we're looping or not
-	if( loop == true && ( sample.pos >= loopStart || sample.pos + samples > loopStart ) )
+	if( streamed == true )
 	{
-		// Calculate the new position based on the type of loop
-		if( loopType == gig::loop_type_bidirectional )
+		// Before the preloaded part ends, there's no looping yet
+		if( sample.pos < sample.cachedFrames )
 		{
-			sample.pos = getPingPongIndex( sample.pos, loopStart, loopStart + loopLength );
+			done = qMin( samples, sample.cachedFrames - sample.pos );
+			std::memcpy( buffer, cached + sample.pos * frameSize,
+							done * frameSize );
 		}
-		else
-		{
-			sample.pos = getLoopedIndex( sample.pos, loopStart, loopStart + loopLength );
-			// TODO: also implement loop_type_backward support
-		}
-
-		sample.sample->SetPos( sample.pos );
 
-		// Load the samples (based on gig::Sample::ReadAndLoop) even around the end
-		// of a loop boundary wrapping to the beginning of the loop region
-		long samplestoread = samples;
-		long samplestoloopend = 0;
-		long readsamples = 0;
-		long totalreadsamples = 0;
-		long loopEnd = loopStart + loopLength;
+		const f_cnt_t wanted = sample.loop.enabled ? samples :
+			qBound<f_cnt_t>( done, total - sample.pos, samples );
 
-		do
+		// Taken when the voice starts, so the streamer can fill it
+		// while the preloaded part is played
+		if( sample.stream == NULL )
 		{
-			samplestoloopend = loopEnd - sample.sample->GetPos();
-			readsamples = sample.sample->Read( &buffer[totalreadsamples * sample.sample->FrameSize],
-					min( samplestoread, samplestoloopend ) );
-			samplestoread -= readsamples;
-			totalreadsamples += readsamples;
+			sample.stream = GigStreamer::createStream( sample.sample,
+				sample.loop, qMax( sample.pos, sample.cachedFrames ) );
+		}
 
-			if( readsamples >= samplestoloopend )
+		if( done < wanted )
+		{
+			if( sample.stream != NULL )
+			{
+				sample.stream->read( &buffer[done * frameSize],
+					sample.pos + done, wanted - done );
+			}
+			else
 			{
-				sample.sample->SetPos( loopStart );
+				std::memset( &buffer[done * frameSize], 0,
+						( wanted - done ) * frameSize );
 			}
+
+			done = wanted;
 		}
-		while( samplestoread > 0 && readsamples > 0 );
 	}
 	else
 	{
-		sample.sample->SetPos( sample.pos );
+		while( done < samples )
+		{
+			f_cnt_t source = 0;
+			bool backward = false;
+			const f_cnt_t frames = sample.loop.run( sample.pos + done,
+					total, samples - done, &source, &backward );
+
+			if( frames <= 0 )
+			{
+				break;
+			}
+
+			if( backward == true )
+			{
+				for( f_cnt_t i = 0; i < frames; ++i )
+				{
+					std::memcpy( &buffer[( done + i ) * frameSize],
+						cached + ( source - i ) * frameSize,
+								frameSize );
+				}
+			}
+			else
+			{
+				std::memcpy( &buffer[done * frameSize],
+					cached + source * frameSize,
+						frames * frameSize );
+			}
 
-		unsigned long size = sample.sample->Read( &buffer, samples ) * sample.sample->FrameSize;
-		std::memset( (int8_t*) &buffer + size, 0, allocationsize - size );
+			done += frames;
+		}
 	}
 
+	// Past the end of the sample
+	std::memset( &buffer[done * frameSize], 0, ( samples - done ) * frameSize );
+
 	// Convert from 16 or 24 bit into 32-bit float
 	if( sample.sample->BitDepth == 24 ) // 24 bit
 	{
@@ -644,39 +691,6 @@ void GigInstrument::loadSample( GigSample& sample, sampleFrame* sampleData, f_cn
 
 
 
-// These two loop index functions taken from SampleBuffer.cpp
-f_cnt_t GigInstrument::getLoopedIndex( f_cnt_t index, f_cnt_t startf, f_cnt_t endf ) const
-{
-	if( index < endf )
-	{
-		return index;
-	}
-
-	return startf + ( index - startf )
-				% ( endf - startf );
-}
-
-
-
-
-f_cnt_t GigInstrument::getPingPongIndex( f_cnt_t index, f_cnt_t startf, f_cnt_t endf ) const
-{
-	if( index < endf )
-	{
-		return index;
-	}
-
-	const f_cnt_t looplen = endf - startf;
-	const f_cnt_t looppos = ( index - endf ) % ( looplen * 2 );
-
-	return ( looppos < looplen )
-		? endf - looppos
-		: startf + ( looppos - looplen );
-}
-
-
-
-
 // A key has been released
 void GigInstrument::deleteNotePluginData( NotePlayHandle * _n )
 {
@@ -889,6 +903,21 @@ void GigInstrument::getInstrument()
 			pInstrument = m_instance->gig.GetNextInstrument();
 		}
 
+		if( pInstrument != m_instrument )
+		{
+			// The notes play samples of the previous instrument, whose
+			// preloaded data is released now
+			m_notesMutex.lock();
+			m_notes.clear();
+			m_notesMutex.unlock();
+
+			GigStreamer::purge();
+
+			QMutexLocker fileLocker( GigStreamer::fileMutex() );
+			preloadSamples( m_instrument, false );
+			preloadSamples( pInstrument, true );
+		}
+
 		m_instrument = pInstrument;
 	}
 }
@@ -896,6 +925,57 @@ void GigInstrument::getInstrument()
 
 
 
+void GigInstrument::preloadSamples( gig::Instrument * instrument, bool load )
+{
+	if( instrument == NULL )
+	{
+		return;
+	}
+
+	const QString preload = ConfigManager::inst()->value( "mixer", "gigpreloadframes" );
+	const f_cnt_t preloadFrames = preload.isEmpty() ?
+		DEFAULT_PRELOAD_FRAMES : qMax( 0, preload.toInt() );
+
+	// Samples may be shared by several dimension regions
+	QSet<gig::Sample *> samples;
+
+	for( gig::Region * pRegion = instrument->GetFirstRegion(); pRegion != NULL;
+			pRegion = instrument->GetNextRegion() )
+	{
+		for( uint32_t i = 0; i < pRegion->DimensionRegions; ++i )
+		{
+			gig::DimensionRegion * pDimRegion = pRegion->pDimensionRegions[i];
+
+			if( pDimRegion == NULL || pDimRegion->pSample == NULL ||
+					samples.contains( pDimRegion->pSample ) )
+			{
+				continue;
+			}
+
+			samples.insert( pDimRegion->pSample );
+
+			try
+			{
+				if( load == false )
+				{
+					pDimRegion->pSample->ReleaseSampleData();
+				}
+				else if( preloadFrames > 0 )
+				{
+					pDimRegion->pSample->LoadSampleData( preloadFrames );
+				}
+			}
+			catch( ... )
+			{
+				// The sample is streamed from the start then
+			}
+		}
+	}
+}
+
+
+
+
 // Since the sample rate changes when we start an export, clear all the
 // currently-playing notes when we get this signal. Then, the export won't
 // include leftover notes that were playing in the program.
@@ -1112,7 +1192,8 @@ void GigInstrumentView::showPatchDialog()
 GigSample::GigSample( gig::Sample * pSample, gig::DimensionRegion * pDimRegion,
 		float attenuation, int interpolation, float desiredFreq )
 	: sample( pSample ), region( pDimRegion ), attenuation( attenuation ),
-	  pos( 0 ), interpolation( interpolation ), srcState( NULL ),
+	  pos( 0 ), loop( pDimRegion, pSample ), cachedFrames( 0 ), stream( NULL ),
+	  interpolation( interpolation ), srcState( NULL ),
 	  sampleFreq( 0 ), freqFactor( 1 )
 {
 	if( sample != NULL && region != NULL )
@@ -1137,6 +1218,11 @@ GigSample::GigSample( gig::Sample * pSample, gig::DimensionRegion * pDimRegion,
 		// resampling the note so that a 1.5 second release ends up being 1.5
 		// seconds after resampling
 		adsr = ADSR( region, sample->SamplesPerSecond / freqFactor );
+
+		if( sample->FrameSize > 0 )
+		{
+			cachedFrames = sample->GetCache().Size / sample->FrameSize;
+		}
 	}
 }
 
@@ -1149,6 +1235,11 @@ GigSample::~GigSample()
 	{
 		src_delete( srcState );
 	}
+
+	if( stream != NULL )
+	{
+		GigStreamer::releaseStream( stream );
+	}
 }
 
 
@@ -1156,9 +1247,11 @@ GigSample::~GigSample()
 
 GigSample::GigSample( const GigSample& g )
 	: sample( g.sample ), region( g.region ), attenuation( g.attenuation ),
-	  adsr( g.adsr ), pos( g.pos ), interpolation( g.interpolation ),
+	  adsr( g.adsr ), pos( g.pos ), loop( g.loop ), cachedFrames( g.cachedFrames ),
+	  stream( NULL ), interpolation( g.interpolation ),
 	  srcState( NULL ), sampleFreq( g.sampleFreq ), freqFactor( g.freqFactor )
 {
+	// The copy gets a stream of its own once it needs one
 	// On the copy, we want to create the object
 	updateSampleRate();
 }
@@ -1173,11 +1266,19 @@ GigSample& GigSample::operator=( const GigSample& g )
 	attenuation = g.attenuation;
 	adsr = g.adsr;
 	pos = g.pos;
+	loop = g.loop;
+	cachedFrames = g.cachedFrames;
 	interpolation = g.interpolation;
 	srcState = NULL;
 	sampleFreq = g.sampleFreq;
 	freqFactor = g.freqFactor;
 
+	if( stream != NULL )
+	{
+		GigStreamer::releaseStream( stream );
+		stream = NULL;
+	}
+
 	if( g.srcState != NULL )
 	{
 		updateSampleRate();
@@ -1255,6 +1356,364 @@ bool GigSample::convertSampleRate( sampleFrame & oldBuf, sampleFrame & newBuf,
 
 
 
+GigLoop::GigLoop( gig::DimensionRegion * region, gig::Sample * sample ) :
+	enabled( false ),
+	bidirectional( false ),
+	start( 0 ),
+	end( 0 )
+{
+	// Currently only support at max one loop
+	if( region != NULL && sample != NULL &&
+		region->pSampleLoops != NULL && region->SampleLoops > 0 )
+	{
+		bidirectional = region->pSampleLoops[0].LoopType ==
+						gig::loop_type_bidirectional;
+		// TODO: also implement loop_type_backward support
+		start = region->pSampleLoops[0].LoopStart;
+		end = qMin<f_cnt_t>( start + region->pSampleLoops[0].LoopLength,
+							sample->SamplesTotal );
+		enabled = end > start;
+	}
+}
+
+
+
+
+GigStream::GigStream() :
+	m_sample( NULL ),
+	m_loop(),
+	m_frameSize( 0 ),
+	m_ring( new int8_t[GIG_STREAM_RING_FRAMES * GIG_STREAM_MAX_FRAME_SIZE] ),
+	m_readBuf( new int8_t[GIG_STREAM_CHUNK_FRAMES * GIG_STREAM_MAX_FRAME_SIZE] ),
+	m_mutex(),
+	m_ringFrame( 0 ),
+	m_readPos( 0 ),
+	m_fill( 0 ),
+	m_generation( 0 ),
+	m_state( Idle )
+{
+}
+
+
+
+
+GigStream::~GigStream()
+{
+	delete[] m_ring;
+	delete[] m_readBuf;
+}
+
+
+
+
+void GigStream::start( gig::Sample * sample, const GigLoop & loop, f_cnt_t startFrame )
+{
+	// The streamer doesn't touch the stream before it's active
+	m_sample = sample;
+	m_loop = loop;
+	m_frameSize = sample->FrameSize;
+	m_ringFrame = startFrame;
+	m_readPos = 0;
+	m_fill = 0;
+	++m_generation;
+
+	m_state.fetchAndStoreOrdered( Active );
+}
+
+
+
+
+bool GigStream::read( int8_t * dst, f_cnt_t frame, f_cnt_t frames )
+{
+	// Never block the audio thread - if the streamer is just updating the
+	// ring, this period counts as starved
+	if( m_mutex.tryLock() == false )
+	{
+		std::memset( dst, 0, frames * m_frameSize );
+		GigStreamer::wakeUp();
+		return false;
+	}
+
+	if( frame < m_ringFrame || frame > m_ringFrame + m_fill )
+	{
+		// Not buffered - let the streamer seek there
+		m_ringFrame = frame;
+		m_readPos = 0;
+		m_fill = 0;
+		++m_generation;
+	}
+	else
+	{
+		const f_cnt_t skip = frame - m_ringFrame;
+		m_readPos = ( m_readPos + skip ) % GIG_STREAM_RING_FRAMES;
+		m_fill -= skip;
+		m_ringFrame = frame;
+	}
+
+	// The frames stay in the ring, as the next period usually starts
+	// within what was read now
+	const f_cnt_t available = qMin( frames, m_fill );
+	const f_cnt_t first = qMin( available, GIG_STREAM_RING_FRAMES - m_readPos );
+	std::memcpy( dst, m_ring + m_readPos * m_frameSize, first * m_frameSize );
+	std::memcpy( dst + first * m_frameSize, m_ring,
+					( available - first ) * m_frameSize );
+
+	m_mutex.unlock();
+
+	GigStreamer::wakeUp();
+
+	if( available < frames )
+	{
+		std::memset( dst + available * m_frameSize, 0,
+					( frames - available ) * m_frameSize );
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+bool GigStream::fill()
+{
+	m_mutex.lock();
+	const int generation = m_generation;
+	const f_cnt_t frame = m_ringFrame + m_fill;
+	const f_cnt_t writePos = ( m_readPos + m_fill ) % GIG_STREAM_RING_FRAMES;
+	const f_cnt_t space = GIG_STREAM_RING_FRAMES - m_fill;
+	m_mutex.unlock();
+
+	// The region behind the valid frames belongs to us, the reader won't
+	// touch it until we publish it by increasing m_fill
+	f_cnt_t source = 0;
+	bool backward = false;
+	const f_cnt_t frames = m_loop.run( frame, m_sample->SamplesTotal,
+			qMin( qMin( space, GIG_STREAM_RING_FRAMES - writePos ),
+						GIG_STREAM_CHUNK_FRAMES ),
+			&source, &backward );
+	if( frames <= 0 )
+	{
+		// Ring full or end of the sample
+		return false;
+	}
+
+	int8_t * dst = m_ring + writePos * m_frameSize;
+	m_sample->SetPos( backward ? source - frames + 1 : source );
+	const f_cnt_t read = m_sample->Read( backward ? m_readBuf : dst, frames );
+	if( backward )
+	{
+		std::memset( m_readBuf + read * m_frameSize, 0,
+					( frames - read ) * m_frameSize );
+		for( f_cnt_t i = 0; i < frames; ++i )
+		{
+			std::memcpy( dst + i * m_frameSize,
+				m_readBuf + ( frames - 1 - i ) * m_frameSize,
+								m_frameSize );
+		}
+	}
+	else
+	{
+		std::memset( dst + read * m_frameSize, 0,
+					( frames - read ) * m_frameSize );
+	}
+
+	m_mutex.lock();
+	// Drop what we've read if the reader has seeked in the meantime
+	if( generation == m_generation )
+	{
+		m_fill += frames;
+	}
+	m_mutex.unlock();
+
+	return true;
+}
+
+
+
+
+GigStreamer::GigStreamer() :
+	QThread(),
+	m_streamCount( 0 ),
+	m_dataNeeded( 0 ),
+	m_quit( false )
+{
+	reserveStreams();
+}
+
+
+
+
+GigStreamer::~GigStreamer()
+{
+	for( int i = 0; i < m_streamCount; ++i )
+	{
+		delete m_streams[i];
+	}
+}
+
+
+
+
+void GigStreamer::acquire()
+{
+	QMutexLocker locker( &s_instanceMutex );
+
+	if( s_references++ == 0 )
+	{
+		s_instance = new GigStreamer;
+		s_instance->start( QThread::HighPriority );
+	}
+}
+
+
+
+
+void GigStreamer::release()
+{
+	QMutexLocker locker( &s_instanceMutex );
+
+	if( --s_references == 0 )
+	{
+		s_instance->m_quit = true;
+		s_instance->wait();
+		delete s_instance;
+		s_instance = NULL;
+	}
+}
+
+
+
+
+GigStream * GigStreamer::createStream( gig::Sample * sample,
+				const GigLoop & loop, f_cnt_t startFrame )
+{
+	if( s_instance == NULL || sample->FrameSize > GIG_STREAM_MAX_FRAME_SIZE )
+	{
+		return NULL;
+	}
+
+	const int count = s_instance->m_streamCount;
+	for( int i = 0; i < count; ++i )
+	{
+		GigStream * stream = s_instance->m_streams[i];
+		if( stream->m_state.testAndSetOrdered( GigStream::Idle,
+						GigStream::Claimed ) )
+		{
+			stream->start( sample, loop, startFrame );
+			wakeUp();
+			return stream;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+void GigStreamer::releaseStream( GigStream * stream )
+{
+	stream->m_state.fetchAndStoreOrdered( GigStream::Released );
+	wakeUp();
+}
+
+
+
+
+void GigStreamer::wakeUp()
+{
+	if( s_instance != NULL )
+	{
+		s_instance->m_dataNeeded.fetchAndStoreOrdered( 1 );
+	}
+}
+
+
+
+
+void GigStreamer::purge()
+{
+	if( s_instance == NULL )
+	{
+		return;
+	}
+
+	// Waits for the streamer to finish its current round
+	QMutexLocker fileLocker( &s_fileMutex );
+
+	for( int i = 0; i < s_instance->m_streamCount; ++i )
+	{
+		s_instance->m_streams[i]->m_state.testAndSetOrdered(
+				GigStream::Released, GigStream::Idle );
+	}
+}
+
+
+
+
+void GigStreamer::reserveStreams()
+{
+	int idle = 0;
+	const int count = m_streamCount;
+	for( int i = 0; i < count; ++i )
+	{
+		if( (int) m_streams[i]->m_state == GigStream::Idle )
+		{
+			++idle;
+		}
+	}
+
+	for( int i = count; i < qMin( count + GIG_STREAM_RESERVE - idle,
+							MaxStreams ); ++i )
+	{
+		m_streams[i] = new GigStream;
+		// Publishes the stream to the audio threads
+		m_streamCount.fetchAndStoreOrdered( i + 1 );
+	}
+}
+
+
+
+
+void GigStreamer::run()
+{
+	while( m_quit == false )
+	{
+		s_fileMutex.lock();
+
+		// Streams only go back to idle with the file mutex held, so the
+		// samples of active ones are still there
+		bool busy = false;
+		for( int i = 0; i < m_streamCount; ++i )
+		{
+			GigStream * stream = m_streams[i];
+			const int state = stream->m_state;
+			if( state == GigStream::Released )
+			{
+				stream->m_state.fetchAndStoreOrdered( GigStream::Idle );
+			}
+			else if( state == GigStream::Active && stream->fill() )
+			{
+				busy = true;
+			}
+		}
+
+		s_fileMutex.unlock();
+
+		reserveStreams();
+
+		if( busy == false &&
+			m_dataNeeded.fetchAndStoreOrdered( 0 ) == 0 )
+		{
+			msleep( GIG_STREAM_POLL_INTERVAL );
+		}
+	}
+}
+
+
+
+
 ADSR::ADSR()
 	: preattack( 0 ), attack( 0 ), decay1( 0 ), decay2( 0 ), infiniteSustain( false ),
 	  sustain( 0 ), release( 0 ),
@@ -30,8 +30,11 @@
 #include <QList>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QThread>
 #include <samplerate.h>
 
+#include "AtomicInt.h"
+#include "GigLoop.h"
 #include "Instrument.h"
 #include "PixmapButton.h"
 #include "InstrumentView.h"
@@ -133,6 +136,116 @@ public:
 
 
 
+// Ring buffer with the raw frames of a sample following its preloaded part,
+// filled ahead of the playback position by the GigStreamer thread and read
+// by exactly one GigSample. The streamer allocates the streams up front and
+// hands them out to the samples.
+class GigStream
+{
+	MM_OPERATORS
+public:
+	// Called from the audio threads - copies frames raw frames, beginning
+	// at position frame, to dst without consuming them, while frames before
+	// position frame are dropped. Frames which have not been read from disk
+	// yet are replaced by silence and false is returned.
+	bool read( int8_t * dst, f_cnt_t frame, f_cnt_t frames );
+
+private:
+	enum States
+	{
+		Idle,
+		Claimed,
+		Active,
+		Released
+	} ;
+
+	GigStream();
+	~GigStream();
+
+	// Called from the audio thread which has claimed the stream
+	void start( gig::Sample * sample, const GigLoop & loop, f_cnt_t startFrame );
+
+	// Called from the GigStreamer thread with the file mutex locked -
+	// returns true if there might be more to do
+	bool fill();
+
+	gig::Sample * m_sample;
+	GigLoop m_loop;
+	int m_frameSize;
+	int8_t * m_ring;
+	int8_t * m_readBuf;
+
+	QMutex m_mutex;
+	f_cnt_t m_ringFrame; // position of the frame at m_readPos
+	f_cnt_t m_readPos;
+	f_cnt_t m_fill;
+	int m_generation; // incremented whenever the reader seeks
+
+	AtomicInt m_state;
+
+	friend class GigStreamer;
+} ;
+
+
+
+
+// Background thread reading ahead all GigStreams in use. It runs as long as
+// there are GigInstruments.
+class GigStreamer : public QThread
+{
+public:
+	static void acquire();
+	static void release();
+
+	// Called from the audio threads - takes an idle stream and starts
+	// filling it, never allocating or locking. Returns NULL if all streams
+	// are in use.
+	static GigStream * createStream( gig::Sample * sample,
+				const GigLoop & loop, f_cnt_t startFrame );
+	// The stream is reused by the streamer thread later on
+	static void releaseStream( GigStream * stream );
+
+	// Lets the streamer start its next round right away instead of after
+	// polling
+	static void wakeUp();
+
+	// Has to be held while accessing GIG files other than through a
+	// stream, as the streamer reads from them in the background
+	static QMutex * fileMutex()
+	{
+		return &s_fileMutex;
+	}
+
+	// Makes released streams idle - after this, the streamer won't access
+	// their samples anymore
+	static void purge();
+
+private:
+	static const int MaxStreams = 256;
+
+	GigStreamer();
+	virtual ~GigStreamer();
+
+	virtual void run();
+
+	// Allocates streams until enough of them are idle
+	void reserveStreams();
+
+	static GigStreamer * s_instance;
+	static QMutex s_instanceMutex;
+	static int s_references;
+	static QMutex s_fileMutex;
+
+	// Only ever appended to by the streamer thread
+	GigStream * m_streams[MaxStreams];
+	AtomicInt m_streamCount;
+	AtomicInt m_dataNeeded;
+	volatile bool m_quit;
+} ;
+
+
+
+
 // The sample from the GIG file with our current position in both the sample
 // and the envelope
 class GigSample
@@ -156,9 +269,15 @@ public:
 	float attenuation;
 	ADSR adsr;
 
-	// The position in sample
+	// The position in sample, counted along the loop
 	f_cnt_t pos;
 
+	// The first part of the sample is preloaded into memory, the rest is
+	// streamed from disk once needed
+	GigLoop loop;
+	f_cnt_t cachedFrames;
+	GigStream * stream;
+
 	// Whether to change the pitch of the samples, e.g. if there's only one
 	// sample per octave and you want that sample pitch shifted for the rest of
 	// the notes in the octave, this will be true
@@ -309,14 +428,17 @@ private:
 	// Open the instrument in the currently-open GIG file
 	void getInstrument();
 
+	// Preload the first part of all samples of the instrument or release
+	// what was preloaded
+	void preloadSamples( gig::Instrument * instrument, bool load );
+
 	// Create "dimension" to select desired samples from GIG file based on
 	// parameters such as velocity
 	Dimension getDimensions( gig::Region * pRegion, int velocity, bool release );
 
-	// Load sample data from the Gig file, looping the sample where needed
+	// Load sample data from the preloaded part and the stream, looping the
+	// sample where needed
 	void loadSample( GigSample& sample, sampleFrame* sampleData, f_cnt_t samples );
-	f_cnt_t getLoopedIndex( f_cnt_t index, f_cnt_t startf, f_cnt_t endf ) const;
-	f_cnt_t getPingPongIndex( f_cnt_t index, f_cnt_t startf, f_cnt_t endf ) const;
 
 	// Add the desired samples to the note, either normal samples or release
 	// samples
@@ -73,7 +73,8 @@ LadspaEffect::LadspaEffect( Model * _parent,
 	m_key( LadspaSubPluginFeatures::subPluginKeyToLadspaKey( _key ) )
 {
 	Ladspa2LMMS * manager = Engine::getLADSPAManager();
-	if( manager->getDescription( m_key ) == NULL )
+	// also loads the library of the plugin, which might fail
+	if( manager->getDescriptor( m_key ) == NULL )
 	{
 		Engine::getSong()->collectError(tr( "Unknown LADSPA plugin %1 requested." ).arg(
 											m_key.second ) );
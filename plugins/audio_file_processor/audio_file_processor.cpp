@@ -84,6 +84,13 @@ audioFileProcessor::audioFileProcessor( InstrumentTrack * _instrument_track ) :
 	m_nextPlayStartPoint( 0 ),
 	m_nextPlayBackwards( false )
 {
+	m_sampleBuffer.allowCompactStorage( true );
+	m_sampleBuffer.allowAsyncLoading( true );
+
+	// files are loaded in the background, so the points have to be
+	// applied again once the length is known
+	connect( &m_sampleBuffer, SIGNAL( sampleUpdated() ),
+				this, SLOT( pointChanged() ) );
 	connect( &m_reverseModel, SIGNAL( dataChanged() ),
 				this, SLOT( reverseModelChanged() ) );
 	connect( &m_ampModel, SIGNAL( dataChanged() ),
@@ -246,7 +253,7 @@ void audioFileProcessor::loadSettings( const QDomElement & _this )
 	}
 	else if( _this.attribute( "sampledata" ) != "" )
 	{
-		m_sampleBuffer.loadFromBase64( _this.attribute( "srcdata" ) );
+		m_sampleBuffer.loadFromBase64( _this.attribute( "sampledata" ) );
 	}
 
 	m_loopModel.loadSettings( _this, "looped" );
@@ -708,6 +715,11 @@ void AudioFileProcessorView::paintEvent( QPaintEvent * )
 		file_name = "..." + file_name;
 	}
 
+	if( a->m_sampleBuffer.isLoading() )
+	{
+		file_name = tr( "Loading..." );
+	}
+
 	p.setPen( QColor( 255, 255, 255 ) );
 	p.drawText( 8, 99, file_name );
 }
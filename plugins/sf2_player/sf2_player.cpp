@@ -23,7 +23,10 @@
  *
  */
 
+#include <algorithm>
+
 #include <QDebug>
+#include <QFileInfo>
 #include <QLayout>
 #include <QLabel>
 #include <QDomDocument>
@@ -34,6 +37,7 @@
 #include "InstrumentTrack.h"
 #include "InstrumentPlayHandle.h"
 #include "Mixer.h"
+#include "BufferManager.h"
 #include "NotePlayHandle.h"
 #include "Knob.h"
 #include "SampleBuffer.h"
@@ -68,16 +72,91 @@ Plugin::Descriptor PLUGIN_EXPORT sf2player_plugin_descriptor =
 struct SF2PluginData
 {
 	int midiNote;
-	int lastPanning;
-	float lastVelocity;
-	fluid_voice_t * fluidVoice;
-	bool isNew;
-	f_cnt_t offset;
 	bool noteOffSent;
 } ;
 
 
 
+
+sf2Instrument::NoteQueue::NoteQueue() :
+	m_writeIndex( 0 ),
+	m_readIndex( 0 ),
+	m_room( Size )
+{
+	for( int i = 0; i < Size; ++i )
+	{
+		m_cells[i].sequence = i;
+	}
+}
+
+
+
+
+bool sf2Instrument::NoteQueue::reserve( int _events )
+{
+	int room = m_room;
+	while( room >= _events )
+	{
+		if( m_room.testAndSetOrdered( room, room - _events ) )
+		{
+			return true;
+		}
+		room = m_room;
+	}
+	return false;
+}
+
+
+
+
+bool sf2Instrument::NoteQueue::push( const NoteEvent & _event )
+{
+	// every cell carries the index it may be written at next, so writers
+	// only have to agree on the write index
+	int pos = m_writeIndex;
+	while( true )
+	{
+		Cell & cell = m_cells[pos & ( Size - 1 )];
+		const int sequence = cell.sequence;
+		if( sequence == pos )
+		{
+			if( m_writeIndex.testAndSetOrdered( pos, pos + 1 ) )
+			{
+				cell.event = _event;
+				cell.sequence.fetchAndStoreOrdered( pos + 1 );
+				return true;
+			}
+		}
+		else if( sequence - pos < 0 )
+		{
+			// not read yet
+			return false;
+		}
+		pos = m_writeIndex;
+	}
+}
+
+
+
+
+bool sf2Instrument::NoteQueue::pop( NoteEvent * _event )
+{
+	Cell & cell = m_cells[m_readIndex & ( Size - 1 )];
+	if( (int) cell.sequence != m_readIndex + 1 )
+	{
+		return false;
+	}
+
+	*_event = cell.event;
+	cell.sequence.fetchAndStoreOrdered( m_readIndex + Size );
+	++m_readIndex;
+	m_room.fetchAndAddOrdered( 1 );
+
+	return true;
+}
+
+
+
 // Static map of current sfonts
 QMap<QString, sf2Font*> sf2Instrument::s_fonts;
 QMutex sf2Instrument::s_fontsMutex;
@@ -112,6 +191,8 @@ sf2Instrument::sf2Instrument( InstrumentTrack * _instrument_track ) :
 		m_notesRunning[i] = 0;
 	}
 
+	m_periodEvents.reserve( NoteQueue::Size );
+
 	m_settings = new_fluid_settings();
 
 	//fluid_settings_setint( m_settings, (char *) "audio.period-size", engine::mixer()->framesPerPeriod() );
@@ -280,7 +361,7 @@ void sf2Instrument::freeFont()
 			qDebug() << "Really deleting " << m_filename;
 
 			fluid_synth_sfunload( m_synth, m_fontId, true );
-			s_fonts.remove( m_filename );
+			s_fonts.remove( m_fontKey );
 			delete m_font;
 		}
 		// Just remove our reference
@@ -306,6 +387,12 @@ void sf2Instrument::openFile( const QString & _sf2File, bool updateTrackName )
 	// Used for loading file
 	char * sf2Ascii = qstrdup( qPrintable( SampleBuffer::tryToMakeAbsolute( _sf2File ) ) );
 	QString relativePath = SampleBuffer::tryToMakeRelative( _sf2File );
+	// the same file referred to by different paths is loaded only once
+	QString fontKey = QFileInfo( sf2Ascii ).canonicalFilePath();
+	if( fontKey.isEmpty() )
+	{
+		fontKey = relativePath;
+	}
 
 	// free reference to soundfont if one is selected
 	freeFont();
@@ -314,11 +401,11 @@ void sf2Instrument::openFile( const QString & _sf2File, bool updateTrackName )
 	s_fontsMutex.lock();
 
 	// Increment Reference
-	if( s_fonts.contains( relativePath ) )
+	if( s_fonts.contains( fontKey ) )
 	{
-		qDebug() << "Using existing reference to " << relativePath;
+		qDebug() << "Using existing reference to " << fontKey;
 
-		m_font = s_fonts[ relativePath ];
+		m_font = s_fonts[ fontKey ];
 
 		m_font->refCount++;
 
@@ -334,7 +421,7 @@ void sf2Instrument::openFile( const QString & _sf2File, bool updateTrackName )
 		{
 			// Grab this sf from the top of the stack and add to list
 			m_font = new sf2Font( fluid_synth_get_sfont( m_synth, 0 ) );
-			s_fonts.insert( relativePath, m_font );
+			s_fonts.insert( fontKey, m_font );
 		}
 		else
 		{
@@ -343,6 +430,11 @@ void sf2Instrument::openFile( const QString & _sf2File, bool updateTrackName )
 		}
 	}
 
+	if( m_font != NULL )
+	{
+		m_fontKey = fontKey;
+	}
+
 	s_fontsMutex.unlock();
 	m_synthMutex.unlock();
 
@@ -544,7 +636,7 @@ void sf2Instrument::playNote( NotePlayHandle * _n, sampleFrame * )
 	{
 		return;
 	}
-	
+
 	const f_cnt_t tfp = _n->totalFramesPlayed();
 
 	if( tfp == 0 )
@@ -559,187 +651,168 @@ void sf2Instrument::playNote( NotePlayHandle * _n, sampleFrame * )
 			return;
 		}
 		const int baseVelocity = instrumentTrack()->midiPort()->baseVelocity();
-		
+
 		SF2PluginData * pluginData = new SF2PluginData;
 		pluginData->midiNote = midiNote;
-		pluginData->lastPanning = 0;
-		pluginData->lastVelocity = _n->midiVelocity( baseVelocity );
-		pluginData->fluidVoice = NULL;
-		pluginData->isNew = true;
-		pluginData->offset = _n->offset();
 		pluginData->noteOffSent = false;
 
 		_n->m_pluginData = pluginData;
-		
-		// insert the nph to the playing notes vector
-		m_playingNotesMutex.lock();
-		m_playingNotes.append( _n );
-		m_playingNotesMutex.unlock();
+
+		NoteEvent event;
+		event.midiNote = midiNote;
+		event.velocity = _n->midiVelocity( baseVelocity );
+		event.offset = _n->offset();
+		event.noteOn = true;
+		// reserve room for the note-off as well, so it never has to
+		// wait for play() to drain the queue
+		if( m_noteQueue.reserve( 2 ) == false )
+		{
+			// nothing to switch off then
+			pluginData->noteOffSent = true;
+			return;
+		}
+		m_noteQueue.push( event );
+
+		// if the note is released during the same period, it has to be
+		// switched off again right away
+		if( _n->isReleased() )
+		{
+			queueNoteOff( pluginData, _n->framesBeforeRelease() );
+		}
 	}
 	else if( _n->isReleased() ) // note is released during this period
 	{
 		SF2PluginData * pluginData = static_cast<SF2PluginData *>( _n->m_pluginData );
-		pluginData->offset = _n->framesBeforeRelease();
-		pluginData->isNew = false;
-		
-		m_playingNotesMutex.lock();
-		m_playingNotes.append( _n );
-		m_playingNotesMutex.unlock();
-
+		if( pluginData != NULL && pluginData->noteOffSent == false )
+		{
+			queueNoteOff( pluginData, _n->framesBeforeRelease() );
+		}
 	}
 }
 
 
-void sf2Instrument::noteOn( SF2PluginData * n )
+
+
+void sf2Instrument::queueNoteOff( SF2PluginData * n, f_cnt_t offset )
 {
-	m_synthMutex.lock();
-	
-	// get list of current voice IDs so we can easily spot the new
-	// voice after the fluid_synth_noteon() call
-	const int poly = fluid_synth_get_polyphony( m_synth );
-	fluid_voice_t * voices[poly];
-	unsigned int id[poly];
-	fluid_synth_get_voicelist( m_synth, voices, poly, -1 );
-	for( int i = 0; i < poly; ++i )
-	{
-		id[i] = 0;
-	}
-	for( int i = 0; i < poly && voices[i]; ++i )
-	{
-		id[i] = fluid_voice_get_id( voices[i] );
-	}
+	NoteEvent event;
+	event.midiNote = n->midiNote;
+	event.velocity = 0;
+	event.offset = offset;
+	event.noteOn = false;
+
+	// room for it was reserved along with the note-on
+	m_noteQueue.push( event );
+	n->noteOffSent = true;
+}
 
-	fluid_synth_noteon( m_synth, m_channel, n->midiNote, n->lastVelocity );
 
-	// get new voice and save it
-	fluid_synth_get_voicelist( m_synth, voices, poly, -1 );
-	for( int i = 0; i < poly && voices[i]; ++i )
-	{
-		const unsigned int newID = fluid_voice_get_id( voices[i] );
-		if( id[i] != newID || newID == 0 )
-		{
-			n->fluidVoice = voices[i];
-			break;
-		}
-	}
 
-	m_synthMutex.unlock();
 
-	m_notesRunningMutex.lock();
-	++m_notesRunning[ n->midiNote ];
-	m_notesRunningMutex.unlock();
+void sf2Instrument::noteOn( const NoteEvent & _event )
+{
+	fluid_synth_noteon( m_synth, m_channel, _event.midiNote, _event.velocity );
+	++m_notesRunning[_event.midiNote];
 }
 
 
-void sf2Instrument::noteOff( SF2PluginData * n )
-{
-	n->noteOffSent = true;
-	m_notesRunningMutex.lock();
-	const int notes = --m_notesRunning[n->midiNote];
-	m_notesRunningMutex.unlock();
 
-	if( notes <= 0 )
+
+void sf2Instrument::noteOff( const NoteEvent & _event )
+{
+	if( --m_notesRunning[_event.midiNote] <= 0 )
 	{
-		m_synthMutex.lock();
-		fluid_synth_noteoff( m_synth, m_channel, n->midiNote );
-		m_synthMutex.unlock();
+		fluid_synth_noteoff( m_synth, m_channel, _event.midiNote );
 	}
-	
 }
 
 
+
+
 void sf2Instrument::play( sampleFrame * _working_buffer )
 {
 	const fpp_t frames = Engine::mixer()->framesPerPeriod();
 
+	// collect the events of this period
+	NoteEvent event;
+	while( m_noteQueue.pop( &event ) )
+	{
+		m_periodEvents.append( event );
+	}
+
+	// don't wait while a soundfont is loaded or the synth is re-created -
+	// the events are kept until the synth is available again
+	if( m_synthMutex.tryLock() == false )
+	{
+		for( int i = 0; i < m_periodEvents.size(); ++i )
+		{
+			// late already, so they go first
+			m_periodEvents[i].offset = 0;
+		}
+		BufferManager::clear( _working_buffer, frames );
+		instrumentTrack()->processAudioBuffer( _working_buffer, frames, NULL );
+		return;
+	}
+
 	// set midi pitch for this period
 	const int currentMidiPitch = instrumentTrack()->midiPitch();
 	if( m_lastMidiPitch != currentMidiPitch )
 	{
 		m_lastMidiPitch = currentMidiPitch;
-		m_synthMutex.lock();
 		fluid_synth_pitch_bend( m_synth, m_channel, m_lastMidiPitch );
-		m_synthMutex.unlock();
-
 	}
 
 	const int currentMidiPitchRange = instrumentTrack()->midiPitchRange();
 	if( m_lastMidiPitchRange != currentMidiPitchRange )
 	{
 		m_lastMidiPitchRange = currentMidiPitchRange;
-		m_synthMutex.lock();
 		fluid_synth_pitch_wheel_sens( m_synth, m_channel, m_lastMidiPitchRange );
-		m_synthMutex.unlock();
-	}
-	// if we have no new noteons/noteoffs, just render a period and call it a day
-	if( m_playingNotes.isEmpty() )
-	{
-		renderFrames( frames, _working_buffer );
-		instrumentTrack()->processAudioBuffer( _working_buffer, frames, NULL );
-		return;
 	}
 
+	// events of the same note are queued in order, so a stable sort keeps
+	// note-ons before note-offs
+	std::stable_sort( m_periodEvents.begin(), m_periodEvents.end() );
+
 	// processing loop
-	// go through noteplayhandles in processing order
+	// go through events in processing order
 	f_cnt_t currentFrame = 0;
-
-	while( ! m_playingNotes.isEmpty() )
+	for( QVector<NoteEvent>::ConstIterator it = m_periodEvents.begin();
+					it != m_periodEvents.end(); ++it )
 	{
-		// find the note with lowest offset
-		NotePlayHandle * currentNote = m_playingNotes[0];
-		for( int i = 1; i < m_playingNotes.size(); ++i )
-		{
-			SF2PluginData * currentData = static_cast<SF2PluginData *>( currentNote->m_pluginData );
-			SF2PluginData * iData = static_cast<SF2PluginData *>( m_playingNotes[i]->m_pluginData );
-			if( currentData->offset > iData->offset )
-			{
-				currentNote = m_playingNotes[i];
-			}
-		}
-		
-		// process the current note:
 		// first see if we're synced in frame count
-		SF2PluginData * currentData = static_cast<SF2PluginData *>( currentNote->m_pluginData );
-		if( currentData->offset > currentFrame )
+		const f_cnt_t offset = qMin<f_cnt_t>( it->offset, frames );
+		if( offset > currentFrame )
 		{
-			renderFrames( currentData->offset - currentFrame, _working_buffer + currentFrame );
-			currentFrame = currentData->offset;
+			renderFrames( offset - currentFrame, _working_buffer + currentFrame );
+			currentFrame = offset;
 		}
-		if( currentData->isNew )
+		if( it->noteOn )
 		{
-			noteOn( currentData );
-			if( currentNote->isReleased() ) // if the note is released during the same period, we have to process it again for noteoff
-			{
-				currentData->isNew = false;
-				currentData->offset = currentNote->framesBeforeRelease();
-			}
-			else // otherwise remove the handle
-			{
-				m_playingNotesMutex.lock();
-				m_playingNotes.remove( m_playingNotes.indexOf( currentNote ) );
-				m_playingNotesMutex.unlock();
-			}
+			noteOn( *it );
 		}
 		else
 		{
-			noteOff( currentData );
-			m_playingNotesMutex.lock();
-			m_playingNotes.remove( m_playingNotes.indexOf( currentNote ) );
-			m_playingNotesMutex.unlock();
+			noteOff( *it );
 		}
 	}
 
+	m_periodEvents.clear();
+
 	if( currentFrame < frames )
 	{
 		renderFrames( frames - currentFrame, _working_buffer + currentFrame );
 	}
+	m_synthMutex.unlock();
+
 	instrumentTrack()->processAudioBuffer( _working_buffer, frames, NULL );
 }
 
-	
+
+
+
+// must be called with m_synthMutex locked
 void sf2Instrument::renderFrames( f_cnt_t frames, sampleFrame * buf )
 {
-	m_synthMutex.lock();
 	if( m_internalSampleRate < Engine::mixer()->processingSampleRate() &&
 							m_srcState != NULL )
 	{
@@ -775,7 +848,6 @@ void sf2Instrument::renderFrames( f_cnt_t frames, sampleFrame * buf )
 	{
 		fluid_synth_write_float( m_synth, frames, buf, 0, 2, buf, 1, 2 );
 	}
-	m_synthMutex.unlock();
 }
 
 
@@ -787,13 +859,7 @@ void sf2Instrument::deleteNotePluginData( NotePlayHandle * _n )
 	if( ! pluginData->noteOffSent ) // if we for some reason haven't noteoffed the note before it gets deleted,
 									// do it here
 	{
-		noteOff( pluginData );
-		m_playingNotesMutex.lock();
-		if( m_playingNotes.indexOf( _n ) >= 0 )
-		{
-			m_playingNotes.remove( m_playingNotes.indexOf( _n ) );
-		}
-		m_playingNotesMutex.unlock();
+		queueNoteOff( pluginData, 0 );
 	}
 	delete pluginData;
 }
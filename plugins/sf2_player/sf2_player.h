@@ -28,8 +28,10 @@
 #define SF2_PLAYER_H
 
 #include <QMutex>
+#include <QVector>
 #include <samplerate.h>
 
+#include "AtomicInt.h"
 #include "Instrument.h"
 #include "PixmapButton.h"
 #include "InstrumentView.h"
@@ -107,9 +109,56 @@ public slots:
 
 
 private:
+	struct NoteEvent
+	{
+		int midiNote;
+		int velocity;
+		f_cnt_t offset;
+		bool noteOn;
+
+		bool operator<( const NoteEvent & _other ) const
+		{
+			return offset < _other.offset;
+		}
+	} ;
+
+	// lock-free queue of note events - filled from any thread by
+	// playNote() and deleteNotePluginData() and drained by play(), so
+	// neither of them has to wait for the other or for the synth
+	class NoteQueue
+	{
+	public:
+		enum { Size = 1024 };
+
+		NoteQueue();
+
+		// reserves room for _events events, false if the queue is
+		// too full for them
+		bool reserve( int _events );
+		// only for events room was reserved for before
+		bool push( const NoteEvent & _event );
+		// only to be called by a single consumer
+		bool pop( NoteEvent * _event );
+
+	private:
+		struct Cell
+		{
+			AtomicInt sequence;
+			NoteEvent event;
+		} ;
+
+		Cell m_cells[Size];
+		AtomicInt m_writeIndex;
+		int m_readIndex;
+		// cells neither filled nor reserved
+		AtomicInt m_room;
+
+	} ;
+
+	// loaded soundfonts, shared by all instances and keyed by their
+	// canonical path - every instance selects its presets on its own synth
 	static QMutex s_fontsMutex;
 	static QMap<QString, sf2Font*> s_fonts;
-	static int (* s_origFree)( fluid_sfont_t * );
 
 	SRC_STATE * m_srcState;
 
@@ -120,9 +169,7 @@ private:
 
 	int m_fontId;
 	QString m_filename;
-
-	// Protect the array of active notes
-	QMutex m_notesRunningMutex;
+	QString m_fontKey;
 
 	// Protect synth when we are re-creating it.
 	QMutex m_synthMutex;
@@ -151,13 +198,15 @@ private:
 	FloatModel m_chorusSpeed;
 	FloatModel m_chorusDepth;
 
-	QVector<NotePlayHandle *> m_playingNotes;
-	QMutex m_playingNotesMutex;
+	NoteQueue m_noteQueue;
+	// only used by play()
+	QVector<NoteEvent> m_periodEvents;
 
 private:
 	void freeFont();
-	void noteOn( SF2PluginData * n );
-	void noteOff( SF2PluginData * n );
+	void queueNoteOff( SF2PluginData * n, f_cnt_t offset );
+	void noteOn( const NoteEvent & _event );
+	void noteOff( const NoteEvent & _event );
 	void renderFrames( f_cnt_t frames, sampleFrame * buf );
 
 	friend class sf2InstrumentView;
@@ -29,6 +29,7 @@
 
 #include "TripleOscillator.h"
 #include "AutomatableButton.h"
+#include "BufferManager.h"
 #include "debug.h"
 #include "Engine.h"
 #include "InstrumentTrack.h"
@@ -38,6 +39,7 @@
 #include "PixmapButton.h"
 #include "SampleBuffer.h"
 #include "ToolTip.h"
+#include "lmms_math.h"
 
 #include "embed.cpp"
 
@@ -209,6 +211,48 @@ void OscillatorObject::updatePhaseOffsetRight()
 
  
 
+OscillatorVoiceBank::OscillatorVoiceBank() :
+	// there can't be more notes than the NotePlayHandleManager has ready,
+	// unless it's extended while playing an awful lot of them at once
+	m_voices( new OscillatorVoice[INITIAL_NPH_CACHE] )
+{
+}
+
+
+
+
+OscillatorVoiceBank::~OscillatorVoiceBank()
+{
+	delete[] m_voices;
+}
+
+
+
+
+OscillatorVoice * OscillatorVoiceBank::acquire()
+{
+	for( int v = 0; v < INITIAL_NPH_CACHE; ++v )
+	{
+		if( m_voices[v].inUse.testAndSetAcquire( 0, 1 ) )
+		{
+			return m_voices + v;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+void OscillatorVoiceBank::release( OscillatorVoice * _voice )
+{
+	_voice->inUse.fetchAndStoreRelease( 0 );
+}
+
+
+
+
 TripleOscillator::TripleOscillator( InstrumentTrack * _instrument_track ) :
 	Instrument( _instrument_track, &tripleoscillator_plugin_descriptor )
 {
@@ -295,74 +339,225 @@ QString TripleOscillator::nodeName() const
 
 
 
-void TripleOscillator::playNote( NotePlayHandle * _n,
-						sampleFrame * _working_buffer )
+template<int W>
+static inline sample_t voiceSample( const float _phase,
+					const SampleBuffer * _userWave )
 {
-	if( _n->totalFramesPlayed() == 0 || _n->m_pluginData == NULL )
+	switch( W )
 	{
-		Oscillator * oscs_l[NUM_OF_OSCILLATORS];
-		Oscillator * oscs_r[NUM_OF_OSCILLATORS];
+		case Oscillator::TriangleWave:
+			return Oscillator::triangleSample( _phase );
+		case Oscillator::SawWave:
+			return Oscillator::sawSample( _phase );
+		case Oscillator::SquareWave:
+			return Oscillator::squareSample( _phase );
+		case Oscillator::MoogSawWave:
+			return Oscillator::moogSawSample( _phase );
+		case Oscillator::ExponentialWave:
+			return Oscillator::expSample( _phase );
+		case Oscillator::WhiteNoise:
+			return Oscillator::noiseSample( _phase );
+		case Oscillator::UserDefinedWave:
+			return _userWave->userWaveSample( _phase );
+		case Oscillator::SineWave:
+		default:
+			return Oscillator::sinSample( _phase );
+	}
+}
+
 
-		for( int i = NUM_OF_OSCILLATORS - 1; i >= 0; --i )
-		{
 
-			// the last oscs needs no sub-oscs...
-			if( i == NUM_OF_OSCILLATORS - 1 )
+
+// renders one oscillator of a voice for both channels at once, combining it
+// with the sub-oscillator's output already in _ab in the same way as the
+// update*() methods of Oscillator do
+template<int W>
+static void renderOscillatorStage( const int _algo, sampleFrame * _ab,
+				const fpp_t _frames,
+				float * _phase, const float * _phaseOffset,
+				const float * _coeff, const float * _volume,
+				float * _subPhase, const float * _subCoeff,
+				const SampleBuffer * _userWave )
+{
+	switch( _algo )
+	{
+		case Oscillator::PhaseModulation:
+			for( fpp_t f = 0; f < _frames; ++f )
 			{
-				oscs_l[i] = new Oscillator(
-						&m_osc[i]->m_waveShapeModel,
-						&m_osc[i]->m_modulationAlgoModel,
-						_n->frequency(),
-						m_osc[i]->m_detuningLeft,
-						m_osc[i]->m_phaseOffsetLeft,
-						m_osc[i]->m_volumeLeft );
-				oscs_r[i] = new Oscillator(
-						&m_osc[i]->m_waveShapeModel,
-						&m_osc[i]->m_modulationAlgoModel,
-						_n->frequency(),
-						m_osc[i]->m_detuningRight,
-						m_osc[i]->m_phaseOffsetRight,
-						m_osc[i]->m_volumeRight );
+				for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+				{
+					_ab[f][ch] = voiceSample<W>( _phase[ch] +
+						_ab[f][ch], _userWave ) * _volume[ch];
+					_phase[ch] += _coeff[ch];
+				}
 			}
-			else
+			break;
+
+		case Oscillator::AmplitudeModulation:
+			for( fpp_t f = 0; f < _frames; ++f )
 			{
-				oscs_l[i] = new Oscillator(
-						&m_osc[i]->m_waveShapeModel,
-						&m_osc[i]->m_modulationAlgoModel,
-						_n->frequency(),
-						m_osc[i]->m_detuningLeft,
-						m_osc[i]->m_phaseOffsetLeft,
-						m_osc[i]->m_volumeLeft,
-						oscs_l[i + 1] );
-				oscs_r[i] = new Oscillator(
-						&m_osc[i]->m_waveShapeModel,
-						&m_osc[i]->m_modulationAlgoModel,
-						_n->frequency(),
-						m_osc[i]->m_detuningRight,
-						m_osc[i]->m_phaseOffsetRight,
-						m_osc[i]->m_volumeRight,
-						oscs_r[i + 1] );
+				for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+				{
+					_ab[f][ch] *= voiceSample<W>( _phase[ch],
+						_userWave ) * _volume[ch];
+					_phase[ch] += _coeff[ch];
+				}
 			}
+			break;
 
-			oscs_l[i]->setUserWave( m_osc[i]->m_sampleBuffer );
-			oscs_r[i]->setUserWave( m_osc[i]->m_sampleBuffer );
+		case Oscillator::SignalMix:
+			for( fpp_t f = 0; f < _frames; ++f )
+			{
+				for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+				{
+					_ab[f][ch] += voiceSample<W>( _phase[ch],
+						_userWave ) * _volume[ch];
+					_phase[ch] += _coeff[ch];
+				}
+			}
+			break;
+
+		case Oscillator::SynchronizedBySubOsc:
+			for( fpp_t f = 0; f < _frames; ++f )
+			{
+				for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+				{
+					// restart our period whenever the
+					// sub-oscillator starts a new one
+					const float subPhase = _subPhase[ch];
+					_subPhase[ch] += _subCoeff[ch];
+					if( floorf( _subPhase[ch] ) >
+							floorf( subPhase ) )
+					{
+						_phase[ch] = _phaseOffset[ch];
+					}
+					_ab[f][ch] = voiceSample<W>( _phase[ch],
+						_userWave ) * _volume[ch];
+					_phase[ch] += _coeff[ch];
+				}
+			}
+			break;
 
+		case Oscillator::FrequencyModulation:
+		{
+			const float sampleRateCorrection = 44100.0f /
+				Engine::mixer()->processingSampleRate();
+			for( fpp_t f = 0; f < _frames; ++f )
+			{
+				for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+				{
+					_phase[ch] += _ab[f][ch] *
+							sampleRateCorrection;
+					_ab[f][ch] = voiceSample<W>( _phase[ch],
+						_userWave ) * _volume[ch];
+					_phase[ch] += _coeff[ch];
+				}
+			}
+			break;
 		}
 
-		_n->m_pluginData = new oscPtr;
-		static_cast<oscPtr *>( _n->m_pluginData )->oscLeft = oscs_l[0];
-		static_cast< oscPtr *>( _n->m_pluginData )->oscRight =
-								oscs_r[0];
+		default:
+			// no sub-oscillator
+			for( fpp_t f = 0; f < _frames; ++f )
+			{
+				for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+				{
+					_ab[f][ch] = voiceSample<W>( _phase[ch],
+						_userWave ) * _volume[ch];
+					_phase[ch] += _coeff[ch];
+				}
+			}
+			break;
+	}
+}
+
+
+
+
+static void renderOscillator( const int _shape, const int _algo,
+				sampleFrame * _ab, const fpp_t _frames,
+				float * _phase, const float * _phaseOffset,
+				const float * _coeff, const float * _volume,
+				float * _subPhase, const float * _subCoeff,
+				const SampleBuffer * _userWave )
+{
+	switch( _shape )
+	{
+		case Oscillator::SineWave:
+		default:
+			renderOscillatorStage<Oscillator::SineWave>( _algo, _ab,
+				_frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
+		case Oscillator::TriangleWave:
+			renderOscillatorStage<Oscillator::TriangleWave>( _algo, _ab,
+				_frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
+		case Oscillator::SawWave:
+			renderOscillatorStage<Oscillator::SawWave>( _algo, _ab,
+				_frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
+		case Oscillator::SquareWave:
+			renderOscillatorStage<Oscillator::SquareWave>( _algo, _ab,
+				_frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
+		case Oscillator::MoogSawWave:
+			renderOscillatorStage<Oscillator::MoogSawWave>( _algo, _ab,
+				_frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
+		case Oscillator::ExponentialWave:
+			renderOscillatorStage<Oscillator::ExponentialWave>( _algo,
+				_ab, _frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
+		case Oscillator::WhiteNoise:
+			renderOscillatorStage<Oscillator::WhiteNoise>( _algo, _ab,
+				_frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
+		case Oscillator::UserDefinedWave:
+			renderOscillatorStage<Oscillator::UserDefinedWave>( _algo,
+				_ab, _frames, _phase, _phaseOffset, _coeff, _volume,
+				_subPhase, _subCoeff, _userWave );
+			break;
 	}
+}
+
+
 
-	Oscillator * osc_l = static_cast<oscPtr *>( _n->m_pluginData )->oscLeft;
-	Oscillator * osc_r = static_cast<oscPtr *>( _n->m_pluginData )->oscRight;
+
+void TripleOscillator::playNote( NotePlayHandle * _n,
+						sampleFrame * _working_buffer )
+{
+	if( _n->totalFramesPlayed() == 0 || _n->m_pluginData == NULL )
+	{
+		if( _n->m_pluginData == NULL )
+		{
+			_n->m_pluginData = m_voiceBank.acquire();
+		}
+		if( _n->m_pluginData != NULL )
+		{
+			initVoice( static_cast<OscillatorVoice *>(
+							_n->m_pluginData ) );
+		}
+	}
 
 	const fpp_t frames = _n->framesLeftForCurrentPeriod();
 	const f_cnt_t offset = _n->noteOffset();
 
-	osc_l->update( _working_buffer + offset, frames, 0 );
-	osc_r->update( _working_buffer + offset, frames, 1 );
+	if( _n->m_pluginData == NULL )
+	{
+		// out of voices
+		BufferManager::clear( _working_buffer + offset, frames );
+		return;
+	}
+
+	renderVoice( static_cast<OscillatorVoice *>( _n->m_pluginData ),
+				_n->frequency(), _working_buffer + offset, frames );
 
 	applyRelease( _working_buffer, _n );
 
@@ -374,11 +569,95 @@ void TripleOscillator::playNote( NotePlayHandle * _n,
 
 void TripleOscillator::deleteNotePluginData( NotePlayHandle * _n )
 {
-	delete static_cast<Oscillator *>( static_cast<oscPtr *>(
-						_n->m_pluginData )->oscLeft );
-	delete static_cast<Oscillator *>( static_cast<oscPtr *>(
-						_n->m_pluginData )->oscRight );
-	delete static_cast<oscPtr *>( _n->m_pluginData );
+	if( _n->m_pluginData != NULL )
+	{
+		m_voiceBank.release( static_cast<OscillatorVoice *>(
+							_n->m_pluginData ) );
+	}
+}
+
+
+
+
+void TripleOscillator::initVoice( OscillatorVoice * _voice )
+{
+	for( int i = 0; i < NUM_OF_OSCILLATORS; ++i )
+	{
+		_voice->phaseOffset[i][0] = m_osc[i]->m_phaseOffsetLeft;
+		_voice->phaseOffset[i][1] = m_osc[i]->m_phaseOffsetRight;
+		_voice->phase[i][0] = _voice->phaseOffset[i][0];
+		_voice->phase[i][1] = _voice->phaseOffset[i][1];
+	}
+}
+
+
+
+
+void TripleOscillator::renderVoice( OscillatorVoice * _voice, const float _freq,
+					sampleFrame * _ab, const fpp_t _frames )
+{
+	if( _freq >= Engine::mixer()->processingSampleRate() / 2 )
+	{
+		BufferManager::clear( _ab, _frames );
+		return;
+	}
+
+	int algo[NUM_OF_OSCILLATORS];
+	float coeff[NUM_OF_OSCILLATORS][DEFAULT_CHANNELS];
+	float volume[NUM_OF_OSCILLATORS][DEFAULT_CHANNELS];
+
+	for( int i = 0; i < NUM_OF_OSCILLATORS; ++i )
+	{
+		const OscillatorObject * osc = m_osc[i];
+		// the last oscillator has no sub-oscillator to be modulated by
+		algo[i] = i < NUM_OF_OSCILLATORS - 1 ?
+				osc->m_modulationAlgoModel.value() :
+				Oscillator::NumModulationAlgos;
+		coeff[i][0] = _freq * osc->m_detuningLeft;
+		coeff[i][1] = _freq * osc->m_detuningRight;
+		volume[i][0] = osc->m_volumeLeft;
+		volume[i][1] = osc->m_volumeRight;
+
+		const float phaseOffset[DEFAULT_CHANNELS] =
+			{ osc->m_phaseOffsetLeft, osc->m_phaseOffsetRight };
+		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+		{
+			// same as Oscillator::recalcPhase()
+			float & phase = _voice->phase[i][ch];
+			if( !typeInfo<float>::isEqual( _voice->phaseOffset[i][ch],
+							phaseOffset[ch] ) )
+			{
+				phase -= _voice->phaseOffset[i][ch];
+				_voice->phaseOffset[i][ch] = phaseOffset[ch];
+				phase += phaseOffset[ch];
+			}
+			phase = absFraction( phase ) + 2;
+		}
+	}
+
+	// render from the last oscillator upwards, so every oscillator finds
+	// the output of its sub-oscillator in the buffer
+	for( int i = NUM_OF_OSCILLATORS - 1; i >= 0; --i )
+	{
+		// an oscillator which syncs its parent is not rendered at all -
+		// its phase is advanced by the parent instead, once per frame.
+		// That's what Oscillator::updateSync() does as well: it calls
+		// syncInit() on the sub-oscillator, which only updates the
+		// sub-oscillator's own sub-oscillator, and advances the
+		// sub-oscillator's phase in syncOk().
+		if( i > 0 && algo[i-1] == Oscillator::SynchronizedBySubOsc )
+		{
+			continue;
+		}
+		const bool hasSub = i < NUM_OF_OSCILLATORS - 1;
+		renderOscillator( m_osc[i]->m_waveShapeModel.value(), algo[i],
+				_ab, _frames,
+				_voice->phase[i], _voice->phaseOffset[i],
+				coeff[i], volume[i],
+				hasSub ? _voice->phase[i+1] : NULL,
+				hasSub ? coeff[i+1] : NULL,
+				m_osc[i]->m_sampleBuffer );
+	}
 }
 
 
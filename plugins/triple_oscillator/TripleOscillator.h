@@ -26,6 +26,7 @@
 #ifndef _TRIPLE_OSCILLATOR_H
 #define _TRIPLE_OSCILLATOR_H
 
+#include "AtomicInt.h"
 #include "Instrument.h"
 #include "InstrumentView.h"
 #include "Oscillator.h"
@@ -90,6 +91,40 @@ private slots:
 
 
 
+// state of one note - the phases of all oscillators for both channels,
+// kept in one flat record so a voice needs no chain of Oscillator objects
+struct OscillatorVoice
+{
+	float phase[NUM_OF_OSCILLATORS][DEFAULT_CHANNELS];
+	float phaseOffset[NUM_OF_OSCILLATORS][DEFAULT_CHANNELS];
+	AtomicInt inUse;
+} ;
+
+
+
+
+// pool of voices, allocated along with the instrument and never resized,
+// so voices can be rendered from any worker thread while other notes start
+// or end. Voices are claimed and given back without locking.
+class OscillatorVoiceBank
+{
+public:
+	OscillatorVoiceBank();
+	~OscillatorVoiceBank();
+
+	// NULL if there are too many notes playing
+	OscillatorVoice * acquire();
+	void release( OscillatorVoice * _voice );
+
+
+private:
+	OscillatorVoice * m_voices;
+
+} ;
+
+
+
+
 class TripleOscillator : public Instrument
 {
 	Q_OBJECT
@@ -120,14 +155,13 @@ protected slots:
 
 
 private:
+	void initVoice( OscillatorVoice * _voice );
+	void renderVoice( OscillatorVoice * _voice, const float _freq,
+					sampleFrame * _ab, const fpp_t _frames );
+
 	OscillatorObject * m_osc[NUM_OF_OSCILLATORS];
 
-	struct oscPtr
-	{
-		MM_OPERATORS
-		Oscillator * oscLeft;
-		Oscillator * oscRight;
-	} ;
+	OscillatorVoiceBank m_voiceBank;
 
 
 	friend class TripleOscillatorView;
@@ -139,6 +139,10 @@ public:
 
 	virtual void processMidiEvent( const MidiEvent& event, const f_cnt_t offset );
 
+	// VST 2 has no timing for parameter changes - the ones of a period
+	// apply from its start
+	virtual void setParameter( int _index, float _value, f_cnt_t _offset );
+
 	// set given sample-rate for plugin
 	virtual void updateSampleRate()
 	{
@@ -868,6 +872,20 @@ void RemoteVstPlugin::processMidiEvent( const MidiEvent& event, const f_cnt_t of
 
 
 
+void RemoteVstPlugin::setParameter( int _index, float _value, f_cnt_t )
+{
+	lock();
+	if( m_plugin != NULL && _index >= 0 && _index < m_plugin->numParams )
+	{
+		m_plugin->setParameter( m_plugin, _index, _value );
+	}
+	unlock();
+}
+
+
+
+
+
 const char * RemoteVstPlugin::pluginName()
 {
 	static char buf[32];
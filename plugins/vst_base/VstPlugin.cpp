@@ -400,6 +400,7 @@ int VstPlugin::currentProgram()
 const QMap<QString, QString> & VstPlugin::parameterDump()
 {
 	lock();
+	sendParameterChanges();
 	sendMessage( IdVstGetParameterDump );
 	waitForMessage( IdVstParameterDump );
 	unlock();
@@ -428,6 +429,7 @@ void VstPlugin::setParameterDump( const QMap<QString, QString> & _pdump )
 		m.addFloat( item.value );
 	}
 	lock();
+	sendParameterChanges();
 	sendMessage( m );
 	unlock();
 }
@@ -523,6 +525,7 @@ void VstPlugin::openPreset( )
 					!ofd.selectedFiles().isEmpty() )
 	{
 		lock();
+		sendParameterChanges();
 		sendMessage( message( IdLoadPresetFile ).
 			addString(
 				QSTR_TO_STDSTR(
@@ -539,6 +542,7 @@ void VstPlugin::openPreset( )
 void VstPlugin::setProgram( int index )
 {
 	lock();
+	sendParameterChanges();
 	sendMessage( message( IdVstSetProgram ).addInt( index ) );
 	waitForMessage( IdVstSetProgram );
 	unlock();
@@ -550,6 +554,7 @@ void VstPlugin::setProgram( int index )
 void VstPlugin::rotateProgram( int offset )
 {
 	lock();
+	sendParameterChanges();
 	sendMessage( message( IdVstRotateProgram ).addInt( offset ) );
 	waitForMessage( IdVstRotateProgram );
 	unlock();
@@ -594,6 +599,7 @@ void VstPlugin::savePreset( )
 			fns = fns + tr(".fxb");
 		else fns = fns.left(fns.length() - 4) + (fns.right( 4 )).toLower();
 		lock();
+		sendParameterChanges();
 		sendMessage( message( IdSavePresetFile ).
 			addString(
 				QSTR_TO_STDSTR(
@@ -609,16 +615,16 @@ void VstPlugin::savePreset( )
 
 void VstPlugin::setParam( int i, float f )
 {
-	lock();
-	sendMessage( message( IdVstSetParameter ).addInt( i ).addFloat( f ) );
-	//waitForMessage( IdVstSetParameter );
-	unlock();
+	// handed over along with the next period
+	setParameter( i, f );
 }
 
 
 
 void VstPlugin::idleUpdate()
 {
+	flushParameterChanges();
+
 	lock();
 	sendMessage( message( IdVstIdleUpdate ) );
 	unlock();
@@ -635,6 +641,7 @@ void VstPlugin::loadChunk( const QByteArray & _chunk )
 		tf.flush();
 
 		lock();
+		sendParameterChanges();
 		sendMessage( message( IdLoadSettingsFromFile ).
 				addString(
 					QSTR_TO_STDSTR(
@@ -655,6 +662,7 @@ QByteArray VstPlugin::saveChunk()
 	if( tf.open() )
 	{
 		lock();
+		sendParameterChanges();
 		sendMessage( message( IdSaveSettingsToFile ).
 				addString(
 					QSTR_TO_STDSTR(
@@ -26,6 +26,7 @@
 
 #include "zynaddsubfx/src/Misc/Util.h"
 #include <unistd.h>
+#include <algorithm>
 #include <ctime>
 
 #include "LocalZynAddSubFx.h"
@@ -39,11 +40,15 @@
 SYNTH_T* synth = NULL;
 
 int LocalZynAddSubFx::s_instanceCount = 0;
+int LocalZynAddSubFx::s_denormalKillBufSize = 0;
 
 
-LocalZynAddSubFx::LocalZynAddSubFx() :
+LocalZynAddSubFx::LocalZynAddSubFx( bool _renderThread ) :
 	m_master( NULL ),
-	m_ioEngine( NULL )
+	m_ioEngine( NULL ),
+	m_threaded( _renderThread ),
+	m_renderPending( false ),
+	m_renderQuit( false )
 {
 	for( int i = 0; i < NumKeys; ++i )
 	{
@@ -68,11 +73,7 @@ LocalZynAddSubFx::LocalZynAddSubFx() :
 
 		srand( time( NULL ) );
 
-		denormalkillbuf = new float[synth->buffersize];
-		for( int i = 0; i < synth->buffersize; ++i )
-		{
-			denormalkillbuf[i] = (RND-0.5)*1e-16;
-		}
+		growDenormalKillBuf( synth->buffersize );
 	}
 
 	++s_instanceCount;
@@ -81,6 +82,19 @@ LocalZynAddSubFx::LocalZynAddSubFx() :
 
 	m_master = new Master();
 	m_master->swaplr = 0;
+
+	if( m_threaded )
+	{
+		pthread_mutex_init( &m_renderMutex, NULL );
+		pthread_cond_init( &m_renderCondition, NULL );
+		if( pthread_create( &m_renderThreadHandle, NULL,
+						renderThread, this ) != 0 )
+		{
+			pthread_cond_destroy( &m_renderCondition );
+			pthread_mutex_destroy( &m_renderMutex );
+			m_threaded = false;
+		}
+	}
 }
 
 
@@ -88,12 +102,26 @@ LocalZynAddSubFx::LocalZynAddSubFx() :
 
 LocalZynAddSubFx::~LocalZynAddSubFx()
 {
+	if( m_threaded )
+	{
+		pthread_mutex_lock( &m_renderMutex );
+		m_renderQuit = true;
+		pthread_cond_broadcast( &m_renderCondition );
+		pthread_mutex_unlock( &m_renderMutex );
+
+		pthread_join( m_renderThreadHandle, NULL );
+		pthread_cond_destroy( &m_renderCondition );
+		pthread_mutex_destroy( &m_renderMutex );
+	}
+
 	delete m_master;
 	delete m_ioEngine;
 
 	if( --s_instanceCount == 0 )
 	{
 		delete[] denormalkillbuf;
+		denormalkillbuf = NULL;
+		s_denormalKillBufSize = 0;
 	}
 }
 
@@ -112,6 +140,8 @@ void LocalZynAddSubFx::initConfig()
 
 void LocalZynAddSubFx::setSampleRate( int sampleRate )
 {
+	finishRendering();
+
 	synth->samplerate = sampleRate;
 	synth->alias();
 }
@@ -121,8 +151,32 @@ void LocalZynAddSubFx::setSampleRate( int sampleRate )
 
 void LocalZynAddSubFx::setBufferSize( int bufferSize )
 {
+	finishRendering();
+
 	synth->buffersize = bufferSize;
 	synth->alias();
+
+	growDenormalKillBuf( bufferSize );
+}
+
+
+
+
+void LocalZynAddSubFx::growDenormalKillBuf( int _size )
+{
+	// the noise added against denormals has to cover a whole buffer
+	if( _size <= s_denormalKillBufSize )
+	{
+		return;
+	}
+
+	delete[] denormalkillbuf;
+	denormalkillbuf = new float[_size];
+	for( int i = 0; i < _size; ++i )
+	{
+		denormalkillbuf[i] = (RND-0.5)*1e-16;
+	}
+	s_denormalKillBufSize = _size;
 }
 
 
@@ -130,6 +184,8 @@ void LocalZynAddSubFx::setBufferSize( int bufferSize )
 
 void LocalZynAddSubFx::saveXML( const std::string & _filename )
 {
+	finishRendering();
+
 	char * name = strdup( _filename.c_str() );
 	m_master->saveXML( name );
 	free( name );
@@ -140,6 +196,8 @@ void LocalZynAddSubFx::saveXML( const std::string & _filename )
 
 void LocalZynAddSubFx::loadXML( const std::string & _filename )
 {
+	finishRendering();
+
 	char * f = strdup( _filename.c_str() );
 
 	pthread_mutex_lock( &m_master->mutex );
@@ -158,6 +216,8 @@ void LocalZynAddSubFx::loadXML( const std::string & _filename )
 
 void LocalZynAddSubFx::loadPreset( const std::string & _filename, int _part )
 {
+	finishRendering();
+
 	char * f = strdup( _filename.c_str() );
 
 	pthread_mutex_lock( &m_master->mutex );
@@ -208,6 +268,8 @@ void LocalZynAddSubFx::setLmmsWorkingDir( const std::string & _dir )
 
 void LocalZynAddSubFx::setPitchWheelBendRange( int semitones )
 {
+	finishRendering();
+
 	for( int i = 0; i < NUM_MIDI_PARTS; ++i )
 	{
 		m_master->part[i]->ctl.setpitchwheelbendrange( semitones * 100 );
@@ -216,7 +278,24 @@ void LocalZynAddSubFx::setPitchWheelBendRange( int semitones )
 
 
 
-void LocalZynAddSubFx::processMidiEvent( const MidiEvent& event )
+void LocalZynAddSubFx::processMidiEvent( const MidiEvent& event, int _offset )
+{
+	if( m_threaded )
+	{
+		// only touched by the caller, the render thread gets them handed
+		// over along with the next block
+		TimedMidiEvent timedEvent = { event, _offset };
+		m_events.push_back( timedEvent );
+		return;
+	}
+
+	applyMidiEvent( event );
+}
+
+
+
+
+void LocalZynAddSubFx::applyMidiEvent( const MidiEvent& event )
 {
 	switch( event.type() )
 	{
@@ -261,6 +340,41 @@ void LocalZynAddSubFx::processMidiEvent( const MidiEvent& event )
 
 void LocalZynAddSubFx::processAudio( sampleFrame * _out )
 {
+	if( m_threaded )
+	{
+		pthread_mutex_lock( &m_renderMutex );
+		while( m_renderPending )
+		{
+			pthread_cond_wait( &m_renderCondition, &m_renderMutex );
+		}
+
+		// zyn itself hands out the block rendered in the previous call,
+		// so running one block ahead doesn't add any latency
+		if( (int) m_renderedL.size() == synth->buffersize )
+		{
+			for( int f = 0; f < synth->buffersize; ++f )
+			{
+				_out[f][0] = m_renderedL[f];
+				_out[f][1] = m_renderedR[f];
+			}
+		}
+		else
+		{
+			// nothing rendered yet or the buffer size changed
+			for( int f = 0; f < synth->buffersize; ++f )
+			{
+				_out[f][0] = _out[f][1] = 0.0f;
+			}
+		}
+
+		m_renderEvents.swap( m_events );
+		m_events.clear();
+		m_renderPending = true;
+		pthread_cond_broadcast( &m_renderCondition );
+		pthread_mutex_unlock( &m_renderMutex );
+		return;
+	}
+
 	float outputl[synth->buffersize];
 	float outputr[synth->buffersize];
 
@@ -275,3 +389,72 @@ void LocalZynAddSubFx::processAudio( sampleFrame * _out )
 }
 
 
+
+
+
+
+void * LocalZynAddSubFx::renderThread( void * _arg )
+{
+	static_cast<LocalZynAddSubFx *>( _arg )->render();
+	return NULL;
+}
+
+
+
+
+void LocalZynAddSubFx::render()
+{
+	pthread_mutex_lock( &m_renderMutex );
+	while( true )
+	{
+		while( m_renderPending == false && m_renderQuit == false )
+		{
+			pthread_cond_wait( &m_renderCondition, &m_renderMutex );
+		}
+		if( m_renderQuit )
+		{
+			break;
+		}
+		pthread_mutex_unlock( &m_renderMutex );
+
+		// zyn renders whole blocks, so events can't take effect in
+		// between - at least keep them in the order they are meant for
+		std::stable_sort( m_renderEvents.begin(), m_renderEvents.end() );
+
+		m_renderedL.resize( synth->buffersize );
+		m_renderedR.resize( synth->buffersize );
+
+		pthread_mutex_lock( &m_master->mutex );
+		for( std::vector<TimedMidiEvent>::const_iterator it =
+						m_renderEvents.begin();
+					it != m_renderEvents.end(); ++it )
+		{
+			applyMidiEvent( it->event );
+		}
+		m_master->AudioOut( &m_renderedL[0], &m_renderedR[0] );
+		pthread_mutex_unlock( &m_master->mutex );
+
+		pthread_mutex_lock( &m_renderMutex );
+		m_renderPending = false;
+		pthread_cond_broadcast( &m_renderCondition );
+	}
+	pthread_mutex_unlock( &m_renderMutex );
+}
+
+
+
+
+void LocalZynAddSubFx::finishRendering()
+{
+	if( m_threaded == false )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &m_renderMutex );
+	while( m_renderPending )
+	{
+		pthread_cond_wait( &m_renderCondition, &m_renderMutex );
+	}
+	pthread_mutex_unlock( &m_renderMutex );
+}
@@ -25,6 +25,9 @@
 #ifndef LOCAL_ZYNADDSUBFX_H
 #define LOCAL_ZYNADDSUBFX_H
 
+#include <pthread.h>
+#include <vector>
+
 #include "MidiEvent.h"
 #include "Note.h"
 
@@ -34,11 +37,16 @@ class NulEngine;
 class LocalZynAddSubFx
 {
 public:
-	LocalZynAddSubFx();
+	// with _renderThread, every block is rendered by a thread of its own
+	// while the caller processes the previous one - processAudio() then
+	// only hands out what was rendered meanwhile
+	LocalZynAddSubFx( bool _renderThread = false );
 	~LocalZynAddSubFx();
 
 	void initConfig();
 
+	// sample rate and buffer size are shared by all instances in the
+	// process, so nothing may render while they're changed
 	void setSampleRate( int _sampleRate );
 	void setBufferSize( int _bufferSize );
 
@@ -52,7 +60,10 @@ public:
 
 	void setPitchWheelBendRange( int semitones );
 
-	void processMidiEvent( const MidiEvent& event );
+	// _offset is the frame of the current period the event belongs to -
+	// with a render thread, events are queued and applied in that order
+	// before the next block is rendered
+	void processMidiEvent( const MidiEvent& event, int _offset = 0 );
 
 	void processAudio( sampleFrame * _out );
 
@@ -63,7 +74,29 @@ public:
 
 
 protected:
+	struct TimedMidiEvent
+	{
+		MidiEvent event;
+		int offset;
+
+		bool operator<( const TimedMidiEvent & _other ) const
+		{
+			return offset < _other.offset;
+		}
+	} ;
+
+	void applyMidiEvent( const MidiEvent& event );
+
+	static void * renderThread( void * _arg );
+	void render();
+	// waits until the block being rendered is done, so the state of the
+	// master can be touched
+	void finishRendering();
+
+	static void growDenormalKillBuf( int _size );
+
 	static int s_instanceCount;
+	static int s_denormalKillBufSize;
 
 	std::string m_presetsDir;
 
@@ -71,6 +104,18 @@ protected:
 	Master * m_master;
 	NulEngine* m_ioEngine;
 
+	bool m_threaded;
+	pthread_t m_renderThreadHandle;
+	pthread_mutex_t m_renderMutex;
+	pthread_cond_t m_renderCondition;
+	bool m_renderPending;
+	bool m_renderQuit;
+	// events for the next block and those the block being rendered uses
+	std::vector<TimedMidiEvent> m_events;
+	std::vector<TimedMidiEvent> m_renderEvents;
+	std::vector<float> m_renderedL;
+	std::vector<float> m_renderedR;
+
 } ;
 
 #endif
@@ -27,6 +27,7 @@
 #include <winsock2.h>
 #endif
 
+#include <list>
 #include <queue>
 
 #define BUILD_REMOTE_PLUGIN_CLIENT
@@ -52,29 +53,65 @@ public:
 		RemotePluginClient( socketPath ),
 #endif
 		LocalZynAddSubFx(),
-		m_guiSleepTime( 100 ),
-		m_guiExit( false )
+		m_ui( NULL ),
+		m_exitProgram( 0 ),
+		m_guiExit( false ),
+		m_guiDone( false )
 	{
-		Nio::start();
+		pthread_mutex_init( &m_guiMutex, NULL );
+
+		pthread_mutex_lock( &s_guiThreadMutex );
+		pthread_mutex_lock( &s_instancesMutex );
+		const bool first = s_instances.empty();
+		s_instances.push_back( this );
+		pthread_mutex_unlock( &s_instancesMutex );
+		if( first )
+		{
+			Nio::start();
+			s_guiExit = false;
+			pthread_create( &s_guiThreadHandle, NULL, guiThread, NULL );
+		}
+		pthread_mutex_unlock( &s_guiThreadMutex );
 
 		setInputCount( 0 );
 		sendMessage( IdInitDone );
 		waitForMessage( IdInitDone );
-
-		pthread_mutex_init( &m_guiMutex, NULL );
-		pthread_create( &m_guiThreadHandle, NULL, guiThread, this );
 	}
 
 	virtual ~RemoteZynAddSubFx()
 	{
+		pthread_mutex_lock( &s_guiThreadMutex );
+
+		// the GUI thread has to be done with this instance
+		pthread_mutex_lock( &s_instancesMutex );
 		m_guiExit = true;
+		pthread_mutex_unlock( &s_instancesMutex );
+		while( m_guiDone == false )
+		{
 #ifdef LMMS_BUILD_WIN32
-		Sleep( m_guiSleepTime * 2 );
+			Sleep( GuiSleepTime );
 #else
-		usleep( m_guiSleepTime * 2 * 1000 );
+			usleep( GuiSleepTime * 1000 );
 #endif
+		}
 
-		Nio::stop();
+		pthread_mutex_lock( &s_instancesMutex );
+		s_instances.remove( this );
+		const bool last = s_instances.empty();
+		if( last )
+		{
+			s_guiExit = true;
+		}
+		pthread_mutex_unlock( &s_instancesMutex );
+		if( last )
+		{
+			pthread_join( s_guiThreadHandle, NULL );
+			Nio::stop();
+		}
+
+		pthread_mutex_unlock( &s_guiThreadMutex );
+
+		pthread_mutex_destroy( &m_guiMutex );
 	}
 
 	virtual void updateSampleRate()
@@ -89,13 +126,35 @@ public:
 
 	void run()
 	{
-		message m;
-		while( ( m = receiveMessage() ).id != IdQuit )
+		while( processNextMessage() )
+		{
+		}
+	}
+
+	virtual bool processNextMessage()
+	{
+		const message m = receiveMessage();
+		if( m.id == IdQuit || m.id == IdUndefined )
+		{
+			return false;
+		}
+		// sample rate and buffer size belong to all instances in the
+		// process, so none of the others may be at work while they're
+		// changed
+		if( m.id == IdSampleRateInformation ||
+					m.id == IdBufferSizeInformation )
+		{
+			pthread_rwlock_wrlock( &s_globalsLock );
+		}
+		else
 		{
-			pthread_mutex_lock( &m_master->mutex );
-			processMessage( m );
-			pthread_mutex_unlock( &m_master->mutex );
+			pthread_rwlock_rdlock( &s_globalsLock );
 		}
+		pthread_mutex_lock( &m_master->mutex );
+		processMessage( m );
+		pthread_mutex_unlock( &m_master->mutex );
+		pthread_rwlock_unlock( &s_globalsLock );
+		return true;
 	}
 
 	virtual bool processMessage( const message & _m )
@@ -151,119 +210,199 @@ public:
 		LocalZynAddSubFx::processAudio( _out );
 	}
 
-	static void * guiThread( void * _arg )
-	{
-		RemoteZynAddSubFx * _this =
-					static_cast<RemoteZynAddSubFx *>( _arg );
-
-		_this->guiThread();
+	// FLTK may only be used from a single thread, which serves the user
+	// interfaces of all instances in the process
+	static void * guiThread( void * _arg );
 
-		return NULL;
-	}
+	// held for writing while the globals of ZynAddSubFx are changed and
+	// for reading while an instance works with them
+	static pthread_rwlock_t s_globalsLock;
 
 
 private:
-	void guiThread();
+	static const int GuiSleepTime = 100;
 
-	const int m_guiSleepTime;
+	// returns whether the instance has a user interface
+	bool updateGui();
+
+	static pthread_mutex_t s_guiThreadMutex;
+	static pthread_mutex_t s_instancesMutex;
+	static std::list<RemoteZynAddSubFx *> s_instances;
+	static pthread_t s_guiThreadHandle;
+	static bool s_guiExit;
+
+	MasterUI * m_ui;
+	int m_exitProgram;
 
-	pthread_t m_guiThreadHandle;
 	pthread_mutex_t m_guiMutex;
 	std::queue<RemotePluginClient::message> m_guiMessages;
 	bool m_guiExit;
+	volatile bool m_guiDone;
 
 } ;
 
 
+pthread_mutex_t RemoteZynAddSubFx::s_guiThreadMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t RemoteZynAddSubFx::s_instancesMutex = PTHREAD_MUTEX_INITIALIZER;
+std::list<RemoteZynAddSubFx *> RemoteZynAddSubFx::s_instances;
+pthread_t RemoteZynAddSubFx::s_guiThreadHandle;
+bool RemoteZynAddSubFx::s_guiExit = false;
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+// with many instances there's always one at work, which mustn't keep a new
+// one or a change of the sample rate waiting forever
+pthread_rwlock_t RemoteZynAddSubFx::s_globalsLock =
+			PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+#else
+pthread_rwlock_t RemoteZynAddSubFx::s_globalsLock = PTHREAD_RWLOCK_INITIALIZER;
+#endif
+
 
 
-void RemoteZynAddSubFx::guiThread()
-{
-	int exitProgram = 0;
-	MasterUI * ui = NULL;
 
-	while( !m_guiExit )
+void * RemoteZynAddSubFx::guiThread( void * )
+{
+	while( true )
 	{
-		if( ui )
+		bool haveUi = false;
+
+		// loading settings and presets works with the globals
+		pthread_rwlock_rdlock( &s_globalsLock );
+		pthread_mutex_lock( &s_instancesMutex );
+		if( s_guiExit )
+		{
+			pthread_mutex_unlock( &s_instancesMutex );
+			pthread_rwlock_unlock( &s_globalsLock );
+			break;
+		}
+		for( std::list<RemoteZynAddSubFx *>::iterator it =
+				s_instances.begin(); it != s_instances.end(); ++it )
 		{
-			Fl::wait( m_guiSleepTime / 1000.0 );
+			if( ( *it )->updateGui() )
+			{
+				haveUi = true;
+			}
+		}
+		pthread_mutex_unlock( &s_instancesMutex );
+		pthread_rwlock_unlock( &s_globalsLock );
+
+		if( haveUi )
+		{
+			Fl::wait( GuiSleepTime / 1000.0 );
 		}
 		else
 		{
 #ifdef LMMS_BUILD_WIN32
-			Sleep( m_guiSleepTime );
+			Sleep( GuiSleepTime );
 #else
-			usleep( m_guiSleepTime*1000 );
+			usleep( GuiSleepTime*1000 );
 #endif
 		}
-		if( exitProgram == 1 )
-		{
-			pthread_mutex_lock( &m_master->mutex );
-			sendMessage( IdHideUI );
-			exitProgram = 0;
-			pthread_mutex_unlock( &m_master->mutex );
-		}
-		pthread_mutex_lock( &m_guiMutex );
-		while( m_guiMessages.size() )
+	}
+	Fl::flush();
+
+	return NULL;
+}
+
+
+
+
+bool RemoteZynAddSubFx::updateGui()
+{
+	if( m_guiDone )
+	{
+		return false;
+	}
+
+	if( m_guiExit )
+	{
+		delete m_ui;
+		m_ui = NULL;
+		m_guiDone = true;
+		return false;
+	}
+
+	if( m_exitProgram == 1 )
+	{
+		pthread_mutex_lock( &m_master->mutex );
+		sendMessage( IdHideUI );
+		m_exitProgram = 0;
+		pthread_mutex_unlock( &m_master->mutex );
+	}
+	pthread_mutex_lock( &m_guiMutex );
+	while( m_guiMessages.size() )
+	{
+		RemotePluginClient::message m = m_guiMessages.front();
+		m_guiMessages.pop();
+		switch( m.id )
 		{
-			RemotePluginClient::message m = m_guiMessages.front();
-			m_guiMessages.pop();
-			switch( m.id )
-			{
-				case IdShowUI:
-					// we only create GUI
-					if( !ui )
-					{
-						Fl::scheme( "plastic" );
-						ui = new MasterUI( m_master, &exitProgram );
-					}
-					ui->showUI();
-					ui->refresh_master_ui();
-					break;
-
-				case IdLoadSettingsFromFile:
+			case IdShowUI:
+				// we only create GUI
+				if( !m_ui )
 				{
-					LocalZynAddSubFx::loadXML( m.getString() );
-					if( ui )
-					{
-						ui->refresh_master_ui();
-					}
-					pthread_mutex_lock( &m_master->mutex );
-					sendMessage( IdLoadSettingsFromFile );
-					pthread_mutex_unlock( &m_master->mutex );
-					break;
+					Fl::scheme( "plastic" );
+					m_ui = new MasterUI( m_master, &m_exitProgram );
 				}
+				m_ui->showUI();
+				m_ui->refresh_master_ui();
+				break;
 
-				case IdLoadPresetFile:
+			case IdLoadSettingsFromFile:
+			{
+				LocalZynAddSubFx::loadXML( m.getString() );
+				if( m_ui )
 				{
-					LocalZynAddSubFx::loadPreset( m.getString(), ui ?
-											ui->npartcounter->value()-1 : 0 );
-					if( ui )
-					{
-						ui->npartcounter->do_callback();
-						ui->updatepanel();
-						ui->refresh_master_ui();
-					}
-					pthread_mutex_lock( &m_master->mutex );
-					sendMessage( IdLoadPresetFile );
-					pthread_mutex_unlock( &m_master->mutex );
-					break;
+					m_ui->refresh_master_ui();
 				}
+				pthread_mutex_lock( &m_master->mutex );
+				sendMessage( IdLoadSettingsFromFile );
+				pthread_mutex_unlock( &m_master->mutex );
+				break;
+			}
 
-				default:
-					break;
+			case IdLoadPresetFile:
+			{
+				LocalZynAddSubFx::loadPreset( m.getString(), m_ui ?
+										m_ui->npartcounter->value()-1 : 0 );
+				if( m_ui )
+				{
+					m_ui->npartcounter->do_callback();
+					m_ui->updatepanel();
+					m_ui->refresh_master_ui();
+				}
+				pthread_mutex_lock( &m_master->mutex );
+				sendMessage( IdLoadPresetFile );
+				pthread_mutex_unlock( &m_master->mutex );
+				break;
 			}
+
+			default:
+				break;
 		}
-		pthread_mutex_unlock( &m_guiMutex );
 	}
-	Fl::flush();
+	pthread_mutex_unlock( &m_guiMutex );
 
-	delete ui;
+	return m_ui != NULL;
 }
 
 
 
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+static RemotePluginClient * createInstance( key_t _shm_in, key_t _shm_out )
+{
+	// a new instance sets up the globals and is told the sample rate and
+	// buffer size while being constructed
+	pthread_rwlock_wrlock( &RemoteZynAddSubFx::s_globalsLock );
+	RemotePluginClient * instance = new RemoteZynAddSubFx( _shm_in,
+								_shm_out );
+	pthread_rwlock_unlock( &RemoteZynAddSubFx::s_globalsLock );
+	return instance;
+}
+#endif
+
+
+
+
 int main( int _argc, char * * _argv )
 {
 #ifdef SYNC_WITH_SHM_FIFO
@@ -285,16 +424,30 @@ int main( int _argc, char * * _argv )
 #endif
 
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+	if( _argc >= 4 && strcmp( _argv[1], "--shared" ) == 0 )
+	{
+		// several instances in this process
+		RemotePluginClientHost * host = new RemotePluginClientHost(
+				atoi( _argv[2] ), atoi( _argv[3] ), createInstance );
+		host->run();
+		delete host;
+	}
+	else
+#endif
+	{
 #ifdef SYNC_WITH_SHM_FIFO
-	RemoteZynAddSubFx * remoteZASF =
-		new RemoteZynAddSubFx( atoi( _argv[1] ), atoi( _argv[2] ) );
+		RemoteZynAddSubFx * remoteZASF = new RemoteZynAddSubFx(
+					atoi( _argv[1] ), atoi( _argv[2] ) );
 #else
-	RemoteZynAddSubFx * remoteZASF = new RemoteZynAddSubFx( _argv[1] );
+		RemoteZynAddSubFx * remoteZASF =
+					new RemoteZynAddSubFx( _argv[1] );
 #endif
 
-	remoteZASF->run();
+		remoteZASF->run();
 
-	delete remoteZASF;
+		delete remoteZASF;
+	}
 
 
 #ifdef LMMS_BUILD_WIN32
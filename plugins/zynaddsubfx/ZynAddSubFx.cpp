@@ -73,7 +73,7 @@ Plugin::Descriptor PLUGIN_EXPORT zynaddsubfx_plugin_descriptor =
 ZynAddSubFxRemotePlugin::ZynAddSubFxRemotePlugin() :
 	RemotePlugin()
 {
-	init( "RemoteZynAddSubFx", false );
+	init( "RemoteZynAddSubFx", false, true );
 }
 
 
@@ -361,7 +361,7 @@ bool ZynAddSubFxInstrument::handleMidiEvent( const MidiEvent& event, const MidiT
 	}
 	else
 	{
-		m_plugin->processMidiEvent( localEvent );
+		m_plugin->processMidiEvent( localEvent, offset );
 	}
 	m_pluginMutex.unlock();
 
@@ -458,7 +458,10 @@ void ZynAddSubFxInstrument::initPlugin()
 	}
 	else
 	{
-		m_plugin = new LocalZynAddSubFx;
+		// optionally render on a thread of its own, one period ahead,
+		// so the mixer thread only has to copy the result
+		m_plugin = new LocalZynAddSubFx( ConfigManager::inst()->value(
+				"mixer", "zynaddsubfxrenderthread" ).toInt() );
 		m_plugin->setSampleRate( Engine::mixer()->processingSampleRate() );
 		m_plugin->setBufferSize( Engine::mixer()->framesPerPeriod() );
 	}
@@ -177,6 +177,14 @@ void ConfigManager::setWorkingDir( const QString & _wd )
 
 
 
+QString ConfigManager::cacheDir() const
+{
+	return ensureTrailingSlash( QFileInfo( m_lmmsRcFile ).absolutePath() );
+}
+
+
+
+
 void ConfigManager::setVSTDir( const QString & _vd )
 {
 	m_vstDir = ensureTrailingSlash( _vd );
@@ -267,7 +275,8 @@ void ConfigManager::addRecentlyOpenedProject( const QString & file )
 {
 	QFileInfo recentFile( file );
 	if( recentFile.suffix().toLower() == "mmp" ||
-			recentFile.suffix().toLower() == "mmpz" )
+			recentFile.suffix().toLower() == "mmpz" ||
+			recentFile.suffix().toLower() == "mmpb" )
 	{
 		m_recentlyOpenedProjects.removeAll( file );
 		if( m_recentlyOpenedProjects.size() > 50 )
@@ -26,13 +26,26 @@
 
 #include "DataFile.h"
 
+#include "lmmsconfig.h"
+
 #include <math.h>
 
+#ifdef LMMS_BUILD_WIN32
+#include <io.h>
+#endif
+
+#ifdef LMMS_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <QBuffer>
+#include <QDateTime>
 #include <QDebug>
 #include <QFile>
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QTextStream>
+#include <QXmlStreamReader>
 
 #include "base64.h"
 #include "ConfigManager.h"
@@ -40,9 +53,13 @@
 #include "GuiApplication.h"
 #include "lmmsversion.h"
 #include "PluginFactory.h"
+#include "ProjectContainer.h"
 #include "ProjectVersion.h"
+#include "SampleBuffer.h"
 #include "SongEditor.h"
 
+#include <zlib.h>
+
 
 
 
@@ -60,6 +77,151 @@ DataFile::typeDescStruct
 } ;
 
 
+// inflates data written by qCompress() while it is read, so compressed
+// projects can be parsed without holding them uncompressed in memory
+class InflatingDevice : public QIODevice
+{
+public:
+	InflatingDevice( QIODevice * _source ) :
+		m_source( _source ),
+		m_finished( false )
+	{
+		memset( &m_stream, 0, sizeof( m_stream ) );
+		// qCompress() prepends the uncompressed size
+		m_failed = _source->read( 4 ).size() != 4 ||
+					inflateInit( &m_stream ) != Z_OK;
+	}
+
+	virtual ~InflatingDevice()
+	{
+		inflateEnd( &m_stream );
+	}
+
+	virtual bool isSequential() const
+	{
+		return true;
+	}
+
+	virtual bool atEnd() const
+	{
+		return m_finished || m_failed;
+	}
+
+	bool failed() const
+	{
+		return m_failed;
+	}
+
+
+protected:
+	virtual qint64 readData( char * _data, qint64 _maxSize )
+	{
+		if( m_failed )
+		{
+			return -1;
+		}
+
+		m_stream.next_out = (Bytef *) _data;
+		m_stream.avail_out = _maxSize;
+		while( !m_finished && m_stream.avail_out == _maxSize )
+		{
+			if( m_stream.avail_in == 0 )
+			{
+				m_input = m_source->read( 65536 );
+				if( m_input.isEmpty() )
+				{
+					// truncated
+					m_failed = true;
+					return -1;
+				}
+				m_stream.next_in = (Bytef *) m_input.data();
+				m_stream.avail_in = m_input.size();
+			}
+
+			const int result = inflate( &m_stream, Z_NO_FLUSH );
+			if( result == Z_STREAM_END )
+			{
+				m_finished = true;
+			}
+			else if( result != Z_OK && result != Z_BUF_ERROR )
+			{
+				m_failed = true;
+				return -1;
+			}
+		}
+		return _maxSize - m_stream.avail_out;
+	}
+
+	virtual qint64 writeData( const char *, qint64 )
+	{
+		return -1;
+	}
+
+
+private:
+	QIODevice * m_source;
+	z_stream m_stream;
+	QByteArray m_input;
+	bool m_finished;
+	bool m_failed;
+
+} ;
+
+
+
+
+// elements and attributes holding embedded samples, see
+// SampleTCO::saveSettings() and audioFileProcessor::saveSettings()
+static const struct
+{
+	const char * element;
+	const char * attribute;
+} s_embeddedSamples[] =
+{
+	{ "sampletco", "data" },
+	{ "audiofileprocessor", "sampledata" }
+} ;
+
+
+static bool isEmbeddedSample( const QString & _element,
+						const QString & _attribute )
+{
+	const int count = sizeof( s_embeddedSamples ) /
+					sizeof( s_embeddedSamples[0] );
+	for( int i = 0; i < count; ++i )
+	{
+		if( _element == s_embeddedSamples[i].element &&
+				_attribute == s_embeddedSamples[i].attribute )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+// removes _file, which on Windows can't go away while a ProjectContainer
+// still maps it - its name is freed by moving it out of the way first
+static bool removeFile( const QString & _file )
+{
+#ifdef LMMS_BUILD_WIN32
+	const QString removed = QString( "%1.%2.removed" ).arg( _file ).
+			arg( QDateTime::currentDateTime().toMSecsSinceEpoch() );
+	if( QFile::rename( _file, removed ) == false )
+	{
+		return false;
+	}
+	QFile::remove( removed );
+	return true;
+#else
+	return QFile::remove( _file );
+#endif
+}
+
+
+
 
 DataFile::LocaleHelper::LocaleHelper( Mode mode )
 {
@@ -97,7 +259,9 @@ DataFile::DataFile( Type type ) :
 	QDomDocument( "lmms-project" ),
 	m_content(),
 	m_head(),
-	m_type( type )
+	m_type( type ),
+	m_sampleLocation(),
+	m_storedSamples()
 {
 	appendChild( createProcessingInstruction("xml", "version=\"1.0\""));
 	QDomElement root = createElement( "lmms-project" );
@@ -121,7 +285,9 @@ DataFile::DataFile( Type type ) :
 DataFile::DataFile( const QString & _fileName ) :
 	QDomDocument(),
 	m_content(),
-	m_head()
+	m_head(),
+	m_sampleLocation(),
+	m_storedSamples()
 {
 	QFile inFile( _fileName );
 	if( !inFile.open( QIODevice::ReadOnly ) )
@@ -140,7 +306,37 @@ DataFile::DataFile( const QString & _fileName ) :
 		return;
 	}
 
-	loadData( inFile.readAll(), _fileName );
+	const QByteArray head = inFile.peek( 16 );
+	if( ProjectContainer::isContainer( head ) )
+	{
+		inFile.close();
+		loadContainer( _fileName );
+		return;
+	}
+
+	// plain XML is parsed straight from the file instead of reading it
+	// into memory first, compressed files are inflated while parsing
+	QString errorMsg;
+	int line = -1, col = -1;
+	bool parsed;
+	if( isCompressed( head ) )
+	{
+		parsed = parseCompressed( inFile, &errorMsg, &line, &col );
+	}
+	else
+	{
+		QXmlStreamReader reader( &inFile );
+		parsed = parse( reader, &errorMsg, &line, &col );
+	}
+	if( !parsed )
+	{
+		// e.g. a compressed file starting with a line break
+		inFile.seek( 0 );
+		loadData( inFile.readAll(), _fileName );
+		return;
+	}
+
+	processDocument( _fileName );
 }
 
 
@@ -149,7 +345,9 @@ DataFile::DataFile( const QString & _fileName ) :
 DataFile::DataFile( const QByteArray & _data ) :
 	QDomDocument(),
 	m_content(),
-	m_head()
+	m_head(),
+	m_sampleLocation(),
+	m_storedSamples()
 {
 	loadData( _data, "<internal data>" );
 }
@@ -157,8 +355,40 @@ DataFile::DataFile( const QByteArray & _data ) :
 
 
 
+DataFile::DataFile( const DataFile & _other ) :
+	QDomDocument( _other ),
+	m_content( _other.m_content ),
+	m_head( _other.m_head ),
+	m_type( _other.m_type ),
+	m_sampleLocation(),
+	m_storedSamples()
+{
+	referenceStoredSamples( _other );
+}
+
+
+
+
 DataFile::~DataFile()
 {
+	releaseStoredSamples();
+}
+
+
+
+
+DataFile & DataFile::operator=( const DataFile & _other )
+{
+	if( this != &_other )
+	{
+		QDomDocument::operator=( _other );
+		m_content = _other.m_content;
+		m_head = _other.m_head;
+		m_type = _other.m_type;
+		releaseStoredSamples();
+		referenceStoredSamples( _other );
+	}
+	return *this;
 }
 
 
@@ -169,7 +399,8 @@ bool DataFile::validate( QString extension )
 	switch( m_type )
 	{
 	case Type::SongProject:
-		if( extension == "mmp" || extension == "mmpz" )
+		if( extension == "mmp" || extension == "mmpz" ||
+					extension == ProjectContainer::Extension )
 		{
 			return true;
 		}
@@ -188,6 +419,7 @@ bool DataFile::validate( QString extension )
 		break;
 	case Type::UnknownType:
 		if (! ( extension == "mmp" || extension == "mpt" || extension == "mmpz" ||
+				extension == ProjectContainer::Extension ||
 				extension == "xpf" || extension == "xml" ||
 				( extension == "xiz" && ! pluginFactory->pluginSupportingExtension(extension).isNull()) ||
 				extension == "sf2" || extension == "pat" || extension == "mid" ||
@@ -218,7 +450,9 @@ QString DataFile::nameWithExtension( const QString & _fn ) const
 		case SongProject:
 			if( _fn.section( '.', -1 ) != "mmp" &&
 					_fn.section( '.', -1 ) != "mpt" &&
-					_fn.section( '.', -1 ) != "mmpz" )
+					_fn.section( '.', -1 ) != "mmpz" &&
+					_fn.section( '.', -1 ) !=
+						ProjectContainer::Extension )
 			{
 				if( ConfigManager::inst()->value( "app",
 						"nommpz" ).toInt() == 0 )
@@ -256,13 +490,22 @@ void DataFile::write( QTextStream & _strm )
 		cleanMetaNodes( documentElement() );
 	}
 
+	QStringList references;
+	QList<QDomAttr> inlined = inlineSamples( &references );
+
 	save(_strm, 2);
+
+	// writing mustn't change the document
+	for( int i = 0; i < inlined.size(); ++i )
+	{
+		inlined[i].setValue( references[i] );
+	}
 }
 
 
 
 
-bool DataFile::writeFile( const QString& filename )
+bool DataFile::writeFile( const QString& filename, bool _showErrors )
 {
 	const QString fullName = nameWithExtension( filename );
 	const QString fullNameTemp = fullName + ".new";
@@ -272,7 +515,7 @@ bool DataFile::writeFile( const QString& filename )
 
 	if( !outfile.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
 	{
-		if( gui )
+		if( gui && _showErrors )
 		{
 			QMessageBox::critical( NULL,
 				SongEditor::tr( "Could not write file" ),
@@ -284,12 +527,26 @@ bool DataFile::writeFile( const QString& filename )
 		return false;
 	}
 
-	if( fullName.section( '.', -1 ) == "mmpz" )
+	if( fullName.section( '.', -1 ) == ProjectContainer::Extension )
+	{
+		// tells the samples apart from the ones of the file replaced
+		if( writeContainer( outfile,
+			ProjectContainer::generation( fullName ) + 1 ) == false )
+		{
+			outfile.remove();
+			return false;
+		}
+	}
+	else if( fullName.section( '.', -1 ) == "mmpz" )
 	{
-		QString xml;
-		QTextStream ts( &xml );
+		// serialize to UTF-8 right away instead of going through a
+		// QString of twice the size
+		QByteArray xml;
+		QTextStream ts( &xml, QIODevice::WriteOnly );
+		ts.setCodec( "UTF-8" );
 		write( ts );
-		outfile.write( qCompress( xml.toUtf8() ) );
+		ts.flush();
+		outfile.write( qCompress( xml ) );
 	}
 	else
 	{
@@ -297,30 +554,54 @@ bool DataFile::writeFile( const QString& filename )
 		write( ts );
 	}
 
+	// make sure the data is on disk before replacing the old file
+	outfile.flush();
+#ifdef LMMS_BUILD_WIN32
+	_commit( outfile.handle() );
+#else
+	fsync( outfile.handle() );
+#endif
 	outfile.close();
 
 	// make sure the file has been written correctly
-	if( QFileInfo( outfile.fileName() ).size() > 0 )
+	if( QFileInfo( outfile.fileName() ).size() <= 0 )
+	{
+		return false;
+	}
+
+	bool replaced = true;
+	if( QFile::exists( fullName ) )
 	{
 		if( ConfigManager::inst()->value( "app", "disablebackup" ).toInt() )
 		{
 			// remove current file
-			QFile::remove( fullName );
+			replaced = removeFile( fullName );
 		}
 		else
 		{
 			// remove old backup file
-			QFile::remove( fullNameBak );
+			removeFile( fullNameBak );
 			// move current file to backup file
-			QFile::rename( fullName, fullNameBak );
+			replaced = QFile::rename( fullName, fullNameBak );
 		}
-		// move temporary file to current file
-		QFile::rename( fullNameTemp, fullName );
-
-		return true;
+	}
+	// move temporary file to current file
+	if( !replaced || !QFile::rename( fullNameTemp, fullName ) )
+	{
+		// the new file is kept, so nothing is lost
+		if( gui && _showErrors )
+		{
+			QMessageBox::critical( NULL,
+				SongEditor::tr( "Could not write file" ),
+				SongEditor::tr( "Could not replace %1 with the "
+						"new version, which was saved "
+						"as %2 instead." ).
+					arg( fullName ).arg( fullNameTemp ) );
+		}
+		return false;
 	}
 
-	return false;
+	return true;
 }
 
 
@@ -909,20 +1190,181 @@ void DataFile::upgrade()
 
 
 
+bool DataFile::isCompressed( const QByteArray & _data )
+{
+	// XML starts with a tag, maybe preceded by a byte order mark or
+	// whitespace, while qCompress() prepends the uncompressed size
+	for( int i = 0; i < _data.size(); ++i )
+	{
+		const char c = _data[i];
+		if( c == '<' || c == '\xef' )
+		{
+			return false;
+		}
+		if( c != ' ' && c != '\t' && c != '\r' && c != '\n' )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+bool DataFile::parseCompressed( QIODevice & _in, QString * _errorMsg,
+							int * _line, int * _col )
+{
+	InflatingDevice inflater( &_in );
+	if( inflater.failed() || !inflater.open( QIODevice::ReadOnly ) )
+	{
+		*_errorMsg = "no compressed data";
+		*_line = *_col = 0;
+		return false;
+	}
+
+	QXmlStreamReader reader( &inflater );
+	if( !parse( reader, _errorMsg, _line, _col ) )
+	{
+		return false;
+	}
+	if( inflater.failed() )
+	{
+		*_errorMsg = "corrupt compressed data";
+		*_line = reader.lineNumber();
+		*_col = reader.columnNumber();
+		return false;
+	}
+	return true;
+}
+
+
+
+
+bool DataFile::parse( QXmlStreamReader & _reader, QString * _errorMsg,
+							int * _line, int * _col )
+{
+	clear();
+	releaseStoredSamples();
+
+	// builds the same tree QDomDocument::setContent() would, i.e.
+	// without whitespace-only text nodes
+	QDomNode parent;
+	while( !_reader.atEnd() )
+	{
+		QDomNode node;
+		switch( _reader.readNext() )
+		{
+			case QXmlStreamReader::StartElement:
+			{
+				const QString name =
+					_reader.qualifiedName().toString();
+				QDomElement element = createElement( name );
+				const QXmlStreamAttributes attributes =
+							_reader.attributes();
+				for( int i = 0; i < attributes.size(); ++i )
+				{
+					const QString attribute =
+						attributes[i].qualifiedName().toString();
+					const QStringRef value = attributes[i].value();
+					QString reference;
+					if( isEmbeddedSample( name, attribute ) )
+					{
+						// decoded from the reader's buffer,
+						// without a copy of the base64 data
+						reference = storeEmbeddedSample(
+							QString::fromRawData(
+								value.unicode(),
+								value.size() ) );
+					}
+					element.setAttribute( attribute,
+						reference.isEmpty() ?
+							value.toString() : reference );
+				}
+				node = element;
+				break;
+			}
+			case QXmlStreamReader::EndElement:
+				parent = parent.parentNode();
+				break;
+			case QXmlStreamReader::Characters:
+				if( _reader.isCDATA() )
+				{
+					node = createCDATASection(
+						_reader.text().toString() );
+				}
+				else if( !_reader.isWhitespace() )
+				{
+					node = createTextNode(
+						_reader.text().toString() );
+				}
+				break;
+			case QXmlStreamReader::Comment:
+				node = createComment( _reader.text().toString() );
+				break;
+			case QXmlStreamReader::ProcessingInstruction:
+				node = createProcessingInstruction(
+					_reader.processingInstructionTarget().toString(),
+					_reader.processingInstructionData().toString() );
+				break;
+			default:
+				break;
+		}
+
+		if( node.isNull() )
+		{
+			continue;
+		}
+		// the document itself only exists once the first node has
+		// been created
+		if( parent.isNull() )
+		{
+			parent = *this;
+		}
+		if( node.isElement() )
+		{
+			parent = parent.appendChild( node );
+		}
+		else
+		{
+			parent.appendChild( node );
+		}
+	}
+
+	if( _reader.hasError() )
+	{
+		*_errorMsg = _reader.errorString();
+		*_line = _reader.lineNumber();
+		*_col = _reader.columnNumber();
+		clear();
+		return false;
+	}
+
+	return !documentElement().isNull();
+}
+
+
+
+
 void DataFile::loadData( const QByteArray & _data, const QString & _sourceFile )
 {
 	QString errorMsg;
 	int line = -1, col = -1;
-	if( !setContent( _data, &errorMsg, &line, &col ) )
+	bool parsed = false;
+	if( isCompressed( _data ) == false )
+	{
+		QXmlStreamReader reader( _data );
+		parsed = parse( reader, &errorMsg, &line, &col );
+	}
+	if( !parsed )
 	{
 		// parsing failed? then try to uncompress data
-		QByteArray uncompressed = qUncompress( _data );
-		if( !uncompressed.isEmpty() )
+		QBuffer buffer;
+		buffer.setData( _data );
+		buffer.open( QIODevice::ReadOnly );
+		if( parseCompressed( buffer, &errorMsg, &line, &col ) )
 		{
-			if( setContent( uncompressed, &errorMsg, &line, &col ) )
-			{
-				line = col = -1;
-			}
+			line = col = -1;
 		}
 		if( line >= 0 && col >= 0 )
 		{
@@ -941,9 +1383,286 @@ void DataFile::loadData( const QByteArray & _data, const QString & _sourceFile )
 		}
 	}
 
+	processDocument( _sourceFile );
+}
+
+
+
+
+void DataFile::loadContainer( const QString & _fileName )
+{
+	QString errorMsg;
+	int line = -1, col = -1;
+	bool parsed = false;
+
+	ProjectContainer * container = ProjectContainer::open( _fileName );
+	QString location;
+	if( container != NULL )
+	{
+		location = container->location();
+		QXmlStreamReader reader( container->document() );
+		parsed = parse( reader, &errorMsg, &line, &col );
+	}
+	if( !parsed )
+	{
+		qWarning() << "at line" << line << "column" << errorMsg;
+		if( gui )
+		{
+			QMessageBox::critical( NULL,
+				SongEditor::tr( "Error in file" ),
+				SongEditor::tr( "The file %1 seems to contain "
+						"errors and therefore can't be "
+						"loaded." ).arg( _fileName ) );
+		}
+	}
+	if( container != NULL )
+	{
+		sharedObject::unref( container );
+	}
+	if( !parsed )
+	{
+		return;
+	}
+
+	// the samples stay in the file, so tell SampleBuffer where to find
+	// them
+	QList<QDomAttr> samples = embeddedSamples();
+	for( int i = 0; i < samples.size(); ++i )
+	{
+		int index;
+		QString sampleLocation;
+		if( ProjectContainer::parseReference( samples[i].value(),
+						&index, &sampleLocation ) &&
+						sampleLocation.isEmpty() )
+		{
+			samples[i].setValue(
+				ProjectContainer::reference( location, index ) );
+		}
+	}
+
+	processDocument( _fileName );
+}
+
+
+
+
+bool DataFile::writeContainer( QIODevice & _out, const quint32 _generation )
+{
+	QList<QDomAttr> samples = embeddedSamples();
+	QStringList values;
+	QList<QByteArray> chunks;
+	// samples of containers are written right from where SampleBuffer
+	// plays them
+	QList<const void *> acquired;
+
+	for( int i = 0; i < samples.size(); ++i )
+	{
+		const QString value = samples[i].value();
+		int index;
+		QString location;
+		SampleCache::Data data;
+		if( ProjectContainer::parseReference( value, &index, &location ) )
+		{
+			if( !location.isEmpty() && ProjectContainer::acquireSample(
+						location, index, &data ) )
+			{
+				chunks.push_back( QByteArray::fromRawData(
+					(const char *) data.data,
+					data.frames * sizeof( sampleFrame ) ) );
+				acquired.push_back( data.data );
+			}
+			else
+			{
+				chunks.push_back( QByteArray() );
+			}
+		}
+		else
+		{
+			char * decoded = NULL;
+			int size = 0;
+			base64::decode( value, &decoded, &size );
+			chunks.push_back( SampleBuffer::decodeEmbedded(
+						QByteArray( decoded, size ) ) );
+			delete[] decoded;
+		}
+
+		values.push_back( value );
+		samples[i].setValue( ProjectContainer::reference( i ) );
+	}
+
+	QString xml;
+	QTextStream ts( &xml );
+	write( ts );
+	ts.flush();
+
+	for( int i = 0; i < samples.size(); ++i )
+	{
+		samples[i].setValue( values[i] );
+	}
+
+	const bool written = ProjectContainer::write( _out, xml.toUtf8(),
+							chunks, _generation );
+
+	chunks.clear();
+	for( int i = 0; i < acquired.size(); ++i )
+	{
+		SampleCache::release( acquired[i] );
+	}
+
+	return written;
+}
+
+
+
+
+QList<QDomAttr> DataFile::inlineSamples( QStringList * _references )
+{
+	QList<QDomAttr> inlined;
+	QList<QDomAttr> samples = embeddedSamples();
+	for( int i = 0; i < samples.size(); ++i )
+	{
+		int index;
+		QString location;
+		if( ProjectContainer::parseReference( samples[i].value(),
+							&index, &location ) == false ||
+							location.isEmpty() )
+		{
+			continue;
+		}
+
+		SampleCache::Data data;
+		if( ProjectContainer::acquireSample( location, index, &data ) )
+		{
+			QString b64;
+			base64::encode( (const char *) data.data,
+					data.frames * sizeof( sampleFrame ), b64 );
+			_references->push_back( samples[i].value() );
+			inlined.push_back( samples[i] );
+			samples[i].setValue( b64 );
+			SampleCache::release( data.data );
+		}
+	}
+	return inlined;
+}
+
+
+
+
+QList<QDomAttr> DataFile::embeddedSamples()
+{
+	QList<QDomAttr> samples;
+	const int count = sizeof( s_embeddedSamples ) /
+					sizeof( s_embeddedSamples[0] );
+	for( int i = 0; i < count; ++i )
+	{
+		const QDomNodeList elements =
+			elementsByTagName( s_embeddedSamples[i].element );
+		for( int j = 0; j < elements.size(); ++j )
+		{
+			const QDomAttr attribute = elements.item( j ).toElement().
+				attributeNode( s_embeddedSamples[i].attribute );
+			if( !attribute.isNull() && !attribute.value().isEmpty() )
+			{
+				samples.push_back( attribute );
+			}
+		}
+	}
+	return samples;
+}
+
+
+
+
+QString DataFile::storeEmbeddedSample( const QString & _b64 )
+{
+	int index;
+	QString location;
+	if( _b64.isEmpty() ||
+		ProjectContainer::parseReference( _b64, &index, &location ) )
+	{
+		return QString();
+	}
+
+	const int size = base64::decodedSize( _b64 );
+	char * decoded = MM_ALLOC( char, size );
+	base64::decodeInto( _b64, decoded );
+	// FLAC unless converted from a binary project file, in which case
+	// the decoded data already are the frames
+	const QByteArray frames = SampleBuffer::decodeEmbedded(
+				QByteArray::fromRawData( decoded, size ) );
+
+	SampleCache::Data data;
+	data.frames = frames.size() / sizeof( sampleFrame );
+	data.format = SampleBuffer::FloatStorage;
+	data.channels = DEFAULT_CHANNELS;
+	if( data.frames == 0 )
+	{
+		MM_FREE( decoded );
+		return QString();
+	}
+	if( frames.constData() == decoded )
+	{
+		data.data = decoded;
+	}
+	else
+	{
+		data.data = MM_ALLOC( sampleFrame, data.frames );
+		memcpy( data.data, frames.constData(),
+					data.frames * sizeof( sampleFrame ) );
+		MM_FREE( decoded );
+	}
+
+	if( m_sampleLocation.isEmpty() )
+	{
+		m_sampleLocation = ProjectContainer::memoryLocation();
+	}
+	index = m_storedSamples.size();
+	ProjectContainer::insertSample( m_sampleLocation, index, &data );
+	m_storedSamples.push_back( data.data );
+
+	return ProjectContainer::reference( m_sampleLocation, index );
+}
+
+
+
+
+void DataFile::referenceStoredSamples( const DataFile & _other )
+{
+	m_sampleLocation = _other.m_sampleLocation;
+	for( int i = 0; i < _other.m_storedSamples.size(); ++i )
+	{
+		SampleCache::Data data;
+		if( ProjectContainer::acquireSample( m_sampleLocation, i,
+								&data ) )
+		{
+			m_storedSamples.push_back( data.data );
+		}
+	}
+}
+
+
+
+
+void DataFile::releaseStoredSamples()
+{
+	for( int i = 0; i < m_storedSamples.size(); ++i )
+	{
+		SampleCache::release( m_storedSamples[i] );
+	}
+	m_storedSamples.clear();
+	m_sampleLocation = QString();
+}
+
+
+
+
+void DataFile::processDocument( const QString & _sourceFile )
+{
 	QDomElement root = documentElement();
 	m_type = type( root.attribute( "type" ) );
-	m_head = root.elementsByTagName( "head" ).item( 0 ).toElement();
+	// head and content are children of the root, so there's no need to
+	// search the whole tree for them
+	m_head = root.firstChildElement( "head" );
 
 
 	if( root.hasAttribute( "creatorversion" ) )
@@ -981,7 +1700,6 @@ void DataFile::loadData( const QByteArray & _data, const QString & _sourceFile )
 		}
 	}
 
-	m_content = root.elementsByTagName( typeName( m_type ) ).
-							item( 0 ).toElement();
+	m_content = root.firstChildElement( typeName( m_type ) );
 }
 
@@ -33,6 +33,10 @@
 #include "ProjectJournal.h"
 #include "Plugin.h"
 #include "PluginFactory.h"
+#include "ProjectWriter.h"
+#include "SampleLoader.h"
+#include "SamplePeaks.h"
+#include "SampleStream.h"
 #include "Song.h"
 #include "BandLimitedWave.h"
 
@@ -59,6 +63,7 @@ void LmmsCore::init( bool renderOnly )
 	BandLimitedWave::generateWaves();
 
 	emit engine->initProgress(tr("Initializing data structures"));
+	ProjectWriter::init();
 	s_projectJournal = new ProjectJournal;
 	s_mixer = new Mixer( renderOnly );
 	s_song = new Song;
@@ -73,6 +78,8 @@ void LmmsCore::init( bool renderOnly )
 	s_mixer->initDevices();
 
 	PresetPreviewPlayHandle::init();
+	SampleStreamer::init();
+	SampleLoader::init();
 	s_dummyTC = new DummyTrackContainer;
 
 	emit engine->initProgress(tr("Launching mixer threads"));
@@ -84,6 +91,7 @@ void LmmsCore::init( bool renderOnly )
 
 void LmmsCore::destroy()
 {
+	ProjectWriter::cleanup();
 	s_projectJournal->stopAllJournalling();
 	s_mixer->stopProcessing();
 
@@ -91,6 +99,10 @@ void LmmsCore::destroy()
 
 	s_song->clearProject();
 
+	SampleLoader::cleanup();
+	SampleStreamer::cleanup();
+	SamplePeaks::cleanup();
+
 	deleteHelper( &s_bbTrackContainer );
 	deleteHelper( &s_dummyTC );
 
@@ -36,52 +36,7 @@ extern const float SECS_PER_ENV_SEGMENT = 5.0f;
 extern const float SECS_PER_LFO_OSCILLATION = 20.0f;
 
 
-EnvelopeAndLfoParameters::LfoInstances * EnvelopeAndLfoParameters::s_lfoInstances = NULL;
-
-
-void EnvelopeAndLfoParameters::LfoInstances::trigger()
-{
-	QMutexLocker m( &m_lfoListMutex );
-	for( LfoList::Iterator it = m_lfos.begin();
-							it != m_lfos.end(); ++it )
-	{
-		( *it )->m_lfoFrame +=
-				Engine::mixer()->framesPerPeriod();
-		( *it )->m_bad_lfoShapeData = true;
-	}
-}
-
-
-
-
-void EnvelopeAndLfoParameters::LfoInstances::reset()
-{
-	QMutexLocker m( &m_lfoListMutex );
-	for( LfoList::Iterator it = m_lfos.begin();
-							it != m_lfos.end(); ++it )
-	{
-		( *it )->m_lfoFrame = 0;
-		( *it )->m_bad_lfoShapeData = true;
-	}
-}
-
-
-
-
-void EnvelopeAndLfoParameters::LfoInstances::add( EnvelopeAndLfoParameters * lfo )
-{
-	QMutexLocker m( &m_lfoListMutex );
-	m_lfos.append( lfo );
-}
-
-
-
-
-void EnvelopeAndLfoParameters::LfoInstances::remove( EnvelopeAndLfoParameters * lfo )
-{
-	QMutexLocker m( &m_lfoListMutex );
-	m_lfos.removeAll( lfo );
-}
+f_cnt_t EnvelopeAndLfoParameters::s_lfoFrame = 0;
 
 
 
@@ -114,20 +69,14 @@ EnvelopeAndLfoParameters::EnvelopeAndLfoParameters(
 	m_lfoWaveModel( SineWave, 0, NumLfoShapes, this, tr( "LFO Wave Shape" ) ),
 	m_x100Model( false, this, tr( "Freq x 100" ) ),
 	m_controlEnvAmountModel( false, this, tr( "Modulate Env-Amount" ) ),
-	m_lfoFrame( 0 ),
+	m_lfoShapeFrame( -1 ),
+	m_lfoShapeUpdating( 0 ),
 	m_lfoAmountIsZero( false ),
 	m_lfoShapeData( NULL )
 {
 	m_amountModel.setCenterValue( 0 );
 	m_lfoAmountModel.setCenterValue( 0 );
 
-	if( s_lfoInstances == NULL )
-	{
-		s_lfoInstances = new LfoInstances();
-	}
-
-	instances()->add( this );
-
 	connect( &m_predelayModel, SIGNAL( dataChanged() ),
 			this, SLOT( updateSampleVars() ) );
 	connect( &m_attackModel, SIGNAL( dataChanged() ),
@@ -188,22 +137,15 @@ EnvelopeAndLfoParameters::~EnvelopeAndLfoParameters()
 	delete[] m_pahdEnv;
 	delete[] m_rEnv;
 	delete[] m_lfoShapeData;
-
-	instances()->remove( this );
-
-	if( instances()->isEmpty() )
-	{
-		delete instances();
-		s_lfoInstances = NULL;
-	}
 }
 
 
 
 
-inline sample_t EnvelopeAndLfoParameters::lfoShapeSample( fpp_t _frame_offset )
+inline sample_t EnvelopeAndLfoParameters::lfoShapeSample( f_cnt_t _lfo_frame,
+							fpp_t _frame_offset )
 {
-	f_cnt_t frame = ( m_lfoFrame + _frame_offset ) % m_lfoOscillationFrames;
+	f_cnt_t frame = ( _lfo_frame + _frame_offset ) % m_lfoOscillationFrames;
 	const float phase = frame / static_cast<float>(
 						m_lfoOscillationFrames );
 	sample_t shape_sample;
@@ -239,14 +181,15 @@ inline sample_t EnvelopeAndLfoParameters::lfoShapeSample( fpp_t _frame_offset )
 
 
 
-void EnvelopeAndLfoParameters::updateLfoShapeData()
+void EnvelopeAndLfoParameters::updateLfoShapeData( f_cnt_t _lfo_frame )
 {
 	const fpp_t frames = Engine::mixer()->framesPerPeriod();
 	for( fpp_t offset = 0; offset < frames; ++offset )
 	{
-		m_lfoShapeData[offset] = lfoShapeSample( offset );
+		m_lfoShapeData[offset] = lfoShapeSample( _lfo_frame, offset );
 	}
-	m_bad_lfoShapeData = false;
+	// readers only look at the data once it's complete
+	m_lfoShapeFrame.fetchAndStoreRelease( _lfo_frame );
 }
 
 
@@ -266,9 +209,20 @@ inline void EnvelopeAndLfoParameters::fillLfoLevel( float * _buf,
 	}
 	_frame -= m_lfoPredelayFrames;
 
-	if( m_bad_lfoShapeData )
+	// shape data is only valid for the period it was calculated in - the
+	// notes of a track are rendered concurrently, so the first one getting
+	// here calculates it and the others wait until it's published
+	const f_cnt_t lfoFrame = s_lfoFrame;
+	while( m_lfoShapeFrame != lfoFrame )
 	{
-		updateLfoShapeData();
+		if( m_lfoShapeUpdating.testAndSetAcquire( 0, 1 ) )
+		{
+			if( m_lfoShapeFrame != lfoFrame )
+			{
+				updateLfoShapeData( lfoFrame );
+			}
+			m_lfoShapeUpdating.fetchAndStoreRelease( 0 );
+		}
 	}
 
 	fpp_t offset = 0;
@@ -529,7 +483,7 @@ void EnvelopeAndLfoParameters::updateSampleVars()
 		m_lfoAmountIsZero = false;
 	}
 
-	m_bad_lfoShapeData = true;
+	m_lfoShapeFrame.fetchAndStoreOrdered( -1 );
 
 	emit dataChanged();
 
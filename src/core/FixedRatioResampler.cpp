@@ -0,0 +1,344 @@
+/*
+ * FixedRatioResampler.cpp - fast resampler for constant pitch playback
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "FixedRatioResampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <samplerate.h>
+
+#include <QtCore/QtGlobal>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "lmms_constants.h"
+
+
+namespace
+{
+
+const int ZeroCrossings = FixedRatioResampler::SincZeroCrossings;
+const int Taps = 2 * ZeroCrossings;
+// table resolution between two zero crossings
+const int Phases = 64;
+// slightly below nyquist so the transition band doesn't alias
+const double Cutoff = 0.94;
+const double KaiserBeta = 8.6;
+
+
+double besselI0( const double _x )
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for( int k = 1; k < 32; ++k )
+	{
+		term *= ( _x / ( 2.0 * k ) ) * ( _x / ( 2.0 * k ) );
+		sum += term;
+	}
+	return sum;
+}
+
+
+
+
+// kaiser windowed sinc, _x in input frames
+double windowedSinc( const double _x )
+{
+	if( fabs( _x ) >= ZeroCrossings )
+	{
+		return 0.0;
+	}
+	const double t = _x / ZeroCrossings;
+	const double window = besselI0( KaiserBeta * sqrt( 1.0 - t * t ) ) /
+							besselI0( KaiserBeta );
+	const double x = Cutoff * _x * D_PI;
+	return Cutoff * ( x == 0.0 ? 1.0 : sin( x ) / x ) * window;
+}
+
+
+
+
+struct SincTables
+{
+	SincTables()
+	{
+		// row p holds the taps for an output frame lying p/Phases
+		// behind an input frame, tap j belongs to the input frame
+		// j - ZeroCrossings + 1 frames away from it
+		for( int p = 0; p <= Phases; ++p )
+		{
+			for( int j = 0; j < Taps; ++j )
+			{
+				polyphase[p][j] = windowedSinc( j - ZeroCrossings + 1 -
+							(double) p / Phases );
+			}
+		}
+		for( int i = 0; i < ZeroCrossings * Phases + 2; ++i )
+		{
+			kernel[i] = windowedSinc( (double) i / Phases );
+		}
+	}
+
+	float polyphase[Phases + 1][Taps];
+	// one side of the filter, used when decimating
+	float kernel[ZeroCrossings * Phases + 2];
+
+} ;
+
+const SincTables s_tables;
+
+}
+
+
+
+
+FixedRatioResampler::FixedRatioResampler()
+{
+	reset();
+}
+
+
+
+
+bool FixedRatioResampler::supports( const double _ratio, const int _mode )
+{
+	switch( _mode )
+	{
+		case SRC_ZERO_ORDER_HOLD:
+		case SRC_LINEAR:
+			return true;
+		// the filter is about as good as libsamplerate's fastest sinc
+		// mode, the better ones are left to libsamplerate
+		case SRC_SINC_FASTEST:
+			return _ratio <= MaxDecimation;
+		default:
+			return false;
+	}
+}
+
+
+
+
+f_cnt_t FixedRatioResampler::lookahead( const double _ratio, const int _mode )
+{
+	switch( _mode )
+	{
+		case SRC_ZERO_ORDER_HOLD:
+			return 0;
+		case SRC_LINEAR:
+			return 1;
+		default:
+			return static_cast<f_cnt_t>( ceil( ZeroCrossings *
+						qMax( 1.0, _ratio ) ) );
+	}
+}
+
+
+
+
+f_cnt_t FixedRatioResampler::process( const sampleFrame * _in,
+				sampleFrame * _out, const fpp_t _frames,
+				const double _ratio, const int _mode )
+{
+	if( _mode == SRC_ZERO_ORDER_HOLD || _mode == SRC_LINEAR )
+	{
+		double pos = m_position;
+		for( fpp_t i = 0; i < _frames; ++i )
+		{
+			const f_cnt_t n = static_cast<f_cnt_t>( pos );
+			if( _mode == SRC_LINEAR )
+			{
+				const float frac = pos - n;
+				_out[i][0] = _in[n][0] + frac * ( _in[n + 1][0] -
+								_in[n][0] );
+				_out[i][1] = _in[n][1] + frac * ( _in[n + 1][1] -
+								_in[n][1] );
+			}
+			else
+			{
+				_out[i][0] = _in[n][0];
+				_out[i][1] = _in[n][1];
+			}
+			pos += _ratio;
+		}
+		const f_cnt_t used = static_cast<f_cnt_t>( pos );
+		m_position = pos - used;
+		return used;
+	}
+
+	if( _ratio <= 1.0 )
+	{
+		processSinc( _in, _out, _frames, _ratio );
+	}
+	else
+	{
+		processSincDecimating( _in, _out, _frames, _ratio );
+	}
+
+	const double end = m_position + _frames * _ratio;
+	const f_cnt_t used = static_cast<f_cnt_t>( end );
+	m_position = end - used;
+	updateHistory( _in, used );
+	return used;
+}
+
+
+
+
+void FixedRatioResampler::reset()
+{
+	m_position = 0;
+	memset( m_history, 0, sizeof( m_history ) );
+}
+
+
+
+
+void FixedRatioResampler::processSinc( const sampleFrame * _in,
+					sampleFrame * _out, const fpp_t _frames,
+					const double _ratio )
+{
+	sampleFrame window[Taps];
+	double pos = m_position;
+
+	for( fpp_t i = 0; i < _frames; ++i, pos += _ratio )
+	{
+		const f_cnt_t n = static_cast<f_cnt_t>( pos );
+		const double phase = ( pos - n ) * Phases;
+		const int p = static_cast<int>( phase );
+		const float frac = phase - p;
+		const float * c0 = s_tables.polyphase[p];
+		const float * c1 = s_tables.polyphase[p + 1];
+
+		// the first outputs reach back into the previous period
+		const f_cnt_t first = n - ZeroCrossings + 1;
+		const sampleFrame * src = _in + first;
+		if( first < 0 )
+		{
+			for( int j = 0; j < Taps; ++j )
+			{
+				const f_cnt_t idx = first + j;
+				const sampleFrame & f = idx < 0 ?
+					m_history[HistoryFrames + idx] : _in[idx];
+				window[j][0] = f[0];
+				window[j][1] = f[1];
+			}
+			src = window;
+		}
+
+#ifdef __SSE__
+		// interpolate between two phases, then multiply each tap with
+		// the left and right sample of its frame at once
+		const __m128 f = _mm_set1_ps( frac );
+		__m128 acc = _mm_setzero_ps();
+		for( int j = 0; j < Taps; j += 4 )
+		{
+			const __m128 a = _mm_loadu_ps( c0 + j );
+			const __m128 b = _mm_loadu_ps( c1 + j );
+			const __m128 c = _mm_add_ps( a, _mm_mul_ps( f,
+							_mm_sub_ps( b, a ) ) );
+			acc = _mm_add_ps( acc, _mm_mul_ps( _mm_unpacklo_ps( c, c ),
+						_mm_loadu_ps( src[j] ) ) );
+			acc = _mm_add_ps( acc, _mm_mul_ps( _mm_unpackhi_ps( c, c ),
+						_mm_loadu_ps( src[j + 2] ) ) );
+		}
+		acc = _mm_add_ps( acc, _mm_movehl_ps( acc, acc ) );
+		_mm_storel_pi( (__m64 *) _out[i], acc );
+#else
+		float left = 0.0f;
+		float right = 0.0f;
+		for( int j = 0; j < Taps; ++j )
+		{
+			const float c = c0[j] + frac * ( c1[j] - c0[j] );
+			left += c * src[j][0];
+			right += c * src[j][1];
+		}
+		_out[i][0] = left;
+		_out[i][1] = right;
+#endif
+	}
+}
+
+
+
+
+void FixedRatioResampler::processSincDecimating( const sampleFrame * _in,
+					sampleFrame * _out, const fpp_t _frames,
+					const double _ratio )
+{
+	// stretch the filter so its cutoff follows the output's nyquist
+	const float scale = 1.0 / _ratio;
+	const int reach = static_cast<int>( ceil( ZeroCrossings * _ratio ) );
+	const float end = ZeroCrossings * Phases;
+	double pos = m_position;
+
+	for( fpp_t i = 0; i < _frames; ++i, pos += _ratio )
+	{
+		const f_cnt_t n = static_cast<f_cnt_t>( pos );
+		const float frac = pos - n;
+		float left = 0.0f;
+		float right = 0.0f;
+		for( int k = -reach + 1; k <= reach; ++k )
+		{
+			const float x = fabsf( ( k - frac ) * scale ) * Phases;
+			if( x >= end )
+			{
+				continue;
+			}
+			const int ix = static_cast<int>( x );
+			const float c = s_tables.kernel[ix] + ( x - ix ) *
+				( s_tables.kernel[ix + 1] - s_tables.kernel[ix] );
+			const f_cnt_t idx = n + k;
+			const sampleFrame & f = idx < 0 ?
+					m_history[HistoryFrames + idx] : _in[idx];
+			left += c * f[0];
+			right += c * f[1];
+		}
+		_out[i][0] = left * scale;
+		_out[i][1] = right * scale;
+	}
+}
+
+
+
+
+void FixedRatioResampler::updateHistory( const sampleFrame * _in,
+							const f_cnt_t _used )
+{
+	if( _used >= HistoryFrames )
+	{
+		memcpy( m_history, _in + _used - HistoryFrames,
+					HistoryFrames * sizeof( sampleFrame ) );
+	}
+	else if( _used > 0 )
+	{
+		memmove( m_history, m_history + _used,
+				( HistoryFrames - _used ) * sizeof( sampleFrame ) );
+		memcpy( m_history + HistoryFrames - _used, _in,
+					_used * sizeof( sampleFrame ) );
+	}
+}
@@ -0,0 +1,297 @@
+/*
+ * HalfBandDecimator.cpp - decimation of oversampled output by powers of two
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "HalfBandDecimator.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <QtCore/QtGlobal>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "lmms_constants.h"
+
+
+namespace
+{
+
+// filter of the last stage, which has to pass everything up to 20 kHz and
+// block from 24.1 kHz on at a final rate of 44.1 kHz
+const int LongPairs = 32;
+// filter of the stages before, which only have to keep out what the
+// following stages can't take care of anymore
+const int ShortPairs = 8;
+// about 90 dB stopband attenuation
+const double KaiserBeta = 9.0;
+
+
+double besselI0( const double _x )
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for( int k = 1; k < 32; ++k )
+	{
+		term *= ( _x / ( 2.0 * k ) ) * ( _x / ( 2.0 * k ) );
+		sum += term;
+	}
+	return sum;
+}
+
+
+
+
+struct HalfBandTables
+{
+	HalfBandTables()
+	{
+		design( longFilter, LongPairs );
+		design( shortFilter, ShortPairs );
+	}
+
+	// a half-band filter is a windowed sinc with its cutoff at half the
+	// nyquist, whose taps at even distances from the centre are 0 - only
+	// the ones at odd distances are stored, from the farthest before the
+	// centre to the farthest after it
+	static void design( float * _coeffs, const int _pairs )
+	{
+		double taps[LongPairs];
+		double sum = 0.0;
+		for( int k = 0; k < _pairs; ++k )
+		{
+			const int n = 2 * k + 1;
+			const double t = (double) n / ( 2 * _pairs );
+			const double window = besselI0( KaiserBeta *
+						sqrt( 1.0 - t * t ) ) /
+							besselI0( KaiserBeta );
+			taps[k] = sin( n * D_PI / 2 ) / ( n * D_PI ) * window;
+			sum += taps[k];
+		}
+
+		// together with the centre tap of 0.5 the gain is 1 at DC
+		for( int k = 0; k < _pairs; ++k )
+		{
+			_coeffs[_pairs - 1 - k] = taps[k] * 0.25 / sum;
+			_coeffs[_pairs + k] = taps[k] * 0.25 / sum;
+		}
+	}
+
+	float longFilter[2 * LongPairs];
+	float shortFilter[2 * ShortPairs];
+
+} ;
+
+const HalfBandTables s_tables;
+
+}
+
+
+
+
+HalfBandDecimator::HalfBandDecimator( const fpp_t _maxFrames ) :
+	m_maxFrames( _maxFrames ),
+	m_stages( 0 )
+{
+	// what's left over from the last call plus the new frames
+	const int size = m_maxFrames / 2 + 2 * LongPairs + 2;
+	for( int s = 0; s < MaxStages; ++s )
+	{
+		m_stage[s].pairs = LongPairs;
+		m_stage[s].coeffs = s_tables.longFilter;
+		m_stage[s].even = new surroundSampleFrame[size];
+		m_stage[s].odd = new surroundSampleFrame[size];
+	}
+	for( int s = 0; s < MaxStages - 1; ++s )
+	{
+		m_temp[s] = new surroundSampleFrame[m_maxFrames / 2 + 2];
+	}
+
+	reset();
+}
+
+
+
+
+HalfBandDecimator::~HalfBandDecimator()
+{
+	for( int s = 0; s < MaxStages; ++s )
+	{
+		delete[] m_stage[s].even;
+		delete[] m_stage[s].odd;
+	}
+	for( int s = 0; s < MaxStages - 1; ++s )
+	{
+		delete[] m_temp[s];
+	}
+}
+
+
+
+
+bool HalfBandDecimator::supports( const int _ratio )
+{
+	return _ratio == 2 || _ratio == 4 || _ratio == 8;
+}
+
+
+
+
+void HalfBandDecimator::setRatio( const int _ratio )
+{
+	m_stages = 0;
+	while( ( 1 << m_stages ) < _ratio && m_stages < MaxStages )
+	{
+		++m_stages;
+	}
+
+	for( int s = 0; s < m_stages; ++s )
+	{
+		const bool last = s == m_stages - 1;
+		m_stage[s].pairs = last ? LongPairs : ShortPairs;
+		m_stage[s].coeffs = last ? s_tables.longFilter :
+							s_tables.shortFilter;
+	}
+
+	reset();
+}
+
+
+
+
+fpp_t HalfBandDecimator::process( const surroundSampleFrame * _in,
+				surroundSampleFrame * _out, const fpp_t _frames )
+{
+	if( m_stages == 0 )
+	{
+		memcpy( _out, _in, _frames * sizeof( surroundSampleFrame ) );
+		return _frames;
+	}
+
+	const surroundSampleFrame * src = _in;
+	fpp_t frames = _frames;
+	for( int s = 0; s < m_stages; ++s )
+	{
+		surroundSampleFrame * dst = s == m_stages - 1 ? _out :
+								m_temp[s];
+		frames = processStage( m_stage[s], src, dst, frames );
+		src = dst;
+	}
+
+	return frames;
+}
+
+
+
+
+void HalfBandDecimator::reset()
+{
+	for( int s = 0; s < MaxStages; ++s )
+	{
+		// the filter starts out on silence - enough of it for every
+		// even frame to give an output right away, so the stage
+		// always outputs half of what it gets
+		Stage & stage = m_stage[s];
+		stage.evenFrames = stage.pairs - 1;
+		stage.oddFrames = 2 * stage.pairs - 1;
+		memset( stage.even, 0, stage.evenFrames *
+					sizeof( surroundSampleFrame ) );
+		memset( stage.odd, 0, stage.oddFrames *
+					sizeof( surroundSampleFrame ) );
+		stage.oddNext = false;
+	}
+}
+
+
+
+
+fpp_t HalfBandDecimator::processStage( Stage & _stage,
+					const surroundSampleFrame * _in,
+					surroundSampleFrame * _out,
+					const fpp_t _frames )
+{
+	for( fpp_t f = 0; f < _frames; ++f )
+	{
+		memcpy( _stage.oddNext ? _stage.odd[_stage.oddFrames++] :
+					_stage.even[_stage.evenFrames++],
+				_in[f], sizeof( surroundSampleFrame ) );
+		_stage.oddNext = !_stage.oddNext;
+	}
+
+	// output frame m is centred on even frame m and needs the odd
+	// frames m - pairs to m + pairs - 1
+	const int taps = 2 * _stage.pairs;
+	const int frames = qMin( _stage.evenFrames, _stage.oddFrames - taps + 1 );
+	if( frames <= 0 )
+	{
+		return 0;
+	}
+
+	// as the odd frames of neighbouring outputs are neighbours as well,
+	// the filter can run over the samples of all channels alike
+	const float * even = _stage.even[0];
+	const float * odd = _stage.odd[0];
+	const float * coeffs = _stage.coeffs;
+	float * out = _out[0];
+	const int samples = frames * SURROUND_CHANNELS;
+	int i = 0;
+
+#ifdef __SSE__
+	const __m128 half = _mm_set1_ps( 0.5f );
+	for( ; i + 4 <= samples; i += 4 )
+	{
+		__m128 acc = _mm_mul_ps( half, _mm_loadu_ps( even + i ) );
+		const float * src = odd + i;
+		for( int j = 0; j < taps; ++j, src += SURROUND_CHANNELS )
+		{
+			acc = _mm_add_ps( acc, _mm_mul_ps(
+						_mm_set1_ps( coeffs[j] ),
+						_mm_loadu_ps( src ) ) );
+		}
+		_mm_storeu_ps( out + i, acc );
+	}
+#endif
+
+	for( ; i < samples; ++i )
+	{
+		float acc = 0.5f * even[i];
+		const float * src = odd + i;
+		for( int j = 0; j < taps; ++j, src += SURROUND_CHANNELS )
+		{
+			acc += coeffs[j] * *src;
+		}
+		out[i] = acc;
+	}
+
+	// keep what the next outputs need
+	_stage.evenFrames -= frames;
+	memmove( _stage.even, _stage.even + frames,
+			_stage.evenFrames * sizeof( surroundSampleFrame ) );
+	_stage.oddFrames -= frames;
+	memmove( _stage.odd, _stage.odd + frames,
+			_stage.oddFrames * sizeof( surroundSampleFrame ) );
+
+	return frames;
+}
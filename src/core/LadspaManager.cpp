@@ -25,6 +25,7 @@
  */
 
 #include <QCoreApplication>
+#include <QDataStream>
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
@@ -35,6 +36,7 @@
 #include "ConfigManager.h"
 #include "LadspaManager.h"
 #include "PluginFactory.h"
+#include "PluginIndex.h"
 
 
 
@@ -57,6 +59,8 @@ LadspaManager::LadspaManager()
 	ladspaDirectories.push_back( "/Library/Audio/Plug-Ins/LADSPA" );
 #endif
 
+	PluginIndex index( ".lmmsladspa.cache" );
+
 	for( QStringList::iterator it = ladspaDirectories.begin(); 
 			 		   it != ladspaDirectories.end(); ++it )
 	{
@@ -78,25 +82,31 @@ LadspaManager::LadspaManager()
 				continue;
 			}
 
-			QLibrary plugin_lib( f.absoluteFilePath() );
-
-			if( plugin_lib.load() == true )
+			QByteArray description = index.lookup( f );
+			if( description.isEmpty() )
 			{
+				QLibrary plugin_lib( f.absoluteFilePath() );
+
+				if( plugin_lib.load() == false )
+				{
+					qWarning() << plugin_lib.errorString();
+					continue;
+				}
+
+				// also remembers libraries without plug-ins, so
+				// they aren't loaded again
 				LADSPA_Descriptor_Function descriptorFunction =
 			( LADSPA_Descriptor_Function ) plugin_lib.resolve(
 							"ladspa_descriptor" );
-				if( descriptorFunction != NULL )
-				{
-					addPlugins( descriptorFunction,
-							f.fileName() );
-				}
-			}
-			else
-			{
-				qWarning() << plugin_lib.errorString();
+				description = describePlugins( descriptorFunction );
+				index.store( f, description );
 			}
+
+			addPlugins( description, f );
 		}
 	}
+
+	index.save();
 	
 	l_ladspa_key_t keys = m_ladspaManagerMap.keys();
 	for( l_ladspa_key_t::iterator it = keys.begin();
@@ -138,17 +148,92 @@ ladspaManagerDescription * LadspaManager::getDescription(
 
 
 
-void LadspaManager::addPlugins(
-		LADSPA_Descriptor_Function _descriptor_func,
-						const QString & _file )
+QByteArray LadspaManager::describePlugins(
+		LADSPA_Descriptor_Function _descriptor_func )
 {
-	const LADSPA_Descriptor * descriptor;
+	QList<const LADSPA_Descriptor *> descriptors;
+	if( _descriptor_func != NULL )
+	{
+		const LADSPA_Descriptor * descriptor;
+		while( ( descriptor = _descriptor_func(
+					descriptors.size() ) ) != NULL )
+		{
+			descriptors.push_back( descriptor );
+		}
+	}
 
-	for( long pluginIndex = 0;
-		( descriptor = _descriptor_func( pluginIndex ) ) != NULL;
-								++pluginIndex )
+	QByteArray description;
+	QDataStream stream( &description, QIODevice::WriteOnly );
+	stream << (quint32) descriptors.size();
+	for( int i = 0; i < descriptors.size(); ++i )
 	{
-		ladspa_key_t key( _file, QString( descriptor->Label ) );
+		const LADSPA_Descriptor * descriptor = descriptors[i];
+		stream << QString( descriptor->Label ) <<
+				QString( descriptor->Name ) <<
+				QString( descriptor->Maker ) <<
+				QString( descriptor->Copyright ) <<
+				(qint32) descriptor->Properties <<
+				getPluginInputs( descriptor ) <<
+				getPluginOutputs( descriptor );
+
+		stream << (quint32) descriptor->PortCount;
+		for( unsigned long port = 0; port < descriptor->PortCount;
+									++port )
+		{
+			const LADSPA_PortRangeHint & hint =
+					descriptor->PortRangeHints[port];
+			stream << (qint32) descriptor->PortDescriptors[port] <<
+				(qint32) hint.HintDescriptor <<
+				hint.LowerBound << hint.UpperBound <<
+				QString( descriptor->PortNames[port] );
+		}
+	}
+
+	return description;
+}
+
+
+
+
+void LadspaManager::addPlugins( const QByteArray & _description,
+						const QFileInfo & _file )
+{
+	QDataStream stream( _description );
+	quint32 count = 0;
+	stream >> count;
+
+	for( quint32 pluginIndex = 0; pluginIndex < count; ++pluginIndex )
+	{
+		QString label;
+		QString name;
+		QString maker;
+		QString copyright;
+		qint32 properties = 0;
+		uint16_t inputChannels = 0;
+		uint16_t outputChannels = 0;
+		quint32 portCount = 0;
+		stream >> label >> name >> maker >> copyright >> properties >>
+				inputChannels >> outputChannels >> portCount;
+
+		QList<ladspaManagerPortDescription> ports;
+		for( quint32 port = 0; port < portCount &&
+				stream.status() == QDataStream::Ok; ++port )
+		{
+			ladspaManagerPortDescription p;
+			qint32 descriptor = 0;
+			qint32 hints = 0;
+			stream >> descriptor >> hints >> p.lowerBound >>
+						p.upperBound >> p.name;
+			p.descriptor = descriptor;
+			p.hints = hints;
+			ports.push_back( p );
+		}
+		if( stream.status() != QDataStream::Ok )
+		{
+			break;
+		}
+
+		ladspa_key_t key( _file.fileName(), label );
 		if( m_ladspaManagerMap.contains( key ) )
 		{
 			continue;
@@ -156,10 +241,17 @@ void LadspaManager::addPlugins(
 
 		ladspaManagerDescription * plugIn = 
 				new ladspaManagerDescription;
-		plugIn->descriptorFunction = _descriptor_func;
+		plugIn->descriptorFunction = NULL;
+		plugIn->library = _file.absoluteFilePath();
 		plugIn->index = pluginIndex;
-		plugIn->inputChannels = getPluginInputs( descriptor );
-		plugIn->outputChannels = getPluginOutputs( descriptor );
+		plugIn->inputChannels = inputChannels;
+		plugIn->outputChannels = outputChannels;
+		plugIn->label = label;
+		plugIn->name = name;
+		plugIn->maker = maker;
+		plugIn->copyright = copyright;
+		plugIn->properties = properties;
+		plugIn->ports = ports;
 
 		if( plugIn->inputChannels == 0 && plugIn->outputChannels > 0 )
 		{
@@ -187,6 +279,53 @@ void LadspaManager::addPlugins(
 
 
 
+static const LADSPA_Descriptor * noDescriptors( unsigned long )
+{
+	return NULL;
+}
+
+
+
+
+LADSPA_Descriptor_Function LadspaManager::loadLibrary(
+				ladspaManagerDescription * _plugin )
+{
+	if( _plugin->descriptorFunction == NULL )
+	{
+		QLibrary plugin_lib( _plugin->library );
+		_plugin->descriptorFunction =
+			( LADSPA_Descriptor_Function ) plugin_lib.resolve(
+							"ladspa_descriptor" );
+		if( _plugin->descriptorFunction == NULL )
+		{
+			// the library was described by the index, but can't
+			// be used anymore, e.g. because of a missing
+			// dependency - getDescriptor() returns NULL then and
+			// we don't try again
+			qWarning() << plugin_lib.errorString();
+			_plugin->descriptorFunction = noDescriptors;
+		}
+	}
+	return _plugin->descriptorFunction;
+}
+
+
+
+
+const ladspaManagerPortDescription * LadspaManager::getPort(
+				const ladspa_key_t & _plugin, uint32_t _port )
+{
+	ladspaManagerDescription * plugIn = getDescription( _plugin );
+	if( plugIn == NULL || _port >= (uint32_t) plugIn->ports.size() )
+	{
+		return( NULL );
+	}
+	return( &plugIn->ports.at( _port ) );
+}
+
+
+
+
 uint16_t LadspaManager::getPluginInputs(
 		const LADSPA_Descriptor * _descriptor )
 {
@@ -251,12 +390,7 @@ QString LadspaManager::getLabel( const ladspa_key_t & _plugin )
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor = 
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( QString( descriptor->Label ) );
+		return( m_ladspaManagerMap[_plugin]->label );
 	}
 	else
 	{
@@ -272,12 +406,8 @@ bool LadspaManager::hasRealTimeDependency(
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( LADSPA_IS_REALTIME( descriptor->Properties ) );
+		return( LADSPA_IS_REALTIME(
+				m_ladspaManagerMap[_plugin]->properties ) );
 	}
 	else
 	{
@@ -292,12 +422,8 @@ bool LadspaManager::isInplaceBroken( const ladspa_key_t &  _plugin )
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( LADSPA_IS_INPLACE_BROKEN( descriptor->Properties ) );
+		return( LADSPA_IS_INPLACE_BROKEN(
+				m_ladspaManagerMap[_plugin]->properties ) );
 	}
 	else
 	{
@@ -313,12 +439,8 @@ bool LadspaManager::isRealTimeCapable(
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( LADSPA_IS_HARD_RT_CAPABLE( descriptor->Properties ) );
+		return( LADSPA_IS_HARD_RT_CAPABLE(
+				m_ladspaManagerMap[_plugin]->properties ) );
 	}
 	else
 	{
@@ -333,12 +455,7 @@ QString LadspaManager::getName( const ladspa_key_t & _plugin )
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( QString( descriptor->Name ) );
+		return( m_ladspaManagerMap[_plugin]->name );
 	}
 	else
 	{
@@ -353,12 +470,7 @@ QString LadspaManager::getMaker( const ladspa_key_t & _plugin )
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( QString( descriptor->Maker ) );
+		return( m_ladspaManagerMap[_plugin]->maker );
 	}
 	else
 	{
@@ -373,12 +485,7 @@ QString LadspaManager::getCopyright( const ladspa_key_t & _plugin )
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( QString( descriptor->Copyright ) );
+		return( m_ladspaManagerMap[_plugin]->copyright );
 	}
 	else
 	{
@@ -393,12 +500,7 @@ uint32_t LadspaManager::getPortCount( const ladspa_key_t & _plugin )
 {
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		return( descriptor->PortCount );
+		return( m_ladspaManagerMap[_plugin]->ports.size() );
 	}
 	else
 	{
@@ -412,22 +514,8 @@ uint32_t LadspaManager::getPortCount( const ladspa_key_t & _plugin )
 bool LadspaManager::isPortInput( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		&& _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		
-		return( LADSPA_IS_PORT_INPUT
-				( descriptor->PortDescriptors[_port] ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_PORT_INPUT( port->descriptor ) );
 }
 
 
@@ -436,22 +524,8 @@ bool LadspaManager::isPortInput( const ladspa_key_t & _plugin,
 bool LadspaManager::isPortOutput( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		
-		return( LADSPA_IS_PORT_OUTPUT
-				( descriptor->PortDescriptors[_port] ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_PORT_OUTPUT( port->descriptor ) );
 }
 
 
@@ -460,22 +534,8 @@ bool LadspaManager::isPortOutput( const ladspa_key_t & _plugin,
 bool LadspaManager::isPortAudio( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		
-		return( LADSPA_IS_PORT_AUDIO
-				( descriptor->PortDescriptors[_port] ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_PORT_AUDIO( port->descriptor ) );
 }
 
 
@@ -484,47 +544,19 @@ bool LadspaManager::isPortAudio( const ladspa_key_t & _plugin,
 bool LadspaManager::isPortControl( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		
-		return( LADSPA_IS_PORT_CONTROL
-				( descriptor->PortDescriptors[_port] ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_PORT_CONTROL( port->descriptor ) );
 }
 
 
 
 
 bool LadspaManager::areHintsSampleRateDependent(
-						const ladspa_key_t & _plugin, 
+						const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		LADSPA_PortRangeHintDescriptor hintDescriptor =
-			descriptor->PortRangeHints[_port].HintDescriptor;
-		return( LADSPA_IS_HINT_SAMPLE_RATE ( hintDescriptor ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_HINT_SAMPLE_RATE( port->hints ) );
 }
 
 
@@ -533,24 +565,10 @@ bool LadspaManager::areHintsSampleRateDependent(
 float LadspaManager::getLowerBound( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	if( port != NULL && LADSPA_IS_HINT_BOUNDED_BELOW( port->hints ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		LADSPA_PortRangeHintDescriptor hintDescriptor =
-			descriptor->PortRangeHints[_port].HintDescriptor;
-		if( LADSPA_IS_HINT_BOUNDED_BELOW( hintDescriptor ) )
-		{
-			return( descriptor->PortRangeHints[_port].LowerBound );
-		}
-		else
-		{
-			return( NOHINT );
-		}
+		return( port->lowerBound );
 	}
 	else
 	{
@@ -561,26 +579,13 @@ float LadspaManager::getLowerBound( const ladspa_key_t & _plugin,
 
 
 
-float LadspaManager::getUpperBound( const ladspa_key_t & _plugin,									uint32_t _port )
+float LadspaManager::getUpperBound( const ladspa_key_t & _plugin,
+								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	if( port != NULL && LADSPA_IS_HINT_BOUNDED_ABOVE( port->hints ) )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		LADSPA_PortRangeHintDescriptor hintDescriptor =
-			descriptor->PortRangeHints[_port].HintDescriptor;
-		if( LADSPA_IS_HINT_BOUNDED_ABOVE( hintDescriptor ) )
-		{
-			return( descriptor->PortRangeHints[_port].UpperBound );
-		}
-		else
-		{
-			return( NOHINT );
-		}
+		return( port->upperBound );
 	}
 	else
 	{
@@ -594,22 +599,8 @@ float LadspaManager::getUpperBound( const ladspa_key_t & _plugin,									uint32
 bool LadspaManager::isPortToggled( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		LADSPA_PortRangeHintDescriptor hintDescriptor =
-			descriptor->PortRangeHints[_port].HintDescriptor;
-		return( LADSPA_IS_HINT_TOGGLED( hintDescriptor ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_HINT_TOGGLED( port->hints ) );
 }
 
 
@@ -618,84 +609,64 @@ bool LadspaManager::isPortToggled( const ladspa_key_t & _plugin,
 float LadspaManager::getDefaultSetting( const ladspa_key_t & _plugin,
 							uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	if( port == NULL )
 	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		LADSPA_PortRangeHintDescriptor hintDescriptor =
-			descriptor->PortRangeHints[_port].HintDescriptor;
-		switch( hintDescriptor & LADSPA_HINT_DEFAULT_MASK ) 
-		{
-			case LADSPA_HINT_DEFAULT_NONE:
-				return( NOHINT );
-			case LADSPA_HINT_DEFAULT_MINIMUM:
-				return( descriptor->PortRangeHints[_port].
-								LowerBound );
-			case LADSPA_HINT_DEFAULT_LOW:
-				if( LADSPA_IS_HINT_LOGARITHMIC
-							( hintDescriptor ) )
-				{
-					return( exp( log( descriptor->PortRangeHints[_port].LowerBound ) 
-						* 0.75
-						+ log( descriptor->PortRangeHints[_port].UpperBound ) 
-						* 0.25 ) );
-				}
-				else 
-				{
-					return( descriptor->PortRangeHints[_port].LowerBound
-						* 0.75
-						+ descriptor->PortRangeHints[_port].UpperBound
-						* 0.25 );
-				}
-			case LADSPA_HINT_DEFAULT_MIDDLE:
-				if( LADSPA_IS_HINT_LOGARITHMIC
-						( hintDescriptor ) ) 
-				{
-					return( sqrt( descriptor->PortRangeHints[_port].LowerBound
-						* descriptor->PortRangeHints[_port].UpperBound ) );
-				}
-				else 
-				{
-					return( 0.5 * ( descriptor->PortRangeHints[_port].LowerBound
-							+ descriptor->PortRangeHints[_port].UpperBound ) );
-				}
-			case LADSPA_HINT_DEFAULT_HIGH:
-				if( LADSPA_IS_HINT_LOGARITHMIC
-						( hintDescriptor ) ) 
-				{
-					return( exp( log( descriptor->PortRangeHints[_port].LowerBound ) 
-						* 0.25
-						+ log( descriptor->PortRangeHints[_port].UpperBound ) 
-						* 0.75 ) );
-				}
-				else 
-				{
-					return( descriptor->PortRangeHints[_port].LowerBound
-						* 0.25
-						+ descriptor->PortRangeHints[_port].UpperBound
-						* 0.75 );
-				}
-			case LADSPA_HINT_DEFAULT_MAXIMUM:
-				return( descriptor->PortRangeHints[_port].UpperBound );
-			case LADSPA_HINT_DEFAULT_0:
-				return( 0.0 );
-			case LADSPA_HINT_DEFAULT_1:
-				return( 1.0 );
-			case LADSPA_HINT_DEFAULT_100:
-				return( 100.0 );
-			case LADSPA_HINT_DEFAULT_440:
-				return( 440.0 );
-			default:
-				return( NOHINT );
-		}
+		return( NOHINT );
 	}
-	else
+
+	const LADSPA_PortRangeHintDescriptor hintDescriptor = port->hints;
+	switch( hintDescriptor & LADSPA_HINT_DEFAULT_MASK )
 	{
-		return( NOHINT );
+		case LADSPA_HINT_DEFAULT_NONE:
+			return( NOHINT );
+		case LADSPA_HINT_DEFAULT_MINIMUM:
+			return( port->lowerBound );
+		case LADSPA_HINT_DEFAULT_LOW:
+			if( LADSPA_IS_HINT_LOGARITHMIC( hintDescriptor ) )
+			{
+				return( exp( log( port->lowerBound ) * 0.75
+					+ log( port->upperBound ) * 0.25 ) );
+			}
+			else
+			{
+				return( port->lowerBound * 0.75
+					+ port->upperBound * 0.25 );
+			}
+		case LADSPA_HINT_DEFAULT_MIDDLE:
+			if( LADSPA_IS_HINT_LOGARITHMIC( hintDescriptor ) )
+			{
+				return( sqrt( port->lowerBound
+						* port->upperBound ) );
+			}
+			else
+			{
+				return( 0.5 * ( port->lowerBound
+						+ port->upperBound ) );
+			}
+		case LADSPA_HINT_DEFAULT_HIGH:
+			if( LADSPA_IS_HINT_LOGARITHMIC( hintDescriptor ) )
+			{
+				return( exp( log( port->lowerBound ) * 0.25
+					+ log( port->upperBound ) * 0.75 ) );
+			}
+			else
+			{
+				return( port->lowerBound * 0.25
+					+ port->upperBound * 0.75 );
+			}
+		case LADSPA_HINT_DEFAULT_MAXIMUM:
+			return( port->upperBound );
+		case LADSPA_HINT_DEFAULT_0:
+			return( 0.0 );
+		case LADSPA_HINT_DEFAULT_1:
+			return( 1.0 );
+		case LADSPA_HINT_DEFAULT_100:
+			return( 100.0 );
+		case LADSPA_HINT_DEFAULT_440:
+			return( 440.0 );
+		default:
+			return( NOHINT );
 	}
 }
 
@@ -705,22 +676,8 @@ float LadspaManager::getDefaultSetting( const ladspa_key_t & _plugin,
 bool LadspaManager::isLogarithmic( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		LADSPA_PortRangeHintDescriptor hintDescriptor =
-			descriptor->PortRangeHints[_port].HintDescriptor;
-		return( LADSPA_IS_HINT_LOGARITHMIC( hintDescriptor ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_HINT_LOGARITHMIC( port->hints ) );
 }
 
 
@@ -729,22 +686,8 @@ bool LadspaManager::isLogarithmic( const ladspa_key_t & _plugin,
 bool LadspaManager::isInteger( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) 
-		   && _port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-		LADSPA_PortRangeHintDescriptor hintDescriptor =
-			descriptor->PortRangeHints[_port].HintDescriptor;
-		return( LADSPA_IS_HINT_INTEGER( hintDescriptor ) );
-	}
-	else
-	{
-		return( false );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL && LADSPA_IS_HINT_INTEGER( port->hints ) );
 }
 
 
@@ -753,21 +696,8 @@ bool LadspaManager::isInteger( const ladspa_key_t & _plugin,
 QString LadspaManager::getPortName( const ladspa_key_t & _plugin,
 								uint32_t _port )
 {
-	if( m_ladspaManagerMap.contains( _plugin ) &&
-					_port < getPortCount( _plugin ) )
-	{
-		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
-		const LADSPA_Descriptor * descriptor =
-				descriptorFunction(
-					m_ladspaManagerMap[_plugin]->index );
-
-		return( QString( descriptor->PortNames[_port] ) );
-	}
-	else
-	{
-		return( QString( "" ) );
-	}
+	const ladspaManagerPortDescription * port = getPort( _plugin, _port );
+	return( port != NULL ? port->name : QString( "" ) );
 }
 
 
@@ -779,11 +709,12 @@ const void * LadspaManager::getImplementationData(
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		return( descriptor->ImplementationData );
+		return( descriptor != NULL ?
+				descriptor->ImplementationData : NULL );
 	}
 	else
 	{
@@ -800,7 +731,7 @@ const LADSPA_Descriptor * LadspaManager::getDescriptor(
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
@@ -822,17 +753,17 @@ LADSPA_Handle LadspaManager::instantiate(
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		return( ( descriptor->instantiate )
+		if( descriptor != NULL )
+		{
+			return( ( descriptor->instantiate )
 						( descriptor, _sample_rate ) );
+		}
 	}
-	else
-	{
-		return( NULL );
-	}
+	return( NULL );
 }
 
 
@@ -847,11 +778,11 @@ bool LadspaManager::connectPort( const ladspa_key_t & _plugin,
 		&& _port < getPortCount( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		if( descriptor->connect_port != NULL )
+		if( descriptor != NULL && descriptor->connect_port != NULL )
 		{
 			( descriptor->connect_port )
 					( _instance, _port, _data_location );
@@ -870,11 +801,11 @@ bool LadspaManager::activate( const ladspa_key_t & _plugin,
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		if( descriptor->activate != NULL )
+		if( descriptor != NULL && descriptor->activate != NULL )
 		{
 			( descriptor->activate ) ( _instance );
 			return( true );
@@ -893,11 +824,11 @@ bool LadspaManager::run( const ladspa_key_t & _plugin,
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		if( descriptor->run != NULL )
+		if( descriptor != NULL && descriptor->run != NULL )
 		{
 			( descriptor->run ) ( _instance, _sample_count );
 			return( true );
@@ -916,11 +847,11 @@ bool LadspaManager::runAdding( const ladspa_key_t & _plugin,
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		if( descriptor->run_adding != NULL &&
+		if( descriptor != NULL && descriptor->run_adding != NULL &&
 			  	descriptor->set_run_adding_gain != NULL )
 		{
 			( descriptor->run_adding ) ( _instance, _sample_count );
@@ -940,11 +871,11 @@ bool LadspaManager::setRunAddingGain( const ladspa_key_t & _plugin,
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		if( descriptor->run_adding != NULL &&
+		if( descriptor != NULL && descriptor->run_adding != NULL &&
 				  descriptor->set_run_adding_gain != NULL )
 		{
 			( descriptor->set_run_adding_gain )
@@ -964,11 +895,11 @@ bool LadspaManager::deactivate( const ladspa_key_t & _plugin,
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		if( descriptor->deactivate != NULL )
+		if( descriptor != NULL && descriptor->deactivate != NULL )
 		{
 			( descriptor->deactivate ) ( _instance );
 			return( true );
@@ -986,11 +917,11 @@ bool LadspaManager::cleanup( const ladspa_key_t & _plugin,
 	if( m_ladspaManagerMap.contains( _plugin ) )
 	{
 		LADSPA_Descriptor_Function descriptorFunction =
-			m_ladspaManagerMap[_plugin]->descriptorFunction;
+			loadLibrary( m_ladspaManagerMap[_plugin] );
 		const LADSPA_Descriptor * descriptor =
 				descriptorFunction(
 					m_ladspaManagerMap[_plugin]->index );
-		if( descriptor->cleanup != NULL )
+		if( descriptor != NULL && descriptor->cleanup != NULL )
 		{
 			( descriptor->cleanup ) ( _instance );
 			return( true );
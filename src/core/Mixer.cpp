@@ -32,6 +32,7 @@
 #include "NotePlayHandle.h"
 #include "Engine.h"
 #include "ConfigManager.h"
+#include "SampleBuffer.h"
 #include "SamplePlayHandle.h"
 #include "GuiApplication.h"
 #include "PianoRoll.h"
@@ -57,6 +58,7 @@
 #include "MidiDummy.h"
 
 #include "MemoryHelper.h"
+#include "MidiPort.h"
 #include "BufferManager.h"
 
 
@@ -75,12 +77,17 @@ Mixer::Mixer( bool renderOnly ) :
 	m_audioDev( NULL ),
 	m_oldAudioDev( NULL ),
 	m_audioDevStartFailed( false ),
+	m_midiPorts(),
+	m_midiClock(),
+	m_midiPeriodStart( -1 ),
 	m_profiler(),
 	m_metronomeActive(false),
 	m_changesSignal( false ),
 	m_waitForMixer( true ),
 	m_changes( 0 ),
-	m_doChangesMutex( QMutex::Recursive )
+	m_doChangesMutex( QMutex::Recursive ),
+	m_latencies(),
+	m_latencyMutex()
 {
 	for( int i = 0; i < 2; ++i )
 	{
@@ -90,6 +97,8 @@ Mixer::Mixer( bool renderOnly ) :
 		BufferManager::clear( m_inputBuffer[i], m_inputBufferSize[i] );
 	}
 
+	m_midiClock.start();
+
 	// determine FIFO size and number of frames per period
 	int fifoSize = 1;
 
@@ -148,6 +157,10 @@ Mixer::Mixer( bool renderOnly ) :
 	m_poolDepth = 2;
 	m_readBuffer = 0;
 	m_writeBuffer = 1;
+
+	SampleBuffer::reserveResamplers(
+				m_qualitySettings.libsrcInterpolation() );
+	SampleBuffer::reserveScratchBuffers( m_framesPerPeriod );
 }
 
 
@@ -203,7 +216,7 @@ void Mixer::initDevices()
 
 void Mixer::startProcessing( bool _needs_fifo )
 {
-	if( _needs_fifo )
+	if( _needs_fifo && m_audioDev->rendersInCallback() == false )
 	{
 		m_fifoWriter = new fifoWriter( this, m_fifo );
 		m_fifoWriter->start( QThread::HighPriority );
@@ -290,6 +303,44 @@ bool Mixer::criticalXRuns() const
 
 
 
+void Mixer::reportLatency( const void * _source, const f_cnt_t _frames )
+{
+	m_latencyMutex.lock();
+	const f_cnt_t before = m_latencies.value( _source, 0 );
+	if( _frames > 0 )
+	{
+		m_latencies[_source] = _frames;
+	}
+	else
+	{
+		m_latencies.remove( _source );
+	}
+	m_latencyMutex.unlock();
+
+	if( before != _frames )
+	{
+		emit latencyChanged();
+	}
+}
+
+
+
+
+f_cnt_t Mixer::latency() const
+{
+	QMutexLocker lock( &m_latencyMutex );
+	f_cnt_t frames = 0;
+	for( QMap<const void *, f_cnt_t>::const_iterator it =
+			m_latencies.begin(); it != m_latencies.end(); ++it )
+	{
+		frames = qMax( frames, it.value() );
+	}
+	return frames;
+}
+
+
+
+
 void Mixer::pushInputFrames( sampleFrame * _ab, const f_cnt_t _frames )
 {
 	lockInputFrames();
@@ -402,6 +453,9 @@ const surroundSampleFrame * Mixer::renderNextBuffer()
 	// create play-handles for new notes, samples etc.
 	song->processNextBuffer();
 
+	// and for notes played live
+	dispatchMidiInput();
+
 	// add all play-handles that have to be added
 	m_playHandleMutex.lock();
 	m_playHandles += m_newPlayHandles;
@@ -454,7 +508,7 @@ const surroundSampleFrame * Mixer::renderNextBuffer()
 	runChangesInModel();
 
 	// and trigger LFOs
-	EnvelopeAndLfoParameters::instances()->trigger();
+	EnvelopeAndLfoParameters::advanceLfoFrame( m_framesPerPeriod );
 	Controller::triggerFrameCounter();
 	AutomatableModel::incrementPeriodCounter();
 
@@ -521,6 +575,7 @@ void Mixer::changeQuality( const struct qualitySettings & _qs )
 
 	m_qualitySettings = _qs;
 	m_audioDev->applyQualitySettings();
+	SampleBuffer::reserveResamplers( _qs.libsrcInterpolation() );
 
 	emit sampleRateChanged();
 	emit qualitySettingsChanged();
@@ -616,6 +671,58 @@ void Mixer::removeAudioPort( AudioPort * _port )
 }
 
 
+void Mixer::removeMidiPort( MidiPort * _port )
+{
+	requestChangeInModel();
+	QVector<MidiPort *>::Iterator it = qFind( m_midiPorts.begin(),
+							m_midiPorts.end(),
+							_port );
+	if( it != m_midiPorts.end() )
+	{
+		m_midiPorts.erase( it );
+	}
+	doneChangeInModel();
+}
+
+
+
+
+void Mixer::dispatchMidiInput()
+{
+	// events are placed into the periods on a clock which advances by
+	// one period length per period and follows real time by one and a
+	// half periods, so the timing between them is kept no matter how
+	// irregularly the periods are rendered
+	const qint64 now = midiClock();
+	const qint64 length = (qint64) m_framesPerPeriod * 1000000 /
+							processingSampleRate();
+	if( m_midiPeriodStart < 0 || now - m_midiPeriodStart > 3 * length )
+	{
+		// first period or after having been held up for a while
+		m_midiPeriodStart = now - length - length / 2;
+	}
+
+	if( m_midiPeriodStart + length > now )
+	{
+		// rendering ahead of time, e.g. while filling the FIFO - the
+		// events of this period haven't been received yet
+		return;
+	}
+
+	const qint64 begin = m_midiPeriodStart;
+	m_midiPeriodStart += length;
+
+	for( QVector<MidiPort *>::ConstIterator it = m_midiPorts.begin();
+						it != m_midiPorts.end(); ++it )
+	{
+		( *it )->dispatchInEvents( begin, begin + length,
+							m_framesPerPeriod );
+	}
+}
+
+
+
+
 bool Mixer::addPlayHandle( PlayHandle* handle )
 {
 	if( criticalXRuns() == false )
@@ -96,7 +96,8 @@ Plugin * Plugin::instantiate( const QString& pluginName, Model * parent,
 								void * data )
 {
 	const PluginFactory::PluginInfo& pi = pluginFactory->pluginInfo(pluginName.toUtf8());
-	if( pi.isNull() )
+	// the library of the plugin might not be loaded yet
+	if( pi.isNull() || pluginFactory->load( pi ) == false )
 	{
 		if( gui )
 		{
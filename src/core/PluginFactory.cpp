@@ -24,13 +24,17 @@
 
 #include "PluginFactory.h"
 
+#include <QtCore/QBuffer>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
 #include <QtCore/QFileInfo>
 #include <QtCore/QLibrary>
 
+#include "embed.h"
 #include "Plugin.h"
+#include "PluginIndex.h"
 
 #ifdef LMMS_BUILD_WIN32
 	QStringList nameFilters("*.dll");
@@ -40,7 +44,98 @@
 
 PluginFactory* PluginFactory::s_instance = nullptr;
 
-PluginFactory::PluginFactory()
+namespace
+{
+
+enum IndexEntryTypes
+{
+	HelperEntry, // a library without plugins
+	PluginEntry
+};
+
+bool haveGui()
+{
+	// logos can't be rendered without one
+	return QCoreApplication::instance()->inherits("QApplication");
+}
+
+// The logo of a plugin whose library isn't loaded, as saved in the index
+class IndexedPixmapLoader : public PixmapLoader
+{
+public:
+	IndexedPixmapLoader(const QString& name, const QByteArray& image) :
+		PixmapLoader(name),
+		m_image(image)
+	{
+	}
+
+	QPixmap pixmap() const override
+	{
+		QPixmap pixmap;
+		pixmap.loadFromData(m_image, "PNG");
+		return pixmap;
+	}
+
+private:
+	QByteArray m_image;
+};
+
+QByteArray helperEntry()
+{
+	QByteArray entry;
+	QDataStream stream(&entry, QIODevice::WriteOnly);
+	stream << (quint8) HelperEntry;
+	return entry;
+}
+
+QByteArray pluginEntry(const Plugin::Descriptor* desc)
+{
+	QByteArray image;
+	if (desc->logo != nullptr && haveGui())
+	{
+		QBuffer buffer(&image);
+		buffer.open(QIODevice::WriteOnly);
+		desc->logo->pixmap().save(&buffer, "PNG");
+	}
+
+	QByteArray entry;
+	QDataStream stream(&entry, QIODevice::WriteOnly);
+	stream << (quint8) PluginEntry
+		<< QByteArray(desc->name) << QByteArray(desc->displayName)
+		<< QByteArray(desc->description) << QByteArray(desc->author)
+		<< (qint32) desc->version << (qint32) desc->type
+		<< QByteArray(desc->supportedFileTypes)
+		<< (desc->logo != nullptr)
+		<< (desc->logo != nullptr ? desc->logo->pixmapName() : QString())
+		<< image
+		<< (desc->subPluginFeatures != nullptr);
+	return entry;
+}
+
+const char* indexedString(const QByteArray& string)
+{
+	return string.isNull() ? nullptr : string.constData();
+}
+
+}
+
+/// A descriptor restored from the plugin index, along with the data it points to
+struct PluginFactory::IndexedPlugin
+{
+	IndexedPlugin() : logo(nullptr) {}
+	~IndexedPlugin() { delete logo; }
+
+	QByteArray name;
+	QByteArray displayName;
+	QByteArray description;
+	QByteArray author;
+	QByteArray supportedFileTypes;
+	PixmapLoader* logo;
+	Plugin::Descriptor descriptor;
+};
+
+PluginFactory::PluginFactory() :
+	m_index(new PluginIndex(".lmmsplugins.cache"))
 {
 	// Adds a search path relative to the main executable to if the path exists.
 	auto addRelativeIfExists = [this] (const QString& path) {
@@ -76,7 +171,8 @@ PluginFactory::PluginFactory()
 
 PluginFactory::~PluginFactory()
 {
-
+	delete m_index;
+	qDeleteAll(m_indexedPlugins);
 }
 
 PluginFactory* PluginFactory::instance()
@@ -118,6 +214,19 @@ const PluginFactory::PluginInfo PluginFactory::pluginInfo(const char* name) cons
 	return PluginInfo();
 }
 
+bool PluginFactory::load(const PluginInfo& info)
+{
+	if (info.library->isLoaded())
+		return true;
+
+	loadHelperLibraries();
+	if (! info.library->load()) {
+		m_errors[info.name()] = info.library->errorString();
+		return false;
+	}
+	return true;
+}
+
 QString PluginFactory::errorString(QString pluginName) const
 {
 	static QString notfound = qApp->translate("PluginFactory", "Plugin not found.");
@@ -129,48 +238,43 @@ void PluginFactory::discoverPlugins()
 	DescriptorMap descriptors;
 	PluginInfoList pluginInfos;
 	m_pluginByExt.clear();
+	m_helperLibraries.clear();
+	// the current descriptors point into these until they're replaced below
+	const QList<IndexedPlugin*> previouslyIndexed = m_indexedPlugins;
+	m_indexedPlugins.clear();
 
 	const QFileInfoList& files = QDir("plugins:").entryInfoList(nameFilters);
 
-	// Cheap dependency handling: zynaddsubfx needs ZynAddSubFxCore. By loading
-	// all libraries twice we ensure that libZynAddSubFxCore is found.
-	for (const QFileInfo& file : files)
-	{
-		QLibrary(file.absoluteFilePath()).load();
-	}
-
+	// Libraries known from the index aren't loaded at all, only new and
+	// changed ones have to be.
+	QFileInfoList unindexed;
 	for (const QFileInfo& file : files)
 	{
-		QLibrary* library = new QLibrary(file.absoluteFilePath());
-
-		if (! library->load()) {
-			m_errors[file.baseName()] = library->errorString();
-			continue;
-		}
-		if (library->resolve("lmms_plugin_main") == nullptr) {
-			continue;
-		}
-
-		QString descriptorName = file.baseName() + "_plugin_descriptor";
-		if( descriptorName.left(3) == "lib" )
+		const QByteArray entry = m_index->lookup(file);
+		if (entry.isEmpty() || ! restoreLibrary(file, entry, pluginInfos))
 		{
-			descriptorName = descriptorName.mid(3);
+			unindexed << file;
 		}
+	}
 
-		Plugin::Descriptor* pluginDescriptor = (Plugin::Descriptor*) library->resolve(descriptorName.toUtf8().constData());
-		if(pluginDescriptor == nullptr)
+	// Cheap dependency handling: zynaddsubfx needs ZynAddSubFxCore. By loading
+	// all libraries twice we ensure that libZynAddSubFxCore is found.
+	if (! unindexed.isEmpty())
+	{
+		loadHelperLibraries();
+		for (const QFileInfo& file : unindexed)
 		{
-			qWarning() << qApp->translate("PluginFactory", "LMMS plugin %1 does not have a plugin descriptor named %2!").
-						  arg(file.absoluteFilePath()).arg(descriptorName);
-			continue;
+			QLibrary(file.absoluteFilePath()).load();
 		}
+	}
 
-		PluginInfo* info = new PluginInfo;
-		info->file = file;
-		info->library = library;
-		info->descriptor = pluginDescriptor;
-		pluginInfos << info;
+	for (const QFileInfo& file : unindexed)
+	{
+		scanLibrary(file, pluginInfos);
+	}
 
+	for (PluginInfo* info : pluginInfos)
+	{
 		for (const QString& ext : QString(info->descriptor->supportedFileTypes).split(','))
 		{
 			m_pluginByExt.insert(ext, info);
@@ -179,6 +283,7 @@ void PluginFactory::discoverPlugins()
 		descriptors.insert(info->descriptor->type, info->descriptor);
 	}
 
+	m_index->save();
 
 	for (PluginInfo* info : m_pluginInfos)
 	{
@@ -187,6 +292,117 @@ void PluginFactory::discoverPlugins()
 	}
 	m_pluginInfos = pluginInfos;
 	m_descriptors = descriptors;
+	qDeleteAll(previouslyIndexed);
+}
+
+void PluginFactory::scanLibrary(const QFileInfo& file, PluginInfoList& infos)
+{
+	QLibrary* library = new QLibrary(file.absoluteFilePath());
+
+	if (! library->load()) {
+		m_errors[file.baseName()] = library->errorString();
+		delete library;
+		return;
+	}
+	if (library->resolve("lmms_plugin_main") == nullptr) {
+		// other plugins might depend on it
+		m_helperLibraries << file.absoluteFilePath();
+		m_index->store(file, helperEntry());
+		delete library;
+		return;
+	}
+
+	QString descriptorName = file.baseName() + "_plugin_descriptor";
+	if( descriptorName.left(3) == "lib" )
+	{
+		descriptorName = descriptorName.mid(3);
+	}
+
+	Plugin::Descriptor* pluginDescriptor = (Plugin::Descriptor*) library->resolve(descriptorName.toUtf8().constData());
+	if(pluginDescriptor == nullptr)
+	{
+		qWarning() << qApp->translate("PluginFactory", "LMMS plugin %1 does not have a plugin descriptor named %2!").
+					  arg(file.absoluteFilePath()).arg(descriptorName);
+		delete library;
+		return;
+	}
+
+	PluginInfo* info = new PluginInfo;
+	info->file = file;
+	info->library = library;
+	info->descriptor = pluginDescriptor;
+	infos << info;
+
+	m_index->store(file, pluginEntry(pluginDescriptor));
+}
+
+bool PluginFactory::restoreLibrary(const QFileInfo& file, const QByteArray& entry,
+						PluginInfoList& infos)
+{
+	QDataStream stream(entry);
+	quint8 type = PluginEntry;
+	stream >> type;
+	if (type == HelperEntry)
+	{
+		m_helperLibraries << file.absoluteFilePath();
+		return true;
+	}
+
+	IndexedPlugin* plugin = new IndexedPlugin;
+	qint32 version = 0;
+	qint32 pluginType = Plugin::Undefined;
+	bool hasLogo = false;
+	QString logoName;
+	QByteArray logo;
+	bool hasSubPluginFeatures = false;
+	stream >> plugin->name >> plugin->displayName
+		>> plugin->description >> plugin->author
+		>> version >> pluginType
+		>> plugin->supportedFileTypes
+		>> hasLogo >> logoName >> logo
+		>> hasSubPluginFeatures;
+
+	// Sub-plugins can only be listed by the library itself and logos can't
+	// be saved without a GUI - such libraries have to be loaded.
+	if (stream.status() != QDataStream::Ok || hasSubPluginFeatures ||
+		(hasLogo && logo.isEmpty() && haveGui()))
+	{
+		delete plugin;
+		return false;
+	}
+
+	if (hasLogo)
+	{
+		plugin->logo = new IndexedPixmapLoader(logoName, logo);
+	}
+
+	Plugin::Descriptor& desc = plugin->descriptor;
+	desc.name = indexedString(plugin->name);
+	desc.displayName = indexedString(plugin->displayName);
+	desc.description = indexedString(plugin->description);
+	desc.author = indexedString(plugin->author);
+	desc.version = version;
+	desc.type = (Plugin::PluginTypes) pluginType;
+	desc.logo = plugin->logo;
+	desc.supportedFileTypes = indexedString(plugin->supportedFileTypes);
+	desc.subPluginFeatures = nullptr;
+	m_indexedPlugins << plugin;
+
+	PluginInfo* info = new PluginInfo;
+	info->file = file;
+	info->library = new QLibrary(file.absoluteFilePath());
+	info->descriptor = &desc;
+	infos << info;
+
+	return true;
+}
+
+void PluginFactory::loadHelperLibraries()
+{
+	for (const QString& file : m_helperLibraries)
+	{
+		QLibrary(file).load();
+	}
 }
 
 
@@ -0,0 +1,192 @@
+/*
+ * PluginIndex.cpp - on-disk cache of plugin library metadata
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "PluginIndex.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#include "ConfigManager.h"
+
+
+namespace
+{
+
+const quint32 Magic = 0x4c4d5049; // "LMPI"
+const quint32 Version = 2;
+
+}
+
+
+
+
+PluginIndex::PluginIndex( const QString & _name ) :
+	m_file( ConfigManager::inst()->cacheDir() + _name ),
+	m_entries(),
+	m_modified( false )
+{
+	load();
+}
+
+
+
+
+PluginIndex::~PluginIndex()
+{
+	save();
+}
+
+
+
+
+QByteArray PluginIndex::lookup( const QFileInfo & _library )
+{
+	QHash<QString, Entry>::iterator it =
+			m_entries.find( _library.absoluteFilePath() );
+	if( it == m_entries.end() )
+	{
+		return QByteArray();
+	}
+
+	if( it->modified != _library.lastModified().toMSecsSinceEpoch() ||
+						it->size != _library.size() )
+	{
+		m_entries.erase( it );
+		m_modified = true;
+		return QByteArray();
+	}
+
+	it->used = true;
+	return it->data;
+}
+
+
+
+
+void PluginIndex::store( const QFileInfo & _library, const QByteArray & _data )
+{
+	QHash<QString, Entry>::iterator it =
+			m_entries.find( _library.absoluteFilePath() );
+	if( it != m_entries.end() && it->used && it->data == _data )
+	{
+		// looked up just before and still the same
+		return;
+	}
+
+	Entry entry;
+	entry.modified = _library.lastModified().toMSecsSinceEpoch();
+	entry.size = _library.size();
+	entry.data = _data;
+	entry.used = true;
+	m_entries[_library.absoluteFilePath()] = entry;
+	m_modified = true;
+}
+
+
+
+
+void PluginIndex::save()
+{
+	QHash<QString, Entry>::iterator it = m_entries.begin();
+	while( it != m_entries.end() )
+	{
+		if( it->used )
+		{
+			++it;
+		}
+		else
+		{
+			it = m_entries.erase( it );
+			m_modified = true;
+		}
+	}
+
+	if( m_modified == false )
+	{
+		return;
+	}
+
+	QFile file( m_file );
+	if( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) == false )
+	{
+		return;
+	}
+
+	QDataStream stream( &file );
+	stream.setVersion( QDataStream::Qt_4_8 );
+	// libraries built for another version of LMMS might describe
+	// themselves differently
+	stream << Magic << Version << QString( LMMS_VERSION ) <<
+						(quint32) m_entries.size();
+	for( it = m_entries.begin(); it != m_entries.end(); ++it )
+	{
+		stream << it.key() << it->modified << it->size << it->data;
+	}
+
+	m_modified = false;
+}
+
+
+
+
+void PluginIndex::load()
+{
+	QFile file( m_file );
+	if( file.open( QIODevice::ReadOnly ) == false )
+	{
+		return;
+	}
+
+	QDataStream stream( &file );
+	stream.setVersion( QDataStream::Qt_4_8 );
+
+	quint32 magic = 0;
+	quint32 version = 0;
+	QString lmmsVersion;
+	quint32 count = 0;
+	stream >> magic >> version >> lmmsVersion >> count;
+	if( stream.status() != QDataStream::Ok || magic != Magic ||
+			version != Version || lmmsVersion != LMMS_VERSION )
+	{
+		return;
+	}
+
+	for( quint32 i = 0; i < count; ++i )
+	{
+		QString library;
+		Entry entry;
+		stream >> library >> entry.modified >> entry.size >>
+								entry.data;
+		if( stream.status() != QDataStream::Ok )
+		{
+			// a damaged index is as good as none
+			m_entries.clear();
+			return;
+		}
+		entry.used = false;
+		m_entries[library] = entry;
+	}
+}
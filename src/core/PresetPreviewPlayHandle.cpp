@@ -52,6 +52,8 @@ public:
 		setJournalling( false );
 		m_previewInstrumentTrack = dynamic_cast<InstrumentTrack *>( Track::create( Track::InstrumentTrack, this ) );
 		m_previewInstrumentTrack->setJournalling( false );
+		// nothing to route elsewhere
+		m_previewInstrumentTrack->audioPort()->setExtOutputEnabled( false );
 	}
 
 	virtual ~PreviewTrackContainer()
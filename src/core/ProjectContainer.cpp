@@ -0,0 +1,554 @@
+/*
+ * ProjectContainer.cpp - binary project files with memory-mapped samples
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "ProjectContainer.h"
+
+#include <string.h>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QtEndian>
+
+#include "lmmsconfig.h"
+
+#ifdef LMMS_BUILD_WIN32
+#include <windows.h>
+#endif
+
+#include "AtomicInt.h"
+#include "MemoryManager.h"
+#include "SampleBuffer.h"
+
+
+const char * const ProjectContainer::Extension = "mmpb";
+
+
+namespace
+{
+
+// the file starts with Magic, the format version, the number of chunks and
+// the generation, followed by the index entries (type, flags, offset and
+// size of each chunk) - all numbers and samples are stored in little endian
+const char Magic[] = "LMMSPRJB";
+const int MagicSize = 8;
+const quint32 Version = 2;
+const qint64 HeaderSize = MagicSize + 3 * sizeof( quint32 );
+// version 1 had no generation
+const qint64 HeaderSizeV1 = MagicSize + 2 * sizeof( quint32 );
+const qint64 EntrySize = 2 * sizeof( quint32 ) + 2 * sizeof( quint64 );
+// sample chunks are aligned for SSE loads
+const qint64 ChunkAlignment = 16;
+
+enum ChunkTypes
+{
+	DocumentChunk = 1,
+	SampleChunk = 2
+} ;
+
+enum ChunkFlags
+{
+	CompressedChunk = 1
+} ;
+
+const QString ReferencePrefix = "#sample";
+// can't be mistaken for a path, which is absolute
+const QString MemoryLocationPrefix = "memory:";
+
+
+qint64 aligned( const qint64 _offset )
+{
+	return ( _offset + ChunkAlignment - 1 ) / ChunkAlignment *
+							ChunkAlignment;
+}
+
+
+
+
+void writePadding( QDataStream & _stream, const qint64 _from,
+							const qint64 _to )
+{
+	static const char zeros[ChunkAlignment] = { 0 };
+	_stream.writeRawData( zeros, _to - _from );
+}
+
+}
+
+
+
+
+bool ProjectContainer::isContainer( const QByteArray & _head )
+{
+	return _head.size() >= MagicSize &&
+			memcmp( _head.constData(), Magic, MagicSize ) == 0;
+}
+
+
+
+
+ProjectContainer * ProjectContainer::open( const QString & _file )
+{
+	ProjectContainer * container = new ProjectContainer( _file );
+	if( container->map() == false )
+	{
+		delete container;
+		return NULL;
+	}
+	return container;
+}
+
+
+
+
+ProjectContainer * ProjectContainer::openLocation( const QString & _location )
+{
+	if( isMemoryLocation( _location ) )
+	{
+		return NULL;
+	}
+
+	// the location is the path followed by the time of the last change,
+	// the size and the generation
+	ProjectContainer * container = open( _location.section( ':', 0, -4 ) );
+	if( container != NULL && container->location() != _location )
+	{
+		sharedObject::unref( container );
+		return NULL;
+	}
+	return container;
+}
+
+
+
+
+ProjectContainer::ProjectContainer( const QString & _file ) :
+	sharedObject(),
+	m_file( QFileInfo( _file ).absoluteFilePath() ),
+#ifdef LMMS_BUILD_WIN32
+	m_fileHandle( NULL ),
+	m_mapping( NULL ),
+#else
+	m_mappedFile( _file ),
+#endif
+	m_key(),
+	m_data( NULL ),
+	m_size( 0 ),
+	m_generation( 0 ),
+	m_samples()
+{
+	m_document.type = 0;
+}
+
+
+
+
+ProjectContainer::~ProjectContainer()
+{
+#ifdef LMMS_BUILD_WIN32
+	if( m_data != NULL )
+	{
+		UnmapViewOfFile( m_data );
+	}
+	if( m_mapping != NULL )
+	{
+		CloseHandle( m_mapping );
+	}
+	if( m_fileHandle != NULL )
+	{
+		CloseHandle( m_fileHandle );
+	}
+#else
+	if( m_data != NULL )
+	{
+		m_mappedFile.unmap( const_cast<uchar *>( m_data ) );
+	}
+	m_mappedFile.close();
+#endif
+}
+
+
+
+
+bool ProjectContainer::map()
+{
+#ifdef LMMS_BUILD_WIN32
+	// saving the project over itself renames or deletes the file, which
+	// Windows only allows while it's mapped if everything is shared
+	HANDLE file = CreateFileW( (LPCWSTR) QDir::toNativeSeparators(
+							m_file ).utf16(),
+				GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE |
+							FILE_SHARE_DELETE,
+				NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+	m_fileHandle = file;
+
+	LARGE_INTEGER size;
+	if( GetFileSizeEx( file, &size ) == false )
+	{
+		return false;
+	}
+	m_size = size.QuadPart;
+	if( m_size < HeaderSizeV1 )
+	{
+		return false;
+	}
+
+	m_mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( m_mapping == NULL )
+	{
+		return false;
+	}
+	m_data = (const uchar *) MapViewOfFile( m_mapping, FILE_MAP_READ,
+								0, 0, 0 );
+#else
+	if( m_mappedFile.open( QIODevice::ReadOnly ) == false )
+	{
+		return false;
+	}
+
+	m_size = m_mappedFile.size();
+	if( m_size < HeaderSizeV1 )
+	{
+		return false;
+	}
+
+	m_data = m_mappedFile.map( 0, m_size );
+#endif
+	if( m_data == NULL || memcmp( m_data, Magic, MagicSize ) != 0 )
+	{
+		return false;
+	}
+
+	const quint32 version = qFromLittleEndian<quint32>( m_data + MagicSize );
+	const qint64 headerSize = version == 1 ? HeaderSizeV1 : HeaderSize;
+	if( version < 1 || version > Version || headerSize > m_size )
+	{
+		return false;
+	}
+
+	const qint64 count = qFromLittleEndian<quint32>( m_data + MagicSize +
+							sizeof( quint32 ) );
+	if( headerSize + count * EntrySize > m_size )
+	{
+		return false;
+	}
+	if( version > 1 )
+	{
+		m_generation = qFromLittleEndian<quint32>( m_data + MagicSize +
+						2 * sizeof( quint32 ) );
+	}
+
+	for( qint64 i = 0; i < count; ++i )
+	{
+		const uchar * entry = m_data + headerSize + i * EntrySize;
+		Chunk chunk;
+		chunk.type = qFromLittleEndian<quint32>( entry );
+		chunk.flags = qFromLittleEndian<quint32>( entry + 4 );
+		chunk.offset = qFromLittleEndian<quint64>( entry + 8 );
+		chunk.size = qFromLittleEndian<quint64>( entry + 16 );
+		if( chunk.offset > (quint64) m_size ||
+				chunk.size > (quint64) m_size - chunk.offset )
+		{
+			return false;
+		}
+
+		// unknown chunks are left to newer versions
+		if( chunk.type == DocumentChunk )
+		{
+			m_document = chunk;
+		}
+		else if( chunk.type == SampleChunk )
+		{
+			m_samples.push_back( chunk );
+		}
+	}
+
+	// the mapping stays valid after the file is replaced, so the samples
+	// of the file as it is now need a key of their own - the generation
+	// tells apart files saved within the resolution of the file system's
+	// timestamps
+	const QFileInfo fileInfo( m_file );
+	m_key = QString( "%1:%2:%3:%4" ).
+			arg( fileInfo.canonicalFilePath() ).
+			arg( fileInfo.lastModified().toMSecsSinceEpoch() ).
+			arg( m_size ).
+			arg( m_generation );
+
+	return m_document.type == DocumentChunk;
+}
+
+
+
+
+quint32 ProjectContainer::generation( const QString & _file )
+{
+	QFile file( _file );
+	if( file.open( QIODevice::ReadOnly ) == false )
+	{
+		return 0;
+	}
+
+	const QByteArray head = file.read( HeaderSize );
+	if( head.size() < HeaderSize || isContainer( head ) == false ||
+		qFromLittleEndian<quint32>( (const uchar *) head.constData() +
+							MagicSize ) < 2 )
+	{
+		return 0;
+	}
+	return qFromLittleEndian<quint32>( (const uchar *) head.constData() +
+					MagicSize + 2 * sizeof( quint32 ) );
+}
+
+
+
+
+bool ProjectContainer::write( QIODevice & _out, const QByteArray & _document,
+					const QList<QByteArray> & _samples,
+					const quint32 _generation )
+{
+	const QByteArray document = qCompress( _document );
+	const quint32 count = _samples.size() + 1;
+
+	QDataStream stream( &_out );
+	stream.setByteOrder( QDataStream::LittleEndian );
+	stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+	stream.writeRawData( Magic, MagicSize );
+	stream << Version << count << _generation;
+
+	// the document comes first, the samples follow in their order
+	qint64 offset = aligned( HeaderSize + count * EntrySize );
+	stream << (quint32) DocumentChunk << (quint32) CompressedChunk <<
+			(quint64) offset << (quint64) document.size();
+	offset = aligned( offset + document.size() );
+	for( int i = 0; i < _samples.size(); ++i )
+	{
+		stream << (quint32) SampleChunk << (quint32) 0 <<
+			(quint64) offset << (quint64) _samples[i].size();
+		offset = aligned( offset + _samples[i].size() );
+	}
+
+	qint64 pos = HeaderSize + count * EntrySize;
+	writePadding( stream, pos, aligned( pos ) );
+	stream.writeRawData( document.constData(), document.size() );
+	pos = aligned( pos ) + document.size();
+
+	for( int i = 0; i < _samples.size(); ++i )
+	{
+		writePadding( stream, pos, aligned( pos ) );
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+		const float * samples = (const float *) _samples[i].constData();
+		const int n = _samples[i].size() / sizeof( float );
+		for( int s = 0; s < n; ++s )
+		{
+			stream << samples[s];
+		}
+#else
+		stream.writeRawData( _samples[i].constData(),
+							_samples[i].size() );
+#endif
+		pos = aligned( pos ) + _samples[i].size();
+	}
+
+	return stream.status() == QDataStream::Ok;
+}
+
+
+
+
+QString ProjectContainer::reference( const int _index )
+{
+	return ReferencePrefix + QString::number( _index );
+}
+
+
+
+
+QString ProjectContainer::reference( const QString & _location,
+							const int _index )
+{
+	return reference( _index ) + ":" + _location;
+}
+
+
+
+
+QString ProjectContainer::memoryLocation()
+{
+	static AtomicInt s_count;
+	return MemoryLocationPrefix +
+		QString::number( s_count.fetchAndAddOrdered( 1 ) );
+}
+
+
+
+
+bool ProjectContainer::isMemoryLocation( const QString & _location )
+{
+	return _location.startsWith( MemoryLocationPrefix );
+}
+
+
+
+
+bool ProjectContainer::parseReference( const QString & _ref, int * _index,
+							QString * _location )
+{
+	// base64 data never contains '#'
+	if( _ref.startsWith( ReferencePrefix ) == false )
+	{
+		return false;
+	}
+
+	const int colon = _ref.indexOf( ':', ReferencePrefix.size() );
+	bool ok = false;
+	*_index = _ref.mid( ReferencePrefix.size(), colon < 0 ? -1 :
+				colon - ReferencePrefix.size() ).toInt( &ok );
+	*_location = colon < 0 ? QString() : _ref.mid( colon + 1 );
+
+	return ok;
+}
+
+
+
+
+QByteArray ProjectContainer::document() const
+{
+	const QByteArray data = QByteArray::fromRawData(
+			(const char *) m_data + m_document.offset,
+							m_document.size );
+	if( m_document.flags & CompressedChunk )
+	{
+		return qUncompress( data );
+	}
+	return data;
+}
+
+
+
+
+QByteArray ProjectContainer::sampleData( const int _index ) const
+{
+	if( _index < 0 || _index >= m_samples.size() )
+	{
+		return QByteArray();
+	}
+
+	const Chunk & chunk = m_samples[_index];
+	return QByteArray::fromRawData( (const char *) m_data + chunk.offset,
+			chunk.size - chunk.size % sizeof( sampleFrame ) );
+}
+
+
+
+
+bool ProjectContainer::acquireSample( const QString & _location,
+					const int _index, SampleCache::Data * _data )
+{
+	if( SampleCache::acquire( sampleKey( _location, _index ), _data ) )
+	{
+		return true;
+	}
+
+	ProjectContainer * container = openLocation( _location );
+	if( container == NULL )
+	{
+		return false;
+	}
+	// the cache keeps the container around as long as the data is used
+	const bool acquired = container->acquireSample( _index, _data );
+	sharedObject::unref( container );
+	return acquired;
+}
+
+
+
+
+void ProjectContainer::insertSample( const QString & _location,
+					const int _index, SampleCache::Data * _data )
+{
+	SampleCache::insert( sampleKey( _location, _index ), _data );
+}
+
+
+
+
+bool ProjectContainer::acquireSample( const int _index,
+						SampleCache::Data * _data )
+{
+	if( _index < 0 || _index >= m_samples.size() )
+	{
+		return false;
+	}
+
+	const QString key = sampleKey( m_key, _index );
+	if( SampleCache::acquire( key, _data ) )
+	{
+		return true;
+	}
+
+	const Chunk & chunk = m_samples[_index];
+	_data->frames = chunk.size / sizeof( sampleFrame );
+	_data->format = SampleBuffer::FloatStorage;
+	_data->channels = DEFAULT_CHANNELS;
+	if( _data->frames == 0 )
+	{
+		return false;
+	}
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	sampleFrame * frames = MM_ALLOC( sampleFrame, _data->frames );
+	const uchar * src = m_data + chunk.offset;
+	for( f_cnt_t f = 0; f < _data->frames; ++f )
+	{
+		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+		{
+			const quint32 s = qFromLittleEndian<quint32>( src );
+			memcpy( &frames[f][ch], &s, sizeof( s ) );
+			src += sizeof( s );
+		}
+	}
+	_data->data = frames;
+	SampleCache::insert( key, _data );
+#else
+	// played right from the mapped file, so only the parts actually used
+	// are ever read from disk
+	_data->data = (void *)( m_data + chunk.offset );
+	SampleCache::insert( key, _data, this );
+#endif
+
+	return true;
+}
+
+
+
+
+QString ProjectContainer::sampleKey( const QString & _location,
+							const int _index )
+{
+	return _location + "#" + QString::number( _index );
+}
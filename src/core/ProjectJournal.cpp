@@ -25,18 +25,29 @@
 #include <cstdlib>
 
 #include "ProjectJournal.h"
+#include "ConfigManager.h"
 #include "Engine.h"
 #include "JournallingObject.h"
 #include "Song.h"
 
 const int ProjectJournal::MAX_UNDO_STATES = 100; // TODO: make this configurable in settings
+// in megabytes
+const int ProjectJournal::DEFAULT_UNDO_MEMORY = 64;
 
 ProjectJournal::ProjectJournal() :
 	m_joIDs(),
 	m_undoCheckPoints(),
 	m_redoCheckPoints(),
-	m_journalling( false )
+	m_journalling( false ),
+	m_memoryLimit( DEFAULT_UNDO_MEMORY )
 {
+	const int limit = ConfigManager::inst()->value( "app",
+						"undomemory" ).toInt();
+	if( limit > 0 )
+	{
+		m_memoryLimit = limit;
+	}
+	m_memoryLimit *= 1024 * 1024;
 }
 
 
@@ -53,18 +64,17 @@ void ProjectJournal::undo()
 {
 	while( !m_undoCheckPoints.isEmpty() )
 	{
-		CheckPoint c = m_undoCheckPoints.pop();
+		CheckPoint c = pop( m_undoCheckPoints );
 		JournallingObject *jo = m_joIDs[c.joID];
 
 		if( jo )
 		{
-			DataFile curState( DataFile::JournalData );
-			jo->saveState( curState, curState.content() );
-			m_redoCheckPoints.push( CheckPoint( c.joID, curState ) );
+			push( m_redoCheckPoints, c.joID, saveState( jo ) );
+			limitMemory();
 
 			bool prev = isJournalling();
 			setJournalling( false );
-			jo->restoreState( c.data.content().firstChildElement() );
+			restoreState( jo, c.data );
 			setJournalling( prev );
 			Engine::getSong()->setModified();
 			break;
@@ -78,18 +88,17 @@ void ProjectJournal::redo()
 {
 	while( !m_redoCheckPoints.isEmpty() )
 	{
-		CheckPoint c = m_redoCheckPoints.pop();
+		CheckPoint c = pop( m_redoCheckPoints );
 		JournallingObject *jo = m_joIDs[c.joID];
 
 		if( jo )
 		{
-			DataFile curState( DataFile::JournalData );
-			jo->saveState( curState, curState.content() );
-			m_undoCheckPoints.push( CheckPoint( c.joID, curState ) );
+			push( m_undoCheckPoints, c.joID, saveState( jo ) );
+			limitMemory();
 
 			bool prev = isJournalling();
 			setJournalling( false );
-			jo->restoreState( c.data.content().firstChildElement() );
+			restoreState( jo, c.data );
 			setJournalling( prev );
 			Engine::getSong()->setModified();
 			break;
@@ -115,14 +124,136 @@ void ProjectJournal::addJournalCheckPoint( JournallingObject *jo )
 	{
 		m_redoCheckPoints.clear();
 
-		DataFile dataFile( DataFile::JournalData );
-		jo->saveState( dataFile, dataFile.content() );
-
-		m_undoCheckPoints.push( CheckPoint( jo->id(), dataFile ) );
+		push( m_undoCheckPoints, jo->id(), saveState( jo ) );
+		// the oldest checkpoints are never referred to by others
 		if( m_undoCheckPoints.size() > MAX_UNDO_STATES )
 		{
 			m_undoCheckPoints.remove( 0, m_undoCheckPoints.size() - MAX_UNDO_STATES );
 		}
+		limitMemory();
+	}
+}
+
+
+
+
+QByteArray ProjectJournal::saveState( JournallingObject * _jo )
+{
+	DataFile dataFile( DataFile::JournalData );
+	_jo->saveState( dataFile, dataFile.content() );
+	// without any indentation, which would only cost memory
+	return dataFile.toByteArray( -1 );
+}
+
+
+
+
+void ProjectJournal::restoreState( JournallingObject * _jo,
+						const QByteArray & _state )
+{
+	DataFile dataFile( _state );
+	_jo->restoreState( dataFile.content().firstChildElement() );
+}
+
+
+
+
+void ProjectJournal::push( CheckPointStack & _stack, const jo_id_t _id,
+						const QByteArray & _state )
+{
+	for( int i = _stack.size() - 1; i >= 0; --i )
+	{
+		CheckPoint & older = _stack[i];
+		if( older.joID != _id )
+		{
+			continue;
+		}
+
+		// small edits only change a small part of the state, so
+		// keeping what's between the common beginning and end is
+		// enough to get the older state back
+		const int size = qMin( older.data.size(), _state.size() );
+		const char * a = older.data.constData();
+		const char * b = _state.constData();
+		int prefix = 0;
+		while( prefix < size && a[prefix] == b[prefix] )
+		{
+			++prefix;
+		}
+		int suffix = 0;
+		while( suffix < size - prefix &&
+			a[older.data.size() - 1 - suffix] ==
+					b[_state.size() - 1 - suffix] )
+		{
+			++suffix;
+		}
+
+		older.delta = true;
+		older.prefix = prefix;
+		older.suffix = suffix;
+		older.data = older.data.mid( prefix,
+				older.data.size() - prefix - suffix );
+		break;
+	}
+
+	_stack.push( CheckPoint( _id, _state ) );
+}
+
+
+
+
+ProjectJournal::CheckPoint ProjectJournal::pop( CheckPointStack & _stack )
+{
+	CheckPoint c = _stack.pop();
+
+	// the next older state of the object becomes the newest one
+	for( int i = _stack.size() - 1; i >= 0; --i )
+	{
+		CheckPoint & older = _stack[i];
+		if( older.joID != c.joID )
+		{
+			continue;
+		}
+
+		if( older.delta )
+		{
+			older.data = c.data.left( older.prefix ) + older.data +
+						c.data.right( older.suffix );
+			older.delta = false;
+			older.prefix = older.suffix = 0;
+		}
+		break;
+	}
+
+	return c;
+}
+
+
+
+
+void ProjectJournal::limitMemory()
+{
+	qint64 used = 0;
+	for( int i = 0; i < m_undoCheckPoints.size(); ++i )
+	{
+		used += m_undoCheckPoints[i].data.size();
+	}
+	for( int i = 0; i < m_redoCheckPoints.size(); ++i )
+	{
+		used += m_redoCheckPoints[i].data.size();
+	}
+
+	// forget the oldest undo steps first, then the redo steps farthest
+	// away - the last step can always be undone though
+	while( used > m_memoryLimit && m_undoCheckPoints.size() > 1 )
+	{
+		used -= m_undoCheckPoints.first().data.size();
+		m_undoCheckPoints.remove( 0 );
+	}
+	while( used > m_memoryLimit && !m_redoCheckPoints.isEmpty() )
+	{
+		used -= m_redoCheckPoints.first().data.size();
+		m_redoCheckPoints.remove( 0 );
 	}
 }
 
@@ -28,6 +28,7 @@
 #include "ProjectRenderer.h"
 #include "Song.h"
 #include "Engine.h"
+#include "SampleLoader.h"
 
 #include "AudioFileWave.h"
 #include "AudioFileOgg.h"
@@ -138,6 +139,12 @@ void ProjectRenderer::startProcessing()
 
 	if( isReady() )
 	{
+		// samples still being decoded would be rendered as silence
+		if( SampleLoader::inst() != NULL )
+		{
+			SampleLoader::inst()->waitForAll();
+		}
+
 		// have to do mixer stuff with GUI-thread-affinity in order to
 		// make slots connected to sampleRateChanged()-signals being
 		// called immediately
@@ -0,0 +1,179 @@
+/*
+ * ProjectWriter.cpp - writes project files in the background
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "ProjectWriter.h"
+
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "DataFile.h"
+
+
+ProjectWriter * ProjectWriter::s_instance = NULL;
+
+
+
+class ProjectWriter::Job : public QRunnable
+{
+public:
+	Job( ProjectWriter * _writer, DataFile * _dataFile,
+				const QString & _file, bool * _success ) :
+		m_writer( _writer ),
+		m_dataFile( _dataFile ),
+		m_file( _file ),
+		m_success( _success )
+	{
+	}
+
+	virtual void run()
+	{
+		// don't compete with the mixer threads
+		QThread::currentThread()->setPriority( QThread::LowPriority );
+
+		// there's no one to show an error to on this thread, the
+		// receivers of written() take care of that
+		const bool success = m_dataFile->writeFile( m_file, false );
+		delete m_dataFile;
+
+		if( m_success != NULL )
+		{
+			*m_success = success;
+		}
+		m_writer->finished( m_file, success );
+	}
+
+
+private:
+	ProjectWriter * m_writer;
+	DataFile * m_dataFile;
+	QString m_file;
+	bool * m_success;
+
+} ;
+
+
+
+
+ProjectWriter::ProjectWriter() :
+	QObject(),
+	m_pool( new QThreadPool( this ) ),
+	m_mutex(),
+	m_pending( 0 )
+{
+	// one thread keeps saves of the same file in order
+	m_pool->setMaxThreadCount( 1 );
+}
+
+
+
+
+ProjectWriter::~ProjectWriter()
+{
+}
+
+
+
+
+void ProjectWriter::init()
+{
+	if( s_instance == NULL )
+	{
+		s_instance = new ProjectWriter;
+	}
+}
+
+
+
+
+void ProjectWriter::cleanup()
+{
+	if( s_instance == NULL )
+	{
+		return;
+	}
+
+	// unlike other background work, pending saves must not be dropped
+	s_instance->waitForAll();
+
+	delete s_instance;
+	s_instance = NULL;
+}
+
+
+
+
+void ProjectWriter::write( DataFile * _dataFile, const QString & _file )
+{
+	m_mutex.lock();
+	++m_pending;
+	m_mutex.unlock();
+
+	m_pool->start( new Job( this, _dataFile, _file, NULL ) );
+}
+
+
+
+
+bool ProjectWriter::writeAndWait( DataFile * _dataFile, const QString & _file )
+{
+	m_mutex.lock();
+	++m_pending;
+	m_mutex.unlock();
+
+	bool success = false;
+	m_pool->start( new Job( this, _dataFile, _file, &success ) );
+	m_pool->waitForDone();
+
+	return success;
+}
+
+
+
+
+void ProjectWriter::waitForAll()
+{
+	m_pool->waitForDone();
+}
+
+
+
+
+int ProjectWriter::pendingWrites() const
+{
+	QMutexLocker lock( &m_mutex );
+	return m_pending;
+}
+
+
+
+
+void ProjectWriter::finished( const QString & _file, bool _success )
+{
+	m_mutex.lock();
+	--m_pending;
+	m_mutex.unlock();
+
+	emit written( _file, _success );
+}
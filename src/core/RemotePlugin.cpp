@@ -33,6 +33,7 @@
 #include "Mixer.h"
 #include "Engine.h"
 #include "ConfigManager.h"
+#include "MicroTimer.h"
 
 #include <QDir>
 
@@ -75,6 +76,116 @@ void ProcessWatcher::run()
 
 
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+QMap<QString, RemotePluginHost *> RemotePluginHost::s_hosts;
+QMutex RemotePluginHost::s_hostsMutex;
+
+
+RemotePluginHost * RemotePluginHost::acquire( const QString & _executable )
+{
+	QMutexLocker lock( &s_hostsMutex );
+
+	RemotePluginHost * host = s_hosts.value( _executable, NULL );
+	if( host == NULL || host->isRunning() == false )
+	{
+		// the instances of a process which died keep their reference
+		// until they're gone
+		shmFifo * control = new shmFifo();
+		// messages to the process itself have to wake it up as well
+		control->setDoorbell( control );
+		host = new RemotePluginHost( _executable, control );
+		if( host->isRunning() == false )
+		{
+			delete host;
+			return NULL;
+		}
+		s_hosts[_executable] = host;
+	}
+
+	++host->m_references;
+	return host;
+}
+
+
+
+
+void RemotePluginHost::release()
+{
+	s_hostsMutex.lock();
+	const bool unused = --m_references == 0;
+	if( unused && s_hosts.value( m_executable ) == this )
+	{
+		s_hosts.remove( m_executable );
+	}
+	s_hostsMutex.unlock();
+
+	if( unused )
+	{
+		delete this;
+	}
+}
+
+
+
+
+void RemotePluginHost::addInstance( int _shmIn, int _shmOut )
+{
+	sendMessage( message( IdHostAddInstance ).
+					addInt( _shmIn ).addInt( _shmOut ) );
+}
+
+
+
+
+bool RemotePluginHost::processMessage( const message & )
+{
+	// the process only ever talks through the FIFOs of its instances
+	return true;
+}
+
+
+
+
+RemotePluginHost::RemotePluginHost( const QString & _executable,
+							shmFifo * _control ) :
+	RemotePluginBase( new shmFifo(), _control ),
+	m_executable( _executable ),
+	m_process(),
+	m_control( _control ),
+	m_references( 0 )
+{
+	QStringList args;
+	args << "--shared";
+	args << QString::number( out()->shmKey() );
+	args << QString::number( in()->shmKey() );
+
+	m_process.setProcessChannelMode( QProcess::ForwardedChannels );
+	m_process.setWorkingDirectory( QCoreApplication::applicationDirPath() );
+	m_process.start( _executable, args );
+}
+
+
+
+
+RemotePluginHost::~RemotePluginHost()
+{
+	if( isRunning() )
+	{
+		sendMessage( IdQuit );
+
+		m_process.waitForFinished( 1000 );
+		if( m_process.state() != QProcess::NotRunning )
+		{
+			m_process.terminate();
+			m_process.kill();
+		}
+	}
+}
+#endif
+
+
+
+
 RemotePlugin::RemotePlugin() :
 	QObject(),
 #ifdef SYNC_WITH_SHM_FIFO
@@ -85,6 +196,9 @@ RemotePlugin::RemotePlugin() :
 	m_failed( true ),
 	m_process(),
 	m_watcher( this ),
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+	m_host( NULL ),
+#endif
 	m_commMutex( QMutex::Recursive ),
 	m_splitChannels( false ),
 #ifdef USE_QT_SHMEM
@@ -95,8 +209,20 @@ RemotePlugin::RemotePlugin() :
 	m_shmSize( 0 ),
 	m_shm( NULL ),
 	m_inputCount( DEFAULT_CHANNELS ),
-	m_outputCount( DEFAULT_CHANNELS )
+	m_outputCount( DEFAULT_CHANNELS ),
+	m_pipelined( ConfigManager::inst()->value( "mixer",
+					"pipelineremoteplugins" ).toInt() ),
+	m_currentSlot( 0 ),
+	m_pendingPeriods( 0 ),
+	m_parameterChanges(),
+	m_parameterMutex(),
+	m_lastPeriod()
 {
+	m_roundTrips.last = 0;
+	m_roundTrips.average = 0;
+	m_roundTrips.max = 0;
+	m_roundTrips.periods = 0;
+
 #ifndef SYNC_WITH_SHM_FIFO
 	struct sockaddr_un sa;
 	sa.sun_family = AF_LOCAL;
@@ -135,6 +261,17 @@ RemotePlugin::~RemotePlugin()
 	m_watcher.quit();
 	m_watcher.wait();
 
+#ifdef DEBUG_REMOTE_PLUGIN
+	qDebug( "remote plugin round trips: %d periods, %d us on average, "
+			"%d us at most", m_roundTrips.periods,
+			m_roundTrips.average, m_roundTrips.max );
+#endif
+
+	if( m_pipelined )
+	{
+		Engine::mixer()->reportLatency( this, 0 );
+	}
+
 	if( m_failed == false )
 	{
 		if( isRunning() )
@@ -142,11 +279,17 @@ RemotePlugin::~RemotePlugin()
 			lock();
 			sendMessage( IdQuit );
 
-			m_process.waitForFinished( 1000 );
-			if( m_process.state() != QProcess::NotRunning )
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+			// an instance in a shared process goes away on its own
+			if( m_host == NULL )
+#endif
 			{
-				m_process.terminate();
-				m_process.kill();
+				m_process.waitForFinished( 1000 );
+				if( m_process.state() != QProcess::NotRunning )
+				{
+					m_process.terminate();
+					m_process.kill();
+				}
 			}
 			unlock();
 		}
@@ -157,6 +300,13 @@ RemotePlugin::~RemotePlugin()
 #endif
 	}
 
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+	if( m_host != NULL )
+	{
+		m_host->release();
+	}
+#endif
+
 #ifndef SYNC_WITH_SHM_FIFO
 	if ( close( m_server ) == -1)
 	{
@@ -170,7 +320,7 @@ RemotePlugin::~RemotePlugin()
 
 
 bool RemotePlugin::init( const QString &pluginExecutable,
-							bool waitForInitDoneMsg )
+				bool waitForInitDoneMsg, bool _shareable )
 {
 	lock();
 	if( m_failed )
@@ -197,22 +347,43 @@ bool RemotePlugin::init( const QString &pluginExecutable,
 		return failed();
 	}
 
-	QStringList args;
+	bool shared = false;
+#ifdef REMOTE_PLUGIN_SHARED_HOST
+	if( _shareable && m_host == NULL && ConfigManager::inst()->value(
+				"mixer", "separateremoteplugins" ).toInt() == 0 )
+	{
+		m_host = RemotePluginHost::acquire( exec );
+	}
+	if( m_host != NULL )
+	{
+		setDoorbell( m_host->doorbell() );
+		// swap in and out for bidirectional communication
+		m_host->addInstance( out()->shmKey(), in()->shmKey() );
+		m_watcher.start( QThread::LowestPriority );
+		shared = true;
+	}
+#endif
+
+	if( shared == false )
+	{
+		QStringList args;
 #ifdef SYNC_WITH_SHM_FIFO
-	// swap in and out for bidirectional communication
-	args << QString::number( out()->shmKey() );
-	args << QString::number( in()->shmKey() );
+		// swap in and out for bidirectional communication
+		args << QString::number( out()->shmKey() );
+		args << QString::number( in()->shmKey() );
 #else
-	args << m_socketFile;
+		args << m_socketFile;
 #endif
 #ifndef DEBUG_REMOTE_PLUGIN
-	m_process.setProcessChannelMode( QProcess::ForwardedChannels );
-	m_process.setWorkingDirectory( QCoreApplication::applicationDirPath() );
-	m_process.start( exec, args );
-	m_watcher.start( QThread::LowestPriority );
+		m_process.setProcessChannelMode( QProcess::ForwardedChannels );
+		m_process.setWorkingDirectory(
+				QCoreApplication::applicationDirPath() );
+		m_process.start( exec, args );
+		m_watcher.start( QThread::LowestPriority );
 #else
-	qDebug() << exec << args;
+		qDebug() << exec << args;
 #endif
+	}
 
 	connect( &m_process, SIGNAL( finished( int, QProcess::ExitStatus ) ),
 		this, SLOT( processFinished( int, QProcess::ExitStatus ) ) );
@@ -242,6 +413,7 @@ bool RemotePlugin::init( const QString &pluginExecutable,
 #endif
 
 	resizeSharedProcessingMemory();
+	reportLatency();
 
 	if( waitForInitDoneMsg )
 	{
@@ -288,7 +460,12 @@ bool RemotePlugin::process( const sampleFrame * _in_buf,
 		return false;
 	}
 
-	memset( m_shm, 0, m_shmSize );
+	const size_t slotSize = REMOTE_PARAMETER_BLOCK_SIZE +
+				( m_inputCount+m_outputCount ) * frames;
+	float * slot = m_shm + m_currentSlot * slotSize;
+	float * shm = slot + REMOTE_PARAMETER_BLOCK_SIZE;
+	memset( shm, 0, ( slotSize - REMOTE_PARAMETER_BLOCK_SIZE ) *
+							sizeof( float ) );
 
 	ch_cnt_t inputs = qMin<ch_cnt_t>( m_inputCount, DEFAULT_CHANNELS );
 
@@ -300,18 +477,18 @@ bool RemotePlugin::process( const sampleFrame * _in_buf,
 			{
 				for( fpp_t frame = 0; frame < frames; ++frame )
 				{
-					m_shm[ch * frames + frame] =
+					shm[ch * frames + frame] =
 							_in_buf[frame][ch];
 				}
 			}
 		}
 		else if( inputs == DEFAULT_CHANNELS )
 		{
-			memcpy( m_shm, _in_buf, frames * BYTES_PER_FRAME );
+			memcpy( shm, _in_buf, frames * BYTES_PER_FRAME );
 		}
 		else
 		{
-			sampleFrame * o = (sampleFrame *) m_shm;
+			sampleFrame * o = (sampleFrame *) shm;
 			for( ch_cnt_t ch = 0; ch < inputs; ++ch )
 			{
 				for( fpp_t frame = 0; frame < frames; ++frame )
@@ -323,7 +500,12 @@ bool RemotePlugin::process( const sampleFrame * _in_buf,
 	}
 
 	lock();
-	sendMessage( IdStartProcessing );
+	// taken from the queue while locked, so changes sent as messages by
+	// sendParameterChanges() can't overtake them or be overtaken
+	writeParameterChanges( (RemoteParameterBlock *) slot );
+	sendMessage( message( IdStartProcessing ).
+				addInt( m_currentSlot * slotSize ) );
+	++m_pendingPeriods;
 
 	if( m_failed || _out_buf == NULL || m_outputCount == 0 )
 	{
@@ -331,9 +513,37 @@ bool RemotePlugin::process( const sampleFrame * _in_buf,
 		return false;
 	}
 
-	waitForMessage( IdProcessingDone );
+	// when pipelined, the period just started may still be running -
+	// the output of the one before is what's needed now
+	const int inFlight = m_pipelined ? 1 : 0;
+#ifdef DEBUG_REMOTE_PLUGIN
+	MicroTimer roundTrip;
+#endif
+	while( m_pendingPeriods > inFlight )
+	{
+		if( waitForMessage( IdProcessingDone ).id != IdProcessingDone )
+		{
+			break;
+		}
+	}
+	// the memory might have been replaced while waiting
+	const int outputSlot = m_pipelined ? ( m_currentSlot + 1 ) % 2 : 0;
+	const float * out = m_shm + outputSlot * ( REMOTE_PARAMETER_BLOCK_SIZE +
+				( m_inputCount+m_outputCount ) * frames ) +
+		REMOTE_PARAMETER_BLOCK_SIZE + m_inputCount * frames;
+	m_currentSlot = m_pipelined ? outputSlot : 0;
 	unlock();
 
+#ifdef DEBUG_REMOTE_PLUGIN
+	const int elapsed = roundTrip.elapsed();
+	m_roundTrips.last = elapsed;
+	m_roundTrips.max = qMax( m_roundTrips.max, elapsed );
+	// moving average over roughly the last 16 periods
+	m_roundTrips.average = m_roundTrips.periods == 0 ? elapsed :
+			m_roundTrips.average + ( elapsed - m_roundTrips.average ) / 16;
+	++m_roundTrips.periods;
+#endif
+
 	const ch_cnt_t outputs = qMin<ch_cnt_t>( m_outputCount,
 							DEFAULT_CHANNELS );
 	if( m_splitChannels )
@@ -342,20 +552,17 @@ bool RemotePlugin::process( const sampleFrame * _in_buf,
 		{
 			for( fpp_t frame = 0; frame < frames; ++frame )
 			{
-				_out_buf[frame][ch] = m_shm[( m_inputCount+ch )*
-								frames + frame];
+				_out_buf[frame][ch] = out[ch * frames + frame];
 			}
 		}
 	}
 	else if( outputs == DEFAULT_CHANNELS )
 	{
-		memcpy( _out_buf, m_shm + m_inputCount * frames,
-						frames * BYTES_PER_FRAME );
+		memcpy( _out_buf, out, frames * BYTES_PER_FRAME );
 	}
 	else
 	{
-		sampleFrame * o = (sampleFrame *) ( m_shm +
-							m_inputCount*frames );
+		const sampleFrame * o = (const sampleFrame *) out;
 		// clear buffer, if plugin didn't fill up both channels
 		BufferManager::clear( _out_buf, frames );
 
@@ -392,10 +599,144 @@ void RemotePlugin::processMidiEvent( const MidiEvent & _e,
 
 
 
+void RemotePlugin::setParameter( int _index, float _value, f_cnt_t _offset )
+{
+	RemoteParameterChange change;
+	change.index = _index;
+	change.value = _value;
+	change.offset = _offset;
+
+	m_parameterMutex.lock();
+	int i = 0;
+	while( i < m_parameterChanges.size() &&
+				m_parameterChanges[i].index != _index )
+	{
+		++i;
+	}
+	if( i < m_parameterChanges.size() )
+	{
+		m_parameterChanges[i] = change;
+	}
+	else
+	{
+		m_parameterChanges.push_back( change );
+	}
+	m_parameterMutex.unlock();
+
+	flushParameterChanges();
+}
+
+
+
+
+void RemotePlugin::flushParameterChanges()
+{
+	m_parameterMutex.lock();
+
+	// nothing being processed means the changes would wait for who knows
+	// how long - they should show in the plugin's editor right away though
+	const int period = Engine::mixer()->framesPerPeriod() * 1000 /
+			( Engine::mixer()->processingSampleRate() / 1000 );
+	const bool idle = m_lastPeriod.elapsed() >= 4 * period;
+	m_parameterMutex.unlock();
+
+	if( idle )
+	{
+		lock();
+		sendParameterChanges();
+		unlock();
+	}
+}
+
+
+
+
+void RemotePlugin::sendParameterChanges()
+{
+	m_parameterMutex.lock();
+	const QVector<RemoteParameterChange> changes = m_parameterChanges;
+	m_parameterChanges.clear();
+	m_parameterMutex.unlock();
+
+	for( int i = 0; i < changes.size(); ++i )
+	{
+		sendMessage( message( IdParameterChange ).
+			addInt( changes[i].index ).addFloat( changes[i].value ) );
+	}
+}
+
+
+
+
+void RemotePlugin::writeParameterChanges( RemoteParameterBlock * _block )
+{
+	const fpp_t frames = Engine::mixer()->framesPerPeriod();
+
+	m_parameterMutex.lock();
+	m_lastPeriod.reset();
+
+	const int count = qMin( m_parameterChanges.size(),
+						REMOTE_PARAMETER_CHANGES );
+	for( int i = 0; i < count; ++i )
+	{
+		_block->changes[i] = m_parameterChanges[i];
+		_block->changes[i].offset = qBound<int32_t>( 0,
+					m_parameterChanges[i].offset, frames - 1 );
+	}
+	_block->count = count;
+	m_parameterChanges.remove( 0, count );
+
+	m_parameterMutex.unlock();
+}
+
+
+
+
+void RemotePlugin::setPipelined( bool _on )
+{
+	lock();
+	if( _on != m_pipelined )
+	{
+		// let the remote process finish what it's working on before
+		// the layout of the shared memory changes
+		while( m_pendingPeriods > 0 && isRunning() )
+		{
+			if( waitForMessage( IdProcessingDone ).id !=
+							IdProcessingDone )
+			{
+				break;
+			}
+		}
+		m_pendingPeriods = 0;
+		m_pipelined = _on;
+		if( m_shm != NULL )
+		{
+			resizeSharedProcessingMemory();
+		}
+	}
+	unlock();
+
+	reportLatency();
+}
+
+
+
+
+void RemotePlugin::reportLatency()
+{
+	Engine::mixer()->reportLatency( this, m_pipelined ?
+				Engine::mixer()->framesPerPeriod() : 0 );
+}
+
+
+
+
 void RemotePlugin::resizeSharedProcessingMemory()
 {
-	const size_t s = ( m_inputCount+m_outputCount ) *
-				Engine::mixer()->framesPerPeriod() *
+	const size_t s = ( m_pipelined ? 2 : 1 ) *
+			( REMOTE_PARAMETER_BLOCK_SIZE +
+				( m_inputCount+m_outputCount ) *
+				Engine::mixer()->framesPerPeriod() ) *
 							sizeof( float );
 	if( m_shm != NULL )
 	{
@@ -425,6 +766,10 @@ void RemotePlugin::resizeSharedProcessingMemory()
 	m_shm = (float *) shmat( m_shmID, 0, 0 );
 #endif
 	m_shmSize = s;
+	// a period still in flight refers to the old memory, so there's
+	// nothing to pick up from the new one until the next period is done
+	memset( m_shm, 0, m_shmSize );
+	m_currentSlot = 0;
 	sendMessage( message( IdChangeSharedMemoryKey ).
 				addInt( shm_key ).addInt( m_shmSize ) );
 }
@@ -484,6 +829,14 @@ bool RemotePlugin::processMessage( const message & _m )
 			break;
 
 		case IdProcessingDone:
+			// counted here, as any wait for a message might be
+			// the one to pick it up
+			if( m_pendingPeriods > 0 )
+			{
+				--m_pendingPeriods;
+			}
+			break;
+
 		case IdQuit:
 		default:
 			break;
@@ -30,12 +30,18 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QMutex>
 #include <QPainter>
 #include <QReadLocker>
+#include <QVector>
 
 
 #include <cstring>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <sndfile.h>
 
 #define OV_EXCLUDE_STATIC_CALLBACKS
@@ -60,18 +66,243 @@
 #include "Engine.h"
 #include "interpolation.h"
 #include "Mixer.h"
+#include "ProjectContainer.h"
+#include "SampleLoader.h"
+#include "SamplePeaks.h"
+#include "SampleStream.h"
 #include "templates.h"
 
 #include "FileDialog.h"
 #include "MemoryManager.h"
 
 
+// creating libsamplerate states is expensive and notes come and go all the
+// time, so finished notes return theirs to a pool, one per converter type
+static QMutex s_resamplerPoolMutex;
+static QVector<SRC_STATE *> s_resamplerPool[SRC_LINEAR + 1];
+// how many states the mixer creates up front, see reserveResamplers() - a
+// note only creates one itself if more are playing at once
+static const int ReservedResamplers = 32;
+
+// the same for the buffers notes read looped or streamed fragments into,
+// see handleState::scratchBuffer() - they hold a few periods, enough for
+// all but the most extreme pitches
+static QMutex s_scratchPoolMutex;
+static QVector<sampleFrame *> s_scratchPool;
+static f_cnt_t s_scratchFrames = 0;
+static const int ScratchPeriods = 4;
+static const int ReservedScratchBuffers = 32;
+
+
+
+
+static SRC_STATE * acquireResampler( const int _mode )
+{
+	s_resamplerPoolMutex.lock();
+	if( !s_resamplerPool[_mode].isEmpty() )
+	{
+		SRC_STATE * state = s_resamplerPool[_mode].takeLast();
+		s_resamplerPoolMutex.unlock();
+		return state;
+	}
+	s_resamplerPoolMutex.unlock();
+
+	int error;
+	SRC_STATE * state = src_new( _mode, DEFAULT_CHANNELS, &error );
+	if( state == NULL )
+	{
+		qDebug( "Error: src_new() failed in sample_buffer.cpp!\n" );
+	}
+	return state;
+}
+
+
+
+
+static void releaseResampler( SRC_STATE * _state, const int _mode )
+{
+	src_reset( _state );
+	s_resamplerPoolMutex.lock();
+	s_resamplerPool[_mode].push_back( _state );
+	s_resamplerPoolMutex.unlock();
+}
+
+
+
+
+void SampleBuffer::reserveResamplers( const int _mode )
+{
+	s_resamplerPoolMutex.lock();
+	QVector<SRC_STATE *> & pool = s_resamplerPool[_mode];
+	pool.reserve( ReservedResamplers );
+	while( pool.size() < ReservedResamplers )
+	{
+		int error;
+		SRC_STATE * state = src_new( _mode, DEFAULT_CHANNELS, &error );
+		if( state == NULL )
+		{
+			qDebug( "Error: src_new() failed in sample_buffer.cpp!\n" );
+			break;
+		}
+		pool.push_back( state );
+	}
+	s_resamplerPoolMutex.unlock();
+}
+
+
+
+
+static sampleFrame * acquireScratchBuffer()
+{
+	s_scratchPoolMutex.lock();
+	if( !s_scratchPool.isEmpty() )
+	{
+		sampleFrame * buf = s_scratchPool.takeLast();
+		s_scratchPoolMutex.unlock();
+		return buf;
+	}
+	s_scratchPoolMutex.unlock();
+
+	return MM_ALLOC( sampleFrame, s_scratchFrames );
+}
+
+
+
+
+static void releaseScratchBuffer( sampleFrame * _buf, const f_cnt_t _frames )
+{
+	if( _buf == NULL )
+	{
+		return;
+	}
+	if( _frames != s_scratchFrames )
+	{
+		// not from the pool
+		MM_FREE( _buf );
+		return;
+	}
+	s_scratchPoolMutex.lock();
+	s_scratchPool.push_back( _buf );
+	s_scratchPoolMutex.unlock();
+}
+
+
+
+
+void SampleBuffer::reserveScratchBuffers( const fpp_t _framesPerPeriod )
+{
+	s_scratchPoolMutex.lock();
+	if( s_scratchFrames != _framesPerPeriod * ScratchPeriods )
+	{
+		for( int i = 0; i < s_scratchPool.size(); ++i )
+		{
+			MM_FREE( s_scratchPool[i] );
+		}
+		s_scratchPool.clear();
+		s_scratchFrames = _framesPerPeriod * ScratchPeriods;
+	}
+	s_scratchPool.reserve( ReservedScratchBuffers );
+	while( s_scratchPool.size() < ReservedScratchBuffers )
+	{
+		s_scratchPool.push_back( MM_ALLOC( sampleFrame, s_scratchFrames ) );
+	}
+	s_scratchPoolMutex.unlock();
+}
+
+
+
+
+static void convertInt16ToFloat( sampleFrame * _dst, const int_sample_t * _src,
+					const f_cnt_t _frames, const ch_cnt_t _channels )
+{
+	const float fac = 1.0f / 32768.0f;
+	f_cnt_t f = 0;
+
+#ifdef __SSE2__
+	const __m128 scale = _mm_set1_ps( fac );
+	if( _channels == 2 )
+	{
+		// 4 frames per iteration, sign extended by shifting the
+		// samples into the upper half and back
+		for( ; f + 4 <= _frames; f += 4 )
+		{
+			const __m128i in = _mm_loadu_si128(
+					(const __m128i *)( _src + f * 2 ) );
+			const __m128i lo = _mm_srai_epi32(
+					_mm_unpacklo_epi16( in, in ), 16 );
+			const __m128i hi = _mm_srai_epi32(
+					_mm_unpackhi_epi16( in, in ), 16 );
+			_mm_storeu_ps( _dst[f], _mm_mul_ps(
+					_mm_cvtepi32_ps( lo ), scale ) );
+			_mm_storeu_ps( _dst[f + 2], _mm_mul_ps(
+					_mm_cvtepi32_ps( hi ), scale ) );
+		}
+	}
+	else
+	{
+		// 8 frames per iteration, each sample goes to both channels
+		for( ; f + 8 <= _frames; f += 8 )
+		{
+			const __m128i in = _mm_loadu_si128(
+					(const __m128i *)( _src + f ) );
+			const __m128 lo = _mm_mul_ps( _mm_cvtepi32_ps(
+				_mm_srai_epi32( _mm_unpacklo_epi16( in, in ), 16 ) ),
+									scale );
+			const __m128 hi = _mm_mul_ps( _mm_cvtepi32_ps(
+				_mm_srai_epi32( _mm_unpackhi_epi16( in, in ), 16 ) ),
+									scale );
+			_mm_storeu_ps( _dst[f], _mm_unpacklo_ps( lo, lo ) );
+			_mm_storeu_ps( _dst[f + 2], _mm_unpackhi_ps( lo, lo ) );
+			_mm_storeu_ps( _dst[f + 4], _mm_unpacklo_ps( hi, hi ) );
+			_mm_storeu_ps( _dst[f + 6], _mm_unpackhi_ps( hi, hi ) );
+		}
+	}
+#endif
+
+	const int ch = ( _channels > 1 ) ? 1 : 0;
+	for( ; f < _frames; ++f )
+	{
+		_dst[f][0] = _src[f * _channels] * fac;
+		_dst[f][1] = _src[f * _channels + ch] * fac;
+	}
+}
+
+
+
+
+static void convertInt24ToFloat( sampleFrame * _dst, const uchar * _src,
+					const f_cnt_t _frames, const ch_cnt_t _channels )
+{
+	const float fac = 1.0f / 8388608.0f;
+	const int ch = ( _channels > 1 ) ? 1 : 0;
+	for( f_cnt_t f = 0; f < _frames; ++f )
+	{
+		const uchar * l = _src + f * _channels * 3;
+		const uchar * r = l + ch * 3;
+		// assemble in the upper bytes so the sign is shifted in
+		_dst[f][0] = ( (int)( ( (unsigned) l[2] << 24 ) |
+				( l[1] << 16 ) | ( l[0] << 8 ) ) >> 8 ) * fac;
+		_dst[f][1] = ( (int)( ( (unsigned) r[2] << 24 ) |
+				( r[1] << 16 ) | ( r[0] << 8 ) ) >> 8 ) * fac;
+	}
+}
+
+
+
+
 SampleBuffer::SampleBuffer( const QString & _audio_file,
 							bool _is_base64_data ) :
 	m_audioFile( ( _is_base64_data == true ) ? "" : _audio_file ),
 	m_origData( NULL ),
 	m_origFrames( 0 ),
 	m_data( NULL ),
+	m_compactData( NULL ),
+	m_storageFormat( FloatStorage ),
+	m_storageChannels( DEFAULT_CHANNELS ),
+	m_compactAllowed( false ),
+	m_asyncAllowed( false ),
+	m_streamingAllowed( false ),
+	m_loading( false ),
 	m_frames( 0 ),
 	m_startFrame( 0 ),
 	m_endFrame( 0 ),
@@ -80,7 +311,16 @@ SampleBuffer::SampleBuffer( const QString & _audio_file,
 	m_amplification( 1.0f ),
 	m_reversed( false ),
 	m_frequency( BaseFreq ),
-	m_sampleRate( Engine::mixer()->baseSampleRate() )
+	m_sampleRate( Engine::mixer()->baseSampleRate() ),
+	m_dataShared( false ),
+	m_expandedData( NULL ),
+	m_expandMutex(),
+	m_streamed( false ),
+	m_headFrames( 0 ),
+	m_revision( 0 ),
+	m_peaks( NULL ),
+	m_containerLocation(),
+	m_containerSample( 0 )
 {
 	if( _is_base64_data == true )
 	{
@@ -98,6 +338,13 @@ SampleBuffer::SampleBuffer( const sampleFrame * _data, const f_cnt_t _frames ) :
 	m_origData( NULL ),
 	m_origFrames( 0 ),
 	m_data( NULL ),
+	m_compactData( NULL ),
+	m_storageFormat( FloatStorage ),
+	m_storageChannels( DEFAULT_CHANNELS ),
+	m_compactAllowed( false ),
+	m_asyncAllowed( false ),
+	m_streamingAllowed( false ),
+	m_loading( false ),
 	m_frames( 0 ),
 	m_startFrame( 0 ),
 	m_endFrame( 0 ),
@@ -106,7 +353,16 @@ SampleBuffer::SampleBuffer( const sampleFrame * _data, const f_cnt_t _frames ) :
 	m_amplification( 1.0f ),
 	m_reversed( false ),
 	m_frequency( BaseFreq ),
-	m_sampleRate( Engine::mixer()->baseSampleRate() )
+	m_sampleRate( Engine::mixer()->baseSampleRate() ),
+	m_dataShared( false ),
+	m_expandedData( NULL ),
+	m_expandMutex(),
+	m_streamed( false ),
+	m_headFrames( 0 ),
+	m_revision( 0 ),
+	m_peaks( NULL ),
+	m_containerLocation(),
+	m_containerSample( 0 )
 {
 	if( _frames > 0 )
 	{
@@ -126,6 +382,13 @@ SampleBuffer::SampleBuffer( const f_cnt_t _frames ) :
 	m_origData( NULL ),
 	m_origFrames( 0 ),
 	m_data( NULL ),
+	m_compactData( NULL ),
+	m_storageFormat( FloatStorage ),
+	m_storageChannels( DEFAULT_CHANNELS ),
+	m_compactAllowed( false ),
+	m_asyncAllowed( false ),
+	m_streamingAllowed( false ),
+	m_loading( false ),
 	m_frames( 0 ),
 	m_startFrame( 0 ),
 	m_endFrame( 0 ),
@@ -134,7 +397,16 @@ SampleBuffer::SampleBuffer( const f_cnt_t _frames ) :
 	m_amplification( 1.0f ),
 	m_reversed( false ),
 	m_frequency( BaseFreq ),
-	m_sampleRate( Engine::mixer()->baseSampleRate() )
+	m_sampleRate( Engine::mixer()->baseSampleRate() ),
+	m_dataShared( false ),
+	m_expandedData( NULL ),
+	m_expandMutex(),
+	m_streamed( false ),
+	m_headFrames( 0 ),
+	m_revision( 0 ),
+	m_peaks( NULL ),
+	m_containerLocation(),
+	m_containerSample( 0 )
 {
 	if( _frames > 0 )
 	{
@@ -151,10 +423,20 @@ SampleBuffer::SampleBuffer( const f_cnt_t _frames ) :
 
 SampleBuffer::~SampleBuffer()
 {
+	if( m_loading && SampleLoader::inst() != NULL )
+	{
+		SampleLoader::inst()->cancel( this );
+	}
+
 	if( m_origData != NULL )
 		MM_FREE( m_origData );
 
-	MM_FREE( m_data );
+	releaseData();
+
+	if( m_peaks != NULL )
+	{
+		sharedObject::unref( m_peaks );
+	}
 }
 
 
@@ -165,22 +447,59 @@ void SampleBuffer::sampleRateChanged()
 }
 
 
-void SampleBuffer::update( bool _keep_settings )
+void SampleBuffer::update( bool _keep_settings, bool _async )
 {
-	const bool lock = ( m_data != NULL );
+	const bool lock = ( m_data != NULL || m_compactData != NULL );
+	if( m_loading && SampleLoader::inst() != NULL )
+	{
+		SampleLoader::inst()->cancel( this );
+	}
+	m_loading = false;
 	if( lock )
 	{
 		Engine::mixer()->requestChangeInModel();
 		m_varLock.lockForWrite();
-		MM_FREE( m_data );
+		releaseData();
+	}
+
+	if( m_peaks != NULL )
+	{
+		sharedObject::unref( m_peaks );
+		m_peaks = NULL;
 	}
 
-	if( m_audioFile.isEmpty() && m_origData != NULL && m_origFrames > 0 )
+	// running streams have to be restarted by their handles
+	m_streamed = false;
+	m_headFrames = 0;
+	++m_revision;
+
+	SampleCache::Data embedded;
+	if( m_audioFile.isEmpty() && !m_containerLocation.isEmpty() &&
+		ProjectContainer::acquireSample( m_containerLocation,
+						m_containerSample, &embedded ) )
+	{
+		// played right from the mapped project file or from what
+		// DataFile decoded while parsing
+		setSharedData( embedded );
+		if( _keep_settings == false )
+		{
+			m_loopStartFrame = m_startFrame = 0;
+			m_loopEndFrame = m_endFrame = m_frames;
+		}
+		m_peaks = SampleCache::peaks( m_data, QString(),
+					Engine::mixer()->baseSampleRate() );
+		if( m_reversed )
+		{
+			reverseData();
+		}
+	}
+	else if( m_audioFile.isEmpty() && m_origData != NULL && m_origFrames > 0 )
 	{
 		// TODO: reverse- and amplification-property is not covered
 		// by following code...
-		m_data = MM_ALLOC( sampleFrame, m_origFrames );
-		memcpy( m_data, m_origData, m_origFrames * BYTES_PER_FRAME );
+		// as nothing is done to the data, we can play the original
+		// one instead of keeping a copy
+		m_data = m_origData;
 		if( _keep_settings == false )
 		{
 			m_frames = m_origFrames;
@@ -203,11 +522,43 @@ void SampleBuffer::update( bool _keep_settings )
 		m_frames = 0;
 
 		const QFileInfo fileInfo( file );
-		if( fileInfo.size() > 100*1024*1024 )
+		const QString cacheKey = this->cacheKey( file );
+		SampleCache::Data cached;
+		if( openStreamed( file, _keep_settings ) )
+		{
+			delete[] f;
+		}
+		else if( fileInfo.size() > 100*1024*1024 )
 		{
 			qWarning( "refusing to load sample files bigger "
 								"than 100 MB" );
 		}
+		else if( SampleCache::acquire( cacheKey, &cached ) )
+		{
+			// someone else already decoded this file
+			delete[] f;
+			setSharedData( cached );
+			normalizeSampleRate( Engine::mixer()->baseSampleRate(),
+							_keep_settings );
+		}
+		else if( _async && !cacheKey.isEmpty() &&
+						SampleLoader::inst() != NULL )
+		{
+			// hold a single silent frame until the loader has put
+			// the file into the cache, see finishLoading()
+			delete[] f;
+			m_loading = true;
+			m_data = MM_ALLOC( sampleFrame, 1 );
+			memset( m_data, 0, sizeof( *m_data ) );
+			m_frames = 1;
+			if( _keep_settings == false )
+			{
+				m_loopStartFrame = m_startFrame = 0;
+				m_loopEndFrame = m_endFrame = 1;
+			}
+			SampleLoader::inst()->load( this, file,
+					m_compactAllowed, _keep_settings );
+		}
 		else
 		{
 
@@ -253,9 +604,42 @@ void SampleBuffer::update( bool _keep_settings )
 			else // otherwise normalize sample rate
 			{
 				normalizeSampleRate( samplerate, _keep_settings );
+				if( !cacheKey.isEmpty() )
+				{
+					cached.frames = m_frames;
+					cached.format = m_storageFormat;
+					cached.channels = m_storageChannels;
+					cached.data = ( m_storageFormat == FloatStorage ) ?
+						(void *) m_data : (void *) m_compactData;
+					SampleCache::insert( cacheKey, &cached );
+					setSharedData( cached );
+				}
 			}
 
 		}
+
+		// the peaks describe the data as found in the file,
+		// visualize() mirrors them for reversed buffers
+		if( m_dataShared )
+		{
+			m_peaks = SampleCache::peaks( ( m_storageFormat ==
+						FloatStorage ) ? (void *) m_data :
+						(void *) m_compactData, file,
+					Engine::mixer()->baseSampleRate() );
+		}
+		else if( m_streamed )
+		{
+			m_peaks = new SamplePeaks( file, m_frames,
+					Engine::mixer()->baseSampleRate() );
+			m_peaks->buildFromFile();
+		}
+
+		// the cache holds the data as found in the file, so reversing
+		// needs a private copy
+		if( m_dataShared && m_reversed )
+		{
+			reverseData();
+		}
 	}
 	else
 	{
@@ -278,6 +662,118 @@ void SampleBuffer::update( bool _keep_settings )
 }
 
 
+void SampleBuffer::finishLoading( bool _keep_settings )
+{
+	update( _keep_settings );
+}
+
+
+
+
+QString SampleBuffer::cacheKey( const QString & _file ) const
+{
+	// compact and float data of a file are cached separately
+	return SampleCache::key( QFileInfo( _file ),
+				Engine::mixer()->baseSampleRate(),
+				useCompactStorage(
+					Engine::mixer()->baseSampleRate(), 1 ) );
+}
+
+
+
+
+bool SampleBuffer::decodeToCache( const QString & _file, bool _compact,
+						SampleCache::Data * _data )
+{
+	SampleBuffer decoder;
+	// drop the single frame the default constructor created, so update()
+	// doesn't need to lock the mixer
+	decoder.releaseData();
+	decoder.m_compactAllowed = _compact;
+	decoder.m_audioFile = _file;
+	decoder.update();
+
+	// our reference keeps the data cached when the decoder goes away
+	return decoder.m_dataShared &&
+		SampleCache::acquire( decoder.cacheKey( _file ), _data );
+}
+
+
+
+
+bool SampleBuffer::openStreamed( const QString & _file, bool _keep_settings )
+{
+	// streaming is configured in seconds, 0 disables it
+	const QString threshold = ConfigManager::inst()->value( "mixer",
+						"samplestreamingthreshold" );
+	const int thresholdSecs = threshold.isEmpty() ?
+		DEFAULT_STREAMING_THRESHOLD : threshold.toInt();
+	const QString preload = ConfigManager::inst()->value( "mixer",
+						"samplestreamingpreload" );
+	const int preloadSecs = preload.isEmpty() ?
+		DEFAULT_STREAMING_PRELOAD : qMax( 1, preload.toInt() );
+
+	// reversed samples need all of their data
+	if( m_streamingAllowed == false || thresholdSecs <= 0 || m_reversed )
+	{
+		return false;
+	}
+
+	SF_INFO sf_info;
+	memset( &sf_info, 0, sizeof( sf_info ) );
+#ifdef LMMS_BUILD_WIN32
+	SNDFILE * snd_file = sf_open( _file.toLocal8Bit().constData(),
+							SFM_READ, &sf_info );
+#else
+	SNDFILE * snd_file = sf_open( _file.toUtf8().constData(),
+							SFM_READ, &sf_info );
+#endif
+	if( snd_file == NULL )
+	{
+		return false;
+	}
+
+	// the stream is not resampled, so only files in our base sample
+	// rate can be streamed
+	const sample_rate_t baseRate = Engine::mixer()->baseSampleRate();
+	if( !sf_info.seekable || (sample_rate_t) sf_info.samplerate != baseRate ||
+			sf_info.frames <= (sf_count_t) thresholdSecs * baseRate ||
+			sf_info.frames > typeInfo<f_cnt_t>::max() )
+	{
+		sf_close( snd_file );
+		return false;
+	}
+
+	const f_cnt_t head = qMin<f_cnt_t>( sf_info.frames,
+						preloadSecs * baseRate );
+	sample_t * buf = new sample_t[head * sf_info.channels];
+	const f_cnt_t read = sf_readf_float( snd_file, buf, head );
+	sf_close( snd_file );
+
+	if( read < head )
+	{
+		delete[] buf;
+		return false;
+	}
+
+	directFloatWrite( buf, head, sf_info.channels );
+
+	m_streamFile = _file;
+	m_streamed = true;
+	m_headFrames = head;
+	m_frames = sf_info.frames;
+	if( _keep_settings == false )
+	{
+		m_loopStartFrame = m_startFrame = 0;
+		m_loopEndFrame = m_endFrame = m_frames;
+	}
+
+	return true;
+}
+
+
+
+
 void SampleBuffer::convertIntToFloat ( int_sample_t * & _ibuf, f_cnt_t _frames, int _channels)
 {
 	// following code transforms int-samples into
@@ -286,70 +782,223 @@ void SampleBuffer::convertIntToFloat ( int_sample_t * & _ibuf, f_cnt_t _frames,
 	m_data = MM_ALLOC( sampleFrame, _frames );
 	const int ch = ( _channels > 1 ) ? 1 : 0;
 
-	// if reversing is on, we also reverse when
-	// scaling
-	if( m_reversed )
+	int idx = 0;
+	for( f_cnt_t frame = 0; frame < _frames; ++frame )
 	{
-		int idx = ( _frames - 1 ) * _channels;
-		for( f_cnt_t frame = 0; frame < _frames;
-						++frame )
-		{
-			m_data[frame][0] = _ibuf[idx+0] * fac;
-			m_data[frame][1] = _ibuf[idx+ch] * fac;
-			idx -= _channels;
-		}
+		m_data[frame][0] = _ibuf[idx+0] * fac;
+		m_data[frame][1] = _ibuf[idx+ch] * fac;
+		idx += _channels;
+	}
+
+	delete[] _ibuf;
+}
+
+void SampleBuffer::directFloatWrite ( sample_t * & _fbuf, f_cnt_t _frames, int _channels)
+
+{
+
+	m_data = MM_ALLOC( sampleFrame, _frames );
+	const int ch = ( _channels > 1 ) ? 1 : 0;
+
+	int idx = 0;
+	for( f_cnt_t frame = 0; frame < _frames; ++frame )
+	{
+		m_data[frame][0] = _fbuf[idx+0];
+		m_data[frame][1] = _fbuf[idx+ch];
+		idx += _channels;
+	}
+
+	delete[] _fbuf;
+}
+
+
+
+
+void SampleBuffer::releaseData()
+{
+	if( m_dataShared )
+	{
+		SampleCache::release( ( m_storageFormat == FloatStorage ) ?
+					(void *) m_data : (void *) m_compactData );
+		m_dataShared = false;
 	}
 	else
 	{
-		int idx = 0;
-		for( f_cnt_t frame = 0; frame < _frames;
-						++frame )
+		// in-memory buffers play m_origData, which is freed separately
+		if( m_data != m_origData )
 		{
-			m_data[frame][0] = _ibuf[idx+0] * fac;
-			m_data[frame][1] = _ibuf[idx+ch] * fac;
-			idx += _channels;
+			MM_FREE( m_data );
 		}
+		MM_FREE( m_compactData );
 	}
+	m_data = NULL;
+	m_compactData = NULL;
+	m_storageFormat = FloatStorage;
+	m_storageChannels = DEFAULT_CHANNELS;
 
-	delete[] _ibuf;
+	m_expandMutex.lock();
+	MM_FREE( m_expandedData );
+	m_expandedData = NULL;
+	m_expandMutex.unlock();
 }
 
-void SampleBuffer::directFloatWrite ( sample_t * & _fbuf, f_cnt_t _frames, int _channels)
 
+
+
+bool SampleBuffer::completeData( SampleCache::Data * _data,
+						bool * _decoded ) const
 {
+	// streamed files only have their first frames in memory, so they
+	// are decoded completely
+	_data->data = m_storageFormat == FloatStorage ?
+				(void *) m_data : (void *) m_compactData;
+	_data->frames = m_frames;
+	_data->format = m_storageFormat;
+	_data->channels = m_storageChannels;
+	*_decoded = m_streamed && decodeToCache( m_streamFile, false, _data );
+	return ( !m_streamed || *_decoded ) && _data->data != NULL;
+}
 
-	m_data = MM_ALLOC( sampleFrame, _frames );
-	const int ch = ( _channels > 1 ) ? 1 : 0;
 
-	// if reversing is on, we also reverse when
-	// scaling
-	if( m_reversed )
+
+
+const sampleFrame * SampleBuffer::data() const
+{
+	if( m_storageFormat == FloatStorage && !m_streamed )
+	{
+		return m_data;
+	}
+
+	QMutexLocker lock( &m_expandMutex );
+	if( m_expandedData == NULL )
 	{
-		int idx = ( _frames - 1 ) * _channels;
-		for( f_cnt_t frame = 0; frame < _frames;
-						++frame )
+		SampleCache::Data source;
+		bool decoded;
+		if( !completeData( &source, &decoded ) )
 		{
-			m_data[frame][0] = _fbuf[idx+0];
-			m_data[frame][1] = _fbuf[idx+ch];
-			idx -= _channels;
+			qWarning( "SampleBuffer::data(): no data to expand" );
+			return NULL;
+		}
+		const f_cnt_t frames = qMin( source.frames, m_frames );
+		m_expandedData = MM_ALLOC( sampleFrame, qMax<f_cnt_t>( m_frames, 1 ) );
+		convertStoredFrames( m_expandedData, source.data,
+				(StorageFormat) source.format, source.channels,
+				0, frames );
+		memset( m_expandedData + frames, 0,
+				( m_frames - frames ) * BYTES_PER_FRAME );
+		if( decoded )
+		{
+			SampleCache::release( source.data );
 		}
 	}
+	return m_expandedData;
+}
+
+
+
+
+void SampleBuffer::setSharedData( const SampleCache::Data & _data )
+{
+	m_frames = _data.frames;
+	m_storageFormat = (StorageFormat) _data.format;
+	m_storageChannels = _data.channels;
+	if( m_storageFormat == FloatStorage )
+	{
+		m_data = (sampleFrame *) _data.data;
+	}
 	else
 	{
-		int idx = 0;
-		for( f_cnt_t frame = 0; frame < _frames;
-						++frame )
+		m_compactData = (char *) _data.data;
+	}
+	m_dataShared = true;
+}
+
+
+
+
+void SampleBuffer::reverseData()
+{
+	if( m_storageFormat == FloatStorage )
+	{
+		sampleFrame * data = MM_ALLOC( sampleFrame, m_frames );
+		for( f_cnt_t frame = 0; frame < m_frames; ++frame )
 		{
-			m_data[frame][0] = _fbuf[idx+0];
-			m_data[frame][1] = _fbuf[idx+ch];
-			idx += _channels;
+			data[frame][0] = m_data[m_frames - 1 - frame][0];
+			data[frame][1] = m_data[m_frames - 1 - frame][1];
 		}
+		releaseData();
+		m_data = data;
+		return;
 	}
 
-	delete[] _fbuf;
+	const StorageFormat format = m_storageFormat;
+	const ch_cnt_t channels = m_storageChannels;
+	const int frameSize = ( format == Int16Storage ? 2 : 3 ) * channels;
+	char * data = MM_ALLOC( char, m_frames * frameSize );
+	for( f_cnt_t frame = 0; frame < m_frames; ++frame )
+	{
+		memcpy( data + frame * frameSize,
+			m_compactData + ( m_frames - 1 - frame ) * frameSize,
+								frameSize );
+	}
+	releaseData();
+	m_compactData = data;
+	m_storageFormat = format;
+	m_storageChannels = channels;
 }
 
 
+
+
+bool SampleBuffer::useCompactStorage( sample_rate_t _sample_rate,
+						ch_cnt_t _channels ) const
+{
+	// compact data can't be resampled, so it has to be in our rate
+	return m_compactAllowed && _channels <= DEFAULT_CHANNELS &&
+		_sample_rate == Engine::mixer()->baseSampleRate() &&
+		ConfigManager::inst()->value( "mixer", "compactsamples" ).toInt();
+}
+
+
+
+
+void SampleBuffer::storeCompact16( int_sample_t * & _buf, f_cnt_t _frames,
+							ch_cnt_t _channels )
+{
+	m_compactData = MM_ALLOC( char, _frames * _channels * 2 );
+	memcpy( m_compactData, _buf, _frames * _channels * 2 );
+	m_storageFormat = Int16Storage;
+	m_storageChannels = _channels;
+
+	delete[] _buf;
+}
+
+
+
+
+void SampleBuffer::storeCompact24( int * & _buf, f_cnt_t _frames,
+							ch_cnt_t _channels )
+{
+	// libsndfile hands out 24 bit samples in the upper bits of an int,
+	// we keep the three upper bytes in little endian order
+	m_compactData = MM_ALLOC( char, _frames * _channels * 3 );
+	uchar * dst = (uchar *) m_compactData;
+	for( f_cnt_t i = 0; i < _frames * _channels; ++i )
+	{
+		const int s = _buf[i] >> 8;
+		dst[i * 3 + 0] = s & 0xff;
+		dst[i * 3 + 1] = ( s >> 8 ) & 0xff;
+		dst[i * 3 + 2] = ( s >> 16 ) & 0xff;
+	}
+	m_storageFormat = Int24Storage;
+	m_storageChannels = _channels;
+
+	delete[] _buf;
+}
+
+
+
+
 void SampleBuffer::normalizeSampleRate( const sample_rate_t _src_sr,
 							bool _keep_settings )
 {
@@ -358,7 +1007,7 @@ void SampleBuffer::normalizeSampleRate( const sample_rate_t _src_sr,
 	{
 		SampleBuffer * resampled = resample( _src_sr,
 					Engine::mixer()->baseSampleRate() );
-		MM_FREE( m_data );
+		releaseData();
 		m_frames = resampled->frames();
 		m_data = MM_ALLOC( sampleFrame, m_frames );
 		memcpy( m_data, resampled->data(), m_frames *
@@ -390,6 +1039,29 @@ f_cnt_t SampleBuffer::decodeSampleSF( const char * _f,
 	if( ( snd_file = sf_open( _f, SFM_READ, &sf_info ) ) != NULL )
 	{
 		frames = sf_info.frames;
+		_channels = sf_info.channels;
+		_samplerate = sf_info.samplerate;
+
+		const int subtype = sf_info.format & SF_FORMAT_SUBMASK;
+		if( frames > 0 && useCompactStorage( _samplerate, _channels ) &&
+			( subtype == SF_FORMAT_PCM_S8 || subtype == SF_FORMAT_PCM_U8 ||
+						subtype == SF_FORMAT_PCM_16 ) )
+		{
+			int_sample_t * ibuf = new int_sample_t[_channels * frames];
+			sf_read_short( snd_file, ibuf, _channels * frames );
+			sf_close( snd_file );
+			storeCompact16( ibuf, frames, _channels );
+			return frames;
+		}
+		if( frames > 0 && useCompactStorage( _samplerate, _channels ) &&
+						subtype == SF_FORMAT_PCM_24 )
+		{
+			int * ibuf = new int[_channels * frames];
+			sf_read_int( snd_file, ibuf, _channels * frames );
+			sf_close( snd_file );
+			storeCompact24( ibuf, frames, _channels );
+			return frames;
+		}
 
 		_buf = new sample_t[sf_info.channels * frames];
 		sf_rr = sf_read_float( snd_file, _buf, sf_info.channels * frames );
@@ -401,9 +1073,6 @@ f_cnt_t SampleBuffer::decodeSampleSF( const char * _f,
 				" sample %s: %s", _f, sf_strerror( NULL ) );
 #endif
 		}
-		_channels = sf_info.channels;
-		_samplerate = sf_info.samplerate;
-
 		sf_close( snd_file );
 	}
 	else
@@ -564,7 +1233,14 @@ f_cnt_t SampleBuffer::decodeSampleOGGVorbis( const char * _f,
 
 	if ( frames > 0 && _buf != NULL )
 	{
-		convertIntToFloat ( _buf, frames, _channels);
+		if( useCompactStorage( _samplerate, _channels ) )
+		{
+			storeCompact16( _buf, frames, _channels );
+		}
+		else
+		{
+			convertIntToFloat ( _buf, frames, _channels);
+		}
 	}
 
 	return frames;
@@ -579,12 +1255,24 @@ f_cnt_t SampleBuffer::decodeSampleDS( const char * _f,
 						ch_cnt_t & _channels,
 						sample_rate_t & _samplerate )
 {
+	// DrumSynth keeps its state in globals, so files being loaded in
+	// parallel have to take turns
+	static QMutex s_drumSynthMutex;
+	s_drumSynthMutex.lock();
 	DrumSynth ds;
 	f_cnt_t frames = ds.GetDSFileSamples( _f, _buf, _channels, _samplerate );
+	s_drumSynthMutex.unlock();
 
 	if ( frames > 0 && _buf != NULL )
 	{
-		convertIntToFloat ( _buf, frames, _channels);
+		if( useCompactStorage( _samplerate, _channels ) )
+		{
+			storeCompact16( _buf, frames, _channels );
+		}
+		else
+		{
+			convertIntToFloat ( _buf, frames, _channels);
+		}
 	}
 
 	return frames;
@@ -604,7 +1292,7 @@ bool SampleBuffer::play( sampleFrame * _ab, handleState * _state,
 	f_cnt_t loopStartFrame = m_loopStartFrame;
 	f_cnt_t loopEndFrame = m_loopEndFrame;
 
-	if( endFrame == 0 || _frames == 0 )
+	if( endFrame == 0 || _frames == 0 || m_loading )
 	{
 		return false;
 	}
@@ -646,51 +1334,85 @@ bool SampleBuffer::play( sampleFrame * _ab, handleState * _state,
 		play_frame = getPingPongIndex( play_frame, loopStartFrame, loopEndFrame );
 	}
 
-	f_cnt_t fragment_size = (f_cnt_t)( _frames * freq_factor ) + MARGIN[ _state->interpolationMode() ];
+	// (re)start streaming from where we are about to play
+	if( m_streamed && ( _state->m_stream == NULL ||
+				_state->m_streamRevision != m_revision ) )
+	{
+		if( _state->m_stream != NULL )
+		{
+			SampleStreamer::releaseStream( _state->m_stream );
+		}
+		_state->m_stream = SampleStreamer::createStream( m_streamFile,
+					qMax( play_frame, m_headFrames ) );
+		_state->m_streamRevision = m_revision;
+	}
 
-	sampleFrame * tmp = NULL;
+	f_cnt_t fragment_size = (f_cnt_t)( _frames * freq_factor ) + MARGIN[ _state->interpolationMode() ];
 
 	// check whether we have to change pitch...
 	if( freq_factor != 1.0 || _state->m_varyingPitch )
 	{
-		SRC_DATA src_data;
-		// Generate output
-		src_data.data_in =
-			getSampleFragment( play_frame, fragment_size, _loopmode, &tmp, &is_backwards,
-			loopStartFrame, loopEndFrame, endFrame )[0];
-		src_data.data_out = _ab[0];
-		src_data.input_frames = fragment_size;
-		src_data.output_frames = _frames;
-		src_data.src_ratio = 1.0 / freq_factor;
-		src_data.end_of_input = 0;
-		int error = src_process( _state->m_resamplingData,
-								&src_data );
-		if( error )
+		f_cnt_t frames_used = 0;
+		if( !_state->m_varyingPitch && FixedRatioResampler::supports(
+				freq_factor, _state->interpolationMode() ) )
 		{
-			printf( "SampleBuffer: error while resampling: %s\n",
-							src_strerror( error ) );
+			fragment_size = (f_cnt_t)( _frames * freq_factor ) +
+				FixedRatioResampler::lookahead( freq_factor,
+					_state->interpolationMode() ) + 2;
+			frames_used = _state->m_fixedResampler.process(
+				getSampleFragment( play_frame, fragment_size, _loopmode,
+					&is_backwards, loopStartFrame,
+					loopEndFrame, endFrame, _state ),
+				_ab, _frames, freq_factor,
+				_state->interpolationMode() );
 		}
-		if( src_data.output_frames_gen > _frames )
+		else
 		{
-			printf( "SampleBuffer: not enough frames: %ld / %d\n",
-					src_data.output_frames_gen, _frames );
+			if( _state->m_resamplingData == NULL )
+			{
+				_state->m_resamplingData = acquireResampler(
+						_state->interpolationMode() );
+			}
+			SRC_DATA src_data;
+			// Generate output
+			src_data.data_in =
+				getSampleFragment( play_frame, fragment_size, _loopmode, &is_backwards,
+				loopStartFrame, loopEndFrame, endFrame, _state )[0];
+			src_data.data_out = _ab[0];
+			src_data.input_frames = fragment_size;
+			src_data.output_frames = _frames;
+			src_data.src_ratio = 1.0 / freq_factor;
+			src_data.end_of_input = 0;
+			int error = src_process( _state->m_resamplingData,
+									&src_data );
+			if( error )
+			{
+				printf( "SampleBuffer: error while resampling: %s\n",
+								src_strerror( error ) );
+			}
+			if( src_data.output_frames_gen > _frames )
+			{
+				printf( "SampleBuffer: not enough frames: %ld / %d\n",
+						src_data.output_frames_gen, _frames );
+			}
+			frames_used = src_data.input_frames_used;
 		}
 		// Advance
 		switch( _loopmode )
 		{
 			case LoopOff:
-				play_frame += src_data.input_frames_used;
+				play_frame += frames_used;
 				break;
 			case LoopOn:
-				play_frame += src_data.input_frames_used;
+				play_frame += frames_used;
 				play_frame = getLoopedIndex( play_frame, loopStartFrame, loopEndFrame );
 				break;
 			case LoopPingPong:
 			{
-				f_cnt_t left = src_data.input_frames_used;
+				f_cnt_t left = frames_used;
 				if( _state->isBackwards() )
 				{
-					play_frame -= src_data.input_frames_used;
+					play_frame -= frames_used;
 					if( play_frame < loopStartFrame )
 					{
 						left -= ( loopStartFrame - play_frame );
@@ -711,8 +1433,8 @@ bool SampleBuffer::play( sampleFrame * _ab, handleState * _state,
 
 		// Generate output
 		memcpy( _ab,
-			getSampleFragment( play_frame, _frames, _loopmode, &tmp, &is_backwards,
-						loopStartFrame, loopEndFrame, endFrame ),
+			getSampleFragment( play_frame, _frames, _loopmode, &is_backwards,
+						loopStartFrame, loopEndFrame, endFrame, _state ),
 						_frames * BYTES_PER_FRAME );
 		// Advance
 		switch( _loopmode )
@@ -744,11 +1466,6 @@ bool SampleBuffer::play( sampleFrame * _ab, handleState * _state,
 		}
 	}
 
-	if( tmp != NULL ) 
-	{
-		MM_FREE( tmp );
-	}
-
 	_state->setBackwards( is_backwards );
 	_state->setFrameIndex( play_frame );
 
@@ -765,49 +1482,55 @@ bool SampleBuffer::play( sampleFrame * _ab, handleState * _state,
 
 
 sampleFrame * SampleBuffer::getSampleFragment( f_cnt_t _index,
-		f_cnt_t _frames, LoopMode _loopmode, sampleFrame * * _tmp, bool * _backwards,
-		f_cnt_t _loopstart, f_cnt_t _loopend, f_cnt_t _end ) const
+		f_cnt_t _frames, LoopMode _loopmode, bool * _backwards,
+		f_cnt_t _loopstart, f_cnt_t _loopend, f_cnt_t _end,
+		handleState * _state ) const
 {
+	// we can only hand out a pointer to m_data if the fragment is in
+	// memory and stored as float
+	const bool inMemory = m_data != NULL &&
+				_index + _frames <= framesInMemory();
+
 	if( _loopmode == LoopOff )
 	{
-		if( _index + _frames <= _end )
+		if( _index + _frames <= _end && inMemory )
 		{
 			return m_data + _index;
 		}
 	}
 	else if( _loopmode == LoopOn )
 	{
-		if( _index + _frames <= _loopend )
+		if( _index + _frames <= _loopend && inMemory )
 		{
 			return m_data + _index;
 		}
 	}
 	else
 	{
-		if( ! *_backwards && _index + _frames < _loopend )
+		if( ! *_backwards && _index + _frames < _loopend && inMemory )
 		{
 			return m_data + _index;
 		}
 	}
 
-	*_tmp = MM_ALLOC( sampleFrame, _frames );
+	sampleFrame * tmp = _state->scratchBuffer( _frames );
 
 	if( _loopmode == LoopOff )
 	{
-		f_cnt_t available = _end - _index;
-		memcpy( *_tmp, m_data + _index, available * BYTES_PER_FRAME );
-		memset( *_tmp + available, 0, ( _frames - available ) *
+		f_cnt_t available = qMin( _frames, _end - _index );
+		readFrames( tmp, _index, available, _state );
+		memset( tmp + available, 0, ( _frames - available ) *
 							BYTES_PER_FRAME );
 	}
 	else if( _loopmode == LoopOn )
 	{
 		f_cnt_t copied = qMin( _frames, _loopend - _index );
-		memcpy( *_tmp, m_data + _index, copied * BYTES_PER_FRAME );
+		readFrames( tmp, _index, copied, _state );
 		f_cnt_t loop_frames = _loopend - _loopstart;
 		while( copied < _frames )
 		{
 			f_cnt_t todo = qMin( _frames - copied, loop_frames );
-			memcpy( *_tmp + copied, m_data + _loopstart, todo * BYTES_PER_FRAME );
+			readFrames( tmp + copied, _loopstart, todo, _state );
 			copied += todo;
 		}
 	}
@@ -823,18 +1546,14 @@ sampleFrame * SampleBuffer::getSampleFragment( f_cnt_t _index,
 		if( backwards )
 		{
 			copied = qMin( _frames, pos - _loopstart );
-			for( int i=0; i < copied; i++ )
-			{
-				(*_tmp)[i][0] = m_data[ pos - i ][0];
-				(*_tmp)[i][1] = m_data[ pos - i ][1];
-			}
+			readFramesBackwards( tmp, pos, copied, _state );
 			pos -= copied;
 			if( pos == _loopstart ) backwards = false;
 		}
 		else
 		{
 			copied = qMin( _frames, _loopend - pos );
-			memcpy( *_tmp, m_data + pos, copied * BYTES_PER_FRAME );
+			readFrames( tmp, pos, copied, _state );
 			pos += copied;
 			if( pos == _loopend ) backwards = true;
 		}
@@ -844,11 +1563,7 @@ sampleFrame * SampleBuffer::getSampleFragment( f_cnt_t _index,
 			if( backwards )
 			{
 				f_cnt_t todo = qMin( _frames - copied, pos - _loopstart );
-				for ( int i=0; i < todo; i++ )
-				{
-					(*_tmp)[ copied + i ][0] = m_data[ pos - i ][0];
-					(*_tmp)[ copied + i ][1] = m_data[ pos - i ][1];
-				}
+				readFramesBackwards( tmp + copied, pos, todo, _state );
 				pos -= todo;
 				copied += todo;
 				if( pos <= _loopstart ) backwards = false;
@@ -856,7 +1571,7 @@ sampleFrame * SampleBuffer::getSampleFragment( f_cnt_t _index,
 			else
 			{
 				f_cnt_t todo = qMin( _frames - copied, _loopend - pos );
-				memcpy( *_tmp + copied, m_data + pos, todo * BYTES_PER_FRAME );
+				readFrames( tmp + copied, pos, todo, _state );
 				pos += todo;
 				copied += todo;
 				if( pos >= _loopend ) backwards = true;
@@ -865,7 +1580,104 @@ sampleFrame * SampleBuffer::getSampleFragment( f_cnt_t _index,
 		*_backwards = backwards;
 	}
 
-	return *_tmp;
+	return tmp;
+}
+
+
+
+
+void SampleBuffer::readFrames( sampleFrame * _dst, f_cnt_t _index,
+				f_cnt_t _frames, handleState * _state ) const
+{
+	if( _frames <= 0 )
+	{
+		return;
+	}
+
+	if( m_streamed == false )
+	{
+		readStoredFrames( _dst, _index, _frames );
+		return;
+	}
+
+	if( _index < m_headFrames )
+	{
+		const f_cnt_t frames = qMin( _frames, m_headFrames - _index );
+		readStoredFrames( _dst, _index, frames );
+		_dst += frames;
+		_index += frames;
+		_frames -= frames;
+	}
+
+	if( _frames > 0 )
+	{
+		if( _state->m_stream == NULL )
+		{
+			memset( _dst, 0, _frames * BYTES_PER_FRAME );
+			SampleStreamer::countStarvation();
+		}
+		else if( _state->m_stream->read( _dst, _index, _frames ) == false )
+		{
+			SampleStreamer::countStarvation();
+		}
+	}
+}
+
+
+
+
+// reads _frames frames in reverse order, beginning at _index
+void SampleBuffer::readFramesBackwards( sampleFrame * _dst, f_cnt_t _index,
+				f_cnt_t _frames, handleState * _state ) const
+{
+	readFrames( _dst, _index - _frames + 1, _frames, _state );
+	for( f_cnt_t i = 0; i < _frames / 2; ++i )
+	{
+		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+		{
+			qSwap( _dst[i][ch], _dst[_frames - 1 - i][ch] );
+		}
+	}
+}
+
+
+
+
+void SampleBuffer::readStoredFrames( sampleFrame * _dst, f_cnt_t _index,
+						f_cnt_t _frames ) const
+{
+	if( m_storageFormat == FloatStorage )
+	{
+		memcpy( _dst, m_data + _index, _frames * BYTES_PER_FRAME );
+		return;
+	}
+	convertStoredFrames( _dst, m_compactData, m_storageFormat,
+					m_storageChannels, _index, _frames );
+}
+
+
+
+
+void SampleBuffer::convertStoredFrames( sampleFrame * _dst, const void * _data,
+					StorageFormat _format, ch_cnt_t _channels,
+					f_cnt_t _index, f_cnt_t _frames )
+{
+	switch( _format )
+	{
+		case Int16Storage:
+			convertInt16ToFloat( _dst, (const int_sample_t *) _data +
+					_index * _channels, _frames, _channels );
+			break;
+		case Int24Storage:
+			convertInt24ToFloat( _dst, (const uchar *) _data +
+					_index * _channels * 3, _frames, _channels );
+			break;
+		case FloatStorage:
+		default:
+			memcpy( _dst, (const sampleFrame *) _data + _index,
+						_frames * BYTES_PER_FRAME );
+			break;
+	}
 }
 
 
@@ -912,6 +1724,16 @@ void SampleBuffer::visualize( QPainter & _p, const QRect & _dr,
 	const float y_space = h*0.5f;
 	const int nb_frames = focus_on_range ? _to_frame - _from_frame : m_frames;
 
+	// when zoomed out, the peaks let us look at a few blocks per pixel
+	// instead of every frame
+	if( m_peaks != NULL && m_peaks->isReady() && w > 0 &&
+				nb_frames / w >= SamplePeaks::BlockFrames )
+	{
+		visualizePeaks( _p, _dr, focus_on_range ? _from_frame : 0,
+					focus_on_range ? _to_frame : m_frames );
+		return;
+	}
+
 	if( nb_frames < 60000 )
 	{
 		_p.setRenderHint( QPainter::Antialiasing );
@@ -925,12 +1747,21 @@ void SampleBuffer::visualize( QPainter & _p, const QRect & _dr,
 	const int xb = _dr.x();
 	const int first = focus_on_range ? _from_frame : 0;
 	const int last = focus_on_range ? _to_frame : m_frames;
+	// streamed samples are drawn flat behind the frames held in memory
+	const int in_memory = framesInMemory();
 	for( int frame = first; frame < last; frame += fpp )
 	{
+		sampleFrame f = { 0.0f, 0.0f };
+		if( frame < in_memory )
+		{
+			readStoredFrames( &f, frame, 1 );
+		}
+		const float left = f[0];
+		const float right = f[1];
 		l[n] = QPoint( xb + ( (frame - first) * double( w ) / nb_frames ),
-			(int)( yb - ( m_data[frame][0] * y_space * m_amplification ) ) );
+			(int)( yb - ( left * y_space * m_amplification ) ) );
 		r[n] = QPoint( xb + ( (frame - first) * double( w ) / nb_frames ),
-			(int)( yb - ( m_data[frame][1] * y_space * m_amplification ) ) );
+			(int)( yb - ( right * y_space * m_amplification ) ) );
 		++n;
 	}
 	_p.drawPolyline( l, nb_frames / fpp );
@@ -942,6 +1773,55 @@ void SampleBuffer::visualize( QPainter & _p, const QRect & _dr,
 
 
 
+void SampleBuffer::visualizePeaks( QPainter & _p, const QRect & _dr,
+					f_cnt_t _first, f_cnt_t _last ) const
+{
+	const int w = _dr.width();
+	const int xb = _dr.x();
+	const int yb = _dr.height() / 2 + _dr.y();
+	const float y_space = _dr.height() * 0.5f * m_amplification;
+	const double framesPerPixel = double( _last - _first ) / w;
+
+	QVector<QLine> peaks;
+	QVector<QLine> rms;
+	peaks.reserve( w * DEFAULT_CHANNELS );
+	rms.reserve( w * DEFAULT_CHANNELS );
+	for( int x = 0; x < w; ++x )
+	{
+		f_cnt_t from = _first + static_cast<f_cnt_t>( x * framesPerPixel );
+		f_cnt_t to = _first + static_cast<f_cnt_t>( ( x + 1 ) *
+								framesPerPixel );
+		if( m_reversed )
+		{
+			// the peaks describe the data as found in the file
+			const f_cnt_t f = m_peaks->frames() - to;
+			to = m_peaks->frames() - from;
+			from = f;
+		}
+		const SamplePeaks::Peak p = m_peaks->range( from, to );
+		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+		{
+			peaks.push_back( QLine( xb + x,
+					(int)( yb - p.max[ch] * y_space ),
+					xb + x,
+					(int)( yb - p.min[ch] * y_space ) ) );
+			const int r = (int)( sqrtf( p.meanSquare[ch] ) * y_space );
+			rms.push_back( QLine( xb + x, yb - r, xb + x, yb + r ) );
+		}
+	}
+
+	_p.drawLines( peaks );
+	_p.save();
+	QPen pen = _p.pen();
+	pen.setColor( pen.color().lighter( 140 ) );
+	_p.setPen( pen );
+	_p.drawLines( rms );
+	_p.restore();
+}
+
+
+
+
 QString SampleBuffer::openAudioFile() const
 {
 	FileDialog ofd( NULL, tr( "Open audio file" ) );
@@ -1084,6 +1964,29 @@ void flacStreamEncoderMetadataCallback( const FLAC__StreamEncoder *,
 
 QString & SampleBuffer::toBase64( QString & _dst ) const
 {
+	if( m_audioFile.isEmpty() && !m_containerLocation.isEmpty() &&
+		!ProjectContainer::isMemoryLocation( m_containerLocation ) )
+	{
+		// the frames are taken right from the container when saving,
+		// so there's no need to encode them - samples only held in
+		// memory are encoded, as e.g. the journal keeps the result
+		// longer than them
+		_dst = ProjectContainer::reference( m_containerLocation,
+							m_containerSample );
+		return _dst;
+	}
+
+	// compact data is converted while encoding
+	SampleCache::Data source;
+	bool decoded;
+	if( !completeData( &source, &decoded ) )
+	{
+		qWarning( "SampleBuffer::toBase64(): no data to encode" );
+		_dst = QString();
+		return _dst;
+	}
+	const StorageFormat format = (StorageFormat) source.format;
+
 #ifdef LMMS_HAVE_FLAC_STREAM_ENCODER_H
 	const f_cnt_t FRAMES_PER_BUF = 1152;
 
@@ -1107,17 +2010,20 @@ QString & SampleBuffer::toBase64( QString & _dst ) const
 		printf( "error within FLAC__stream_encoder_init()!\n" );
 	}
 	f_cnt_t frame_cnt = 0;
-	while( frame_cnt < m_frames )
+	while( frame_cnt < source.frames )
 	{
 		f_cnt_t remaining = qMin<f_cnt_t>( FRAMES_PER_BUF,
-							m_frames - frame_cnt );
+						source.frames - frame_cnt );
+		sampleFrame frames[FRAMES_PER_BUF];
+		convertStoredFrames( frames, source.data, format,
+				source.channels, frame_cnt, remaining );
 		FLAC__int32 buf[FRAMES_PER_BUF * DEFAULT_CHANNELS];
 		for( f_cnt_t f = 0; f < remaining; ++f )
 		{
 			for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
 			{
 				buf[f*DEFAULT_CHANNELS+ch] = (FLAC__int32)(
-					Mixer::clip( m_data[f+frame_cnt][ch] ) *
+					Mixer::clip( frames[f][ch] ) *
 						OUTPUT_SAMPLE_MULTIPLIER );
 			}
 		}
@@ -1136,11 +2042,28 @@ QString & SampleBuffer::toBase64( QString & _dst ) const
 
 #else	/* LMMS_HAVE_FLAC_STREAM_ENCODER_H */
 
-	base64::encode( (const char *) m_data,
-					m_frames * sizeof( sampleFrame ), _dst );
+	if( format == FloatStorage )
+	{
+		base64::encode( (const char *) source.data,
+				source.frames * sizeof( sampleFrame ), _dst );
+	}
+	else
+	{
+		sampleFrame * frames = MM_ALLOC( sampleFrame, source.frames );
+		convertStoredFrames( frames, source.data, format,
+				source.channels, 0, source.frames );
+		base64::encode( (const char *) frames,
+				source.frames * sizeof( sampleFrame ), _dst );
+		MM_FREE( frames );
+	}
 
 #endif	/* LMMS_HAVE_FLAC_STREAM_ENCODER_H */
 
+	if( decoded )
+	{
+		SampleCache::release( source.data );
+	}
+
 	return _dst;
 }
 
@@ -1190,8 +2113,9 @@ SampleBuffer * SampleBuffer::resample( const sample_rate_t _src_sr,
 
 void SampleBuffer::setAudioFile( const QString & _audio_file )
 {
+	m_containerLocation = QString();
 	m_audioFile = tryToMakeRelative( _audio_file );
-	update();
+	update( false, m_asyncAllowed );
 }
 
 
@@ -1289,15 +2213,17 @@ void flacStreamDecoderErrorCallback( const FLAC__StreamDecoder *,
 #endif
 
 
-void SampleBuffer::loadFromBase64( const QString & _data )
+QByteArray SampleBuffer::decodeEmbedded( const QByteArray & _data )
 {
-	char * dst = NULL;
-	int dsize = 0;
-	base64::decode( _data, &dst, &dsize );
-
 #ifdef LMMS_HAVE_FLAC_STREAM_DECODER_H
+	if( _data.startsWith( "fLaC" ) == false )
+	{
+		// e.g. converted from a binary project file
+		return _data;
+	}
 
-	QByteArray orig_data = QByteArray::fromRawData( dst, dsize );
+	// QBuffer needs a non-const array - shared, not copied
+	QByteArray orig_data = _data;
 	QBuffer ba_reader( &orig_data );
 	ba_reader.open( QBuffer::ReadOnly );
 
@@ -1327,25 +2253,74 @@ void SampleBuffer::loadFromBase64( const QString & _data )
 
 	ba_reader.close();
 
-	orig_data = ba_writer.buffer();
-	printf("%d\n", (int) orig_data.size() );
+	return ba_writer.buffer();
+#else
+	return _data;
+#endif
+}
+
+
+
+
+void SampleBuffer::loadFromBase64( const QString & _data )
+{
+	m_containerLocation = QString();
+	if( ProjectContainer::parseReference( _data, &m_containerSample,
+						&m_containerLocation ) )
+	{
+		// samples of binary project files and the ones decoded while
+		// parsing aren't copied at all
+		if( m_origData != m_data )
+		{
+			MM_FREE( m_origData );
+		}
+		m_origData = NULL;
+		m_origFrames = 0;
+		m_audioFile = QString();
+		update();
+		return;
+	}
+
+#ifdef LMMS_HAVE_FLAC_STREAM_DECODER_H
+
+	char * dst = NULL;
+	int dsize = 0;
+	base64::decode( _data, &dst, &dsize );
+
+	const QByteArray orig_data = decodeEmbedded(
+				QByteArray::fromRawData( dst, dsize ) );
 
 	m_origFrames = orig_data.size() / sizeof( sampleFrame );
-	MM_FREE( m_origData );
+	// if we're playing the original data, update() frees it as soon as
+	// the audio threads are done with it
+	if( m_origData != m_data )
+	{
+		MM_FREE( m_origData );
+	}
 	m_origData = MM_ALLOC( sampleFrame, m_origFrames );
-	memcpy( m_origData, orig_data.data(), orig_data.size() );
+	memcpy( m_origData, orig_data.data(),
+				m_origFrames * sizeof( sampleFrame ) );
+
+	delete[] dst;
 
 #else /* LMMS_HAVE_FLAC_STREAM_DECODER_H */
 
+	// samples embedded into projects can be large, so decode them right
+	// into the sample memory instead of going through temporary buffers
+	const int dsize = base64::decodedSize( _data );
 	m_origFrames = dsize / sizeof( sampleFrame );
-	MM_FREE( m_origData );
-	m_origData = MM_ALLOC( sampleFrame, m_origFrames );
-	memcpy( m_origData, dst, dsize );
+	// if we're playing the original data, update() frees it as soon as
+	// the audio threads are done with it
+	if( m_origData != m_data )
+	{
+		MM_FREE( m_origData );
+	}
+	m_origData = MM_ALLOC( sampleFrame, ( dsize + sizeof( sampleFrame ) - 1 ) /
+							sizeof( sampleFrame ) );
+	base64::decodeInto( _data, (char *) m_origData );
 
 #endif
 
-	delete[] dst;
-
 	m_audioFile = QString();
 	update();
 }
@@ -1441,21 +2416,55 @@ QString SampleBuffer::tryToMakeAbsolute(const QString& file)
 SampleBuffer::handleState::handleState( bool _varying_pitch, int interpolation_mode ) :
 	m_frameIndex( 0 ),
 	m_varyingPitch( _varying_pitch ),
-	m_isBackwards( false )
+	m_isBackwards( false ),
+	m_resamplingData( NULL ),
+	m_interpolationMode( interpolation_mode ),
+	m_stream( NULL ),
+	m_streamRevision( 0 ),
+	m_scratch( NULL ),
+	m_scratchFrames( 0 )
 {
-	int error;
-	m_interpolationMode = interpolation_mode;
-	
-	if( ( m_resamplingData = src_new( interpolation_mode, DEFAULT_CHANNELS, &error ) ) == NULL )
+}
+
+
+
+
+SampleBuffer::handleState::~handleState()
+{
+	if( m_resamplingData != NULL )
 	{
-		qDebug( "Error: src_new() failed in sample_buffer.cpp!\n" );
+		releaseResampler( m_resamplingData, m_interpolationMode );
 	}
+	if( m_stream != NULL )
+	{
+		SampleStreamer::releaseStream( m_stream );
+	}
+	releaseScratchBuffer( m_scratch, m_scratchFrames );
 }
 
 
 
 
-SampleBuffer::handleState::~handleState()
+sampleFrame * SampleBuffer::handleState::scratchBuffer( const f_cnt_t _frames )
 {
-	src_delete( m_resamplingData );
+	if( _frames <= m_scratchFrames )
+	{
+		return m_scratch;
+	}
+
+	releaseScratchBuffer( m_scratch, m_scratchFrames );
+	if( _frames <= s_scratchFrames )
+	{
+		m_scratch = acquireScratchBuffer();
+		m_scratchFrames = s_scratchFrames;
+	}
+	else
+	{
+		// pitched up further than the pooled buffers allow - grow in
+		// bigger steps, fragments vary a bit from period to period
+		// when resampling
+		m_scratchFrames = qMax( _frames, m_scratchFrames * 2 );
+		m_scratch = MM_ALLOC( sampleFrame, m_scratchFrames );
+	}
+	return m_scratch;
 }
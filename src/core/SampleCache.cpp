@@ -0,0 +1,171 @@
+/*
+ * SampleCache.cpp - process-wide cache of decoded sample files
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "SampleCache.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+
+#include "MemoryManager.h"
+#include "SamplePeaks.h"
+
+
+QMutex SampleCache::s_mutex;
+QHash<QString, SampleCache::Entry *> SampleCache::s_entries;
+QHash<const void *, SampleCache::Entry *> SampleCache::s_entriesByData;
+
+
+
+
+QString SampleCache::key( const QFileInfo & _file,
+				const sample_rate_t _sampleRate, bool _compact )
+{
+	if( _file.exists() == false )
+	{
+		return QString();
+	}
+
+	return QString( "%1:%2:%3:%4:%5" ).
+			arg( _file.canonicalFilePath() ).
+			arg( _file.lastModified().toTime_t() ).
+			arg( _file.size() ).
+			arg( _sampleRate ).
+			arg( _compact ? "c" : "f" );
+}
+
+
+
+
+bool SampleCache::acquire( const QString & _key, Data * _data )
+{
+	if( _key.isEmpty() )
+	{
+		return false;
+	}
+
+	QMutexLocker lock( &s_mutex );
+
+	Entry * entry = s_entries.value( _key, NULL );
+	if( entry == NULL )
+	{
+		return false;
+	}
+
+	++entry->refCount;
+	*_data = entry->data;
+
+	return true;
+}
+
+
+
+
+void SampleCache::insert( const QString & _key, Data * _data,
+						sharedObject * _owner )
+{
+	QMutexLocker lock( &s_mutex );
+
+	Entry * entry = s_entries.value( _key, NULL );
+	if( entry != NULL )
+	{
+		// decoded twice at the same time, keep the first one
+		if( _owner == NULL )
+		{
+			MM_FREE( _data->data );
+		}
+		++entry->refCount;
+		*_data = entry->data;
+		return;
+	}
+
+	entry = new Entry;
+	entry->key = _key;
+	entry->data = *_data;
+	entry->refCount = 1;
+	entry->peaks = NULL;
+	entry->owner = _owner != NULL ? sharedObject::ref( _owner ) : NULL;
+
+	s_entries[_key] = entry;
+	s_entriesByData[_data->data] = entry;
+}
+
+
+
+
+void SampleCache::release( const void * _data )
+{
+	QMutexLocker lock( &s_mutex );
+
+	Entry * entry = s_entriesByData.value( _data, NULL );
+	if( entry == NULL )
+	{
+		qWarning( "SampleCache::release(): unknown data" );
+		return;
+	}
+
+	if( --entry->refCount <= 0 )
+	{
+		s_entries.remove( entry->key );
+		s_entriesByData.remove( _data );
+		if( entry->owner != NULL )
+		{
+			sharedObject::unref( entry->owner );
+		}
+		else
+		{
+			MM_FREE( entry->data.data );
+		}
+		if( entry->peaks != NULL )
+		{
+			sharedObject::unref( entry->peaks );
+		}
+		delete entry;
+	}
+}
+
+
+
+
+SamplePeaks * SampleCache::peaks( const void * _data, const QString & _file,
+						const sample_rate_t _sampleRate )
+{
+	QMutexLocker lock( &s_mutex );
+
+	Entry * entry = s_entriesByData.value( _data, NULL );
+	if( entry == NULL )
+	{
+		return NULL;
+	}
+
+	if( entry->peaks == NULL )
+	{
+		entry->peaks = new SamplePeaks( _file, entry->data.frames,
+								_sampleRate );
+		// the builder keeps the data alive until it's done
+		++entry->refCount;
+		entry->peaks->buildFromData( entry->data );
+	}
+
+	return sharedObject::ref( entry->peaks );
+}
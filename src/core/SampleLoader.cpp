@@ -0,0 +1,236 @@
+/*
+ * SampleLoader.cpp - decodes sample files in the background
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "SampleLoader.h"
+
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "SampleBuffer.h"
+
+
+SampleLoader * SampleLoader::s_instance = NULL;
+
+
+
+class SampleLoader::Job : public QRunnable
+{
+public:
+	Job( SampleLoader * _loader, Request * _request ) :
+		m_loader( _loader ),
+		m_request( _request )
+	{
+	}
+
+	virtual void run()
+	{
+		m_loader->decode( m_request );
+	}
+
+
+private:
+	SampleLoader * m_loader;
+	Request * m_request;
+
+} ;
+
+
+
+
+SampleLoader::SampleLoader() :
+	QObject(),
+	m_pool( new QThreadPool( this ) ),
+	m_mutex(),
+	m_requests()
+{
+	// decoding is mostly CPU bound, so use all cores while loading a
+	// project
+	m_pool->setMaxThreadCount( qMax( 1, QThread::idealThreadCount() ) );
+
+	// buffers are updated from the thread we live in
+	connect( this, SIGNAL( requestFinished() ),
+			this, SLOT( publishFinished() ), Qt::QueuedConnection );
+}
+
+
+
+
+SampleLoader::~SampleLoader()
+{
+}
+
+
+
+
+void SampleLoader::init()
+{
+	if( s_instance == NULL )
+	{
+		s_instance = new SampleLoader;
+	}
+}
+
+
+
+
+void SampleLoader::cleanup()
+{
+	if( s_instance == NULL )
+	{
+		return;
+	}
+
+	s_instance->m_mutex.lock();
+	for( int i = 0; i < s_instance->m_requests.size(); ++i )
+	{
+		s_instance->m_requests[i]->buffer = NULL;
+	}
+	s_instance->m_mutex.unlock();
+
+	// requests not yet started return immediately now
+	s_instance->m_pool->waitForDone();
+	s_instance->publishFinished();
+
+	delete s_instance;
+	s_instance = NULL;
+}
+
+
+
+
+void SampleLoader::load( SampleBuffer * _buffer, const QString & _file,
+					bool _compact, bool _keepSettings )
+{
+	cancel( _buffer );
+
+	Request * request = new Request;
+	request->buffer = _buffer;
+	request->file = _file;
+	request->compact = _compact;
+	request->keepSettings = _keepSettings;
+	request->finished = false;
+	request->decoded = false;
+
+	m_mutex.lock();
+	m_requests.push_back( request );
+	m_mutex.unlock();
+
+	m_pool->start( new Job( this, request ) );
+}
+
+
+
+
+void SampleLoader::cancel( SampleBuffer * _buffer )
+{
+	QMutexLocker lock( &m_mutex );
+	for( int i = 0; i < m_requests.size(); ++i )
+	{
+		if( m_requests[i]->buffer == _buffer )
+		{
+			// the job finishes anyway, the result is dropped then
+			m_requests[i]->buffer = NULL;
+		}
+	}
+}
+
+
+
+
+void SampleLoader::waitForAll()
+{
+	m_pool->waitForDone();
+	publishFinished();
+}
+
+
+
+
+void SampleLoader::publishFinished()
+{
+	QList<Request *> finished;
+
+	m_mutex.lock();
+	for( int i = 0; i < m_requests.size(); )
+	{
+		if( m_requests[i]->finished )
+		{
+			finished.push_back( m_requests.takeAt( i ) );
+		}
+		else
+		{
+			++i;
+		}
+	}
+	m_mutex.unlock();
+
+	for( int i = 0; i < finished.size(); ++i )
+	{
+		Request * request = finished[i];
+		// buffers loading asynchronously live in the GUI thread and
+		// cancel their requests when destroyed, so this one is alive
+		if( request->buffer != NULL )
+		{
+			request->buffer->finishLoading( request->keepSettings );
+		}
+		dropRequest( request );
+	}
+}
+
+
+
+
+void SampleLoader::decode( Request * _request )
+{
+	m_mutex.lock();
+	const bool cancelled = _request->buffer == NULL;
+	const QString file = _request->file;
+	const bool compact = _request->compact;
+	m_mutex.unlock();
+
+	SampleCache::Data data = SampleCache::Data();
+	const bool decoded = !cancelled &&
+			SampleBuffer::decodeToCache( file, compact, &data );
+
+	m_mutex.lock();
+	_request->decoded = decoded;
+	_request->data = data;
+	_request->finished = true;
+	m_mutex.unlock();
+
+	emit requestFinished();
+}
+
+
+
+
+void SampleLoader::dropRequest( Request * _request )
+{
+	if( _request->decoded )
+	{
+		SampleCache::release( _request->data.data );
+	}
+	delete _request;
+}
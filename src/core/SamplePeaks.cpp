@@ -0,0 +1,481 @@
+/*
+ * SamplePeaks.cpp - multi-resolution peak data for drawing sample waveforms
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "SamplePeaks.h"
+
+#include <cstring>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include <sndfile.h>
+
+#include "ConfigManager.h"
+#include "lmmsconfig.h"
+#include "MemoryManager.h"
+#include "SampleBuffer.h"
+
+
+// frames converted at once while building, a multiple of BlockFrames
+const f_cnt_t PEAK_CHUNK_FRAMES = SamplePeaks::BlockFrames * 64;
+
+const quint32 PEAK_FILE_MAGIC = 0x4c4d5050;	// "LMPP"
+const quint32 PEAK_FILE_VERSION = 1;
+
+
+static QMutex s_poolMutex;
+static QThreadPool * s_pool = NULL;
+static AtomicInt s_quit( 0 );
+
+
+
+class SamplePeaks::Builder : public QRunnable
+{
+public:
+	Builder( SamplePeaks * _peaks, const SampleCache::Data * _data ) :
+		m_peaks( sharedObject::ref( _peaks ) ),
+		m_hasData( _data != NULL )
+	{
+		if( m_hasData )
+		{
+			m_data = *_data;
+		}
+	}
+
+	virtual void run()
+	{
+		// drawing is not time critical, leave the CPU to the mixer
+		QThread::currentThread()->setPriority( QThread::LowestPriority );
+
+		m_peaks->build( m_hasData ? &m_data : NULL );
+		if( m_hasData )
+		{
+			SampleCache::release( m_data.data );
+		}
+		sharedObject::unref( m_peaks );
+	}
+
+
+private:
+	SamplePeaks * m_peaks;
+	bool m_hasData;
+	SampleCache::Data m_data;
+
+} ;
+
+
+
+
+static void startBuilder( QRunnable * _builder )
+{
+	QMutexLocker lock( &s_poolMutex );
+	if( s_pool == NULL )
+	{
+		// one thread is enough, we don't want to compete with the
+		// mixer for memory bandwidth
+		s_pool = new QThreadPool;
+		s_pool->setMaxThreadCount( 1 );
+	}
+	s_pool->start( _builder );
+}
+
+
+
+
+SamplePeaks::SamplePeaks( const QString & _file, const f_cnt_t _frames,
+						const sample_rate_t _sampleRate ) :
+	m_file( _file ),
+	m_persistent( !_file.isEmpty() && ConfigManager::inst()->value( "ui",
+					"samplepeakfiles" ).toInt() ),
+	m_frames( _frames ),
+	m_sampleRate( _sampleRate ),
+	m_levels(),
+	m_ready( 0 )
+{
+}
+
+
+
+
+SamplePeaks::~SamplePeaks()
+{
+}
+
+
+
+
+void SamplePeaks::buildFromData( const SampleCache::Data & _data )
+{
+	startBuilder( new Builder( this, &_data ) );
+}
+
+
+
+
+void SamplePeaks::buildFromFile()
+{
+	startBuilder( new Builder( this, NULL ) );
+}
+
+
+
+
+void SamplePeaks::cleanup()
+{
+	s_poolMutex.lock();
+	QThreadPool * pool = s_pool;
+	s_pool = NULL;
+	s_poolMutex.unlock();
+
+	if( pool != NULL )
+	{
+		// builds still queued return immediately
+		s_quit.fetchAndStoreOrdered( 1 );
+		pool->waitForDone();
+		delete pool;
+		s_quit.fetchAndStoreOrdered( 0 );
+	}
+}
+
+
+
+
+SamplePeaks::Peak SamplePeaks::range( f_cnt_t _from, f_cnt_t _to ) const
+{
+	Peak result;
+	memset( &result, 0, sizeof( result ) );
+	if( m_levels.isEmpty() || m_levels[0].isEmpty() )
+	{
+		return result;
+	}
+
+	const f_cnt_t length = qMax<f_cnt_t>( _to - _from, 1 );
+	int level = 0;
+	f_cnt_t blockFrames = BlockFrames;
+	while( level + 1 < m_levels.size() &&
+				blockFrames * LevelFactor <= length )
+	{
+		++level;
+		blockFrames *= LevelFactor;
+	}
+
+	const QVector<Peak> & peaks = m_levels[level];
+	const int first = qBound<int>( 0, _from / blockFrames,
+							peaks.size() - 1 );
+	const int last = qBound<int>( first, ( _from + length - 1 ) /
+					blockFrames, peaks.size() - 1 );
+
+	result = peaks[first];
+	for( int i = first + 1; i <= last; ++i )
+	{
+		const Peak & p = peaks[i];
+		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+		{
+			result.min[ch] = qMin( result.min[ch], p.min[ch] );
+			result.max[ch] = qMax( result.max[ch], p.max[ch] );
+			result.meanSquare[ch] += p.meanSquare[ch];
+		}
+	}
+	for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+	{
+		result.meanSquare[ch] /= last - first + 1;
+	}
+
+	return result;
+}
+
+
+
+
+void SamplePeaks::build( const SampleCache::Data * _data )
+{
+	if( (int) s_quit )
+	{
+		return;
+	}
+
+	if( m_persistent && load() )
+	{
+		m_ready.fetchAndStoreOrdered( 1 );
+		return;
+	}
+
+	SNDFILE * sndFile = NULL;
+	float * fileBuf = NULL;
+	int channels = 0;
+	if( _data == NULL )
+	{
+		SF_INFO sfInfo;
+		memset( &sfInfo, 0, sizeof( sfInfo ) );
+#ifdef LMMS_BUILD_WIN32
+		sndFile = sf_open( m_file.toLocal8Bit().constData(),
+							SFM_READ, &sfInfo );
+#else
+		sndFile = sf_open( m_file.toUtf8().constData(),
+							SFM_READ, &sfInfo );
+#endif
+		if( sndFile == NULL )
+		{
+			return;
+		}
+		channels = sfInfo.channels;
+		fileBuf = new float[PEAK_CHUNK_FRAMES * channels];
+	}
+
+	sampleFrame * buf = MM_ALLOC( sampleFrame, PEAK_CHUNK_FRAMES );
+	m_levels.resize( 1 );
+	m_levels[0].reserve( ( m_frames + BlockFrames - 1 ) / BlockFrames );
+
+	bool complete = true;
+	for( f_cnt_t pos = 0; pos < m_frames; pos += PEAK_CHUNK_FRAMES )
+	{
+		if( (int) s_quit )
+		{
+			complete = false;
+			break;
+		}
+
+		const f_cnt_t frames = qMin( PEAK_CHUNK_FRAMES, m_frames - pos );
+		if( _data != NULL )
+		{
+			SampleBuffer::convertStoredFrames( buf, _data->data,
+					(SampleBuffer::StorageFormat) _data->format,
+					_data->channels, pos, frames );
+		}
+		else
+		{
+			const f_cnt_t read = qMax<f_cnt_t>( 0,
+				sf_readf_float( sndFile, fileBuf, frames ) );
+			const int ch = ( channels > 1 ) ? 1 : 0;
+			for( f_cnt_t f = 0; f < read; ++f )
+			{
+				buf[f][0] = fileBuf[f * channels];
+				buf[f][1] = fileBuf[f * channels + ch];
+			}
+			memset( buf + read, 0,
+				( frames - read ) * sizeof( sampleFrame ) );
+		}
+
+		for( f_cnt_t f = 0; f < frames; f += BlockFrames )
+		{
+			addBlock( buf + f, qMin( BlockFrames, frames - f ) );
+		}
+	}
+
+	MM_FREE( buf );
+	if( sndFile != NULL )
+	{
+		sf_close( sndFile );
+	}
+	delete[] fileBuf;
+
+	if( complete == false )
+	{
+		return;
+	}
+
+	buildLevels();
+	if( m_persistent )
+	{
+		save();
+	}
+	m_ready.fetchAndStoreOrdered( 1 );
+}
+
+
+
+
+void SamplePeaks::addBlock( const sampleFrame * _frames, const f_cnt_t _count )
+{
+	Peak p;
+	for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+	{
+		float min = _frames[0][ch];
+		float max = _frames[0][ch];
+		float squares = 0.0f;
+		for( f_cnt_t f = 0; f < _count; ++f )
+		{
+			const float s = _frames[f][ch];
+			min = qMin( min, s );
+			max = qMax( max, s );
+			squares += s * s;
+		}
+		p.min[ch] = min;
+		p.max[ch] = max;
+		p.meanSquare[ch] = squares / _count;
+	}
+	m_levels[0].push_back( p );
+}
+
+
+
+
+void SamplePeaks::buildLevels()
+{
+	while( m_levels.last().size() > 1 )
+	{
+		const QVector<Peak> & below = m_levels.last();
+		QVector<Peak> level( ( below.size() + LevelFactor - 1 ) /
+								LevelFactor );
+		for( int i = 0; i < level.size(); ++i )
+		{
+			const int first = i * LevelFactor;
+			const int count = qMin( LevelFactor,
+						below.size() - first );
+			Peak p = below[first];
+			for( int j = 1; j < count; ++j )
+			{
+				const Peak & b = below[first + j];
+				for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS;
+									++ch )
+				{
+					p.min[ch] = qMin( p.min[ch], b.min[ch] );
+					p.max[ch] = qMax( p.max[ch], b.max[ch] );
+					p.meanSquare[ch] += b.meanSquare[ch];
+				}
+			}
+			for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+			{
+				p.meanSquare[ch] /= count;
+			}
+			level[i] = p;
+		}
+		m_levels.push_back( level );
+	}
+}
+
+
+
+
+QString SamplePeaks::peakFile() const
+{
+	return m_file + ".lmmspeaks";
+}
+
+
+
+
+bool SamplePeaks::load()
+{
+	QFile file( peakFile() );
+	if( file.open( QIODevice::ReadOnly ) == false )
+	{
+		return false;
+	}
+
+	QDataStream in( &file );
+	in.setFloatingPointPrecision( QDataStream::SinglePrecision );
+
+	// the peak file has to belong to the very same sample data
+	const QFileInfo sample( m_file );
+	quint32 magic, version, sampleRate, modified;
+	qint64 size;
+	qint32 frames, levels;
+	in >> magic >> version >> size >> modified >> sampleRate >> frames >>
+									levels;
+	if( in.status() != QDataStream::Ok || magic != PEAK_FILE_MAGIC ||
+			version != PEAK_FILE_VERSION ||
+			size != sample.size() ||
+			modified != sample.lastModified().toTime_t() ||
+			sampleRate != m_sampleRate || frames != m_frames ||
+			levels <= 0 || levels > 32 )
+	{
+		return false;
+	}
+
+	m_levels.resize( levels );
+	for( int l = 0; l < levels; ++l )
+	{
+		qint32 count;
+		in >> count;
+		if( in.status() != QDataStream::Ok || count <= 0 ||
+						count > m_frames / BlockFrames + 1 )
+		{
+			m_levels.clear();
+			return false;
+		}
+		m_levels[l].resize( count );
+		for( int i = 0; i < count; ++i )
+		{
+			Peak & p = m_levels[l][i];
+			for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+			{
+				in >> p.min[ch] >> p.max[ch] >> p.meanSquare[ch];
+			}
+		}
+	}
+
+	if( in.status() != QDataStream::Ok )
+	{
+		m_levels.clear();
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+void SamplePeaks::save() const
+{
+	QFile file( peakFile() );
+	if( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) == false )
+	{
+		// e.g. a read-only factory sample directory
+		return;
+	}
+
+	QDataStream out( &file );
+	out.setFloatingPointPrecision( QDataStream::SinglePrecision );
+
+	const QFileInfo sample( m_file );
+	out << PEAK_FILE_MAGIC << PEAK_FILE_VERSION << (qint64) sample.size() <<
+		(quint32) sample.lastModified().toTime_t() <<
+		(quint32) m_sampleRate << (qint32) m_frames <<
+		(qint32) m_levels.size();
+	for( int l = 0; l < m_levels.size(); ++l )
+	{
+		out << (qint32) m_levels[l].size();
+		for( int i = 0; i < m_levels[l].size(); ++i )
+		{
+			const Peak & p = m_levels[l][i];
+			for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+			{
+				out << p.min[ch] << p.max[ch] << p.meanSquare[ch];
+			}
+		}
+	}
+
+	if( out.status() != QDataStream::Ok )
+	{
+		file.remove();
+	}
+}
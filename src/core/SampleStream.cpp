@@ -0,0 +1,398 @@
+/*
+ * SampleStream.cpp - streaming of long samples from disk
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "SampleStream.h"
+
+#include <cstring>
+
+#include <sndfile.h>
+
+#include "lmmsconfig.h"
+
+
+// how many frames each stream buffers ahead
+const f_cnt_t STREAM_RING_FRAMES = 65536;
+// how many frames are read from disk at once
+const f_cnt_t STREAM_CHUNK_FRAMES = 4096;
+// how many streams are kept ready for new notes
+const int STREAM_RESERVE = 8;
+// how long the streamer sleeps when there's nothing to read, in ms
+const int STREAM_POLL_INTERVAL = 5;
+
+
+SampleStreamer * SampleStreamer::s_instance = NULL;
+AtomicInt SampleStreamer::s_starvations;
+
+
+
+SampleStream::SampleStream() :
+	m_file(),
+	m_sndFile( NULL ),
+	m_channels( 0 ),
+	m_filePos( -1 ),
+	m_readBuf( NULL ),
+	m_ring( MM_ALLOC( sampleFrame, STREAM_RING_FRAMES ) ),
+	m_mutex(),
+	m_ringFrame( 0 ),
+	m_readPos( 0 ),
+	m_fill( 0 ),
+	m_generation( 0 ),
+	m_state( Idle )
+{
+}
+
+
+
+
+SampleStream::~SampleStream()
+{
+	reset();
+	MM_FREE( m_ring );
+}
+
+
+
+
+void SampleStream::start( const QString & _file, const f_cnt_t _startFrame )
+{
+	// the streamer doesn't touch the stream before it's active, and
+	// reset() has dropped the previous file, so assigning just shares
+	// the string
+	m_file = _file;
+	m_ringFrame = _startFrame;
+	m_readPos = 0;
+	m_fill = 0;
+	++m_generation;
+
+	m_state.fetchAndStoreOrdered( Active );
+}
+
+
+
+
+void SampleStream::reset()
+{
+	if( m_sndFile != NULL )
+	{
+		sf_close( m_sndFile );
+		m_sndFile = NULL;
+	}
+	delete[] m_readBuf;
+	m_readBuf = NULL;
+	m_channels = 0;
+	m_filePos = -1;
+	m_file = QString();
+}
+
+
+
+
+bool SampleStream::read( sampleFrame * _dst, const f_cnt_t _index,
+							const f_cnt_t _frames )
+{
+	// never block the audio thread - if the streamer is just updating
+	// the ring, we simply count this period as starved
+	if( m_mutex.tryLock() == false )
+	{
+		memset( _dst, 0, _frames * sizeof( sampleFrame ) );
+		SampleStreamer::wakeUp();
+		return false;
+	}
+
+	if( _index < m_ringFrame || _index > m_ringFrame + m_fill )
+	{
+		// not buffered - let the streamer seek there
+		m_ringFrame = _index;
+		m_readPos = 0;
+		m_fill = 0;
+		++m_generation;
+	}
+	else
+	{
+		const f_cnt_t skip = _index - m_ringFrame;
+		m_readPos = ( m_readPos + skip ) % STREAM_RING_FRAMES;
+		m_fill -= skip;
+		m_ringFrame = _index;
+	}
+
+	const f_cnt_t frames = qMin( _frames, m_fill );
+	const f_cnt_t first = qMin( frames, STREAM_RING_FRAMES - m_readPos );
+	memcpy( _dst, m_ring + m_readPos, first * sizeof( sampleFrame ) );
+	memcpy( _dst + first, m_ring, ( frames - first ) * sizeof( sampleFrame ) );
+
+	m_readPos = ( m_readPos + frames ) % STREAM_RING_FRAMES;
+	m_fill -= frames;
+	m_ringFrame += frames;
+
+	m_mutex.unlock();
+
+	SampleStreamer::wakeUp();
+
+	if( frames < _frames )
+	{
+		memset( _dst + frames, 0,
+			( _frames - frames ) * sizeof( sampleFrame ) );
+		return false;
+	}
+	return true;
+}
+
+
+
+
+bool SampleStream::fill()
+{
+	if( m_sndFile == NULL )
+	{
+		if( m_channels < 0 )
+		{
+			// opening failed before
+			return false;
+		}
+		SF_INFO sfInfo;
+		memset( &sfInfo, 0, sizeof( sfInfo ) );
+#ifdef LMMS_BUILD_WIN32
+		m_sndFile = sf_open( m_file.toLocal8Bit().constData(),
+							SFM_READ, &sfInfo );
+#else
+		m_sndFile = sf_open( m_file.toUtf8().constData(),
+							SFM_READ, &sfInfo );
+#endif
+		if( m_sndFile == NULL )
+		{
+			qWarning( "SampleStream: could not open %s",
+						qPrintable( m_file ) );
+			m_channels = -1;
+			return false;
+		}
+		m_channels = sfInfo.channels;
+		m_readBuf = new float[STREAM_CHUNK_FRAMES * m_channels];
+	}
+
+	m_mutex.lock();
+	const int generation = m_generation;
+	const f_cnt_t fileFrame = m_ringFrame + m_fill;
+	const f_cnt_t writePos = ( m_readPos + m_fill ) % STREAM_RING_FRAMES;
+	const f_cnt_t space = STREAM_RING_FRAMES - m_fill;
+	m_mutex.unlock();
+
+	// the region behind the valid frames belongs to us, the reader won't
+	// touch it until we publish it by increasing m_fill
+	const f_cnt_t todo = qMin( qMin( space, STREAM_RING_FRAMES - writePos ),
+							STREAM_CHUNK_FRAMES );
+	if( todo <= 0 )
+	{
+		return false;
+	}
+
+	if( fileFrame != m_filePos )
+	{
+		if( sf_seek( m_sndFile, fileFrame, SEEK_SET ) < 0 )
+		{
+			return false;
+		}
+		m_filePos = fileFrame;
+	}
+
+	const f_cnt_t frames = sf_readf_float( m_sndFile, m_readBuf, todo );
+	if( frames <= 0 )
+	{
+		// end of file
+		return false;
+	}
+	m_filePos += frames;
+
+	const int ch = ( m_channels > 1 ) ? 1 : 0;
+	sampleFrame * dst = m_ring + writePos;
+	for( f_cnt_t f = 0; f < frames; ++f )
+	{
+		dst[f][0] = m_readBuf[f * m_channels];
+		dst[f][1] = m_readBuf[f * m_channels + ch];
+	}
+
+	m_mutex.lock();
+	// drop what we've read if the reader has seeked in the meantime
+	if( generation == m_generation )
+	{
+		m_fill += frames;
+	}
+	m_mutex.unlock();
+
+	return true;
+}
+
+
+
+
+SampleStreamer::SampleStreamer() :
+	QThread(),
+	m_streamCount( 0 ),
+	m_dataNeeded( 0 ),
+	m_quit( false )
+{
+	reserveStreams();
+}
+
+
+
+
+SampleStreamer::~SampleStreamer()
+{
+	for( int i = 0; i < m_streamCount; ++i )
+	{
+		delete m_streams[i];
+	}
+}
+
+
+
+
+void SampleStreamer::init()
+{
+	if( s_instance == NULL )
+	{
+		s_instance = new SampleStreamer;
+		s_instance->start( QThread::HighPriority );
+	}
+}
+
+
+
+
+void SampleStreamer::cleanup()
+{
+	if( s_instance != NULL )
+	{
+		s_instance->m_quit = true;
+		s_instance->wait();
+		delete s_instance;
+		s_instance = NULL;
+	}
+}
+
+
+
+
+SampleStream * SampleStreamer::createStream( const QString & _file,
+						const f_cnt_t _startFrame )
+{
+	if( s_instance == NULL )
+	{
+		return NULL;
+	}
+
+	const int count = s_instance->m_streamCount;
+	for( int i = 0; i < count; ++i )
+	{
+		SampleStream * stream = s_instance->m_streams[i];
+		if( stream->m_state.testAndSetOrdered( SampleStream::Idle,
+						SampleStream::Claimed ) )
+		{
+			stream->start( _file, _startFrame );
+			wakeUp();
+			return stream;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+void SampleStreamer::releaseStream( SampleStream * _stream )
+{
+	_stream->m_state.fetchAndStoreOrdered( SampleStream::Released );
+	wakeUp();
+}
+
+
+
+
+void SampleStreamer::wakeUp()
+{
+	if( s_instance != NULL )
+	{
+		s_instance->m_dataNeeded.fetchAndStoreOrdered( 1 );
+	}
+}
+
+
+
+
+void SampleStreamer::reserveStreams()
+{
+	int idle = 0;
+	const int count = m_streamCount;
+	for( int i = 0; i < count; ++i )
+	{
+		if( (int) m_streams[i]->m_state == SampleStream::Idle )
+		{
+			++idle;
+		}
+	}
+
+	for( int i = count; i < qMin<int>( count + STREAM_RESERVE - idle,
+							MaxStreams ); ++i )
+	{
+		m_streams[i] = new SampleStream;
+		// publishes the stream to the audio threads
+		m_streamCount.fetchAndStoreOrdered( i + 1 );
+	}
+}
+
+
+
+
+void SampleStreamer::run()
+{
+	while( m_quit == false )
+	{
+		bool busy = false;
+		for( int i = 0; i < m_streamCount; ++i )
+		{
+			SampleStream * stream = m_streams[i];
+			const int state = stream->m_state;
+			if( state == SampleStream::Released )
+			{
+				stream->reset();
+				stream->m_state.fetchAndStoreOrdered(
+							SampleStream::Idle );
+			}
+			else if( state == SampleStream::Active &&
+							stream->fill() )
+			{
+				busy = true;
+			}
+		}
+
+		reserveStreams();
+
+		if( busy == false &&
+			m_dataNeeded.fetchAndStoreOrdered( 0 ) == 0 )
+		{
+			msleep( STREAM_POLL_INTERVAL );
+		}
+	}
+}
@@ -59,6 +59,7 @@
 #include "ProjectJournal.h"
 #include "ProjectNotes.h"
 #include "ProjectRenderer.h"
+#include "ProjectWriter.h"
 #include "RenameDialog.h"
 #include "SongEditor.h"
 #include "templates.h"
@@ -84,6 +85,7 @@ Song::Song() :
 	m_fileName(),
 	m_oldFileName(),
 	m_modified( false ),
+	m_modifiedSinceSaving( false ),
 	m_recording( false ),
 	m_exporting( false ),
 	m_exportLoop( false ),
@@ -113,6 +115,13 @@ Song::Song() :
 
 	connect( &m_masterVolumeModel, SIGNAL( dataChanged() ),
 			this, SLOT( masterVolumeChanged() ) );
+
+	if( ProjectWriter::inst() != NULL )
+	{
+		connect( ProjectWriter::inst(),
+				SIGNAL( written( const QString &, bool ) ),
+			this, SLOT( projectWritten( const QString &, bool ) ) );
+	}
 /*	connect( &m_masterPitchModel, SIGNAL( dataChanged() ),
 			this, SLOT( masterPitchChanged() ) );*/
 
@@ -216,7 +225,7 @@ void Song::processNextBuffer()
 			// at song-start we have to reset the LFOs
 			if( m_playPos[Mode_PlaySong] == 0 )
 			{
-				EnvelopeAndLfoParameters::instances()->reset();
+				EnvelopeAndLfoParameters::resetLfoFrame();
 			}
 			break;
 
@@ -1081,76 +1090,162 @@ void Song::loadProject( const QString & fileName )
 }
 
 
-// only save current song as _filename and do nothing else
-bool Song::saveProjectFile( const QString & filename )
+DataFile * Song::createProjectDataFile()
 {
 	DataFile::LocaleHelper localeHelper( DataFile::LocaleHelper::ModeSave );
 
-	DataFile dataFile( DataFile::SongProject );
+	DataFile * dataFile = new DataFile( DataFile::SongProject );
 
-	m_tempoModel.saveSettings( dataFile, dataFile.head(), "bpm" );
-	m_timeSigModel.saveSettings( dataFile, dataFile.head(), "timesig" );
-	m_masterVolumeModel.saveSettings( dataFile, dataFile.head(), "mastervol" );
-	m_masterPitchModel.saveSettings( dataFile, dataFile.head(), "masterpitch" );
+	m_tempoModel.saveSettings( *dataFile, dataFile->head(), "bpm" );
+	m_timeSigModel.saveSettings( *dataFile, dataFile->head(), "timesig" );
+	m_masterVolumeModel.saveSettings( *dataFile, dataFile->head(), "mastervol" );
+	m_masterPitchModel.saveSettings( *dataFile, dataFile->head(), "masterpitch" );
 
-	saveState( dataFile, dataFile.content() );
+	saveState( *dataFile, dataFile->content() );
 
-	m_globalAutomationTrack->saveState( dataFile, dataFile.content() );
-	Engine::fxMixer()->saveState( dataFile, dataFile.content() );
+	m_globalAutomationTrack->saveState( *dataFile, dataFile->content() );
+	Engine::fxMixer()->saveState( *dataFile, dataFile->content() );
 	if( gui )
 	{
-		gui->getControllerRackView()->saveState( dataFile, dataFile.content() );
-		gui->pianoRoll()->saveState( dataFile, dataFile.content() );
-		gui->automationEditor()->m_editor->saveState( dataFile, dataFile.content() );
-		gui->getProjectNotes()->SerializingObject::saveState( dataFile, dataFile.content() );
-		m_playPos[Mode_PlaySong].m_timeLine->saveState( dataFile, dataFile.content() );
+		gui->getControllerRackView()->saveState( *dataFile, dataFile->content() );
+		gui->pianoRoll()->saveState( *dataFile, dataFile->content() );
+		gui->automationEditor()->m_editor->saveState( *dataFile, dataFile->content() );
+		gui->getProjectNotes()->SerializingObject::saveState( *dataFile, dataFile->content() );
+		m_playPos[Mode_PlaySong].m_timeLine->saveState( *dataFile, dataFile->content() );
 	}
 
-	saveControllerStates( dataFile, dataFile.content() );
+	saveControllerStates( *dataFile, dataFile->content() );
+
+	return dataFile;
+}
+
+
+
+
+// only save current song as _filename and do nothing else
+bool Song::saveProjectFile( const QString & filename )
+{
+	DataFile * dataFile = createProjectDataFile();
+	const bool success = dataFile->writeFile( filename );
+	delete dataFile;
+	return success;
+}
+
+
 
-	return dataFile.writeFile( filename );
+
+void Song::saveProjectFileInBackground( const QString & filename )
+{
+	if( ProjectWriter::inst() == NULL )
+	{
+		saveProjectFile( filename );
+		return;
+	}
+
+	// only taking the snapshot has to happen here, turning it into
+	// text, compressing and writing it doesn't involve any models
+	ProjectWriter::inst()->write( createProjectDataFile(), filename );
 }
 
 
 
-// save current song and update the gui
-bool Song::guiSaveProject()
+// save current song and update the gui - the result is reported by
+// projectWritten() once the file is written
+bool Song::guiSaveProject( bool waitUntilWritten )
 {
 	DataFile dataFile( DataFile::SongProject );
 	m_fileName = dataFile.nameWithExtension( m_fileName );
-	if( saveProjectFile( m_fileName ) && gui != nullptr )
+
+	// changes made from now on aren't part of the file
+	m_modifiedSinceSaving = false;
+	if( waitUntilWritten )
+	{
+		const bool success = ProjectWriter::inst() != NULL ?
+			ProjectWriter::inst()->writeAndWait(
+				createProjectDataFile(), m_fileName ) :
+			saveProjectFile( m_fileName );
+		if( success == false )
+		{
+			return false;
+		}
+		projectSaved();
+	}
+	else
+	{
+		saveProjectFileInBackground( m_fileName );
+	}
+
+	if( gui != nullptr )
+	{
+		ConfigManager::inst()->addRecentlyOpenedProject( m_fileName );
+		gui->mainWindow()->resetWindowTitle();
+	}
+
+	return true;
+}
+
+
+
+
+void Song::projectSaved()
+{
+	if( m_modifiedSinceSaving == false )
+	{
+		m_modified = false;
+		if( gui != nullptr )
+		{
+			gui->mainWindow()->resetWindowTitle();
+		}
+	}
+}
+
+
+
+
+void Song::projectWritten( const QString & _file, bool _success )
+{
+	// autosaves are silent
+	if( gui == nullptr || _file == ConfigManager::inst()->recoveryFile() )
 	{
+		return;
+	}
+
+	if( _success )
+	{
+		if( _file == m_fileName )
+		{
+			projectSaved();
+		}
 		TextFloat::displayMessage( tr( "Project saved" ),
 					tr( "The project %1 is now saved."
-							).arg( m_fileName ),
+							).arg( _file ),
 				embed::getIconPixmap( "project_save", 24, 24 ),
 									2000 );
-		ConfigManager::inst()->addRecentlyOpenedProject( m_fileName );
-		m_modified = false;
-		gui->mainWindow()->resetWindowTitle();
 	}
-	else if( gui != nullptr )
+	else
 	{
 		TextFloat::displayMessage( tr( "Project NOT saved." ),
 				tr( "The project %1 was not saved!" ).arg(
-							m_fileName ),
+							_file ),
 				embed::getIconPixmap( "error" ), 4000 );
-		return false;
+		if( _file == m_fileName )
+		{
+			setModified();
+		}
 	}
-
-	return true;
 }
 
 
 
 
 // save current song in given filename
-bool Song::guiSaveProjectAs( const QString & _file_name )
+bool Song::guiSaveProjectAs( const QString & _file_name,
+						bool _waitUntilWritten )
 {
 	QString o = m_oldFileName;
 	m_oldFileName = m_fileName;
 	m_fileName = _file_name;
-	if( guiSaveProject() == false )
+	if( guiSaveProject( _waitUntilWritten ) == false )
 	{
 		m_fileName = m_oldFileName;
 		m_oldFileName = o;
@@ -1385,6 +1480,7 @@ void Song::setModified()
 	if( !m_loadingProject )
 	{
 		m_modified = true;
+		m_modifiedSinceSaving = true;
 		if( gui != nullptr && gui->mainWindow() &&
 			QThread::currentThread() == gui->mainWindow()->thread() )
 		{
@@ -50,35 +50,20 @@ AudioAlsa::AudioAlsa( bool & _success_ful, Mixer*  _mixer ) :
 	m_handle( NULL ),
 	m_hwParams( NULL ),
 	m_swParams( NULL ),
-	m_convertEndian( false )
+	m_mmap( false ),
+	m_format( SND_PCM_FORMAT_S16 ),
+	m_convertEndian( false ),
+	m_outBuf( new surroundSampleFrame[mixer()->framesPerPeriod()] ),
+	m_outBufFrames( 0 ),
+	m_outBufPos( 0 )
 {
 	_success_ful = false;
 
-	int err;
-
-	if( ( err = snd_pcm_open( &m_handle,
-					probeDevice().toLatin1().constData(),
-						SND_PCM_STREAM_PLAYBACK,
-						0 ) ) < 0 )
-	{
-		printf( "Playback open error: %s\n", snd_strerror( err ) );
-		return;
-	}
-
 	snd_pcm_hw_params_malloc( &m_hwParams );
 	snd_pcm_sw_params_malloc( &m_swParams );
 
-	if( ( err = setHWParams( channels(),
-					SND_PCM_ACCESS_RW_INTERLEAVED ) ) < 0 )
-	{
-		printf( "Setting of hwparams failed: %s\n",
-							snd_strerror( err ) );
-		return;
-	}
-	if( ( err = setSWParams() ) < 0 )
+	if( openDevice() < 0 )
 	{
-		printf( "Setting of swparams failed: %s\n",
-							snd_strerror( err ) );
 		return;
 	}
 
@@ -121,6 +106,8 @@ AudioAlsa::~AudioAlsa()
 	{
 		snd_pcm_sw_params_free( m_swParams );
 	}
+
+	delete[] m_outBuf;
 }
 
 
@@ -196,11 +183,54 @@ AudioAlsa::DeviceInfoCollection AudioAlsa::getAvailableDevices()
 
 
 
+int AudioAlsa::openDevice()
+{
+	int err;
+
+	if( ( err = snd_pcm_open( &m_handle,
+					probeDevice().toLatin1().constData(),
+						SND_PCM_STREAM_PLAYBACK,
+						0 ) ) < 0 )
+	{
+		printf( "Playback open error: %s\n", snd_strerror( err ) );
+		m_handle = NULL;
+		return err;
+	}
+
+	// prefer writing right into the buffer of the device, which saves
+	// copying every period through ALSA
+	m_mmap = true;
+	if( ( err = setHWParams( channels(),
+				SND_PCM_ACCESS_MMAP_INTERLEAVED ) ) < 0 )
+	{
+		m_mmap = false;
+		err = setHWParams( channels(), SND_PCM_ACCESS_RW_INTERLEAVED );
+	}
+	if( err < 0 )
+	{
+		printf( "Setting of hwparams failed: %s\n",
+							snd_strerror( err ) );
+		return err;
+	}
+	if( ( err = setSWParams() ) < 0 )
+	{
+		printf( "Setting of swparams failed: %s\n",
+							snd_strerror( err ) );
+		return err;
+	}
+
+	return 0;
+}
+
+
+
+
 int AudioAlsa::handleError( int _err )
 {
 	if( _err == -EPIPE )
 	{
 		// under-run
+		countXRun();
 		_err = snd_pcm_prepare( m_handle );
 		if( _err < 0 )
 			printf( "Can't recover from underrun, prepare "
@@ -266,28 +296,8 @@ void AudioAlsa::applyQualitySettings()
 			snd_pcm_close( m_handle );
 		}
 
-		int err;
-		if( ( err = snd_pcm_open( &m_handle,
-					probeDevice().toLatin1().constData(),
-						SND_PCM_STREAM_PLAYBACK,
-								0 ) ) < 0 )
-		{
-			printf( "Playback open error: %s\n",
-							snd_strerror( err ) );
-			return;
-		}
-
-		if( ( err = setHWParams( channels(),
-					SND_PCM_ACCESS_RW_INTERLEAVED ) ) < 0 )
-		{
-			printf( "Setting of hwparams failed: %s\n",
-							snd_strerror( err ) );
-			return;
-		}
-		if( ( err = setSWParams() ) < 0 )
+		if( openDevice() < 0 )
 		{
-			printf( "Setting of swparams failed: %s\n",
-							snd_strerror( err ) );
 			return;
 		}
 	}
@@ -300,57 +310,118 @@ void AudioAlsa::applyQualitySettings()
 
 void AudioAlsa::run()
 {
-	surroundSampleFrame * temp =
-		new surroundSampleFrame[mixer()->framesPerPeriod()];
-	int_sample_t * outbuf =
-			new int_sample_t[mixer()->framesPerPeriod() *
-								channels()];
-	int_sample_t * pcmbuf = new int_sample_t[m_periodSize * channels()];
+	m_outBufFrames = 0;
+	m_outBufPos = 0;
+
+	if( m_mmap )
+	{
+		writePeriodsMmap();
+	}
+	else
+	{
+		writePeriods();
+	}
+}
 
-	int outbuf_size = mixer()->framesPerPeriod() * channels();
-	int outbuf_pos = 0;
-	int pcmbuf_size = m_periodSize * channels();
 
+
+
+void AudioAlsa::writePeriodsMmap()
+{
 	bool quit = false;
 	while( quit == false )
 	{
-		int_sample_t * ptr = pcmbuf;
-		int len = pcmbuf_size;
-		while( len )
+		const snd_pcm_sframes_t avail = snd_pcm_avail_update( m_handle );
+		if( avail < 0 )
 		{
-			if( outbuf_pos == 0 )
+			if( handleError( avail ) < 0 )
 			{
-				// frames depend on the sample rate
-				const fpp_t frames = getNextBuffer( temp );
-				if( !frames )
+				printf( "Write error: %s\n", snd_strerror( avail ) );
+				// keep the mixer going at least
+				writePeriods();
+				return;
+			}
+			continue;
+		}
+
+		if( avail < (snd_pcm_sframes_t) m_periodSize )
+		{
+			if( snd_pcm_state( m_handle ) == SND_PCM_STATE_PREPARED )
+			{
+				// buffer is full, but the device wasn't started
+				snd_pcm_start( m_handle );
+			}
+			else
+			{
+				const int err = snd_pcm_wait( m_handle, 1000 );
+				if( err < 0 )
 				{
-					quit = true;
-					memset( ptr, 0, len
-						* sizeof( int_sample_t ) );
-					break;
+					handleError( err );
 				}
-				outbuf_size = frames * channels();
+			}
+			continue;
+		}
 
-				convertToS16( temp, frames,
-						mixer()->masterGain(),
-						outbuf,
-						m_convertEndian );
+		snd_pcm_uframes_t frames = m_periodSize;
+		while( frames > 0 )
+		{
+			const snd_pcm_channel_area_t * areas;
+			snd_pcm_uframes_t offset;
+			snd_pcm_uframes_t todo = frames;
+			int err = snd_pcm_mmap_begin( m_handle, &areas, &offset,
+									&todo );
+			if( err < 0 )
+			{
+				handleError( err );
+				break;
+			}
+
+			// interleaved, so the first area covers all channels
+			void * dst = (char *) areas[0].addr +
+				( areas[0].first + offset * areas[0].step ) / 8;
+			if( quit )
+			{
+				snd_pcm_format_set_silence( m_format, dst,
+							todo * channels() );
+			}
+			else
+			{
+				quit = fillBuffer( dst, todo ) == false;
 			}
-			int min_len = qMin( len, outbuf_size - outbuf_pos );
-			memcpy( ptr, outbuf + outbuf_pos,
-					min_len * sizeof( int_sample_t ) );
-			ptr += min_len;
-			len -= min_len;
-			outbuf_pos += min_len;
-			outbuf_pos %= outbuf_size;
+
+			const snd_pcm_sframes_t committed =
+				snd_pcm_mmap_commit( m_handle, offset, todo );
+			if( committed < 0 ||
+				(snd_pcm_uframes_t) committed != todo )
+			{
+				handleError( committed < 0 ? committed : -EPIPE );
+				break;
+			}
+			frames -= todo;
 		}
+	}
+}
 
-		f_cnt_t frames = m_periodSize;
-		ptr = pcmbuf;
+
+
+
+void AudioAlsa::writePeriods()
+{
+	char * pcmbuf = new char[snd_pcm_frames_to_bytes( m_handle,
+							m_periodSize )];
+
+	bool quit = false;
+	while( quit == false )
+	{
+		quit = fillBuffer( pcmbuf, m_periodSize ) == false;
+
+		snd_pcm_uframes_t frames = m_periodSize;
+		char * ptr = pcmbuf;
 
 		while( frames )
 		{
-			int err = snd_pcm_writei( m_handle, ptr, frames );
+			snd_pcm_sframes_t err = snd_pcm_writei( m_handle, ptr,
+									frames );
 
 			if( err == -EAGAIN )
 			{
@@ -366,19 +437,87 @@ void AudioAlsa::run()
 				}
 				break;	// skip this buffer
 			}
-			ptr += err * channels();
+			ptr += snd_pcm_frames_to_bytes( m_handle, err );
 			frames -= err;
 		}
 	}
 
-	delete[] temp;
-	delete[] outbuf;
 	delete[] pcmbuf;
 }
 
 
 
 
+bool AudioAlsa::fillBuffer( void * _dst, snd_pcm_uframes_t _frames )
+{
+	char * dst = (char *) _dst;
+	while( _frames > 0 )
+	{
+		if( m_outBufPos == m_outBufFrames )
+		{
+			// frames depend on the sample rate
+			m_outBufFrames = getNextBuffer( m_outBuf );
+			m_outBufPos = 0;
+			if( !m_outBufFrames )
+			{
+				snd_pcm_format_set_silence( m_format, dst,
+							_frames * channels() );
+				return false;
+			}
+		}
+
+		const fpp_t frames = qMin<snd_pcm_uframes_t>( _frames,
+					m_outBufFrames - m_outBufPos );
+		const surroundSampleFrame * src = m_outBuf + m_outBufPos;
+		const float gain = mixer()->masterGain();
+
+		switch( m_format )
+		{
+			case SND_PCM_FORMAT_FLOAT:
+			{
+				float * o = (float *) dst;
+				for( fpp_t frame = 0; frame < frames; ++frame )
+				{
+					for( ch_cnt_t ch = 0; ch < channels(); ++ch )
+					{
+						*o++ = src[frame][ch] * gain;
+					}
+				}
+				break;
+			}
+			case SND_PCM_FORMAT_S32:
+			{
+				int32_t * o = (int32_t *) dst;
+				for( fpp_t frame = 0; frame < frames; ++frame )
+				{
+					for( ch_cnt_t ch = 0; ch < channels(); ++ch )
+					{
+						*o++ = static_cast<int32_t>(
+							Mixer::clip( src[frame][ch] *
+								gain ) *
+							2147483647.0 );
+					}
+				}
+				break;
+			}
+			default:
+				convertToS16( src, frames, gain,
+						(int_sample_t *) dst,
+						m_convertEndian );
+				break;
+		}
+
+		dst += snd_pcm_frames_to_bytes( m_handle, frames );
+		m_outBufPos += frames;
+		_frames -= frames;
+	}
+
+	return true;
+}
+
+
+
+
 int AudioAlsa::setHWParams( const ch_cnt_t _channels, snd_pcm_access_t _access )
 {
 	int err, dir;
@@ -400,22 +539,36 @@ int AudioAlsa::setHWParams( const ch_cnt_t _channels, snd_pcm_access_t _access )
 		return err;
 	}
 
-	// set the sample format
-	if( ( snd_pcm_hw_params_set_format( m_handle, m_hwParams,
-						SND_PCM_FORMAT_S16_LE ) ) < 0 )
+	// set the sample format - float and 32 bit samples can be written
+	// without losing resolution
+	m_convertEndian = false;
+	if( snd_pcm_hw_params_set_format( m_handle, m_hwParams,
+						SND_PCM_FORMAT_FLOAT ) >= 0 )
 	{
-		if( ( snd_pcm_hw_params_set_format( m_handle, m_hwParams,
-						SND_PCM_FORMAT_S16_BE ) ) < 0 )
-		{
-			printf( "Neither little- nor big-endian available for "
-					"playback: %s\n", snd_strerror( err ) );
-			return err;
-		}
+		m_format = SND_PCM_FORMAT_FLOAT;
+	}
+	else if( snd_pcm_hw_params_set_format( m_handle, m_hwParams,
+						SND_PCM_FORMAT_S32 ) >= 0 )
+	{
+		m_format = SND_PCM_FORMAT_S32;
+	}
+	else if( snd_pcm_hw_params_set_format( m_handle, m_hwParams,
+						SND_PCM_FORMAT_S16_LE ) >= 0 )
+	{
+		m_format = SND_PCM_FORMAT_S16_LE;
+		m_convertEndian = !isLittleEndian();
+	}
+	else if( ( err = snd_pcm_hw_params_set_format( m_handle, m_hwParams,
+						SND_PCM_FORMAT_S16_BE ) ) >= 0 )
+	{
+		m_format = SND_PCM_FORMAT_S16_BE;
 		m_convertEndian = isLittleEndian();
 	}
 	else
 	{
-		m_convertEndian = !isLittleEndian();
+		printf( "No sample format available for playback: %s\n",
+							snd_strerror( err ) );
+		return err;
 	}
 
 	// set the count of channels
@@ -442,7 +595,6 @@ int AudioAlsa::setHWParams( const ch_cnt_t _channels, snd_pcm_access_t _access )
 	}
 
 	m_periodSize = mixer()->framesPerPeriod();
-	m_bufferSize = m_periodSize * 8;
 	dir = 0;
 	err = snd_pcm_hw_params_set_period_size_near( m_handle, m_hwParams,
 							&m_periodSize, &dir );
@@ -461,6 +613,16 @@ int AudioAlsa::setHWParams( const ch_cnt_t _channels, snd_pcm_access_t _access )
 							snd_strerror( err ) );
 	}
 
+	// the fewer periods, the lower the latency - and the more likely
+	// an under-run
+	int periods = ConfigManager::inst()->value( "audioalsa",
+							"periods" ).toInt();
+	if( periods < 2 )
+	{
+		periods = DEFAULT_PERIODS;
+	}
+	m_bufferSize = m_periodSize * periods;
+
 	dir = 0;
 	err = snd_pcm_hw_params_set_buffer_size_near( m_handle, m_hwParams,
 								&m_bufferSize );
@@ -36,7 +36,9 @@ AudioDevice::AudioDevice( const ch_cnt_t _channels, Mixer*  _mixer ) :
 	m_sampleRate( _mixer->processingSampleRate() ),
 	m_channels( _channels ),
 	m_mixer( _mixer ),
-	m_buffer( new surroundSampleFrame[mixer()->framesPerPeriod()] )
+	m_decimator( _mixer->framesPerPeriod() ),
+	m_buffer( new surroundSampleFrame[mixer()->framesPerPeriod()] ),
+	m_xruns( 0 )
 {
 	int error;
 	if( ( m_srcState = src_new(
@@ -87,6 +89,27 @@ fpp_t AudioDevice::getNextBuffer( surroundSampleFrame * _ab )
 		return 0;
 	}
 
+	const sample_rate_t processingRate = mixer()->processingSampleRate();
+	const int ratio = processingRate / m_sampleRate;
+	if( processingRate % m_sampleRate == 0 &&
+				HalfBandDecimator::supports( ratio ) )
+	{
+		// oversampling only - the decimator belongs to the thread
+		// fetching the buffers, so there's nothing to lock
+		if( m_decimator.ratio() != ratio )
+		{
+			m_decimator.setRatio( ratio );
+		}
+		frames = m_decimator.process( b, _ab, frames );
+
+		if( mixer()->hasFifoWriter() )
+		{
+			delete[] b;
+		}
+
+		return frames;
+	}
+
 	// make sure, no other thread is accessing device
 	lock();
 
@@ -133,6 +156,8 @@ void AudioDevice::stopProcessing()
 
 void AudioDevice::applyQualitySettings()
 {
+	m_decimator.reset();
+
 	src_delete( m_srcState );
 
 	int error;
@@ -38,9 +38,11 @@
 #include "gui_templates.h"
 #include "ConfigManager.h"
 #include "LcdSpinBox.h"
+#include "LedCheckbox.h"
 #include "AudioPort.h"
 #include "MainWindow.h"
 #include "Mixer.h"
+#include "ToolTip.h"
 
 
 
@@ -52,10 +54,21 @@ AudioJack::AudioJack( bool & _success_ful, Mixer*  _mixer ) :
 								_mixer ),
 	m_client( NULL ),
 	m_active( false ),
+	m_stopped( false ),
+	m_renderInCallback( ConfigManager::inst()->value( "audiojack",
+					"renderincallback" ).toInt() ),
+	m_processingMutex(),
 	m_tempOutBufs( new jack_default_audio_sample_t *[channels()] ),
 	m_outBuf( new surroundSampleFrame[mixer()->framesPerPeriod()] ),
 	m_framesDoneInCurBuf( 0 ),
-	m_framesToDoInCurBuf( 0 )
+	m_framesToDoInCurBuf( 0 ),
+	m_trackOutputs( m_renderInCallback &&
+			ConfigManager::inst()->value( "audiojack",
+						"trackoutputs" ).toInt() ),
+	m_portMap(),
+	m_portMapMutex(),
+	m_writePorts( false ),
+	m_portFrame( 0 )
 {
 	_success_ful = initJackClient();
 	if( _success_ful )
@@ -72,12 +85,10 @@ AudioJack::AudioJack( bool & _success_ful, Mixer*  _mixer ) :
 
 AudioJack::~AudioJack()
 {
-#ifdef AUDIO_PORT_SUPPORT
 	while( m_portMap.size() )
 	{
 		unregisterPort( m_portMap.begin().key() );
 	}
-#endif
 
 	if( m_client != NULL )
 	{
@@ -100,6 +111,17 @@ void AudioJack::restartAfterZombified()
 {
 	if( initJackClient() )
 	{
+		// the ports of the tracks went away along with the old client
+		m_portMapMutex.lock();
+		const QList<AudioPort *> ports = m_portMap.keys();
+		m_portMap.clear();
+		m_portMapMutex.unlock();
+		for( QList<AudioPort *>::ConstIterator it = ports.begin();
+							it != ports.end(); ++it )
+		{
+			registerPort( *it );
+		}
+
 		m_active = false;
 		startProcessing();
 		QMessageBox::information( gui->mainWindow(),
@@ -169,6 +191,7 @@ bool AudioJack::initJackClient()
 		setSampleRate( jack_get_sample_rate( m_client ) );
 	}
 
+	m_outputPorts.clear();
 	for( ch_cnt_t ch = 0; ch < channels(); ++ch )
 	{
 		QString name = QString( "master out " ) +
@@ -245,6 +268,11 @@ void AudioJack::startProcessing()
 
 void AudioJack::stopProcessing()
 {
+	// wait for a running process callback - it doesn't touch the mixer
+	// anymore afterwards
+	m_processingMutex.lock();
+	m_stopped = true;
+	m_processingMutex.unlock();
 }
 
 
@@ -270,20 +298,29 @@ void AudioJack::applyQualitySettings()
 
 void AudioJack::registerPort( AudioPort * _port )
 {
-#ifdef AUDIO_PORT_SUPPORT
+	if( m_trackOutputs == false || m_client == NULL )
+	{
+		return;
+	}
+
 	// make sure, port is not already registered
 	unregisterPort( _port );
 	const QString name[2] = { _port->name() + " L",
 					_port->name() + " R" } ;
 
+	StereoPort port;
 	for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
 	{
-		m_portMap[_port].ports[ch] = jack_port_register( m_client,
+		port.ports[ch] = jack_port_register( m_client,
 						name[ch].toLatin1().constData(),
 						JACK_DEFAULT_AUDIO_TYPE,
 							JackPortIsOutput, 0 );
+		port.buffers[ch] = NULL;
 	}
-#endif
+
+	m_portMapMutex.lock();
+	m_portMap[_port] = port;
+	m_portMapMutex.unlock();
 }
 
 
@@ -291,20 +328,29 @@ void AudioJack::registerPort( AudioPort * _port )
 
 void AudioJack::unregisterPort( AudioPort * _port )
 {
-#ifdef AUDIO_PORT_SUPPORT
-	if( m_portMap.contains( _port ) )
+	if( m_trackOutputs == false )
 	{
-		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+		return;
+	}
+
+	m_portMapMutex.lock();
+	JackPortMap::Iterator it = m_portMap.find( _port );
+	if( it == m_portMap.end() )
+	{
+		m_portMapMutex.unlock();
+		return;
+	}
+	const StereoPort port = *it;
+	m_portMap.erase( it );
+	m_portMapMutex.unlock();
+
+	for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+	{
+		if( port.ports[ch] != NULL && m_client != NULL )
 		{
-			if( m_portMap[_port].ports[ch] != NULL )
-			{
-				jack_port_unregister( m_client,
-						m_portMap[_port].ports[ch] );
-			}
+			jack_port_unregister( m_client, port.ports[ch] );
 		}
-		m_portMap.erase( m_portMap.find( _port ) );
 	}
-#endif
 }
 
 
@@ -312,18 +358,55 @@ void AudioJack::unregisterPort( AudioPort * _port )
 
 void AudioJack::renamePort( AudioPort * _port )
 {
-#ifdef AUDIO_PORT_SUPPORT
-	if( m_portMap.contains( _port ) )
+	// the map is only changed by the thread calling us
+	JackPortMap::ConstIterator it = m_portMap.constFind( _port );
+	if( it != m_portMap.constEnd() )
 	{
 		const QString name[2] = { _port->name() + " L",
 					_port->name() + " R" };
 		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
 		{
-			jack_port_set_name( m_portMap[_port].ports[ch],
+			if( it->ports[ch] != NULL )
+			{
+				jack_port_set_name( it->ports[ch],
 					name[ch].toLatin1().constData() );
+			}
+		}
+	}
+}
+
+
+
+
+void AudioJack::writePortBuffer( AudioPort * _port, const sampleFrame * _buf,
+							const fpp_t _frames )
+{
+	if( m_writePorts == false )
+	{
+		return;
+	}
+
+	// ports registered after the process callback fetched the buffers
+	// don't have any yet, those unregistered meanwhile are gone
+	QMutexLocker lock( &m_portMapMutex );
+	JackPortMap::ConstIterator it = m_portMap.constFind( _port );
+	if( it == m_portMap.constEnd() )
+	{
+		return;
+	}
+
+	for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
+	{
+		if( it->buffers[ch] == NULL )
+		{
+			continue;
+		}
+		jack_default_audio_sample_t * o = it->buffers[ch] + m_portFrame;
+		for( fpp_t frame = 0; frame < _frames; ++frame )
+		{
+			o[frame] = _buf[frame][ch];
 		}
 	}
-#endif
 }
 
 
@@ -338,68 +421,134 @@ int AudioJack::processCallback( jack_nframes_t _nframes, void * _udata )
 												m_outputPorts[c], _nframes );
 	}
 
-#ifdef AUDIO_PORT_SUPPORT
-	const int frames = qMin<int>( _nframes, mixer()->framesPerPeriod() );
-	for( jackPortMap::iterator it = m_portMap.begin();
+	// the ports of the tracks stay silent unless the periods are
+	// rendered right into them - the map is only locked for a moment, as
+	// ports are unregistered while the mixer waits for a change in the
+	// model, which rendering below can get stuck in
+	m_portMapMutex.lock();
+	for( JackPortMap::Iterator it = m_portMap.begin();
 						it != m_portMap.end(); ++it )
 	{
-		for( ch_cnt_t ch = 0; ch < channels(); ++ch )
+		for( ch_cnt_t ch = 0; ch < DEFAULT_CHANNELS; ++ch )
 		{
-			if( it.data().ports[ch] == NULL )
+			if( it->ports[ch] == NULL )
 			{
 				continue;
 			}
-			jack_default_audio_sample_t * buf =
-			(jack_default_audio_sample_t *) jack_port_get_buffer(
-							it.data().ports[ch],
-								_nframes );
-			for( int frame = 0; frame < frames; ++frame )
-			{
-				buf[frame] = it.key()->firstBuffer()[frame][ch];
-			}
+			it->buffers[ch] = (jack_default_audio_sample_t *)
+				jack_port_get_buffer( it->ports[ch], _nframes );
+			memset( it->buffers[ch], 0,
+					sizeof( *it->buffers[ch] ) * _nframes );
 		}
 	}
-#endif
+	m_portMapMutex.unlock();
+
+	jack_nframes_t done = 0;
+	// stopProcessing() is waiting for us to leave the mixer alone
+	if( m_processingMutex.tryLock() )
+	{
+		// rendering right here needs whole periods at our sample rate
+		// and nothing left over from copying buffers
+		if( m_renderInCallback && mixer()->hasFifoWriter() == false &&
+			_nframes % mixer()->framesPerPeriod() == 0 &&
+			mixer()->processingSampleRate() == sampleRate() &&
+			m_framesDoneInCurBuf == m_framesToDoInCurBuf )
+		{
+			done = renderPeriods( _nframes );
+		}
+		else
+		{
+			done = copyBuffers( _nframes );
+		}
+		m_processingMutex.unlock();
+	}
+
+	for( int c = 0; c < channels(); ++c )
+	{
+		jack_default_audio_sample_t * b = m_tempOutBufs[c] + done;
+		memset( b, 0, sizeof( *b ) * ( _nframes - done ) );
+	}
+
+	return 0;
+}
+
+
+
+
+// renders the periods of the mixer straight into the JACK buffers
+jack_nframes_t AudioJack::renderPeriods( jack_nframes_t _nframes )
+{
+	const fpp_t fpp = mixer()->framesPerPeriod();
+
+	m_writePorts = true;
 
 	jack_nframes_t done = 0;
 	while( done < _nframes && m_stopped == false )
 	{
-		jack_nframes_t todo = qMin<jack_nframes_t>(
-						_nframes,
-						m_framesToDoInCurBuf -
-							m_framesDoneInCurBuf );
+		m_portFrame = done;
+		const surroundSampleFrame * b = mixer()->nextBuffer();
+		if( b == NULL )
+		{
+			m_stopped = true;
+			break;
+		}
+
 		const float gain = mixer()->masterGain();
 		for( int c = 0; c < channels(); ++c )
 		{
-			jack_default_audio_sample_t * o = m_tempOutBufs[c];
-			for( jack_nframes_t frame = 0; frame < todo; ++frame )
+			jack_default_audio_sample_t * o = m_tempOutBufs[c] + done;
+			for( fpp_t frame = 0; frame < fpp; ++frame )
 			{
-				o[done+frame] = m_outBuf[m_framesDoneInCurBuf+frame][c] * gain;
+				o[frame] = b[frame][c] * gain;
 			}
 		}
-		done += todo;
-		m_framesDoneInCurBuf += todo;
+		done += fpp;
+	}
+
+	m_writePorts = false;
+
+	return done;
+}
+
+
+
+
+// copies buffers of the mixer (resampled if needed) into the JACK buffers,
+// which works for any size of both
+jack_nframes_t AudioJack::copyBuffers( jack_nframes_t _nframes )
+{
+	jack_nframes_t done = 0;
+	while( done < _nframes && m_stopped == false )
+	{
 		if( m_framesDoneInCurBuf == m_framesToDoInCurBuf )
 		{
 			m_framesToDoInCurBuf = getNextBuffer( m_outBuf );
+			m_framesDoneInCurBuf = 0;
 			if( !m_framesToDoInCurBuf )
 			{
 				m_stopped = true;
+				break;
 			}
-			m_framesDoneInCurBuf = 0;
 		}
-	}
 
-	if( m_stopped == true )
-	{
+		jack_nframes_t todo = qMin<jack_nframes_t>(
+						_nframes - done,
+						m_framesToDoInCurBuf -
+							m_framesDoneInCurBuf );
+		const float gain = mixer()->masterGain();
 		for( int c = 0; c < channels(); ++c )
 		{
-			jack_default_audio_sample_t * b = m_tempOutBufs[c] + done;
-			memset( b, 0, sizeof( *b ) * ( _nframes - done ) );
+			jack_default_audio_sample_t * o = m_tempOutBufs[c];
+			for( jack_nframes_t frame = 0; frame < todo; ++frame )
+			{
+				o[done+frame] = m_outBuf[m_framesDoneInCurBuf+frame][c] * gain;
+			}
 		}
+		done += todo;
+		m_framesDoneInCurBuf += todo;
 	}
 
-	return 0;
+	return done;
 }
 
 
@@ -451,6 +600,23 @@ AudioJack::setupWidget::setupWidget( QWidget * _parent ) :
 	m_channels->setLabel( tr( "CHANNELS" ) );
 	m_channels->move( 180, 20 );
 
+	m_renderInCallback = new LedCheckBox( tr( "Render in callback" ),
+									this );
+	m_renderInCallback->move( 230, 20 );
+	m_renderInCallback->setChecked( ConfigManager::inst()->value(
+				"audiojack", "renderincallback" ).toInt() );
+	ToolTip::add( m_renderInCallback,
+		tr( "Render each JACK period right when JACK asks for it. "
+			"Set the buffer size to JACK's period size or a "
+			"divisor of it for this to take effect." ) );
+
+	m_trackOutputs = new LedCheckBox( tr( "Track outputs" ), this );
+	m_trackOutputs->move( 230, 38 );
+	m_trackOutputs->setChecked( ConfigManager::inst()->value(
+				"audiojack", "trackoutputs" ).toInt() );
+	ToolTip::add( m_trackOutputs,
+		tr( "Provide a JACK output for each track when rendering "
+							"in callback." ) );
 }
 
 
@@ -470,6 +636,10 @@ void AudioJack::setupWidget::saveSettings()
 							m_clientName->text() );
 	ConfigManager::inst()->setValue( "audiojack", "channels",
 				QString::number( m_channels->value<int>() ) );
+	ConfigManager::inst()->setValue( "audiojack", "renderincallback",
+			QString::number( m_renderInCallback->isChecked() ) );
+	ConfigManager::inst()->setValue( "audiojack", "trackoutputs",
+			QString::number( m_trackOutputs->isChecked() ) );
 }
 
 
@@ -48,7 +48,6 @@ AudioPort::AudioPort( const QString & _name, bool _has_effect_chain,
 	m_mutedModel( mutedModel )
 {
 	Engine::mixer()->addAudioPort( this );
-	setExtOutputEnabled( true );
 }
 
 
@@ -223,6 +222,11 @@ void AudioPort::doProcessing()
 	const bool me = processEffects();
 	if( me || m_bufferUsage )
 	{
+		if( m_extOutputEnabled )
+		{
+			Engine::mixer()->audioDev()->writePortBuffer( this,
+							m_portBuffer, fpp );
+		}
 		Engine::fxMixer()->mixToChannel( m_portBuffer, m_nextFxChannel ); 	// send output to fx mixer
 																			// TODO: improve the flow here - convert to pull model
 		m_bufferUsage = false;
@@ -35,6 +35,84 @@ namespace base64
 {
 
 
+// value of a base64 digit, -1 for padding and everything
+// QByteArray::fromBase64() skips
+static inline int digitValue( const ushort _c )
+{
+	if( _c >= 'A' && _c <= 'Z' )
+	{
+		return _c - 'A';
+	}
+	if( _c >= 'a' && _c <= 'z' )
+	{
+		return _c - 'a' + 26;
+	}
+	if( _c >= '0' && _c <= '9' )
+	{
+		return _c - '0' + 52;
+	}
+	if( _c == '+' )
+	{
+		return 62;
+	}
+	if( _c == '/' )
+	{
+		return 63;
+	}
+	return -1;
+}
+
+
+
+
+int decodedSize( const QString & _b64 )
+{
+	const QChar * c = _b64.constData();
+	const int len = _b64.length();
+	int digits = 0;
+	for( int i = 0; i < len; ++i )
+	{
+		if( digitValue( c[i].unicode() ) >= 0 )
+		{
+			++digits;
+		}
+	}
+	return digits * 3 / 4;
+}
+
+
+
+
+int decodeInto( const QString & _b64, char * _dst )
+{
+	const QChar * c = _b64.constData();
+	const int len = _b64.length();
+	unsigned int bits = 0;
+	int bitCount = 0;
+	int size = 0;
+	for( int i = 0; i < len; ++i )
+	{
+		const int d = digitValue( c[i].unicode() );
+		if( d < 0 )
+		{
+			continue;
+		}
+		bits = ( bits << 6 ) | d;
+		bitCount += 6;
+		if( bitCount >= 8 )
+		{
+			bitCount -= 8;
+			_dst[size++] = (char)( bits >> bitCount );
+			bits &= ( 1 << bitCount ) - 1;
+		}
+	}
+	return size;
+}
+
+
+
+
+
 QVariant decode( const QString & _b64, QVariant::Type _force_type )
 {
 	char * dst = NULL;
@@ -69,6 +69,7 @@
 #include "GuiApplication.h"
 #include "ImportFilter.h"
 #include "MainWindow.h"
+#include "ProjectContainer.h"
 #include "ProjectRenderer.h"
 #include "RenderManager.h"
 #include "DataFile.h"
@@ -140,7 +141,7 @@ void printHelp()
 		"-b, --bitrate <bitrate>       Specify output bitrate in KBit/s\n"
 		"       Default: 160.\n"
 		"-c, --config <configfile>     Get the configuration from <configfile>\n"
-		"-d, --dump <in>               Dump XML of compressed file <in>\n"
+		"-d, --dump <in>               Dump XML of compressed or binary file <in>\n"
 		"-f, --format <format>         Specify format of render-output where\n"
 		"       Format is either 'wav' or 'ogg'.\n"
 		"    --geometry <geometry>     Specify the size and position of the main window\n"
@@ -165,6 +166,7 @@ void printHelp()
 		"       Range: 44100 (default) to 192000\n"
 		"-u, --upgrade <in> [out]      Upgrade file <in> and save as <out>\n"
 		"       Standard out is used if no output file is specifed\n"
+		"       An <out> ending in .mmpb is saved as binary project\n"
 		"-v, --version                 Show version information and exit.\n"
 		"    --allowroot               Bypass root user startup check (use with caution).\n"
 		"-x, --oversampling <value>    Specify oversampling\n"
@@ -312,7 +314,20 @@ int main( int argc, char * * argv )
 			}
 
 
-			QFile f( QString::fromLocal8Bit( argv[i] ) );
+			const QString file = QString::fromLocal8Bit( argv[i] );
+			ProjectContainer * container =
+					ProjectContainer::open( file );
+			if( container != NULL )
+			{
+				// samples are shown as references to their chunks
+				const QByteArray d = container->document();
+				fwrite( d.constData(), 1, d.size(), stdout );
+				printf( "\n" );
+				sharedObject::unref( container );
+				return EXIT_SUCCESS;
+			}
+
+			QFile f( file );
 			f.open( QIODevice::ReadOnly );
 			QString d = qUncompress( f.readAll() );
 			printf( "%s\n", d.toUtf8().constData() );
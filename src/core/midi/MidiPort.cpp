@@ -26,12 +26,73 @@
 #include <QDomElement>
 
 #include "MidiPort.h"
+#include "Engine.h"
 #include "MidiClient.h"
+#include "Mixer.h"
 #include "Note.h"
 #include "Song.h"
 
 
 
+MidiPort::InEventQueue::InEventQueue() :
+	m_writeIndex( 0 ),
+	m_readIndex( 0 )
+{
+	for( int i = 0; i < Size; ++i )
+	{
+		m_cells[i].sequence = i;
+	}
+}
+
+
+
+
+bool MidiPort::InEventQueue::push( const InEvent& event )
+{
+	// a cell may be written once its sequence equals the write index -
+	// the threads of some clients may deliver events concurrently
+	int pos = m_writeIndex;
+	while( true )
+	{
+		Cell& cell = m_cells[pos & ( Size - 1 )];
+		const int sequence = cell.sequence;
+		if( sequence == pos )
+		{
+			if( m_writeIndex.testAndSetOrdered( pos, pos + 1 ) )
+			{
+				cell.event = event;
+				cell.sequence.fetchAndStoreOrdered( pos + 1 );
+				return true;
+			}
+		}
+		else if( sequence - pos < 0 )
+		{
+			return false;
+		}
+		pos = m_writeIndex;
+	}
+}
+
+
+
+
+bool MidiPort::InEventQueue::pop( InEvent* event )
+{
+	Cell& cell = m_cells[m_readIndex & ( Size - 1 )];
+	if( (int) cell.sequence != m_readIndex + 1 )
+	{
+		return false;
+	}
+
+	*event = cell.event;
+	cell.sequence.fetchAndStoreOrdered( m_readIndex + Size );
+	++m_readIndex;
+
+	return true;
+}
+
+
+
 MidiPort::MidiPort( const QString& name,
 					MidiClient* client,
 					MidiEventProcessor* eventProcessor,
@@ -53,7 +114,14 @@ MidiPort::MidiPort( const QString& name,
 	m_outputProgramModel( 1, 1, MidiProgramCount, this, tr( "Output MIDI program" ) ),
 	m_baseVelocityModel( MidiMaxVelocity/2, 1, MidiMaxVelocity, this, tr( "Base velocity" ) ),
 	m_readableModel( false, this, tr( "Receive MIDI-events" ) ),
-	m_writableModel( false, this, tr( "Send MIDI-events" ) )
+	m_writableModel( false, this, tr( "Send MIDI-events" ) ),
+	m_inEventOverflow(),
+	m_inEventOverflowMutex(),
+	m_inEventsOverflowing( 0 ),
+	m_heldInEvent(),
+	m_hasHeldInEvent( false ),
+	m_deferredInEvent(),
+	m_inEventDeferred( 0 )
 {
 	m_midiClient->addPort( this );
 
@@ -78,6 +146,8 @@ MidiPort::MidiPort( const QString& name,
 	}
 
 	updateMidiPortMode();
+
+	Engine::mixer()->addMidiPort( this );
 }
 
 
@@ -85,6 +155,8 @@ MidiPort::MidiPort( const QString& name,
 
 MidiPort::~MidiPort()
 {
+	Engine::mixer()->removeMidiPort( this );
+
 	// unsubscribe ports
 	m_readableModel.setValue( false );
 	m_writableModel.setValue( false );
@@ -136,8 +208,116 @@ void MidiPort::processInEvent( const MidiEvent& event, const MidiTime& time )
 			inEvent.setVelocity( fixedInputVelocity() );
 		}
 
-		m_midiEventProcessor->processInEvent( inEvent, time );
+		InEvent queued;
+		queued.event = inEvent;
+		queued.time = time;
+		queued.arrival = Engine::mixer()->midiClock();
+
+		// once an event didn't fit, all following ones go the same way
+		// until the mixer has taken them, so they stay in order
+		if( m_inEventsOverflowing || m_inEvents.push( queued ) == false )
+		{
+			QMutexLocker lock( &m_inEventOverflowMutex );
+			m_inEventOverflow.append( queued );
+			m_inEventsOverflowing.fetchAndStoreOrdered( 1 );
+		}
+	}
+}
+
+
+
+
+void MidiPort::dispatchInEvents( qint64 begin, qint64 end, fpp_t frames )
+{
+	if( m_inEventDeferred )
+	{
+		return;
+	}
+
+	if( m_hasHeldInEvent )
+	{
+		if( dispatchInEvent( m_heldInEvent, begin, end, frames ) == false )
+		{
+			return;
+		}
+		m_hasHeldInEvent = false;
+	}
+
+	while( m_inEventDeferred == 0 && m_inEvents.pop( &m_heldInEvent ) )
+	{
+		if( dispatchInEvent( m_heldInEvent, begin, end, frames ) == false )
+		{
+			m_hasHeldInEvent = true;
+			return;
+		}
+	}
+
+	// the overflow is only looked at once the queue is empty as it holds
+	// the newer events - if the MIDI-client is appending to it right now,
+	// they're dispatched with the next period
+	if( m_inEventDeferred == 0 && m_inEventsOverflowing &&
+					m_inEventOverflowMutex.tryLock() )
+	{
+		int dispatched = 0;
+		while( m_inEventDeferred == 0 &&
+				dispatched < m_inEventOverflow.size() &&
+				dispatchInEvent( m_inEventOverflow[dispatched],
+						begin, end, frames ) )
+		{
+			++dispatched;
+		}
+		m_inEventOverflow.remove( 0, dispatched );
+		if( m_inEventOverflow.isEmpty() )
+		{
+			m_inEventsOverflowing.fetchAndStoreOrdered( 0 );
+		}
+		m_inEventOverflowMutex.unlock();
+	}
+}
+
+
+
+
+bool MidiPort::dispatchInEvent( const InEvent& queued, qint64 begin,
+						qint64 end, fpp_t frames )
+{
+	if( queued.arrival >= end )
+	{
+		return false;
+	}
+
+	// channel mode messages stop all notes, which can't be done from
+	// within a period - the GUI thread takes care of them and everything
+	// received afterwards waits until it's done so
+	if( queued.event.type() == MidiControlChange &&
+		queued.event.controllerNumber() >= MidiControllerAllSoundOff )
+	{
+		m_deferredInEvent = queued;
+		m_inEventDeferred.fetchAndStoreOrdered( 1 );
+		QMetaObject::invokeMethod( this, "processDeferredInEvent",
+							Qt::QueuedConnection );
+		return true;
 	}
+
+	// events which arrived before this period are late anyway
+	const qint64 arrival = qMax( begin, queued.arrival );
+	const f_cnt_t offset = qMin<f_cnt_t>( ( arrival - begin ) * frames /
+						qMax<qint64>( end - begin, 1 ),
+						frames - 1 );
+
+	m_midiEventProcessor->processInEvent( queued.event, queued.time,
+								offset );
+	return true;
+}
+
+
+
+
+void MidiPort::processDeferredInEvent()
+{
+	m_midiEventProcessor->processInEvent( m_deferredInEvent.event,
+						m_deferredInEvent.time );
+	m_inEventDeferred.fetchAndStoreOrdered( 0 );
 }
 
 
@@ -83,6 +83,22 @@ AudioAlsaSetupWidget::AudioAlsaSetupWidget( QWidget * _parent ) :
 	m_channels->setLabel( tr( "CHANNELS" ) );
 	m_channels->move( 180, 20 );
 
+	int periods = ConfigManager::inst()->value( "audioalsa",
+							"periods" ).toInt();
+	if( periods < 2 )
+	{
+		periods = AudioAlsa::DEFAULT_PERIODS;
+	}
+
+	LcdSpinBoxModel * pm = new LcdSpinBoxModel( /* this */ );
+	pm->setRange( 2, 32 );
+	pm->setStep( 1 );
+	pm->setValue( periods );
+
+	m_periods = new LcdSpinBox( 2, this );
+	m_periods->setModel( pm );
+	m_periods->setLabel( tr( "PERIODS" ) );
+	m_periods->move( 230, 20 );
 }
 
 
@@ -91,6 +107,7 @@ AudioAlsaSetupWidget::AudioAlsaSetupWidget( QWidget * _parent ) :
 AudioAlsaSetupWidget::~AudioAlsaSetupWidget()
 {
 	delete m_channels->model();
+	delete m_periods->model();
 }
 
 
@@ -109,6 +126,8 @@ void AudioAlsaSetupWidget::saveSettings()
 	ConfigManager::inst()->setValue( "audioalsa", "device", deviceText );
 	ConfigManager::inst()->setValue( "audioalsa", "channels",
 				QString::number( m_channels->value<int>() ) );
+	ConfigManager::inst()->setValue( "audioalsa", "periods",
+				QString::number( m_periods->value<int>() ) );
 }
 
 
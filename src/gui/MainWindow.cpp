@@ -60,6 +60,7 @@
 #include "PluginView.h"
 #include "ProjectJournal.h"
 #include "ProjectNotes.h"
+#include "ProjectWriter.h"
 #include "SetupDialog.h"
 #include "SideBar.h"
 #include "Song.h"
@@ -108,7 +109,7 @@ MainWindow::MainWindow() :
 	sideBar->appendTab( new FileBrowser(
 				confMgr->userProjectsDir() + "*" +
 				confMgr->factoryProjectsDir(),
-					"*.mmp *.mmpz *.xml *.mid *.flp",
+					"*.mmp *.mmpz *.mmpb *.xml *.mid *.flp",
 							tr( "My Projects" ),
 					embed::getIconPixmap( "project_file" ).transformed( QTransform().rotate( 90 ) ),
 							splitter, false, true ) );
@@ -712,7 +713,8 @@ bool MainWindow::mayChangeProject(bool stopPlayback)
 
 	if( answer == QMessageBox::Save )
 	{
-		return( saveProject() );
+		// the project is going away, so it has to be on disk
+		return( saveProject( true ) );
 	}
 	else if( answer == QMessageBox::Discard )
 	{
@@ -855,7 +857,7 @@ void MainWindow::openProject()
 {
 	if( mayChangeProject(false) )
 	{
-		FileDialog ofd( this, tr( "Open Project" ), "", tr( "LMMS (*.mmp *.mmpz)" ) );
+		FileDialog ofd( this, tr( "Open Project" ), "", tr( "LMMS (*.mmp *.mmpz *.mmpb)" ) );
 
 		ofd.setDirectory( ConfigManager::inst()->userProjectsDir() );
 		ofd.setFileMode( FileDialog::ExistingFiles );
@@ -920,19 +922,23 @@ void MainWindow::openRecentlyOpenedProject( QAction * _action )
 
 
 
-bool MainWindow::saveProject()
+bool MainWindow::saveProject( bool waitUntilWritten )
 {
 	if( Engine::getSong()->projectFileName() == "" )
 	{
-		return( saveProjectAs() );
+		return( saveProjectAs( waitUntilWritten ) );
 	}
-	else
+
+	// the recovery file may only go once the project is on disk
+	const bool recovered = getSession() == Recover;
+	if( Engine::getSong()->guiSaveProject(
+				waitUntilWritten || recovered ) == false )
 	{
-		Engine::getSong()->guiSaveProject();
-		if( getSession() == Recover )
-		{
-			sessionCleanup();
-		}
+		return( false );
+	}
+	if( recovered )
+	{
+		sessionCleanup();
 	}
 	return( true );
 }
@@ -940,10 +946,11 @@ bool MainWindow::saveProject()
 
 
 
-bool MainWindow::saveProjectAs()
+bool MainWindow::saveProjectAs( bool waitUntilWritten )
 {
 	VersionedSaveDialog sfd( this, tr( "Save Project" ), "",
 			tr( "LMMS Project" ) + " (*.mmpz *.mmp);;" +
+				tr( "LMMS Binary Project" ) + " (*.mmpb);;" +
 				tr( "LMMS Project Template" ) + " (*.mpt)" );
 	QString f = Engine::getSong()->projectFileName();
 	if( f != "" )
@@ -964,8 +971,13 @@ bool MainWindow::saveProjectAs()
 		{
 			fname += ".mpt";
 		}
-		Engine::getSong()->guiSaveProjectAs( fname );
-		if( getSession() == Recover )
+		const bool recovered = getSession() == Recover;
+		if( Engine::getSong()->guiSaveProjectAs( fname,
+				waitUntilWritten || recovered ) == false )
+		{
+			return( false );
+		}
+		if( recovered )
 		{
 			sessionCleanup();
 		}
@@ -1374,6 +1386,12 @@ void MainWindow::closeEvent( QCloseEvent * _ce )
 
 void MainWindow::sessionCleanup()
 {
+	// an autosave still being written would bring the file back - there
+	// is no writer yet if we're shutting down early
+	if( ProjectWriter::inst() != NULL )
+	{
+		ProjectWriter::inst()->waitForAll();
+	}
 	// delete recover session files
 	QFile::remove( ConfigManager::inst()->recoveryFile() );
 	setSession( Normal );
@@ -1512,11 +1530,15 @@ void MainWindow::browseHelp()
 
 void MainWindow::autoSave()
 {
+	// a big project might still be written by the last autosave
 	if( !( Engine::getSong()->isPlaying() ||
 			Engine::getSong()->isExporting() ||
-				QApplication::mouseButtons() ) )
+				QApplication::mouseButtons() ||
+				( ProjectWriter::inst() != NULL &&
+				ProjectWriter::inst()->pendingWrites() > 0 ) ) )
 	{
-		Engine::getSong()->saveProjectFile(ConfigManager::inst()->recoveryFile());
+		Engine::getSong()->saveProjectFileInBackground(
+					ConfigManager::inst()->recoveryFile() );
 		autoSaveTimerReset();  // Reset timer
 	}
 	else
@@ -27,14 +27,19 @@
 #include <QPainter>
 
 #include "CPULoadWidget.h"
+#include "AudioDevice.h"
 #include "embed.h"
 #include "Engine.h"
 #include "Mixer.h"
+#include "SampleStream.h"
+#include "ToolTip.h"
 
 
 CPULoadWidget::CPULoadWidget( QWidget * _parent ) :
 	QWidget( _parent ),
 	m_currentLoad( 0 ),
+	m_xruns( -1 ),
+	m_starvations( -1 ),
 	m_temp(),
 	m_background( embed::getIconPixmap( "cpuload_bg" ) ),
 	m_leds( embed::getIconPixmap( "cpuload_leds" ) ),
@@ -99,6 +104,18 @@ void CPULoadWidget::updateCpuLoad()
 		m_changed = true;
 		update();
 	}
+
+	const int xruns = Engine::mixer()->audioDev()->xruns();
+	const int starvations = SampleStreamer::starvations();
+	if( xruns != m_xruns || starvations != m_starvations )
+	{
+		m_xruns = xruns;
+		m_starvations = starvations;
+		ToolTip::add( this, tr( "Buffer under-runs of the audio "
+					"device: %1\nPeriods in which samples "
+					"weren't read from disk in time: %2" ).
+					arg( m_xruns ).arg( m_starvations ) );
+	}
 }
 
 
@@ -128,6 +128,8 @@ InstrumentTrack::InstrumentTrack( TrackContainer* tc ) :
 
 	m_effectChannelModel.setRange( 0, Engine::fxMixer()->numChannels()-1, 1);
 
+	m_audioPort.setExtOutputEnabled( true );
+
 	for( int i = 0; i < NumKeys; ++i )
 	{
 		m_notes[i] = NULL;
@@ -55,8 +55,16 @@
 
 SampleTCO::SampleTCO( Track * _track ) :
 	TrackContentObject( _track ),
-	m_sampleBuffer( new SampleBuffer )
+	m_sampleBuffer( new SampleBuffer ),
+	m_lengthPending( false )
 {
+	m_sampleBuffer->allowCompactStorage( true );
+	m_sampleBuffer->allowAsyncLoading( true );
+	// sample tracks never loop
+	m_sampleBuffer->allowStreaming( true );
+	connect( m_sampleBuffer, SIGNAL( sampleUpdated() ),
+					this, SLOT( sampleLoaded() ) );
+
 	saveJournallingState( false );
 	setSampleFile( "" );
 	restoreJournallingState();
@@ -109,6 +117,9 @@ void SampleTCO::setSampleBuffer( SampleBuffer* sb )
 {
 	sharedObject::unref( m_sampleBuffer );
 	m_sampleBuffer = sb;
+	connect( m_sampleBuffer, SIGNAL( sampleUpdated() ),
+					this, SLOT( sampleLoaded() ) );
+	m_lengthPending = false;
 	updateLength();
 
 	emit sampleChanged();
@@ -119,6 +130,9 @@ void SampleTCO::setSampleBuffer( SampleBuffer* sb )
 void SampleTCO::setSampleFile( const QString & _sf )
 {
 	m_sampleBuffer->setAudioFile( _sf );
+	// adapt the length again once the file is loaded, unless
+	// loadSettings() restores it
+	m_lengthPending = m_sampleBuffer->isLoading();
 	updateLength();
 
 	emit sampleChanged();
@@ -127,6 +141,25 @@ void SampleTCO::setSampleFile( const QString & _sf )
 
 
 
+void SampleTCO::sampleLoaded()
+{
+	if( m_sampleBuffer->isLoading() )
+	{
+		return;
+	}
+
+	if( m_lengthPending )
+	{
+		m_lengthPending = false;
+		updateLength();
+	}
+
+	emit sampleChanged();
+}
+
+
+
+
 void SampleTCO::toggleRecord()
 {
 	m_recordModel.setValue( !m_recordModel.value() );
@@ -188,6 +221,7 @@ void SampleTCO::loadSettings( const QDomElement & _this )
 		m_sampleBuffer->loadFromBase64( _this.attribute( "data" ) );
 	}
 	changeLength( _this.attribute( "len" ).toInt() );
+	m_lengthPending = false;
 	setMuted( _this.attribute( "muted" ).toInt() );
 }
 
@@ -394,6 +428,10 @@ void SampleTCOView::paintEvent( QPaintEvent * pe )
 				pixelsPerTact() / DefaultTicksPerTact ), 1 ),
 					rect().bottom() - 2 * spacing );
 	m_tco->m_sampleBuffer->visualize( p, r, pe->rect() );
+	if( m_tco->m_sampleBuffer->isLoading() )
+	{
+		p.drawText( rect(), Qt::AlignCenter, tr( "Loading..." ) );
+	}
 
 	// disable antialiasing for borders, since its not needed
 	p.setRenderHint( QPainter::Antialiasing, false );
@@ -457,6 +495,8 @@ SampleTrack::SampleTrack( TrackContainer* tc ) :
 {
 	setName( tr( "Sample track" ) );
 	m_panningModel.setCenterValue( DefaultPanning );
+
+	m_audioPort.setExtOutputEnabled( true );
 }
 
 
@@ -0,0 +1,78 @@
+/*
+ * Base64Test.cpp
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "QTestSuite.h"
+
+#include <QtCore/QByteArray>
+
+#include "base64.h"
+
+class Base64Test : QTestSuite
+{
+	Q_OBJECT
+private:
+	static QByteArray decodeInto( const QString & b64 )
+	{
+		QByteArray decoded( base64::decodedSize( b64 ), 0 );
+		const int size = base64::decodeInto( b64, decoded.data() );
+		decoded.resize( size );
+		return decoded;
+	}
+
+private slots:
+	void DecodesWhatQtEncodes()
+	{
+		// every amount of padding
+		QByteArray data;
+		for( int size = 0; size < 64; ++size )
+		{
+			const QString b64 = data.toBase64();
+			QCOMPARE( base64::decodedSize( b64 ), size );
+			QCOMPARE( decodeInto( b64 ), data );
+			data.append( (char)( size * 37 + 11 ) );
+		}
+	}
+
+	void SkipsWhatQtSkips()
+	{
+		const QByteArray data( "samples embedded into projects" );
+		QString b64 = data.toBase64();
+		b64.insert( 8, "\n" );
+		b64.insert( 4, " \r\n\t" );
+		QCOMPARE( decodeInto( b64 ), QByteArray::fromBase64( b64.toLatin1() ) );
+		QCOMPARE( decodeInto( b64 ), data );
+	}
+
+	void MatchesDecode()
+	{
+		const QString b64 = QByteArray( "LMMS" ).toBase64();
+		char * data = NULL;
+		int size = 0;
+		base64::decode( b64, &data, &size );
+		QCOMPARE( QByteArray( data, size ), QByteArray( "LMMS" ) );
+		delete[] data;
+	}
+} Base64Tests;
+
+#include "Base64Test.moc"
@@ -0,0 +1,119 @@
+/*
+ * FixedRatioResamplerTest.cpp
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "QTestSuite.h"
+
+#include <math.h>
+
+#include <samplerate.h>
+
+#include "FixedRatioResampler.h"
+
+class FixedRatioResamplerTest : QTestSuite
+{
+	Q_OBJECT
+private:
+	static const fpp_t Frames = 256;
+	static const int Periods = 16;
+
+	// streams a constant signal through the resampler in periods - returns
+	// the frames consumed and the largest deviation from the input value
+	// once the filter has filled up
+	static f_cnt_t run( const double ratio, const int mode, float * error )
+	{
+		const float value = 0.5f;
+		const f_cnt_t inFrames = static_cast<f_cnt_t>( Frames * ratio ) +
+				FixedRatioResampler::lookahead( ratio, mode ) + 2;
+		sampleFrame * in = new sampleFrame[inFrames];
+		for( f_cnt_t f = 0; f < inFrames; ++f )
+		{
+			in[f][0] = in[f][1] = value;
+		}
+		sampleFrame out[Frames];
+
+		FixedRatioResampler resampler;
+		f_cnt_t used = 0;
+		*error = 0.0f;
+		for( int p = 0; p < Periods; ++p )
+		{
+			used += resampler.process( in, out, Frames, ratio, mode );
+			// the first period starts with silent history
+			for( fpp_t f = 0; p > 0 && f < Frames; ++f )
+			{
+				*error = qMax( *error, qMax(
+					fabsf( out[f][0] - value ),
+					fabsf( out[f][1] - value ) ) );
+			}
+		}
+		delete[] in;
+		return used;
+	}
+
+private slots:
+	void Supports()
+	{
+		QVERIFY( FixedRatioResampler::supports( 8.0, SRC_LINEAR ) );
+		QVERIFY( FixedRatioResampler::supports( 8.0, SRC_ZERO_ORDER_HOLD ) );
+		QVERIFY( FixedRatioResampler::supports( 2.0, SRC_SINC_FASTEST ) );
+		QVERIFY( ! FixedRatioResampler::supports( 8.0, SRC_SINC_FASTEST ) );
+		// left to libsamplerate for their quality
+		QVERIFY( ! FixedRatioResampler::supports( 1.0, SRC_SINC_MEDIUM_QUALITY ) );
+		QVERIFY( ! FixedRatioResampler::supports( 1.0, SRC_SINC_BEST_QUALITY ) );
+	}
+
+	void RatioAndLength()
+	{
+		const int modes[] = { SRC_ZERO_ORDER_HOLD, SRC_LINEAR, SRC_SINC_FASTEST };
+		const double ratios[] = { 0.37, 0.5, 1.0, 1.5, 2.0, 3.3 };
+		for( int m = 0; m < 3; ++m )
+		{
+			for( int r = 0; r < 6; ++r )
+			{
+				float error;
+				const f_cnt_t used = run( ratios[r], modes[m], &error );
+				// the fractional position carries over, so nothing
+				// is lost between the periods
+				QCOMPARE( used, static_cast<f_cnt_t>(
+					floor( Frames * Periods * ratios[r] ) ) );
+			}
+		}
+	}
+
+	void DcGain()
+	{
+		const int modes[] = { SRC_ZERO_ORDER_HOLD, SRC_LINEAR, SRC_SINC_FASTEST };
+		const double ratios[] = { 0.37, 0.5, 1.0, 1.5, 2.0, 3.3 };
+		for( int m = 0; m < 3; ++m )
+		{
+			for( int r = 0; r < 6; ++r )
+			{
+				float error;
+				run( ratios[r], modes[m], &error );
+				QVERIFY( error < 1e-4f );
+			}
+		}
+	}
+} FixedRatioResamplerTests;
+
+#include "FixedRatioResamplerTest.moc"
@@ -0,0 +1,160 @@
+/*
+ * HalfBandDecimatorTest.cpp
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "QTestSuite.h"
+
+#include <math.h>
+
+#include "HalfBandDecimator.h"
+#include "lmms_constants.h"
+
+class HalfBandDecimatorTest : QTestSuite
+{
+	Q_OBJECT
+private:
+	static const fpp_t Frames = 256;
+	static const int Periods = 64;
+	// periods left out of the measurement while the filters fill up
+	static const int Settle = 8;
+
+	// level of a sine at _freq, relative to the final rate, after
+	// decimating it by _ratio - in dB relative to the input
+	static float level( const int _ratio, const double _freq )
+	{
+		HalfBandDecimator decimator( Frames );
+		decimator.setRatio( _ratio );
+
+		surroundSampleFrame in[Frames];
+		surroundSampleFrame out[Frames];
+		double sum = 0.0;
+		int count = 0;
+		long t = 0;
+		for( int p = 0; p < Periods; ++p )
+		{
+			for( fpp_t f = 0; f < Frames; ++f, ++t )
+			{
+				for( ch_cnt_t ch = 0; ch < SURROUND_CHANNELS; ++ch )
+				{
+					in[f][ch] = sin( 2 * D_PI * _freq / _ratio * t );
+				}
+			}
+			const fpp_t frames = decimator.process( in, out, Frames );
+			for( fpp_t f = 0; p >= Settle && f < frames; ++f )
+			{
+				sum += out[f][0] * out[f][0];
+				++count;
+			}
+		}
+		return 20 * log10( sqrt( sum / count ) / sqrt( 0.5 ) );
+	}
+
+private slots:
+	void Supports()
+	{
+		QVERIFY( HalfBandDecimator::supports( 2 ) );
+		QVERIFY( HalfBandDecimator::supports( 4 ) );
+		QVERIFY( HalfBandDecimator::supports( 8 ) );
+		QVERIFY( ! HalfBandDecimator::supports( 3 ) );
+		QVERIFY( ! HalfBandDecimator::supports( 16 ) );
+	}
+
+	void FramesPerRatio()
+	{
+		for( int ratio = 2; ratio <= 8; ratio *= 2 )
+		{
+			HalfBandDecimator decimator( Frames );
+			decimator.setRatio( ratio );
+			QCOMPARE( decimator.ratio(), ratio );
+
+			surroundSampleFrame in[Frames] = { { 0 } };
+			surroundSampleFrame out[Frames];
+			QCOMPARE( (int) decimator.process( in, out, Frames ),
+							Frames / ratio );
+
+			// frames left over are carried into the next call
+			const fpp_t odd = 100;
+			int total = 0;
+			for( int p = 0; p < ratio; ++p )
+			{
+				total += decimator.process( in, out, odd );
+			}
+			QCOMPARE( total, odd );
+		}
+	}
+
+	void UnityDcGain()
+	{
+		for( int ratio = 2; ratio <= 8; ratio *= 2 )
+		{
+			HalfBandDecimator decimator( Frames );
+			decimator.setRatio( ratio );
+
+			surroundSampleFrame in[Frames];
+			surroundSampleFrame out[Frames];
+			for( fpp_t f = 0; f < Frames; ++f )
+			{
+				for( ch_cnt_t ch = 0; ch < SURROUND_CHANNELS; ++ch )
+				{
+					in[f][ch] = 0.5f;
+				}
+			}
+			for( int p = 0; p < Periods; ++p )
+			{
+				const fpp_t frames = decimator.process( in, out, Frames );
+				for( fpp_t f = 0; p >= Settle && f < frames; ++f )
+				{
+					for( ch_cnt_t ch = 0; ch < SURROUND_CHANNELS; ++ch )
+					{
+						QVERIFY( fabsf( out[f][ch] - 0.5f ) < 1e-5f );
+					}
+				}
+			}
+		}
+	}
+
+	void PassesBelowNyquist()
+	{
+		for( int ratio = 2; ratio <= 8; ratio *= 2 )
+		{
+			// up to 20 kHz at a final rate of 44.1 kHz
+			QVERIFY( fabsf( level( ratio, 0.1 ) ) < 0.1f );
+			QVERIFY( fabsf( level( ratio, 0.45 ) ) < 0.1f );
+		}
+	}
+
+	void AttenuatesAboveNyquist()
+	{
+		for( int ratio = 2; ratio <= 8; ratio *= 2 )
+		{
+			// from 24.1 kHz at a final rate of 44.1 kHz up to the
+			// nyquist of the input
+			for( double freq = 0.55; freq < ratio / 2.0; freq += 0.2 )
+			{
+				QVERIFY( level( ratio, freq ) < -85.0f );
+			}
+		}
+	}
+} HalfBandDecimatorTests;
+
+#include "HalfBandDecimatorTest.moc"
@@ -0,0 +1,92 @@
+/*
+ * MidiInEventQueueTest.cpp
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "QTestSuite.h"
+
+#include "MidiPort.h"
+
+class MidiInEventQueueTest : QTestSuite
+{
+	Q_OBJECT
+private slots:
+	void PushPopKeepsOrder()
+	{
+		MidiPort::InEventQueue queue;
+		MidiPort::InEvent e;
+		QVERIFY( ! queue.pop( &e ) );
+
+		for( int i = 0; i < 10; ++i )
+		{
+			e.event = MidiEvent( MidiNoteOn, 0, i, 100 );
+			e.arrival = i;
+			QVERIFY( queue.push( e ) );
+		}
+		for( int i = 0; i < 10; ++i )
+		{
+			QVERIFY( queue.pop( &e ) );
+			QCOMPARE( (int) e.event.key(), i );
+			QCOMPARE( e.arrival, (qint64) i );
+		}
+		QVERIFY( ! queue.pop( &e ) );
+	}
+
+	void PushFailsWhenFull()
+	{
+		MidiPort::InEventQueue queue;
+		MidiPort::InEvent e;
+		for( int i = 0; i < MidiPort::InEventQueue::Size; ++i )
+		{
+			e.event = MidiEvent( MidiNoteOn, 0, i % 128, 100 );
+			QVERIFY( queue.push( e ) );
+		}
+		QVERIFY( ! queue.push( e ) );
+
+		// a popped cell can be written again
+		QVERIFY( queue.pop( &e ) );
+		QCOMPARE( (int) e.event.key(), 0 );
+		e.event = MidiEvent( MidiNoteOn, 0, 42, 100 );
+		QVERIFY( queue.push( e ) );
+		QVERIFY( ! queue.push( e ) );
+	}
+
+	void WrapsAround()
+	{
+		MidiPort::InEventQueue queue;
+		MidiPort::InEvent e;
+		for( int round = 0; round < 5 * MidiPort::InEventQueue::Size; ++round )
+		{
+			e.event = MidiEvent( MidiNoteOn, 0, round % 128, 100 );
+			QVERIFY( queue.push( e ) );
+			e.event = MidiEvent( MidiNoteOn, 0, ( round + 1 ) % 128, 100 );
+			QVERIFY( queue.push( e ) );
+			QVERIFY( queue.pop( &e ) );
+			QCOMPARE( (int) e.event.key(), round % 128 );
+			QVERIFY( queue.pop( &e ) );
+			QCOMPARE( (int) e.event.key(), ( round + 1 ) % 128 );
+		}
+		QVERIFY( ! queue.pop( &e ) );
+	}
+} MidiInEventQueueTests;
+
+#include "MidiInEventQueueTest.moc"
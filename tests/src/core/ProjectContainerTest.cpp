@@ -0,0 +1,166 @@
+/*
+ * ProjectContainerTest.cpp
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "QTestSuite.h"
+
+#include <string.h>
+
+#include <QtCore/QTemporaryFile>
+
+#include "MemoryManager.h"
+#include "ProjectContainer.h"
+
+class ProjectContainerTest : QTestSuite
+{
+	Q_OBJECT
+private slots:
+	void RoundTrip()
+	{
+		const QByteArray document( "<lmms-project><song/></lmms-project>" );
+		QList<QByteArray> samples;
+		samples << QByteArray( 10 * sizeof( sampleFrame ), 0 ) <<
+				QByteArray( 3 * sizeof( sampleFrame ), 0 );
+		( (float *) samples[0].data() )[5] = 0.25f;
+		( (float *) samples[1].data() )[1] = -0.5f;
+
+		QTemporaryFile file;
+		QVERIFY( file.open() );
+		QVERIFY( ProjectContainer::write( file, document, samples, 1 ) );
+		file.close();
+
+		QVERIFY( file.open() );
+		QVERIFY( ProjectContainer::isContainer( file.peek( 16 ) ) );
+		file.close();
+		QCOMPARE( ProjectContainer::generation( file.fileName() ),
+								(quint32) 1 );
+
+		ProjectContainer * container =
+				ProjectContainer::open( file.fileName() );
+		QVERIFY( container != NULL );
+		QCOMPARE( container->document(), document );
+		QCOMPARE( container->sampleCount(), 2 );
+		QCOMPARE( container->sampleData( 0 ), samples[0] );
+		QCOMPARE( container->sampleData( 1 ), samples[1] );
+
+		SampleCache::Data data;
+		QVERIFY( container->acquireSample( 1, &data ) );
+		QCOMPARE( data.frames, (f_cnt_t) 3 );
+		QVERIFY( memcmp( data.data, samples[1].constData(),
+						samples[1].size() ) == 0 );
+		SampleCache::release( data.data );
+		QVERIFY( ! container->acquireSample( 2, &data ) );
+
+		const QString location = container->location();
+		sharedObject::unref( container );
+
+		// references resolve to the file as it was written
+		int index;
+		QString parsedLocation;
+		QVERIFY( ProjectContainer::parseReference(
+				ProjectContainer::reference( location, 1 ),
+						&index, &parsedLocation ) );
+		QCOMPARE( index, 1 );
+		QCOMPARE( parsedLocation, location );
+		QVERIFY( ProjectContainer::acquireSample( location, 0, &data ) );
+		QCOMPARE( data.frames, (f_cnt_t) 10 );
+		SampleCache::release( data.data );
+
+		QVERIFY( ProjectContainer::parseReference(
+				ProjectContainer::reference( 4 ),
+						&index, &parsedLocation ) );
+		QCOMPARE( index, 4 );
+		QVERIFY( parsedLocation.isEmpty() );
+		// e.g. base64 data
+		QVERIFY( ! ProjectContainer::parseReference( "ZkxhQw==",
+						&index, &parsedLocation ) );
+	}
+
+	void ReplacedFileIsNotResolved()
+	{
+		QTemporaryFile file;
+		QList<QByteArray> samples;
+		samples << QByteArray( 8 * sizeof( sampleFrame ), 0 );
+		QVERIFY( file.open() );
+		QVERIFY( ProjectContainer::write( file, "<lmms-project/>",
+								samples, 1 ) );
+		file.close();
+
+		ProjectContainer * container =
+				ProjectContainer::open( file.fileName() );
+		QVERIFY( container != NULL );
+		const QString location = container->location();
+		sharedObject::unref( container );
+
+		// the same size, written right away - only the generation
+		// tells the files apart
+		QVERIFY( file.open() );
+		QVERIFY( file.seek( 0 ) );
+		QVERIFY( ProjectContainer::write( file, "<lmms-project/>",
+								samples, 2 ) );
+		file.close();
+
+		QVERIFY( ProjectContainer::openLocation( location ) == NULL );
+		SampleCache::Data data;
+		QVERIFY( ! ProjectContainer::acquireSample( location, 0, &data ) );
+	}
+
+	void NoContainer()
+	{
+		QTemporaryFile file;
+		QVERIFY( file.open() );
+		file.write( "<?xml version=\"1.0\"?><lmms-project/>" );
+		file.close();
+
+		QVERIFY( ProjectContainer::open( file.fileName() ) == NULL );
+		QCOMPARE( ProjectContainer::generation( file.fileName() ),
+								(quint32) 0 );
+		QVERIFY( ! ProjectContainer::isContainer( "<?xml" ) );
+	}
+
+	void MemoryLocations()
+	{
+		const QString location = ProjectContainer::memoryLocation();
+		QVERIFY( ProjectContainer::isMemoryLocation( location ) );
+		QVERIFY( ProjectContainer::memoryLocation() != location );
+		QVERIFY( ProjectContainer::openLocation( location ) == NULL );
+
+		SampleCache::Data data;
+		QVERIFY( ! ProjectContainer::acquireSample( location, 0, &data ) );
+		data.data = MM_ALLOC( sampleFrame, 4 );
+		data.frames = 4;
+		data.format = 0;
+		data.channels = DEFAULT_CHANNELS;
+		const void * frames = data.data;
+		ProjectContainer::insertSample( location, 0, &data );
+
+		SampleCache::Data acquired;
+		QVERIFY( ProjectContainer::acquireSample( location, 0, &acquired ) );
+		QVERIFY( acquired.data == frames );
+		SampleCache::release( frames );
+		SampleCache::release( frames );
+		QVERIFY( ! ProjectContainer::acquireSample( location, 0, &acquired ) );
+	}
+} ProjectContainerTests;
+
+#include "ProjectContainerTest.moc"
@@ -0,0 +1,114 @@
+/*
+ * ProjectJournalTest.cpp
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "QTestSuite.h"
+
+#include <QtCore/QList>
+
+#include "ProjectJournal.h"
+
+class ProjectJournalTest : QTestSuite
+{
+	Q_OBJECT
+private:
+	typedef ProjectJournal::CheckPointStack Stack;
+
+	static QByteArray pattern( int key, int notes )
+	{
+		QByteArray state = "<pattern name=\"drums\">";
+		for( int i = 0; i < notes; ++i )
+		{
+			state += "<note pos=\"" + QByteArray::number( i * 48 ) +
+				"\" key=\"" + QByteArray::number( i == notes / 2 ?
+							key : 57 ) + "\"/>";
+		}
+		return state + "</pattern>";
+	}
+
+private slots:
+	void PopRestoresPushedStates()
+	{
+		QList<QByteArray> states;
+		states << pattern( 57, 100 ) << pattern( 60, 100 )
+			<< pattern( 60, 101 ) << "<pattern/>" << pattern( 62, 3 )
+			<< pattern( 62, 3 ) << QByteArray();
+
+		Stack stack;
+		for( int i = 0; i < states.size(); ++i )
+		{
+			ProjectJournal::push( stack, 1, states[i] );
+		}
+		for( int i = states.size() - 1; i >= 0; --i )
+		{
+			const ProjectJournal::CheckPoint c =
+						ProjectJournal::pop( stack );
+			QCOMPARE( c.joID, (jo_id_t) 1 );
+			QVERIFY( ! c.delta );
+			QCOMPARE( c.data, states[i] );
+		}
+		QVERIFY( stack.isEmpty() );
+	}
+
+	void OlderStatesAreDeltas()
+	{
+		Stack stack;
+		ProjectJournal::push( stack, 1, pattern( 57, 1000 ) );
+		ProjectJournal::push( stack, 1, pattern( 60, 1000 ) );
+
+		// only the changed key is kept of the older state
+		QVERIFY( stack[0].delta );
+		QVERIFY( stack[0].data.size() <= 2 );
+		QVERIFY( ! stack[1].delta );
+		QCOMPARE( stack[1].data, pattern( 60, 1000 ) );
+	}
+
+	void ObjectsAreKeptApart()
+	{
+		Stack stack;
+		ProjectJournal::push( stack, 1, pattern( 57, 10 ) );
+		ProjectJournal::push( stack, 2, "<knob value=\"0.5\"/>" );
+		ProjectJournal::push( stack, 1, pattern( 59, 10 ) );
+		ProjectJournal::push( stack, 2, "<knob value=\"0.75\"/>" );
+		ProjectJournal::push( stack, 1, pattern( 61, 10 ) );
+
+		QCOMPARE( ProjectJournal::pop( stack ).data, pattern( 61, 10 ) );
+		QCOMPARE( ProjectJournal::pop( stack ).data,
+					QByteArray( "<knob value=\"0.75\"/>" ) );
+
+		// a new state in between is diffed against the newest one
+		ProjectJournal::push( stack, 1, pattern( 63, 10 ) );
+		QCOMPARE( ProjectJournal::pop( stack ).data, pattern( 63, 10 ) );
+		QCOMPARE( ProjectJournal::pop( stack ).data, pattern( 59, 10 ) );
+
+		ProjectJournal::CheckPoint c = ProjectJournal::pop( stack );
+		QCOMPARE( c.joID, (jo_id_t) 2 );
+		QCOMPARE( c.data, QByteArray( "<knob value=\"0.5\"/>" ) );
+		c = ProjectJournal::pop( stack );
+		QCOMPARE( c.joID, (jo_id_t) 1 );
+		QCOMPARE( c.data, pattern( 57, 10 ) );
+		QVERIFY( stack.isEmpty() );
+	}
+} ProjectJournalTests;
+
+#include "ProjectJournalTest.moc"
@@ -0,0 +1,159 @@
+/*
+ * SampleCacheTest.cpp
+ *
+ * Copyright (c) 2016 LMMS Developers
+ *
+ * This file is part of LMMS - http://lmms.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "QTestSuite.h"
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QTemporaryFile>
+
+#include "MemoryManager.h"
+#include "SampleCache.h"
+#include "shared_object.h"
+
+class SampleCacheTest : QTestSuite
+{
+	Q_OBJECT
+private:
+	class Owner : public sharedObject
+	{
+	public:
+		Owner( bool * deleted ) :
+			m_deleted( deleted )
+		{
+		}
+
+		virtual ~Owner()
+		{
+			*m_deleted = true;
+		}
+
+	private:
+		bool * m_deleted;
+	} ;
+
+private slots:
+	void UnknownKeysAreNotFound()
+	{
+		SampleCache::Data data;
+		QVERIFY( ! SampleCache::acquire( "SampleCacheTest:unknown", &data ) );
+		QVERIFY( ! SampleCache::acquire( QString(), &data ) );
+	}
+
+	void InsertedDataIsShared()
+	{
+		SampleCache::Data inserted;
+		inserted.data = MM_ALLOC( sampleFrame, 64 );
+		inserted.frames = 64;
+		inserted.format = 0;
+		inserted.channels = DEFAULT_CHANNELS;
+		const void * data = inserted.data;
+		SampleCache::insert( "SampleCacheTest:shared", &inserted );
+		QVERIFY( inserted.data == data );
+
+		SampleCache::Data acquired;
+		QVERIFY( SampleCache::acquire( "SampleCacheTest:shared", &acquired ) );
+		QVERIFY( acquired.data == data );
+		QCOMPARE( acquired.frames, (f_cnt_t) 64 );
+		QCOMPARE( (int) acquired.channels, (int) DEFAULT_CHANNELS );
+
+		// the data stays cached until the last reference is gone
+		SampleCache::release( data );
+		QVERIFY( SampleCache::acquire( "SampleCacheTest:shared", &acquired ) );
+		SampleCache::release( data );
+		SampleCache::release( data );
+		QVERIFY( ! SampleCache::acquire( "SampleCacheTest:shared", &acquired ) );
+	}
+
+	void FirstInsertWins()
+	{
+		SampleCache::Data first;
+		first.data = MM_ALLOC( sampleFrame, 16 );
+		first.frames = 16;
+		first.format = 0;
+		first.channels = DEFAULT_CHANNELS;
+		const void * data = first.data;
+		SampleCache::insert( "SampleCacheTest:twice", &first );
+
+		// decoded a second time in the meantime
+		SampleCache::Data second;
+		second.data = MM_ALLOC( sampleFrame, 32 );
+		second.frames = 32;
+		second.format = 0;
+		second.channels = DEFAULT_CHANNELS;
+		SampleCache::insert( "SampleCacheTest:twice", &second );
+		QVERIFY( second.data == data );
+		QCOMPARE( second.frames, (f_cnt_t) 16 );
+
+		SampleCache::release( data );
+		SampleCache::release( data );
+		SampleCache::Data acquired;
+		QVERIFY( ! SampleCache::acquire( "SampleCacheTest:twice", &acquired ) );
+	}
+
+	void OwnerIsKeptWhileCached()
+	{
+		static sampleFrame frames[8];
+		bool deleted = false;
+		Owner * owner = new Owner( &deleted );
+
+		SampleCache::Data data;
+		data.data = frames;
+		data.frames = 8;
+		data.format = 0;
+		data.channels = DEFAULT_CHANNELS;
+		SampleCache::insert( "SampleCacheTest:owned", &data, owner );
+		sharedObject::unref( owner );
+		QVERIFY( ! deleted );
+
+		// data of an owner isn't freed but the owner is released
+		SampleCache::release( frames );
+		QVERIFY( deleted );
+	}
+
+	void KeysFollowTheFile()
+	{
+		QTemporaryFile file;
+		QVERIFY( file.open() );
+		file.write( "RIFF" );
+		file.flush();
+
+		const QFileInfo info( file.fileName() );
+		const QString key = SampleCache::key( info, 44100, false );
+		QVERIFY( ! key.isEmpty() );
+		QCOMPARE( SampleCache::key( info, 44100, false ), key );
+		QVERIFY( SampleCache::key( info, 48000, false ) != key );
+		QVERIFY( SampleCache::key( info, 44100, true ) != key );
+
+		// a changed file must not be mistaken for the cached one
+		file.write( "WAVE" );
+		file.flush();
+		QVERIFY( SampleCache::key( QFileInfo( file.fileName() ),
+							44100, false ) != key );
+
+		QVERIFY( SampleCache::key( QFileInfo( file.fileName() + ".missing" ),
+							44100, false ).isEmpty() );
+	}
+} SampleCacheTests;
+
+#include "SampleCacheTest.moc"
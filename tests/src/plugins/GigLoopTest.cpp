@@ -0,0 +1,134 @@
+#include "QTestSuite.h"
+
+#include "GigLoop.h"
+
+class GigLoopTest : QTestSuite
+{
+	Q_OBJECT
+private:
+	// the frame of the sample played at position frame, stepping through
+	// the loop one frame at a time
+	static f_cnt_t played( const GigLoop & loop, f_cnt_t frame )
+	{
+		f_cnt_t source = 0;
+		bool backward = false;
+		for( f_cnt_t f = 0; f < frame; ++f )
+		{
+			if( backward )
+			{
+				if( source == loop.start )
+				{
+					backward = false;
+				}
+				else
+				{
+					--source;
+				}
+			}
+			else if( source + 1 < loop.end )
+			{
+				++source;
+			}
+			else if( loop.bidirectional )
+			{
+				backward = true;
+			}
+			else
+			{
+				source = loop.start;
+			}
+		}
+		return source;
+	}
+
+private slots:
+	void WithoutLoop()
+	{
+		GigLoop loop;
+		f_cnt_t source;
+		bool backward;
+		QCOMPARE( loop.run( 0, 100, 30, &source, &backward ), (f_cnt_t) 30 );
+		QCOMPARE( source, (f_cnt_t) 0 );
+		QVERIFY( ! backward );
+		QCOMPARE( loop.run( 90, 100, 30, &source, &backward ), (f_cnt_t) 10 );
+		QCOMPARE( source, (f_cnt_t) 90 );
+		// past the end of the sample
+		QCOMPARE( loop.run( 100, 100, 30, &source, &backward ), (f_cnt_t) 0 );
+		QCOMPARE( loop.run( 120, 100, 30, &source, &backward ), (f_cnt_t) 0 );
+	}
+
+	void ForwardLoop()
+	{
+		GigLoop loop;
+		loop.enabled = true;
+		loop.start = 10;
+		loop.end = 20;
+		f_cnt_t source;
+		bool backward;
+		QCOMPARE( loop.run( 5, 1000, 100, &source, &backward ), (f_cnt_t) 15 );
+		QCOMPARE( source, (f_cnt_t) 5 );
+		QCOMPARE( loop.run( 20, 1000, 100, &source, &backward ), (f_cnt_t) 10 );
+		QCOMPARE( source, (f_cnt_t) 10 );
+		QCOMPARE( loop.run( 35, 1000, 3, &source, &backward ), (f_cnt_t) 3 );
+		QCOMPARE( source, (f_cnt_t) 15 );
+		QVERIFY( ! backward );
+	}
+
+	void BidirectionalLoop()
+	{
+		GigLoop loop;
+		loop.enabled = true;
+		loop.bidirectional = true;
+		loop.start = 10;
+		loop.end = 20;
+		f_cnt_t source;
+		bool backward;
+		// turns around at the end of the loop, playing its last
+		// frame again
+		QCOMPARE( loop.run( 20, 1000, 100, &source, &backward ), (f_cnt_t) 10 );
+		QCOMPARE( source, (f_cnt_t) 19 );
+		QVERIFY( backward );
+		QCOMPARE( loop.run( 29, 1000, 100, &source, &backward ), (f_cnt_t) 1 );
+		QCOMPARE( source, (f_cnt_t) 10 );
+		QVERIFY( backward );
+		QCOMPARE( loop.run( 30, 1000, 100, &source, &backward ), (f_cnt_t) 10 );
+		QCOMPARE( source, (f_cnt_t) 10 );
+		QVERIFY( ! backward );
+	}
+
+	void RunsFollowTheLoop()
+	{
+		// every run returned from any position matches stepping
+		// through the loop frame by frame
+		const f_cnt_t loops[][3] = {
+			// start, end, bidirectional
+			{ 10, 20, 0 },
+			{ 0, 1, 0 },
+			{ 10, 20, 1 },
+			{ 5, 7, 1 }
+		} ;
+		for( int l = 0; l < 4; ++l )
+		{
+			GigLoop loop;
+			loop.enabled = true;
+			loop.start = loops[l][0];
+			loop.end = loops[l][1];
+			loop.bidirectional = loops[l][2] != 0;
+			for( f_cnt_t frame = 0; frame < 100; ++frame )
+			{
+				f_cnt_t source;
+				bool backward;
+				const f_cnt_t run = loop.run( frame, loop.end, 1000,
+								&source, &backward );
+				QVERIFY( run > 0 );
+				for( f_cnt_t i = 0; i < run; ++i )
+				{
+					QCOMPARE( played( loop, frame + i ),
+						backward ? source - i : source + i );
+				}
+			}
+		}
+	}
+} GigLoopTests;
+
+#include "GigLoopTest.moc"